@@ -0,0 +1,115 @@
+/**
+ * mesh_data.hpp - Vertices, indices and submeshes of an imported mesh.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vtrs {
+
+struct mesh_vertex {
+    float position[3] = {0.0f, 0.0f, 0.0f};
+    float normal[3] = {0.0f, 0.0f, 0.0f};
+    float uv[2] = {0.0f, 0.0f};
+};
+
+struct mesh_submesh {
+    std::string name {};
+    std::string material {};
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+};
+
+struct mesh_lod {
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+
+    /* Object space error of the simplified triangles. */
+    float error = 0.0f;
+};
+
+struct mesh_meshlet {
+    uint32_t vertexOffset = 0;
+    uint32_t triangleOffset = 0;
+    uint32_t vertexCount = 0;
+    uint32_t triangleCount = 0;
+};
+
+/* Position as 16-bit snorm within the bounds, w is always one. */
+struct mesh_packed_position {
+    int16_t position[4] = {0, 0, 0, 32767};
+};
+
+/* Octahedral normal as 16-bit snorm and texture coordinates as half floats. */
+struct mesh_packed_attributes {
+    int16_t normal[2] = {0, 0};
+    uint16_t uv[2] = {0, 0};
+};
+
+/**
+ * @brief Compact copies of the vertices and indices for the GPU.
+ *
+ * A packed position p maps back with p * scale + bias. The indices are
+ * also kept as 16 bits when every vertex can be addressed that way,
+ * otherwise indices16 is empty.
+ */
+struct mesh_packed_streams {
+    std::vector<struct mesh_packed_position> positions {};
+    std::vector<struct mesh_packed_attributes> attributes {};
+    std::vector<uint16_t> indices16 {};
+
+    float scale[3] = {1.0f, 1.0f, 1.0f};
+    float bias[3] = {0.0f, 0.0f, 0.0f};
+};
+
+/**
+ * @brief An indexed triangle list as produced by the importers.
+ *
+ * Vertices are unique and numbered in the order the triangles first
+ * use them. Submeshes cover consecutive ranges of the index list.
+ *
+ * Levels of detail and meshlets are optional. Each level of detail is
+ * a range of the index list past the submeshes, coarsest last. A
+ * meshlet lists its vertices in meshletVertices and its triangles as
+ * three bytes each in meshletTriangles, indexing that vertex list.
+ *
+ * Packed streams are optional too. VertexPacker fills them in from the
+ * vertices and indices, so it runs after anything that reorders them.
+ */
+struct mesh_data {
+    std::vector<struct mesh_vertex> vertices {};
+    std::vector<uint32_t> indices {};
+    std::vector<struct mesh_submesh> submeshes {};
+
+    std::vector<struct mesh_lod> lods {};
+    std::vector<struct mesh_meshlet> meshlets {};
+    std::vector<uint32_t> meshletVertices {};
+    std::vector<uint8_t> meshletTriangles {};
+
+    struct mesh_packed_streams packed {};
+
+    float boundsMin[3] = {0.0f, 0.0f, 0.0f};
+    float boundsMax[3] = {0.0f, 0.0f, 0.0f};
+};
+
+} // namespace vtrs
@@ -0,0 +1,567 @@
+/**
+ * mesh_file.cpp - Binary mesh files mapped straight into memory.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+#include "platform/logger.hpp"
+#include "platform/profiler.hpp"
+#include "except.hpp"
+#include "mesh_file.hpp"
+
+#define VTRS_MESH_FILE_MAGIC 0x48534D56U
+/* Version 2 added the packed vertex streams. */
+#define VTRS_MESH_FILE_VERSION 2U
+#define VTRS_MESH_FILE_ALIGNMENT 64U
+
+static_assert(sizeof(vtrs::mesh_vertex) == 32 && std::is_trivially_copyable<vtrs::mesh_vertex>::value,
+              "Mesh vertices are stored as they are laid out in memory.");
+static_assert(sizeof(vtrs::mesh_packed_position) == 8 && sizeof(vtrs::mesh_packed_attributes) == 8,
+              "Packed vertices are stored as they are laid out in memory.");
+
+namespace {
+
+uint64_t alignOffset(uint64_t offset) {
+    return (offset + VTRS_MESH_FILE_ALIGNMENT - 1) & ~static_cast<uint64_t>(VTRS_MESH_FILE_ALIGNMENT - 1);
+}
+
+uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+/* Tells whether every value is below the limit, one pass with no early exit so it vectorises. */
+template<typename Value>
+bool isBelow(const Value* values, uint32_t count, uint32_t limit) {
+    uint32_t largest = 0;
+
+    for (uint32_t index = 0; index < count; index++) {
+        largest = std::max<uint32_t>(largest, values[index]);
+    }
+
+    return count == 0 || largest < limit;
+}
+
+/* Bytes of a section as they are written out. */
+struct section_data {
+    uint32_t type;
+    uint32_t count;
+    const void* data;
+    uint64_t size;
+};
+
+} // namespace
+
+void vtrs::MeshFile::bootstrap_() {
+    auto bytes = static_cast<const uint8_t*>(m_file->getData());
+    uint64_t file_size = m_file->getSize();
+
+    file_header header {};
+
+    if (file_size < sizeof(header)) {
+        throw vtrs::AssetError(m_file->getPath() + ": Mesh file is truncated.", vtrs::AssetError::E_TYPE_MALFORMED);
+    }
+
+    std::memcpy(&header, bytes, sizeof(header));
+
+    if (header.magic != VTRS_MESH_FILE_MAGIC || header.version != VTRS_MESH_FILE_VERSION || header.vertexStride != sizeof(mesh_vertex)) {
+        throw vtrs::AssetError(m_file->getPath() + ": Mesh file has an unknown format.", vtrs::AssetError::E_TYPE_MALFORMED);
+    }
+
+    if (header.fileSize != file_size || header.sectionCount > (file_size - sizeof(header)) / sizeof(file_section)) {
+        throw vtrs::AssetError(m_file->getPath() + ": Mesh file is truncated.", vtrs::AssetError::E_TYPE_MALFORMED);
+    }
+
+    m_sourceHash = header.sourceHash;
+    std::memcpy(m_boundsMin, header.boundsMin, sizeof(m_boundsMin));
+    std::memcpy(m_boundsMax, header.boundsMax, sizeof(m_boundsMax));
+
+    const file_submesh* submeshes = nullptr;
+    const char* strings = nullptr;
+    uint32_t submesh_count = 0;
+    uint64_t strings_size = 0;
+    uint32_t packed_vertex_counts[2] = {0, 0};
+    uint32_t packed_index_count = 0;
+    const uint8_t* quantization = nullptr;
+    uint32_t quantization_count = 0;
+
+    for (uint32_t index = 0; index < header.sectionCount; index++) {
+        file_section section {};
+        std::memcpy(&section, bytes + sizeof(header) + index * sizeof(file_section), sizeof(section));
+
+        if (section.offset % VTRS_MESH_FILE_ALIGNMENT != 0 || section.offset > file_size || section.size > file_size - section.offset) {
+            throw vtrs::AssetError(m_file->getPath() + ": Mesh file section is out of bounds.", vtrs::AssetError::E_TYPE_MALFORMED);
+        }
+
+        const uint8_t* data = bytes + section.offset;
+        size_t element_size = 0;
+
+        switch (section.type) {
+            case SECTION_VERTICES:
+                m_vertices = reinterpret_cast<const mesh_vertex*>(data);
+                m_vertexCount = section.count;
+                element_size = sizeof(mesh_vertex);
+                break;
+
+            case SECTION_INDICES:
+                m_indices = reinterpret_cast<const uint32_t*>(data);
+                m_indexCount = section.count;
+                element_size = sizeof(uint32_t);
+                break;
+
+            case SECTION_SUBMESHES:
+                submeshes = reinterpret_cast<const file_submesh*>(data);
+                submesh_count = section.count;
+                element_size = sizeof(file_submesh);
+                break;
+
+            case SECTION_STRINGS:
+                strings = reinterpret_cast<const char*>(data);
+                strings_size = section.size;
+                element_size = 1;
+                break;
+
+            case SECTION_LODS:
+                m_lods = reinterpret_cast<const mesh_lod*>(data);
+                m_lodCount = section.count;
+                element_size = sizeof(mesh_lod);
+                break;
+
+            case SECTION_MESHLETS:
+                m_meshlets = reinterpret_cast<const mesh_meshlet*>(data);
+                m_meshletCount = section.count;
+                element_size = sizeof(mesh_meshlet);
+                break;
+
+            case SECTION_MESHLET_VERTICES:
+                m_meshletVertices = reinterpret_cast<const uint32_t*>(data);
+                m_meshletVertexCount = section.count;
+                element_size = sizeof(uint32_t);
+                break;
+
+            case SECTION_MESHLET_TRIANGLES:
+                m_meshletTriangles = data;
+                m_meshletTriangleCount = section.count;
+                element_size = 1;
+                break;
+
+            case SECTION_PACKED_POSITIONS:
+                m_packedPositions = reinterpret_cast<const mesh_packed_position*>(data);
+                packed_vertex_counts[0] = section.count;
+                element_size = sizeof(mesh_packed_position);
+                break;
+
+            case SECTION_PACKED_ATTRIBUTES:
+                m_packedAttributes = reinterpret_cast<const mesh_packed_attributes*>(data);
+                packed_vertex_counts[1] = section.count;
+                element_size = sizeof(mesh_packed_attributes);
+                break;
+
+            case SECTION_PACKED_INDICES16:
+                m_packedIndices = reinterpret_cast<const uint16_t*>(data);
+                packed_index_count = section.count;
+                element_size = sizeof(uint16_t);
+                break;
+
+            case SECTION_PACKED_QUANTIZATION:
+                quantization = data;
+                quantization_count = section.count;
+                element_size = sizeof(float);
+                break;
+
+            default:
+                continue;
+        }
+
+        if (section.size != static_cast<uint64_t>(section.count) * element_size) {
+            throw vtrs::AssetError(m_file->getPath() + ": Mesh file section size does not match its count.", vtrs::AssetError::E_TYPE_MALFORMED);
+        }
+    }
+
+    if (m_vertices == nullptr || m_indices == nullptr || m_indexCount % 3 != 0) {
+        throw vtrs::AssetError(m_file->getPath() + ": Mesh file has no triangles.", vtrs::AssetError::E_TYPE_MALFORMED);
+    }
+
+    if ((m_packedPositions != nullptr && packed_vertex_counts[0] != m_vertexCount) ||
+        (m_packedAttributes != nullptr && packed_vertex_counts[1] != m_vertexCount) ||
+        (m_packedIndices != nullptr && packed_index_count != m_indexCount) ||
+        (m_packedPositions != nullptr && quantization_count != 6)) {
+
+        throw vtrs::AssetError(m_file->getPath() + ": Mesh file packed streams do not match the mesh.", vtrs::AssetError::E_TYPE_MALFORMED);
+    }
+
+    /* Indices go to the GPU as they are, one past the vertices would read out of the vertex buffer. */
+    if (!isBelow(m_indices, m_indexCount, m_vertexCount) ||
+        (m_packedIndices != nullptr && !isBelow(m_packedIndices, m_indexCount, m_vertexCount)) ||
+        (m_meshletVertices != nullptr && !isBelow(m_meshletVertices, m_meshletVertexCount, m_vertexCount))) {
+
+        throw vtrs::AssetError(m_file->getPath() + ": Mesh file has an index past its vertices.", vtrs::AssetError::E_TYPE_MALFORMED);
+    }
+
+    if (quantization != nullptr && quantization_count == 6) {
+        std::memcpy(m_positionScale, quantization, sizeof(m_positionScale));
+        std::memcpy(m_positionBias, quantization + sizeof(m_positionScale), sizeof(m_positionBias));
+    }
+
+    for (uint32_t index = 0; index < submesh_count; index++) {
+        const file_submesh& source = submeshes[index];
+
+        if (static_cast<uint64_t>(source.firstIndex) + source.indexCount > m_indexCount ||
+            static_cast<uint64_t>(source.nameOffset) + source.nameLength > strings_size ||
+            static_cast<uint64_t>(source.materialOffset) + source.materialLength > strings_size) {
+
+            throw vtrs::AssetError(m_file->getPath() + ": Mesh file submesh is out of bounds.", vtrs::AssetError::E_TYPE_MALFORMED);
+        }
+
+        mesh_submesh submesh {};
+        submesh.firstIndex = source.firstIndex;
+        submesh.indexCount = source.indexCount;
+
+        if (strings != nullptr) {
+            submesh.name.assign(strings + source.nameOffset, source.nameLength);
+            submesh.material.assign(strings + source.materialOffset, source.materialLength);
+        }
+
+        m_submeshes.push_back(std::move(submesh));
+    }
+
+    for (uint32_t index = 0; index < m_lodCount; index++) {
+        if (static_cast<uint64_t>(m_lods[index].firstIndex) + m_lods[index].indexCount > m_indexCount) {
+            throw vtrs::AssetError(m_file->getPath() + ": Mesh file level of detail is out of bounds.", vtrs::AssetError::E_TYPE_MALFORMED);
+        }
+    }
+
+    for (uint32_t index = 0; index < m_meshletCount; index++) {
+        const mesh_meshlet& meshlet = m_meshlets[index];
+
+        if (static_cast<uint64_t>(meshlet.vertexOffset) + meshlet.vertexCount > m_meshletVertexCount ||
+            static_cast<uint64_t>(meshlet.triangleOffset) + meshlet.triangleCount * 3ULL > m_meshletTriangleCount ||
+            !isBelow(m_meshletTriangles + meshlet.triangleOffset, meshlet.triangleCount * 3, meshlet.vertexCount)) {
+
+            throw vtrs::AssetError(m_file->getPath() + ": Mesh file meshlet is out of bounds.", vtrs::AssetError::E_TYPE_MALFORMED);
+        }
+    }
+}
+
+void vtrs::MeshFile::adopt_(vtrs::mesh_data&& mesh, uint64_t source_hash) {
+    m_mesh = std::move(mesh);
+    m_sourceHash = source_hash;
+
+    std::memcpy(m_boundsMin, m_mesh.boundsMin, sizeof(m_boundsMin));
+    std::memcpy(m_boundsMax, m_mesh.boundsMax, sizeof(m_boundsMax));
+
+    m_vertices = m_mesh.vertices.data();
+    m_indices = m_mesh.indices.data();
+    m_lods = m_mesh.lods.empty() ? nullptr : m_mesh.lods.data();
+    m_meshlets = m_mesh.meshlets.empty() ? nullptr : m_mesh.meshlets.data();
+    m_meshletVertices = m_mesh.meshletVertices.empty() ? nullptr : m_mesh.meshletVertices.data();
+    m_meshletTriangles = m_mesh.meshletTriangles.empty() ? nullptr : m_mesh.meshletTriangles.data();
+    m_packedPositions = m_mesh.packed.positions.empty() ? nullptr : m_mesh.packed.positions.data();
+    m_packedAttributes = m_mesh.packed.attributes.empty() ? nullptr : m_mesh.packed.attributes.data();
+    m_packedIndices = m_mesh.packed.indices16.empty() ? nullptr : m_mesh.packed.indices16.data();
+
+    std::memcpy(m_positionScale, m_mesh.packed.scale, sizeof(m_positionScale));
+    std::memcpy(m_positionBias, m_mesh.packed.bias, sizeof(m_positionBias));
+
+    m_vertexCount = static_cast<uint32_t>(m_mesh.vertices.size());
+    m_indexCount = static_cast<uint32_t>(m_mesh.indices.size());
+    m_lodCount = static_cast<uint32_t>(m_mesh.lods.size());
+    m_meshletCount = static_cast<uint32_t>(m_mesh.meshlets.size());
+    m_meshletVertexCount = static_cast<uint32_t>(m_mesh.meshletVertices.size());
+    m_meshletTriangleCount = static_cast<uint32_t>(m_mesh.meshletTriangles.size());
+
+    m_submeshes = m_mesh.submeshes;
+}
+
+vtrs::MeshFile* vtrs::MeshFile::factory(const std::string& path) {
+    VTRS_PROFILE_FUNCTION();
+
+    std::unique_ptr<vtrs::MeshFile> instance(new MeshFile());
+    instance->m_file.reset(vtrs::MappedFile::factory(path));
+    instance->bootstrap_();
+
+    return instance.release();
+}
+
+vtrs::MeshFile* vtrs::MeshFile::importCached(const std::string& source_path, const vtrs::MeshFile::Importer& importer, uint64_t settings_hash) {
+    VTRS_PROFILE_FUNCTION();
+
+    uint64_t source_hash;
+
+    {
+        std::unique_ptr<vtrs::MappedFile> source(vtrs::MappedFile::factory(source_path));
+        source_hash = mix(hashSource(source->getData(), source->getSize()) ^ mix(settings_hash + VTRS_MESH_FILE_VERSION));
+    }
+
+    std::string cache_path = source_path + ".vmesh";
+    std::ifstream probe(cache_path, std::ios::binary);
+
+    if (probe.is_open()) {
+        probe.close();
+
+        try {
+            std::unique_ptr<vtrs::MeshFile> cached(factory(cache_path));
+
+            if (cached->getSourceHash() == source_hash) {
+                return cached.release();
+            }
+
+            vtrs::Logger::info("Mesh cache is older than its source, importing afresh:", source_path);
+
+        } catch (vtrs::RuntimeError& error) {
+            vtrs::Logger::warn("Ignoring unusable mesh cache:", error.what());
+        }
+    }
+
+    Mesh mesh = importer(source_path);
+
+    try {
+        write(cache_path, mesh, source_hash);
+        return factory(cache_path);
+
+    } catch (vtrs::RuntimeError& error) {
+        vtrs::Logger::warn("Unable to cache mesh, keeping it in memory:", error.what());
+    }
+
+    std::unique_ptr<vtrs::MeshFile> instance(new MeshFile());
+    instance->adopt_(std::move(mesh), source_hash);
+
+    return instance.release();
+}
+
+void vtrs::MeshFile::write(const std::string& path, const vtrs::MeshFile::Mesh& mesh, uint64_t source_hash) {
+    VTRS_PROFILE_FUNCTION();
+
+    std::vector<file_submesh> submeshes {};
+    std::string strings {};
+
+    for (const auto& submesh : mesh.submeshes) {
+        file_submesh entry {};
+        entry.firstIndex = submesh.firstIndex;
+        entry.indexCount = submesh.indexCount;
+        entry.nameOffset = static_cast<uint32_t>(strings.size());
+        entry.nameLength = static_cast<uint32_t>(submesh.name.size());
+        strings += submesh.name;
+
+        entry.materialOffset = static_cast<uint32_t>(strings.size());
+        entry.materialLength = static_cast<uint32_t>(submesh.material.size());
+        strings += submesh.material;
+
+        submeshes.push_back(entry);
+    }
+
+    std::vector<section_data> sections = {
+        {SECTION_VERTICES, static_cast<uint32_t>(mesh.vertices.size()), mesh.vertices.data(), mesh.vertices.size() * sizeof(mesh_vertex)},
+        {SECTION_INDICES, static_cast<uint32_t>(mesh.indices.size()), mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t)},
+        {SECTION_SUBMESHES, static_cast<uint32_t>(submeshes.size()), submeshes.data(), submeshes.size() * sizeof(file_submesh)},
+        {SECTION_STRINGS, static_cast<uint32_t>(strings.size()), strings.data(), strings.size()}
+    };
+
+    if (!mesh.lods.empty()) {
+        sections.push_back({SECTION_LODS, static_cast<uint32_t>(mesh.lods.size()), mesh.lods.data(), mesh.lods.size() * sizeof(mesh_lod)});
+    }
+
+    if (!mesh.meshlets.empty()) {
+        sections.push_back({SECTION_MESHLETS, static_cast<uint32_t>(mesh.meshlets.size()), mesh.meshlets.data(), mesh.meshlets.size() * sizeof(mesh_meshlet)});
+        sections.push_back({SECTION_MESHLET_VERTICES, static_cast<uint32_t>(mesh.meshletVertices.size()), mesh.meshletVertices.data(), mesh.meshletVertices.size() * sizeof(uint32_t)});
+        sections.push_back({SECTION_MESHLET_TRIANGLES, static_cast<uint32_t>(mesh.meshletTriangles.size()), mesh.meshletTriangles.data(), mesh.meshletTriangles.size()});
+    }
+
+    const mesh_packed_streams& packed = mesh.packed;
+    float quantization[6] = {
+        packed.scale[0], packed.scale[1], packed.scale[2],
+        packed.bias[0], packed.bias[1], packed.bias[2]
+    };
+
+    if (!packed.positions.empty()) {
+        sections.push_back({SECTION_PACKED_POSITIONS, static_cast<uint32_t>(packed.positions.size()), packed.positions.data(), packed.positions.size() * sizeof(mesh_packed_position)});
+        sections.push_back({SECTION_PACKED_ATTRIBUTES, static_cast<uint32_t>(packed.attributes.size()), packed.attributes.data(), packed.attributes.size() * sizeof(mesh_packed_attributes)});
+        sections.push_back({SECTION_PACKED_QUANTIZATION, 6, quantization, sizeof(quantization)});
+    }
+
+    if (!packed.indices16.empty()) {
+        sections.push_back({SECTION_PACKED_INDICES16, static_cast<uint32_t>(packed.indices16.size()), packed.indices16.data(), packed.indices16.size() * sizeof(uint16_t)});
+    }
+
+    std::vector<file_section> table(sections.size());
+    uint64_t offset = alignOffset(sizeof(file_header) + table.size() * sizeof(file_section));
+
+    for (size_t index = 0; index < sections.size(); index++) {
+        table[index].type = sections[index].type;
+        table[index].count = sections[index].count;
+        table[index].offset = offset;
+        table[index].size = sections[index].size;
+
+        offset = alignOffset(offset + sections[index].size);
+    }
+
+    file_header header {};
+    header.magic = VTRS_MESH_FILE_MAGIC;
+    header.version = VTRS_MESH_FILE_VERSION;
+    header.sourceHash = source_hash;
+    header.fileSize = offset;
+    header.sectionCount = static_cast<uint32_t>(table.size());
+    header.vertexStride = sizeof(mesh_vertex);
+    std::memcpy(header.boundsMin, mesh.boundsMin, sizeof(header.boundsMin));
+    std::memcpy(header.boundsMax, mesh.boundsMax, sizeof(header.boundsMax));
+
+    std::string temp_path = path + ".tmp";
+
+    {
+        static const char s_padding[VTRS_MESH_FILE_ALIGNMENT] = {};
+
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(table.size() * sizeof(file_section)));
+
+        uint64_t written = sizeof(header) + table.size() * sizeof(file_section);
+
+        for (size_t index = 0; index < sections.size(); index++) {
+            file.write(s_padding, static_cast<std::streamsize>(table[index].offset - written));
+            file.write(static_cast<const char*>(sections[index].data), static_cast<std::streamsize>(sections[index].size));
+            written = table[index].offset + sections[index].size;
+        }
+
+        file.write(s_padding, static_cast<std::streamsize>(header.fileSize - written));
+        file.flush();
+
+        if (!file) {
+            std::remove(temp_path.c_str());
+            throw vtrs::AssetError("Unable to write mesh file " + path + ".", vtrs::AssetError::E_TYPE_GENERAL);
+        }
+    }
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        throw vtrs::AssetError("Unable to replace mesh file " + path + ".", vtrs::AssetError::E_TYPE_GENERAL);
+    }
+}
+
+uint64_t vtrs::MeshFile::hashSource(const void* data, size_t size) {
+    VTRS_PROFILE_FUNCTION();
+
+    auto bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = mix(size);
+    size_t index = 0;
+
+    /* Four lanes keep the multiplies independent, which hashes several bytes per cycle. */
+    uint64_t lanes[4] = {hash, hash ^ 0x9E3779B97F4A7C15ULL, hash ^ 0xC2B2AE3D27D4EB4FULL, hash ^ 0x165667B19E3779F9ULL};
+
+    for (; index + 32 <= size; index += 32) {
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            std::memcpy(&word, bytes + index + lane * 8, sizeof(word));
+
+            lanes[lane] = (lanes[lane] ^ word) * 0x9E3779B97F4A7C15ULL;
+            lanes[lane] ^= lanes[lane] >> 29;
+        }
+    }
+
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        hash = mix(hash ^ lanes[lane]);
+    }
+
+    for (; index < size; index++) {
+        hash = (hash ^ bytes[index]) * 1099511628211ULL;
+    }
+
+    return mix(hash);
+}
+
+bool vtrs::MeshFile::isMapped() const {
+    return m_file != nullptr;
+}
+
+uint64_t vtrs::MeshFile::getSourceHash() const {
+    return m_sourceHash;
+}
+
+const vtrs::mesh_vertex* vtrs::MeshFile::getVertices(uint32_t* count) const {
+    *count = m_vertexCount;
+    return m_vertices;
+}
+
+const uint32_t* vtrs::MeshFile::getIndices(uint32_t* count) const {
+    *count = m_indexCount;
+    return m_indices;
+}
+
+const vtrs::mesh_lod* vtrs::MeshFile::getLods(uint32_t* count) const {
+    *count = m_lodCount;
+    return m_lods;
+}
+
+const vtrs::mesh_meshlet* vtrs::MeshFile::getMeshlets(uint32_t* count) const {
+    *count = m_meshletCount;
+    return m_meshlets;
+}
+
+const uint32_t* vtrs::MeshFile::getMeshletVertices(uint32_t* count) const {
+    *count = m_meshletVertexCount;
+    return m_meshletVertices;
+}
+
+const uint8_t* vtrs::MeshFile::getMeshletTriangles(uint32_t* count) const {
+    *count = m_meshletTriangleCount;
+    return m_meshletTriangles;
+}
+
+const vtrs::mesh_packed_position* vtrs::MeshFile::getPackedPositions(uint32_t* count) const {
+    *count = m_packedPositions != nullptr ? m_vertexCount : 0;
+    return m_packedPositions;
+}
+
+const vtrs::mesh_packed_attributes* vtrs::MeshFile::getPackedAttributes(uint32_t* count) const {
+    *count = m_packedAttributes != nullptr ? m_vertexCount : 0;
+    return m_packedAttributes;
+}
+
+const uint16_t* vtrs::MeshFile::getPackedIndices(uint32_t* count) const {
+    *count = m_packedIndices != nullptr ? m_indexCount : 0;
+    return m_packedIndices;
+}
+
+const float* vtrs::MeshFile::getPositionScale() const {
+    return m_positionScale;
+}
+
+const float* vtrs::MeshFile::getPositionBias() const {
+    return m_positionBias;
+}
+
+const std::vector<vtrs::mesh_submesh>& vtrs::MeshFile::getSubmeshes() const {
+    return m_submeshes;
+}
+
+const float* vtrs::MeshFile::getBoundsMin() const {
+    return m_boundsMin;
+}
+
+const float* vtrs::MeshFile::getBoundsMax() const {
+    return m_boundsMax;
+}
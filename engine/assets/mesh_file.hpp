@@ -0,0 +1,272 @@
+/**
+ * mesh_file.hpp - Binary mesh files mapped straight into memory.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "platform/mapped_file.hpp"
+#include "mesh_data.hpp"
+
+namespace vtrs {
+
+/**
+ * @brief A mesh in the binary .vmesh format.
+ *
+ * The file is a header, a table of sections and the sections, each
+ * aligned to 64 bytes. Vertices and indices are stored exactly as they
+ * are uploaded, so a mapped file is handed to the GPU without touching
+ * a single vertex on the CPU. Sections of unknown type are skipped,
+ * which lets optional data be added without breaking older readers.
+ *
+ * Files are written in the byte order of the host, which is checked on
+ * load along with the format version. They are meant as a cache next
+ * to the source asset, see importCached, rather than for distribution.
+ */
+class MeshFile {
+
+public:
+    enum Section : uint32_t {
+        SECTION_VERTICES = 1,
+        SECTION_INDICES,
+        SECTION_SUBMESHES,
+        SECTION_STRINGS,
+        SECTION_LODS,
+        SECTION_MESHLETS,
+        SECTION_MESHLET_VERTICES,
+        SECTION_MESHLET_TRIANGLES,
+        SECTION_PACKED_POSITIONS,
+        SECTION_PACKED_ATTRIBUTES,
+        SECTION_PACKED_INDICES16,
+        SECTION_PACKED_QUANTIZATION
+    };
+
+private:
+    struct file_header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t sourceHash;
+        uint64_t fileSize;
+        uint32_t sectionCount;
+        uint32_t vertexStride;
+        float    boundsMin[3];
+        float    boundsMax[3];
+    };
+
+    struct file_section {
+        uint32_t type;
+        uint32_t count;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct file_submesh {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t materialOffset;
+        uint32_t materialLength;
+    };
+
+    std::unique_ptr<vtrs::MappedFile> m_file {};
+
+    /* Holds the mesh when it could not be written out and mapped back. */
+    struct mesh_data m_mesh {};
+
+    uint64_t m_sourceHash = 0;
+    float    m_boundsMin[3] = {0.0f, 0.0f, 0.0f};
+    float    m_boundsMax[3] = {0.0f, 0.0f, 0.0f};
+
+    const struct mesh_vertex*  m_vertices = nullptr;
+    const uint32_t*            m_indices = nullptr;
+    const struct mesh_lod*     m_lods = nullptr;
+    const struct mesh_meshlet* m_meshlets = nullptr;
+    const uint32_t*            m_meshletVertices = nullptr;
+    const uint8_t*             m_meshletTriangles = nullptr;
+
+    const struct mesh_packed_position*   m_packedPositions = nullptr;
+    const struct mesh_packed_attributes* m_packedAttributes = nullptr;
+    const uint16_t*                      m_packedIndices = nullptr;
+    float m_positionScale[3] = {1.0f, 1.0f, 1.0f};
+    float m_positionBias[3] = {0.0f, 0.0f, 0.0f};
+
+    uint32_t m_vertexCount = 0;
+    uint32_t m_indexCount = 0;
+    uint32_t m_lodCount = 0;
+    uint32_t m_meshletCount = 0;
+    uint32_t m_meshletVertexCount = 0;
+    uint32_t m_meshletTriangleCount = 0;
+
+    std::vector<struct mesh_submesh> m_submeshes {};
+
+    /**
+     * @brief Validates the mapped file and points the accessors into it.
+     *
+     * Section bounds, element counts and submesh ranges are checked, and
+     * every index against the vertex count. The file may be corrupted or
+     * made by hand, so nothing is trusted because of its source hash.
+     */
+    void bootstrap_();
+
+    /**
+     * @brief Takes over a mesh that stays in memory instead.
+     */
+    void adopt_(struct mesh_data&& mesh, uint64_t source_hash);
+
+    MeshFile() = default;
+
+public:
+    typedef struct mesh_data Mesh;
+    typedef std::function<struct mesh_data(const std::string& path)> Importer;
+
+    MeshFile(const MeshFile&) = delete;
+    MeshFile& operator=(const MeshFile&) = delete;
+
+    /**
+     * @brief Maps a .vmesh file.
+     * @param path Path to the file.
+     * @return Instance of the mesh file.
+     * @throws vtrs::PlatformError Thrown if the file could not be opened or mapped.
+     * @throws vtrs::AssetError Thrown if the file is malformed or of another version.
+     */
+    static MeshFile* factory(const std::string& path);
+
+    /**
+     * @brief Loads a source asset through its .vmesh cache.
+     * @param source_path   Path to the source asset, the cache is written next to it with .vmesh appended.
+     * @param importer      Imports the source when the cache is missing or stale.
+     * @param settings_hash Hash of the import settings, changing it invalidates the cache.
+     * @return Instance of the mesh file.
+     *
+     * The cache is keyed by a hash of the source contents. When it can
+     * not be written, a warning is logged and the imported mesh is kept
+     * in memory instead.
+     */
+    static MeshFile* importCached(const std::string& source_path, const Importer& importer, uint64_t settings_hash = 0);
+
+    /**
+     * @brief Writes a mesh to a .vmesh file, replacing it atomically.
+     * @param path Path to the file.
+     * @param mesh Mesh to write.
+     * @param source_hash Key the file is checked against when it is loaded through the cache.
+     * @throws vtrs::AssetError Thrown if the file could not be written.
+     */
+    static void write(const std::string& path, const Mesh& mesh, uint64_t source_hash);
+
+    /**
+     * @brief Hashes the contents of a source asset.
+     */
+    static uint64_t hashSource(const void* data, size_t size);
+
+    /**
+     * @brief Tells whether the mesh is served from a mapped file.
+     */
+    [[nodiscard]] bool isMapped() const;
+
+    /**
+     * @brief Returns the hash of the source the mesh was imported from.
+     */
+    [[nodiscard]] uint64_t getSourceHash() const;
+
+    /**
+     * @brief Returns the vertices, which stay valid for the lifetime of the instance.
+     * @param count Receives the number of vertices.
+     */
+    const struct mesh_vertex* getVertices(uint32_t* count) const;
+
+    /**
+     * @brief Returns the indices.
+     * @param count Receives the number of indices.
+     */
+    const uint32_t* getIndices(uint32_t* count) const;
+
+    /**
+     * @brief Returns the levels of detail, nullptr if there are none.
+     * @param count Receives the number of levels.
+     */
+    const struct mesh_lod* getLods(uint32_t* count) const;
+
+    /**
+     * @brief Returns the meshlets, nullptr if there are none.
+     * @param count Receives the number of meshlets.
+     */
+    const struct mesh_meshlet* getMeshlets(uint32_t* count) const;
+
+    /**
+     * @brief Returns the vertex lists of the meshlets.
+     * @param count Receives the number of entries.
+     */
+    const uint32_t* getMeshletVertices(uint32_t* count) const;
+
+    /**
+     * @brief Returns the triangles of the meshlets, three bytes each.
+     * @param count Receives the number of bytes.
+     */
+    const uint8_t* getMeshletTriangles(uint32_t* count) const;
+
+    /**
+     * @brief Returns the packed positions, nullptr if the mesh was not packed.
+     * @param count Receives the number of vertices.
+     */
+    const struct mesh_packed_position* getPackedPositions(uint32_t* count) const;
+
+    /**
+     * @brief Returns the packed normals and texture coordinates, nullptr if the mesh was not packed.
+     * @param count Receives the number of vertices.
+     */
+    const struct mesh_packed_attributes* getPackedAttributes(uint32_t* count) const;
+
+    /**
+     * @brief Returns the 16-bit indices, nullptr if the mesh needs 32-bit ones.
+     * @param count Receives the number of indices.
+     */
+    const uint16_t* getPackedIndices(uint32_t* count) const;
+
+    /**
+     * @brief Returns the scale that maps packed positions back.
+     */
+    [[nodiscard]] const float* getPositionScale() const;
+
+    /**
+     * @brief Returns the bias added after the scale.
+     */
+    [[nodiscard]] const float* getPositionBias() const;
+
+    /**
+     * @brief Returns the submeshes.
+     */
+    [[nodiscard]] const std::vector<struct mesh_submesh>& getSubmeshes() const;
+
+    /**
+     * @brief Returns the minimum corner of the bounding box.
+     */
+    [[nodiscard]] const float* getBoundsMin() const;
+
+    /**
+     * @brief Returns the maximum corner of the bounding box.
+     */
+    [[nodiscard]] const float* getBoundsMax() const;
+};
+
+} // namespace vtrs
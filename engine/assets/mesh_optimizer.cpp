@@ -0,0 +1,441 @@
+/**
+ * mesh_optimizer.cpp - Triangle and vertex reordering for GPU cache efficiency.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "platform/logger.hpp"
+#include "platform/profiler.hpp"
+#include "except.hpp"
+#include "mesh_optimizer.hpp"
+
+namespace {
+
+/**
+ * FIFO post-transform cache. A vertex is resident while fewer than
+ * cache_size misses happened since it was last loaded, so a lookup is
+ * a single comparison instead of a search through the entries.
+ */
+class CacheSimulator {
+
+private:
+    std::vector<uint32_t> m_stamps;
+    uint32_t m_cacheSize;
+    uint32_t m_time;
+
+public:
+    CacheSimulator(size_t vertex_count, uint32_t cache_size) :
+        m_stamps(vertex_count, 0), m_cacheSize(cache_size), m_time(cache_size + 1) {}
+
+    /* Returns true if the vertex had to be transformed. */
+    bool access(uint32_t vertex) {
+        if (m_time - m_stamps[vertex] <= m_cacheSize) {
+            return false;
+        }
+
+        m_stamps[vertex] = m_time++;
+        return true;
+    }
+
+    /* Evicts every entry. */
+    void flush() {
+        m_time += m_cacheSize + 1;
+    }
+};
+
+void subtract(const float* left, const float* right, float* result) {
+    result[0] = left[0] - right[0];
+    result[1] = left[1] - right[1];
+    result[2] = left[2] - right[2];
+}
+
+} // namespace
+
+void vtrs::MeshOptimizer::tipsify_(const std::vector<uint32_t>& indices, uint32_t vertex_count, std::vector<uint32_t>& output, std::vector<uint32_t>& clusters) const {
+    auto triangle_count = static_cast<uint32_t>(indices.size() / 3);
+    auto cache_size = static_cast<int64_t>(m_options.cacheSize);
+
+    /* Triangles around each vertex, packed by vertex. */
+    std::vector<uint32_t> live(vertex_count, 0);
+    std::vector<uint32_t> offsets(vertex_count + 1, 0);
+    std::vector<uint32_t> adjacency(indices.size());
+
+    for (uint32_t index : indices) {
+        live[index]++;
+    }
+
+    for (uint32_t vertex = 0; vertex < vertex_count; vertex++) {
+        offsets[vertex + 1] = offsets[vertex] + live[vertex];
+    }
+
+    std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+
+    for (uint32_t corner = 0; corner < indices.size(); corner++) {
+        adjacency[cursors[indices[corner]]++] = corner / 3;
+    }
+
+    std::vector<int64_t> cache_times(vertex_count, 0);
+    std::vector<bool> is_emitted(triangle_count, false);
+    std::vector<uint32_t> dead_ends {};
+    std::vector<uint32_t> candidates {};
+
+    int64_t time = cache_size + 1;
+    uint32_t scan_cursor = 0;
+    uint32_t fan_vertex = 0;
+
+    output.clear();
+    output.reserve(indices.size());
+    clusters.clear();
+
+    /* The walk starts from a jump, which opens the first cluster. */
+    while (scan_cursor < vertex_count && live[scan_cursor] == 0) {
+        scan_cursor++;
+    }
+
+    fan_vertex = scan_cursor;
+    clusters.push_back(0);
+
+    while (fan_vertex < vertex_count) {
+        candidates.clear();
+
+        for (uint32_t slot = offsets[fan_vertex]; slot < offsets[fan_vertex + 1]; slot++) {
+            uint32_t triangle = adjacency[slot];
+
+            if (is_emitted[triangle]) {
+                continue;
+            }
+
+            is_emitted[triangle] = true;
+
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                uint32_t vertex = indices[triangle * 3 + corner];
+
+                output.push_back(vertex);
+                dead_ends.push_back(vertex);
+                candidates.push_back(vertex);
+                live[vertex]--;
+
+                if (time - cache_times[vertex] > cache_size) {
+                    cache_times[vertex] = time++;
+                }
+            }
+        }
+
+        /* Prefer the oldest candidate that will still be cached once its remaining fan is emitted. */
+        uint32_t next_vertex = UINT32_MAX;
+        int64_t best_priority = -1;
+
+        for (uint32_t vertex : candidates) {
+            if (live[vertex] == 0) {
+                continue;
+            }
+
+            int64_t priority = 0;
+
+            if (time - cache_times[vertex] + 2 * static_cast<int64_t>(live[vertex]) <= cache_size) {
+                priority = time - cache_times[vertex];
+            }
+
+            if (priority > best_priority) {
+                best_priority = priority;
+                next_vertex = vertex;
+            }
+        }
+
+        if (next_vertex != UINT32_MAX) {
+            fan_vertex = next_vertex;
+            continue;
+        }
+
+        /* Nothing adjacent is left, so the walk jumps and a new cluster starts. */
+        while (!dead_ends.empty() && live[dead_ends.back()] == 0) {
+            dead_ends.pop_back();
+        }
+
+        if (!dead_ends.empty()) {
+            fan_vertex = dead_ends.back();
+            dead_ends.pop_back();
+
+        } else {
+            while (scan_cursor < vertex_count && live[scan_cursor] == 0) {
+                scan_cursor++;
+            }
+
+            fan_vertex = scan_cursor;
+        }
+
+        if (fan_vertex < vertex_count) {
+            clusters.push_back(static_cast<uint32_t>(output.size() / 3));
+        }
+    }
+}
+
+void vtrs::MeshOptimizer::sortClusters_(std::vector<uint32_t>& indices, const std::vector<const float*>& positions, std::vector<uint32_t>& clusters) const {
+    auto triangle_count = static_cast<uint32_t>(indices.size() / 3);
+    clusters.push_back(triangle_count);
+
+    /* Clusters are split wherever the cache cost so far is close enough to that of the whole cluster. */
+    CacheSimulator cache(positions.size(), m_options.cacheSize);
+    std::vector<uint32_t> splits {};
+
+    for (size_t cluster = 0; cluster + 1 < clusters.size(); cluster++) {
+        uint32_t first = clusters[cluster];
+        uint32_t end = clusters[cluster + 1];
+        uint32_t misses = 0;
+
+        cache.flush();
+
+        for (uint32_t index = first * 3; index < end * 3; index++) {
+            misses += cache.access(indices[index]) ? 1 : 0;
+        }
+
+        float limit = m_options.overdrawThreshold * static_cast<float>(misses) / static_cast<float>(end - first);
+        uint32_t split_first = first;
+        misses = 0;
+
+        cache.flush();
+        splits.push_back(first);
+
+        for (uint32_t triangle = first; triangle + 1 < end; triangle++) {
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                misses += cache.access(indices[triangle * 3 + corner]) ? 1 : 0;
+            }
+
+            if (static_cast<float>(misses) <= limit * static_cast<float>(triangle + 1 - split_first)) {
+                split_first = triangle + 1;
+                misses = 0;
+
+                cache.flush();
+                splits.push_back(split_first);
+            }
+        }
+    }
+
+    splits.push_back(triangle_count);
+
+    /* Area weighted centroid and normal of every cluster, and of the whole range. */
+    auto split_count = static_cast<uint32_t>(splits.size() - 1);
+    std::vector<float> centroids(static_cast<size_t>(split_count) * 3, 0.0f);
+    std::vector<float> normals(static_cast<size_t>(split_count) * 3, 0.0f);
+    std::vector<float> areas(split_count, 0.0f);
+
+    float mesh_centroid[3] = {0.0f, 0.0f, 0.0f};
+    float mesh_area = 0.0f;
+
+    for (uint32_t split = 0; split < split_count; split++) {
+        for (uint32_t triangle = splits[split]; triangle < splits[split + 1]; triangle++) {
+            const float* corners[3] = {positions[indices[triangle * 3]], positions[indices[triangle * 3 + 1]], positions[indices[triangle * 3 + 2]]};
+            float edges[2][3], normal[3];
+
+            subtract(corners[1], corners[0], edges[0]);
+            subtract(corners[2], corners[0], edges[1]);
+
+            normal[0] = edges[0][1] * edges[1][2] - edges[0][2] * edges[1][1];
+            normal[1] = edges[0][2] * edges[1][0] - edges[0][0] * edges[1][2];
+            normal[2] = edges[0][0] * edges[1][1] - edges[0][1] * edges[1][0];
+
+            float area = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+            for (uint32_t axis = 0; axis < 3; axis++) {
+                float center = (corners[0][axis] + corners[1][axis] + corners[2][axis]) / 3.0f;
+
+                centroids[split * 3 + axis] += center * area;
+                normals[split * 3 + axis] += normal[axis];
+                mesh_centroid[axis] += center * area;
+            }
+
+            areas[split] += area;
+            mesh_area += area;
+        }
+    }
+
+    if (mesh_area <= 0.0f) {
+        return;
+    }
+
+    /* Clusters that face away from the middle of the mesh are likely to occlude the rest, so they go first. */
+    std::vector<float> keys(split_count, 0.0f);
+
+    for (uint32_t split = 0; split < split_count; split++) {
+        float* normal = &normals[split * 3];
+        float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+        if (areas[split] <= 0.0f || length <= 0.0f) {
+            continue;
+        }
+
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            float offset = centroids[split * 3 + axis] / areas[split] - mesh_centroid[axis] / mesh_area;
+            keys[split] += offset * normal[axis] / length;
+        }
+    }
+
+    std::vector<uint32_t> order(split_count);
+
+    for (uint32_t split = 0; split < split_count; split++) {
+        order[split] = split;
+    }
+
+    std::stable_sort(order.begin(), order.end(), [&keys](uint32_t left, uint32_t right) {
+        return keys[left] > keys[right];
+    });
+
+    std::vector<uint32_t> sorted {};
+    sorted.reserve(indices.size());
+
+    for (uint32_t split : order) {
+        sorted.insert(sorted.end(), indices.begin() + splits[split] * 3, indices.begin() + splits[split + 1] * 3);
+    }
+
+    indices.swap(sorted);
+}
+
+void vtrs::MeshOptimizer::optimizeRange_(const struct mesh_data* mesh, uint32_t* indices, uint32_t index_count, std::vector<uint32_t>& local_ids) const {
+    std::vector<uint32_t> local_indices(index_count);
+    std::vector<uint32_t> global_ids {};
+
+    for (uint32_t index = 0; index < index_count; index++) {
+        uint32_t vertex = indices[index];
+
+        if (local_ids[vertex] == UINT32_MAX) {
+            local_ids[vertex] = static_cast<uint32_t>(global_ids.size());
+            global_ids.push_back(vertex);
+        }
+
+        local_indices[index] = local_ids[vertex];
+    }
+
+    auto vertex_count = static_cast<uint32_t>(global_ids.size());
+    std::vector<uint32_t> ordered {};
+    std::vector<uint32_t> clusters {};
+
+    tipsify_(local_indices, vertex_count, ordered, clusters);
+
+    if (m_options.optimizeOverdraw) {
+        std::vector<const float*> positions(vertex_count);
+
+        for (uint32_t vertex = 0; vertex < vertex_count; vertex++) {
+            positions[vertex] = mesh->vertices[global_ids[vertex]].position;
+        }
+
+        sortClusters_(ordered, positions, clusters);
+    }
+
+    for (uint32_t index = 0; index < index_count; index++) {
+        indices[index] = global_ids[ordered[index]];
+    }
+
+    for (uint32_t vertex : global_ids) {
+        local_ids[vertex] = UINT32_MAX;
+    }
+}
+
+vtrs::MeshOptimizer::MeshOptimizer(vtrs::mesh_optimizer_opts* options) : m_options(*options) {}
+
+vtrs::MeshOptimizer* vtrs::MeshOptimizer::factory(vtrs::MeshOptimizer::Options* options) {
+    vtrs::MeshOptimizer::Options optimizer_options = options != nullptr ? *options : vtrs::MeshOptimizer::Options {};
+    optimizer_options.cacheSize = std::max<uint32_t>(optimizer_options.cacheSize, 3);
+    optimizer_options.overdrawThreshold = std::max(optimizer_options.overdrawThreshold, 1.0f);
+
+    return new MeshOptimizer(&optimizer_options);
+}
+
+vtrs::MeshOptimizer::Report vtrs::MeshOptimizer::optimize(vtrs::MeshOptimizer::Mesh* mesh) const {
+    VTRS_PROFILE_FUNCTION();
+
+    if (mesh->indices.size() % 3 != 0) {
+        throw vtrs::AssetError("Index count is not a multiple of three.", vtrs::AssetError::E_TYPE_MALFORMED);
+    }
+
+    for (uint32_t index : mesh->indices) {
+        if (index >= mesh->vertices.size()) {
+            throw vtrs::AssetError("Index refers past the end of the vertex list.", vtrs::AssetError::E_TYPE_MALFORMED);
+        }
+    }
+
+    vtrs::MeshOptimizer::Report report {};
+    report.before = analyze(*mesh, m_options.cacheSize);
+
+    std::vector<uint32_t> local_ids(mesh->vertices.size(), UINT32_MAX);
+
+    if (mesh->submeshes.empty()) {
+        auto index_count = static_cast<uint32_t>(mesh->lods.empty() ? mesh->indices.size() : mesh->lods.front().firstIndex);
+        optimizeRange_(mesh, mesh->indices.data(), index_count - index_count % 3, local_ids);
+    }
+
+    for (const auto& submesh : mesh->submeshes) {
+        if (submesh.indexCount % 3 != 0 || submesh.firstIndex + static_cast<size_t>(submesh.indexCount) > mesh->indices.size()) {
+            throw vtrs::AssetError("Submesh " + submesh.name + " does not cover whole triangles.", vtrs::AssetError::E_TYPE_MALFORMED);
+        }
+
+        optimizeRange_(mesh, mesh->indices.data() + submesh.firstIndex, submesh.indexCount, local_ids);
+    }
+
+    /* Renumber vertices in first use order; local_ids is all UINT32_MAX again at this point. */
+    std::vector<struct mesh_vertex> vertices {};
+    vertices.reserve(mesh->vertices.size());
+
+    for (uint32_t& index : mesh->indices) {
+        if (local_ids[index] == UINT32_MAX) {
+            local_ids[index] = static_cast<uint32_t>(vertices.size());
+            vertices.push_back(mesh->vertices[index]);
+        }
+
+        index = local_ids[index];
+    }
+
+    for (uint32_t& vertex : mesh->meshletVertices) {
+        vertex = local_ids[vertex];
+    }
+
+    mesh->vertices.swap(vertices);
+    report.after = analyze(*mesh, m_options.cacheSize);
+
+    return report;
+}
+
+vtrs::MeshOptimizer::Stats vtrs::MeshOptimizer::analyze(const vtrs::MeshOptimizer::Mesh& mesh, uint32_t cache_size) {
+    vtrs::MeshOptimizer::Stats stats {};
+
+    if (mesh.indices.size() < 3 || mesh.vertices.empty()) {
+        return stats;
+    }
+
+    CacheSimulator cache(mesh.vertices.size(), cache_size);
+    uint32_t misses = 0;
+
+    for (uint32_t index : mesh.indices) {
+        misses += cache.access(index) ? 1 : 0;
+    }
+
+    stats.acmr = static_cast<float>(misses) / static_cast<float>(mesh.indices.size() / 3);
+    stats.atvr = static_cast<float>(misses) / static_cast<float>(mesh.vertices.size());
+
+    return stats;
+}
+
+void vtrs::MeshOptimizer::printReport(const vtrs::MeshOptimizer::Report& report) {
+    vtrs::Logger::print("");
+    vtrs::Logger::print("Mesh Optimizer");
+    vtrs::Logger::print("**************");
+    vtrs::Logger::print("ACMR before:", report.before.acmr, "after:", report.after.acmr);
+    vtrs::Logger::print("ATVR before:", report.before.atvr, "after:", report.after.atvr);
+    vtrs::Logger::print("");
+}
@@ -0,0 +1,610 @@
+/**
+ * obj_importer.cpp - Parallel Wavefront OBJ importer over a mapped file.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <cmath>
+#include "platform/mapped_file.hpp"
+#include "platform/profiler.hpp"
+#include "except.hpp"
+#include "obj_importer.hpp"
+
+namespace {
+
+bool isBlank(char value) {
+    return value == ' ' || value == '\t' || value == '\r';
+}
+
+const char* skipBlanks(const char* cursor, const char* end) {
+    while (cursor < end && isBlank(*cursor)) {
+        cursor++;
+    }
+
+    return cursor;
+}
+
+/**
+ * Parses a decimal float such as -1.25e-3 in place. Digits past the
+ * nineteenth only shift the exponent, which is well beyond float
+ * precision. Returns nullptr if no number starts at the cursor.
+ */
+const char* parseFloat(const char* cursor, const char* end, float* value) {
+    static const double s_powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool is_negative = false;
+
+    if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+        is_negative = *cursor == '-';
+        cursor++;
+    }
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digit_count = 0;
+    bool has_digits = false;
+
+    for (; cursor < end && *cursor >= '0' && *cursor <= '9'; cursor++) {
+        has_digits = true;
+
+        if (digit_count < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*cursor - '0');
+            digit_count += mantissa > 0 ? 1 : 0;
+
+        } else {
+            exponent++;
+        }
+    }
+
+    if (cursor < end && *cursor == '.') {
+        cursor++;
+
+        for (; cursor < end && *cursor >= '0' && *cursor <= '9'; cursor++) {
+            has_digits = true;
+
+            if (digit_count < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*cursor - '0');
+                digit_count += mantissa > 0 ? 1 : 0;
+                exponent--;
+            }
+        }
+    }
+
+    if (!has_digits) {
+        return nullptr;
+    }
+
+    if (cursor < end && (*cursor == 'e' || *cursor == 'E')) {
+        const char* exponent_cursor = cursor + 1;
+        bool is_exponent_negative = false;
+
+        if (exponent_cursor < end && (*exponent_cursor == '-' || *exponent_cursor == '+')) {
+            is_exponent_negative = *exponent_cursor == '-';
+            exponent_cursor++;
+        }
+
+        if (exponent_cursor < end && *exponent_cursor >= '0' && *exponent_cursor <= '9') {
+            int written = 0;
+
+            for (; exponent_cursor < end && *exponent_cursor >= '0' && *exponent_cursor <= '9'; exponent_cursor++) {
+                written = std::min(written * 10 + (*exponent_cursor - '0'), 10000);
+            }
+
+            exponent += is_exponent_negative ? -written : written;
+            cursor = exponent_cursor;
+        }
+    }
+
+    auto result = static_cast<double>(mantissa);
+
+    if (mantissa != 0 && exponent != 0) {
+        if (exponent >= -22 && exponent <= 22) {
+            result = exponent > 0 ? result * s_powers[exponent] : result / s_powers[-exponent];
+
+        } else {
+            result *= std::pow(10.0, exponent);
+        }
+    }
+
+    *value = static_cast<float>(is_negative ? -result : result);
+    return cursor;
+}
+
+/**
+ * Parses a signed decimal integer in place, returns nullptr if none starts at the cursor.
+ */
+const char* parseInteger(const char* cursor, const char* end, int64_t* value) {
+    bool is_negative = false;
+
+    if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+        is_negative = *cursor == '-';
+        cursor++;
+    }
+
+    const char* digits = cursor;
+    int64_t result = 0;
+
+    for (; cursor < end && *cursor >= '0' && *cursor <= '9'; cursor++) {
+        result = std::min<int64_t>(result * 10 + (*cursor - '0'), INT32_MAX + 1LL);
+    }
+
+    if (cursor == digits) {
+        return nullptr;
+    }
+
+    *value = is_negative ? -result : result;
+    return cursor;
+}
+
+/**
+ * Hashes the bits of a vertex. The words go through FNV-1a and the
+ * result through a 64-bit finaliser, so both halves are well mixed
+ * for the shard and slot selection.
+ */
+uint64_t hashVertex(const vtrs::mesh_vertex& vertex) {
+    uint32_t words[sizeof(vtrs::mesh_vertex) / sizeof(uint32_t)];
+    memcpy(words, &vertex, sizeof(words));
+
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (auto word : words) {
+        hash ^= word;
+        hash *= 0x100000001b3ULL;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+} // namespace
+
+void vtrs::ObjImporter::parseChunk_(const char* begin, const char* end, parsed_chunk* chunk, size_t offset) {
+    VTRS_PROFILE_FUNCTION();
+
+    std::vector<face_corner> polygon {};
+    std::vector<uint32_t> polygon_slots {};
+
+    auto fail = [begin, offset](const char* cursor, const std::string& message) {
+        throw vtrs::AssetError(message + " at byte " + std::to_string(offset + (cursor - begin)) + ".", vtrs::AssetError::E_TYPE_MALFORMED);
+    };
+
+    for (const char* cursor = begin; cursor < end;) {
+        auto line_end = static_cast<const char*>(memchr(cursor, '\n', end - cursor));
+
+        if (line_end == nullptr) {
+            line_end = end;
+        }
+
+        const char* line = skipBlanks(cursor, line_end);
+        cursor = line_end + 1;
+
+        if (line_end - line < 2) {
+            continue;
+        }
+
+        char keyword = line[0];
+        char modifier = line[1];
+
+        if (keyword == 'v') {
+            std::vector<float>* target = nullptr;
+            int component_count = 3;
+            int required_count = 3;
+
+            if (isBlank(modifier)) {
+                target = &chunk->positions;
+
+            } else if (modifier == 't' && line_end - line > 2 && isBlank(line[2])) {
+                target = &chunk->uvs;
+                component_count = 2;
+                required_count = 1;
+
+            } else if (modifier == 'n' && line_end - line > 2 && isBlank(line[2])) {
+                target = &chunk->normals;
+
+            } else {
+                continue;
+            }
+
+            const char* field = line + (target == &chunk->positions ? 1 : 2);
+
+            /* Extra components, such as w or vertex colours, are ignored. */
+            for (int component = 0; component < component_count; component++) {
+                field = skipBlanks(field, line_end);
+                float value = 0.0f;
+
+                const char* next = field < line_end ? parseFloat(field, line_end, &value) : nullptr;
+
+                if (next == nullptr) {
+                    if (component < required_count) {
+                        fail(field, "Expected a number");
+                    }
+
+                    value = 0.0f;
+                    next = field;
+                }
+
+                target->push_back(value);
+                field = next;
+            }
+
+            continue;
+        }
+
+        if (keyword == 'f' && isBlank(modifier)) {
+            polygon.clear();
+            polygon_slots.clear();
+
+            const char* field = skipBlanks(line + 1, line_end);
+
+            int32_t counts[3] = {
+                static_cast<int32_t>(chunk->positions.size() / 3),
+                static_cast<int32_t>(chunk->uvs.size() / 2),
+                static_cast<int32_t>(chunk->normals.size() / 3)
+            };
+
+            while (field < line_end) {
+                face_corner corner {};
+                int32_t* attributes[3] = {&corner.position, &corner.uv, &corner.normal};
+
+                for (uint32_t attribute = 0; attribute < 3 && field < line_end; attribute++) {
+                    if (attribute > 0) {
+                        if (*field != '/') {
+                            break;
+                        }
+
+                        field++;
+
+                        /* An empty field, as in v//vn, leaves the attribute out. */
+                        if (field < line_end && *field == '/') {
+                            continue;
+                        }
+                    }
+
+                    int64_t index = 0;
+                    const char* next = parseInteger(field, line_end, &index);
+
+                    if (next == nullptr || index == 0) {
+                        fail(field, "Expected a face index");
+                    }
+
+                    /* Negative indices count back from the data seen so far, which only this chunk knows about. */
+                    if (index < 0) {
+                        *attributes[attribute] = counts[attribute] + static_cast<int32_t>(index);
+                        polygon_slots.push_back(static_cast<uint32_t>(polygon.size() * 3 + attribute));
+
+                    } else {
+                        *attributes[attribute] = static_cast<int32_t>(index - 1);
+                    }
+
+                    field = next;
+                }
+
+                polygon.push_back(corner);
+                field = skipBlanks(field, line_end);
+            }
+
+            if (polygon.size() < 3) {
+                fail(line, "Face with less than three corners");
+            }
+
+            for (size_t corner = 2; corner < polygon.size(); corner++) {
+                auto fan_corner = static_cast<uint32_t>(chunk->corners.size());
+                size_t sources[3] = {0, corner - 1, corner};
+
+                chunk->corners.push_back(polygon[sources[0]]);
+                chunk->corners.push_back(polygon[sources[1]]);
+                chunk->corners.push_back(polygon[sources[2]]);
+
+                for (auto slot : polygon_slots) {
+                    for (uint32_t vertex = 0; vertex < 3; vertex++) {
+                        if (slot / 3 == sources[vertex]) {
+                            chunk->relativeSlots.push_back((fan_corner + vertex) * 3 + slot % 3);
+                        }
+                    }
+                }
+            }
+
+            continue;
+        }
+
+        bool is_group = (keyword == 'o' || keyword == 'g') && isBlank(modifier);
+        bool is_material = line_end - line > 7 && memcmp(line, "usemtl", 6) == 0 && isBlank(line[6]);
+
+        if (is_group || is_material) {
+            const char* name = skipBlanks(line + (is_group ? 1 : 6), line_end);
+            const char* name_end = line_end;
+
+            while (name_end > name && isBlank(name_end[-1])) {
+                name_end--;
+            }
+
+            group_marker marker {};
+            marker.triangle = static_cast<uint32_t>(chunk->corners.size() / 3);
+            marker.isMaterial = is_material;
+            marker.name.assign(name, name_end);
+
+            chunk->groups.push_back(marker);
+        }
+    }
+}
+
+void vtrs::ObjImporter::run_(uint32_t task_count, const std::function<void(uint32_t worker, uint32_t task)>& job) const {
+    if (m_threadPool != nullptr && task_count > 1) {
+        m_threadPool->dispatch(task_count, job);
+        return;
+    }
+
+    for (uint32_t task = 0; task < task_count; task++) {
+        job(0, task);
+    }
+}
+
+void vtrs::ObjImporter::weld_(const std::vector<struct mesh_vertex>& corners, struct mesh_data* mesh) const {
+    VTRS_PROFILE_FUNCTION();
+
+    auto corner_count = static_cast<uint32_t>(corners.size());
+    std::vector<uint64_t> hashes(corner_count);
+
+    uint32_t task_count = m_threadPool != nullptr ? m_threadPool->getThreadCount() : 1;
+    uint32_t span = (corner_count + task_count - 1) / task_count;
+
+    run_(task_count, [&](uint32_t, uint32_t task) {
+        uint32_t end = std::min(corner_count, (task + 1) * span);
+
+        for (uint32_t corner = task * span; corner < end; corner++) {
+            hashes[corner] = hashVertex(corners[corner]);
+        }
+    });
+
+    /* Each shard owns the corners whose hash falls into it, so the tables need no locking.
+     * A corner is mapped to the first corner of its shard holding the same vertex. */
+    std::vector<uint32_t> first_corners(corner_count);
+    uint32_t shard_count = task_count;
+
+    run_(shard_count, [&](uint32_t, uint32_t shard) {
+        uint32_t shard_size = 0;
+
+        for (uint32_t corner = 0; corner < corner_count; corner++) {
+            shard_size += (hashes[corner] >> 32) % shard_count == shard ? 1 : 0;
+        }
+
+        uint32_t capacity = 16;
+
+        while (capacity < shard_size * 2) {
+            capacity <<= 1;
+        }
+
+        std::vector<uint32_t> table(capacity, UINT32_MAX);
+        uint32_t mask = capacity - 1;
+
+        for (uint32_t corner = 0; corner < corner_count; corner++) {
+            uint64_t hash = hashes[corner];
+
+            if ((hash >> 32) % shard_count != shard) {
+                continue;
+            }
+
+            auto slot = static_cast<uint32_t>(hash) & mask;
+
+            while (true) {
+                uint32_t entry = table[slot];
+
+                if (entry == UINT32_MAX) {
+                    table[slot] = corner;
+                    first_corners[corner] = corner;
+                    break;
+                }
+
+                if (hashes[entry] == hash && memcmp(&corners[entry], &corners[corner], sizeof(mesh_vertex)) == 0) {
+                    first_corners[corner] = entry;
+                    break;
+                }
+
+                slot = (slot + 1) & mask;
+            }
+        }
+    });
+
+    /* Vertices are numbered in the order the triangles first use them. */
+    std::vector<uint32_t> vertex_ids(corner_count, UINT32_MAX);
+    mesh->indices.resize(corner_count);
+
+    for (uint32_t corner = 0; corner < corner_count; corner++) {
+        uint32_t first_corner = first_corners[corner];
+
+        if (vertex_ids[first_corner] == UINT32_MAX) {
+            vertex_ids[first_corner] = static_cast<uint32_t>(mesh->vertices.size());
+            mesh->vertices.push_back(corners[first_corner]);
+        }
+
+        mesh->indices[corner] = vertex_ids[first_corner];
+    }
+}
+
+vtrs::ObjImporter::ObjImporter(vtrs::ThreadPool* thread_pool, vtrs::obj_importer_opts* options) :
+    m_threadPool(thread_pool), m_options(*options) {}
+
+vtrs::ObjImporter* vtrs::ObjImporter::factory(vtrs::ThreadPool* thread_pool, vtrs::ObjImporter::Options* options) {
+    vtrs::ObjImporter::Options importer_options = options != nullptr ? *options : vtrs::ObjImporter::Options {};
+    importer_options.chunkSize = std::max<size_t>(importer_options.chunkSize, 4096);
+
+    return new ObjImporter(thread_pool, &importer_options);
+}
+
+vtrs::ObjImporter::Mesh vtrs::ObjImporter::load(const std::string& path) const {
+    VTRS_PROFILE_FUNCTION();
+
+    std::unique_ptr<vtrs::MappedFile> file(vtrs::MappedFile::factory(path));
+
+    auto data = static_cast<const char*>(file->getData());
+    const char* data_end = data + file->getSize();
+
+    std::vector<const char*> bounds {data};
+
+    while (bounds.back() < data_end) {
+        const char* split = bounds.back() + std::min<size_t>(m_options.chunkSize, data_end - bounds.back());
+        const char* line_end = split < data_end ? static_cast<const char*>(memchr(split, '\n', data_end - split)) : nullptr;
+
+        bounds.push_back(line_end != nullptr ? line_end + 1 : data_end);
+    }
+
+    auto chunk_count = static_cast<uint32_t>(bounds.size() - 1);
+    std::vector<parsed_chunk> chunks(chunk_count);
+
+    try {
+        run_(chunk_count, [&](uint32_t, uint32_t task) {
+            parseChunk_(bounds[task], bounds[task + 1], &chunks[task], bounds[task] - data);
+        });
+
+    } catch (vtrs::AssetError& error) {
+        throw vtrs::AssetError(path + ": " + error.what(), vtrs::AssetError::E_TYPE_MALFORMED);
+    }
+
+    /* Attribute and corner offsets of each chunk. */
+    std::vector<uint32_t> position_bases(chunk_count + 1, 0);
+    std::vector<uint32_t> uv_bases(chunk_count + 1, 0);
+    std::vector<uint32_t> normal_bases(chunk_count + 1, 0);
+    std::vector<uint32_t> corner_bases(chunk_count + 1, 0);
+
+    for (uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+        position_bases[chunk + 1] = position_bases[chunk] + static_cast<uint32_t>(chunks[chunk].positions.size() / 3);
+        uv_bases[chunk + 1] = uv_bases[chunk] + static_cast<uint32_t>(chunks[chunk].uvs.size() / 2);
+        normal_bases[chunk + 1] = normal_bases[chunk] + static_cast<uint32_t>(chunks[chunk].normals.size() / 3);
+        corner_bases[chunk + 1] = corner_bases[chunk] + static_cast<uint32_t>(chunks[chunk].corners.size());
+    }
+
+    std::vector<float> positions(static_cast<size_t>(position_bases[chunk_count]) * 3);
+    std::vector<float> uvs(static_cast<size_t>(uv_bases[chunk_count]) * 2);
+    std::vector<float> normals(static_cast<size_t>(normal_bases[chunk_count]) * 3);
+
+    run_(chunk_count, [&](uint32_t, uint32_t task) {
+        const parsed_chunk& chunk = chunks[task];
+
+        std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + static_cast<ptrdiff_t>(position_bases[task]) * 3);
+        std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + static_cast<ptrdiff_t>(uv_bases[task]) * 2);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + static_cast<ptrdiff_t>(normal_bases[task]) * 3);
+    });
+
+    /* Corners are resolved into full vertices, which is what gets welded. */
+    std::vector<mesh_vertex> corners(corner_bases[chunk_count]);
+
+    run_(chunk_count, [&](uint32_t, uint32_t task) {
+        parsed_chunk& chunk = chunks[task];
+        uint32_t bases[3] = {position_bases[task], uv_bases[task], normal_bases[task]};
+
+        for (auto slot : chunk.relativeSlots) {
+            face_corner& corner = chunk.corners[slot / 3];
+            int32_t* attributes[3] = {&corner.position, &corner.uv, &corner.normal};
+
+            *attributes[slot % 3] += static_cast<int32_t>(bases[slot % 3]);
+
+            /* Checked here, as a reference one before the first would otherwise read as no attribute. */
+            if (*attributes[slot % 3] < 0) {
+                throw vtrs::AssetError(path + ": A face refers back past the first vertex attribute.", vtrs::AssetError::E_TYPE_MALFORMED);
+            }
+        }
+
+        for (size_t index = 0; index < chunk.corners.size(); index++) {
+            const face_corner& corner = chunk.corners[index];
+            mesh_vertex& vertex = corners[corner_bases[task] + index];
+
+            if (corner.position < 0 || static_cast<uint32_t>(corner.position) >= position_bases[chunk_count] ||
+                corner.uv >= static_cast<int32_t>(uv_bases[chunk_count]) || corner.normal >= static_cast<int32_t>(normal_bases[chunk_count]) ||
+                corner.uv < -1 || corner.normal < -1) {
+                throw vtrs::AssetError(path + ": A face refers to a vertex attribute that does not exist.", vtrs::AssetError::E_TYPE_MALFORMED);
+            }
+
+            /* Adding zero turns -0 into 0, so both weld together. */
+            for (uint32_t axis = 0; axis < 3; axis++) {
+                vertex.position[axis] = positions[static_cast<size_t>(corner.position) * 3 + axis] + 0.0f;
+            }
+
+            if (m_options.importNormals && corner.normal >= 0) {
+                for (uint32_t axis = 0; axis < 3; axis++) {
+                    vertex.normal[axis] = normals[static_cast<size_t>(corner.normal) * 3 + axis] + 0.0f;
+                }
+            }
+
+            if (corner.uv >= 0) {
+                float v = uvs[static_cast<size_t>(corner.uv) * 2 + 1];
+
+                vertex.uv[0] = uvs[static_cast<size_t>(corner.uv) * 2] + 0.0f;
+                vertex.uv[1] = (m_options.flipV ? 1.0f - v : v) + 0.0f;
+            }
+        }
+
+        chunk.corners = std::vector<face_corner>();
+    });
+
+    Mesh mesh {};
+    weld_(corners, &mesh);
+
+    /* Group and material statements split the index list into submeshes, empty ones are dropped. */
+    mesh.submeshes.push_back({});
+
+    for (uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+        for (const auto& group : chunks[chunk].groups) {
+            uint32_t first_index = corner_bases[chunk] + group.triangle * 3;
+
+            if (first_index != mesh.submeshes.back().firstIndex) {
+                mesh_submesh& current = mesh.submeshes.back();
+                current.indexCount = first_index - current.firstIndex;
+
+                mesh_submesh next {};
+                next.name = current.name;
+                next.material = current.material;
+                next.firstIndex = first_index;
+
+                mesh.submeshes.push_back(next);
+            }
+
+            (group.isMaterial ? mesh.submeshes.back().material : mesh.submeshes.back().name) = group.name;
+        }
+    }
+
+    mesh.submeshes.back().indexCount = static_cast<uint32_t>(mesh.indices.size()) - mesh.submeshes.back().firstIndex;
+
+    if (mesh.submeshes.back().indexCount == 0) {
+        mesh.submeshes.pop_back();
+    }
+
+    if (!mesh.vertices.empty()) {
+        std::copy(mesh.vertices[0].position, mesh.vertices[0].position + 3, mesh.boundsMin);
+        std::copy(mesh.vertices[0].position, mesh.vertices[0].position + 3, mesh.boundsMax);
+    }
+
+    for (const auto& vertex : mesh.vertices) {
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            mesh.boundsMin[axis] = std::min(mesh.boundsMin[axis], vertex.position[axis]);
+            mesh.boundsMax[axis] = std::max(mesh.boundsMax[axis], vertex.position[axis]);
+        }
+    }
+
+    return mesh;
+}
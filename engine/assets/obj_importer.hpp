@@ -0,0 +1,144 @@
+/**
+ * obj_importer.hpp - Parallel Wavefront OBJ importer over a mapped file.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "platform/thread_pool.hpp"
+#include "mesh_data.hpp"
+
+namespace vtrs {
+
+struct obj_importer_opts {
+    /* Bytes of text parsed per task, rounded up to the next line end. */
+    size_t chunkSize = 4 * 1024 * 1024;
+
+    /* Flip V so textures authored with a bottom left origin come out upright. */
+    bool flipV = true;
+
+    /* Read normals, which then take part in the weld. Off for meshes whose shaders ignore them. */
+    bool importNormals = true;
+};
+
+/**
+ * @brief Imports Wavefront OBJ meshes on a thread pool.
+ *
+ * The file is mapped rather than streamed and split into chunks that
+ * end on line boundaries. Chunks are parsed in parallel with a float
+ * parser that works on the mapping in place. Relative indices are
+ * resolved once the attribute counts of the earlier chunks are known.
+ *
+ * Face corners are welded into unique vertices with open addressing
+ * tables, sharded by hash so each worker owns one. Corners weld when
+ * position, texture coordinate and normal all match. A hard edge keeps
+ * its vertices apart, so a mesh whose shaders ignore normals should be
+ * imported with importNormals off to weld on position and UV alone. Vertices are then
+ * numbered in the order the triangles first use them. Polygons are
+ * triangulated as fans. The o and g statements start a new submesh and
+ * name it, usemtl starts one with another material name. Material
+ * libraries, smoothing groups, lines and points are ignored.
+ */
+class ObjImporter {
+
+private:
+    struct face_corner {
+        /* Zero based attribute indices, -1 when the corner has none. */
+        int32_t position = -1;
+        int32_t uv = -1;
+        int32_t normal = -1;
+    };
+
+    struct group_marker {
+        /* Triangle of the chunk the statement precedes. */
+        uint32_t triangle = 0;
+        bool isMaterial = false;
+        std::string name {};
+    };
+
+    struct parsed_chunk {
+        std::vector<float> positions {};
+        std::vector<float> uvs {};
+        std::vector<float> normals {};
+
+        /* Three per triangle. */
+        std::vector<face_corner> corners {};
+
+        /* Attributes given as negative indices, which count back from the end of this chunk's data. */
+        std::vector<uint32_t> relativeSlots {};
+
+        std::vector<group_marker> groups {};
+    };
+
+    vtrs::ThreadPool* m_threadPool = nullptr;
+
+    struct obj_importer_opts m_options {};
+
+    /**
+     * @brief Parses the lines of one chunk. Runs on a worker thread.
+     * @param begin First byte of the chunk.
+     * @param end One past the last byte, right after a line end or at the end of the file.
+     * @param chunk Receives the attributes, corners and groups.
+     * @param offset Offset of the chunk in the file, used for error messages.
+     */
+    static void parseChunk_(const char* begin, const char* end, parsed_chunk* chunk, size_t offset);
+
+    /**
+     * @brief Runs a job on the thread pool, or inline without one.
+     */
+    void run_(uint32_t task_count, const std::function<void(uint32_t worker, uint32_t task)>& job) const;
+
+    /**
+     * @brief Welds face corners into unique vertices and fills the index list.
+     */
+    void weld_(const std::vector<struct mesh_vertex>& corners, struct mesh_data* mesh) const;
+
+    /**
+     * @brief Initialises member variables.
+     */
+    ObjImporter(vtrs::ThreadPool*, struct obj_importer_opts*);
+
+public:
+    typedef struct obj_importer_opts Options;
+    typedef struct mesh_data Mesh;
+
+    ObjImporter(const ObjImporter&) = delete;
+    ObjImporter& operator=(const ObjImporter&) = delete;
+
+    /**
+     * @brief Creates an importer.
+     * @param thread_pool Pool the chunks are parsed on, nullptr to parse on the calling thread.
+     * @param options Importer configuration, nullptr for the defaults.
+     * @return Instance of the importer.
+     */
+    static ObjImporter* factory(vtrs::ThreadPool* thread_pool, ObjImporter::Options* options = nullptr);
+
+    /**
+     * @brief Imports a mesh.
+     * @param path Path to the OBJ file.
+     * @return The welded triangle list.
+     * @throws vtrs::PlatformError Thrown if the file could not be mapped.
+     * @throws vtrs::AssetError Thrown if the file is malformed or refers to missing data.
+     */
+    Mesh load(const std::string& path) const;
+};
+
+} // namespace vtrs
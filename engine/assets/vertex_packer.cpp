@@ -0,0 +1,130 @@
+/**
+ * vertex_packer.cpp - Quantization of mesh vertices into compact GPU streams.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "platform/profiler.hpp"
+#include "vertex_packer.hpp"
+
+vtrs::VertexPacker::VertexPacker(vtrs::vertex_packer_opts* options) : m_options(*options) {}
+
+vtrs::VertexPacker* vtrs::VertexPacker::factory(vtrs::VertexPacker::Options* options) {
+    vtrs::VertexPacker::Options packer_options = options != nullptr ? *options : vtrs::VertexPacker::Options {};
+    return new VertexPacker(&packer_options);
+}
+
+void vtrs::VertexPacker::pack(vtrs::VertexPacker::Mesh* mesh) const {
+    VTRS_PROFILE_FUNCTION();
+
+    mesh_packed_streams& packed = mesh->packed;
+    packed = mesh_packed_streams {};
+
+    /* Positions are mapped from the bounds onto [-1, 1] along each axis. */
+    for (uint32_t axis = 0; axis < 3; axis++) {
+        float extent = (mesh->boundsMax[axis] - mesh->boundsMin[axis]) * 0.5f;
+
+        packed.scale[axis] = extent > 0.0f ? extent : 1.0f;
+        packed.bias[axis] = (mesh->boundsMax[axis] + mesh->boundsMin[axis]) * 0.5f;
+    }
+
+    packed.positions.resize(mesh->vertices.size());
+    packed.attributes.resize(mesh->vertices.size());
+
+    for (size_t index = 0; index < mesh->vertices.size(); index++) {
+        const mesh_vertex& vertex = mesh->vertices[index];
+        mesh_packed_position& position = packed.positions[index];
+        mesh_packed_attributes& attributes = packed.attributes[index];
+
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            position.position[axis] = encodeSnorm16((vertex.position[axis] - packed.bias[axis]) / packed.scale[axis]);
+        }
+
+        encodeOctahedral(vertex.normal, attributes.normal);
+        attributes.uv[0] = encodeHalf(vertex.uv[0]);
+        attributes.uv[1] = encodeHalf(vertex.uv[1]);
+    }
+
+    if (m_options.allowIndex16 && mesh->vertices.size() <= 65536) {
+        packed.indices16.assign(mesh->indices.begin(), mesh->indices.end());
+    }
+}
+
+uint16_t vtrs::VertexPacker::encodeHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000U);
+    uint32_t magnitude = bits & 0x7FFFFFFFU;
+
+    /* Infinity and NaN, which stays a quiet NaN. */
+    if (magnitude >= 0x7F800000U) {
+        return static_cast<uint16_t>(sign | (magnitude > 0x7F800000U ? 0x7E00U : 0x7C00U));
+    }
+
+    /* Anything from 65520 up rounds past the largest half. */
+    if (magnitude >= 0x477FF000U) {
+        return static_cast<uint16_t>(sign | 0x7C00U);
+    }
+
+    /* Below 2^-14 the half is subnormal, a multiple of 2^-24. */
+    if (magnitude < 0x38800000U) {
+        float absolute;
+        std::memcpy(&absolute, &magnitude, sizeof(absolute));
+
+        return static_cast<uint16_t>(sign | static_cast<uint16_t>(std::nearbyint(absolute * 16777216.0f)));
+    }
+
+    /* Rebias the exponent from 127 to 15 and round the 13 dropped bits to nearest even. */
+    uint32_t half = magnitude - 0x38000000U;
+    half += 0x0FFFU + ((half >> 13) & 1U);
+
+    return static_cast<uint16_t>(sign | (half >> 13));
+}
+
+int16_t vtrs::VertexPacker::encodeSnorm16(float value) {
+    return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+void vtrs::VertexPacker::encodeOctahedral(const float* normal, int16_t* output) {
+    float length = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+
+    if (length <= 0.0f) {
+        output[0] = 0;
+        output[1] = 0;
+        return;
+    }
+
+    float x = normal[0] / length;
+    float y = normal[1] / length;
+
+    /* The lower half of the octahedron is folded over the upper one. */
+    if (normal[2] < 0.0f) {
+        float folded_x = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        float folded_y = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+
+        x = folded_x;
+        y = folded_y;
+    }
+
+    output[0] = encodeSnorm16(x);
+    output[1] = encodeSnorm16(y);
+}
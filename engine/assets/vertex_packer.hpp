@@ -0,0 +1,90 @@
+/**
+ * vertex_packer.hpp - Quantization of mesh vertices into compact GPU streams.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include "mesh_data.hpp"
+
+namespace vtrs {
+
+struct vertex_packer_opts {
+    /* Keep 16-bit indices for meshes with at most 65536 vertices. */
+    bool allowIndex16 = true;
+};
+
+/**
+ * @brief Quantizes mesh vertices into the packed streams of the mesh.
+ *
+ * Each vertex shrinks from 32 to 16 bytes, in two streams:
+ * - Positions as 16-bit snorm relative to the bounds, 8 bytes. Passes
+ *   that only need positions read this stream and nothing else.
+ * - Octahedral normals as 16-bit snorm and texture coordinates as half
+ *   floats, 8 bytes.
+ *
+ * The error is at most 1/65534 of the bounds along each axis for
+ * positions. Normals are off by less than a tenth of a degree.
+ */
+class VertexPacker {
+
+private:
+    struct vertex_packer_opts m_options {};
+
+    /**
+     * @brief Initialises member variables.
+     */
+    explicit VertexPacker(struct vertex_packer_opts*);
+
+public:
+    typedef struct vertex_packer_opts Options;
+    typedef struct mesh_data Mesh;
+
+    /**
+     * @brief Creates a packer.
+     * @param options Packer configuration, nullptr for the defaults.
+     * @return Instance of the packer.
+     */
+    static VertexPacker* factory(VertexPacker::Options* options = nullptr);
+
+    /**
+     * @brief Fills in the packed streams from the vertices, indices and bounds.
+     * @param mesh Mesh to pack, its packed streams are replaced.
+     */
+    void pack(Mesh* mesh) const;
+
+    /**
+     * @brief Converts a float to a half float, rounding to nearest even.
+     */
+    static uint16_t encodeHalf(float value);
+
+    /**
+     * @brief Converts a value in [-1, 1] to 16-bit snorm.
+     */
+    static int16_t encodeSnorm16(float value);
+
+    /**
+     * @brief Folds a normal onto an octahedron and stores it as two 16-bit snorm values.
+     * @param normal Normal to encode, a zero normal comes back as +Z.
+     * @param output Receives the two components.
+     */
+    static void encodeOctahedral(const float* normal, int16_t* output);
+};
+
+} // namespace vtrs
@@ -0,0 +1,97 @@
+/**
+ * mapped_file.cpp - Read-only memory mapped files.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "platform/except.hpp"
+#include "platform/mapped_file.hpp"
+
+void vtrs::MappedFile::bootstrap_(const std::string& path) {
+    m_path = path;
+
+    int descriptor = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (descriptor < 0) {
+        throw vtrs::PlatformError("Unable to open file " + path, vtrs::PlatformError::E_TYPE_FILE_IO, errno);
+    }
+
+    struct stat file_stat {};
+
+    if (fstat(descriptor, &file_stat) != 0) {
+        int error_code = errno;
+        ::close(descriptor);
+
+        throw vtrs::PlatformError("Unable to stat file " + path, vtrs::PlatformError::E_TYPE_FILE_IO, error_code);
+    }
+
+    m_size = static_cast<size_t>(file_stat.st_size);
+
+    /* Mapping zero bytes is an error, an empty file simply has no data. */
+    if (m_size > 0) {
+        void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+        if (data == MAP_FAILED) {
+            int error_code = errno;
+            ::close(descriptor);
+
+            throw vtrs::PlatformError("Unable to map file " + path, vtrs::PlatformError::E_TYPE_FILE_IO, error_code);
+        }
+
+        m_data = data;
+    }
+
+    ::close(descriptor);
+}
+
+vtrs::MappedFile* vtrs::MappedFile::factory(const std::string& path) {
+    auto mapped_file = new MappedFile();
+
+    try {
+        mapped_file->bootstrap_(path);
+
+    } catch (vtrs::PlatformError&) {
+        delete mapped_file;
+        throw;
+    }
+
+    return mapped_file;
+}
+
+vtrs::MappedFile::~MappedFile() {
+    if (m_data != nullptr) {
+        munmap(m_data, m_size);
+    }
+}
+
+const void* vtrs::MappedFile::getData() const {
+    return m_data;
+}
+
+size_t vtrs::MappedFile::getSize() const {
+    return m_size;
+}
+
+const std::string& vtrs::MappedFile::getPath() const {
+    return m_path;
+}
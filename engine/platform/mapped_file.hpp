@@ -0,0 +1,83 @@
+/**
+ * mapped_file.hpp - Read-only memory mapped files.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+namespace vtrs {
+
+/**
+ * @brief A file mapped read-only into the address space.
+ *
+ * The mapping is page aligned and stays valid until the instance is
+ * deleted, so its contents can be handed to APIs without copying.
+ */
+class MappedFile {
+
+private:
+    std::string m_path {};
+    void*       m_data = nullptr;
+    size_t      m_size = 0;
+
+    /**
+     * @brief Opens and maps the file.
+     * @param path Path to the file.
+     */
+    void bootstrap_(const std::string& path);
+
+    MappedFile() = default;
+
+public:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Maps a file and returns the new instance.
+     * @param path Path to the file.
+     * @return Instance of the mapped file.
+     * @throws vtrs::PlatformError Thrown if the file could not be opened or mapped.
+     */
+    static MappedFile* factory(const std::string& path);
+
+    /**
+     * @brief Unmaps the file.
+     */
+    ~MappedFile();
+
+    /**
+     * @brief Returns the first byte of the mapping, or nullptr for empty files.
+     */
+    [[nodiscard]] const void* getData() const;
+
+    /**
+     * @brief Returns the size of the file in bytes.
+     */
+    [[nodiscard]] size_t getSize() const;
+
+    /**
+     * @brief Returns the path the file was mapped from.
+     */
+    [[nodiscard]] const std::string& getPath() const;
+};
+
+} // namespace vtrs
@@ -0,0 +1,293 @@
+/**
+ * profiler.cpp - Scoped CPU zones captured into Chrome trace files.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <csignal>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "platform/logger.hpp"
+#include "platform/profiler.hpp"
+
+namespace {
+
+struct profiler_event {
+    const char* name;
+    uint64_t    begin;
+    uint64_t    end;
+};
+
+/* Written by its own thread only, read by the thread ending a capture. */
+struct thread_buffer {
+    uint32_t    threadId = 0;
+    std::string threadName {};
+
+    std::vector<profiler_event> events {};
+    std::atomic<uint32_t> count {0};
+    std::atomic<uint32_t> dropped {0};
+    std::atomic<uint32_t> generation {0};
+};
+
+std::mutex s_registryMutex {};
+std::vector<std::unique_ptr<thread_buffer>> s_buffers {};
+thread_local thread_buffer* t_buffer = nullptr;
+
+std::atomic<uint32_t> s_generation {0};
+std::atomic<uint32_t> s_threadCapacity {65536};
+uint64_t s_captureBegin = 0;
+
+/* Frame triggers, touched by the frame loop thread only. */
+uint32_t    s_armedFrames = 0;
+uint32_t    s_remainingFrames = 0;
+uint64_t    s_frameBegin = 0;
+std::string s_armedPath {};
+std::string s_capturePath {};
+
+volatile std::sig_atomic_t s_isSignalRaised = 0;
+uint32_t    s_signalFrames = 0;
+std::string s_signalPath {};
+
+void onSignal(int) {
+    s_isSignalRaised = 1;
+}
+
+thread_buffer* threadBuffer() {
+    if (t_buffer != nullptr) {
+        return t_buffer;
+    }
+
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+
+    auto buffer = std::make_unique<thread_buffer>();
+    buffer->threadId = static_cast<uint32_t>(s_buffers.size()) + 1;
+    buffer->threadName = "Thread " + std::to_string(buffer->threadId);
+    buffer->events.resize(s_threadCapacity.load(std::memory_order_relaxed));
+
+    /* Buffers outlive their threads, so a capture can still read them. */
+    t_buffer = buffer.get();
+    s_buffers.push_back(std::move(buffer));
+
+    return t_buffer;
+}
+
+double ticksPerSecond() {
+    static const double ticks_per_second = []() {
+#if defined(VTRS_PROFILER_USE_TSC)
+        auto clock_begin = std::chrono::steady_clock::now();
+        auto tick_begin = vtrs::Profiler::now();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        auto tick_end = vtrs::Profiler::now();
+        auto clock_end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(clock_end - clock_begin).count();
+        return static_cast<double>(tick_end - tick_begin) / seconds;
+#else
+        return 1000000000.0;
+#endif // defined(VTRS_PROFILER_USE_TSC)
+    }();
+
+    return ticks_per_second;
+}
+
+void writeEscaped(std::ofstream& stream, const std::string& text) {
+    for (auto character : text) {
+        if (character == '"' || character == '\\') {
+            stream << '\\' << character;
+
+        } else if (static_cast<unsigned char>(character) >= 0x20) {
+            stream << character;
+        }
+    }
+}
+
+} // namespace
+
+std::atomic<bool> vtrs::Profiler::s_isCapturing {false};
+
+void vtrs::Profiler::record_(const char* name, uint64_t begin, uint64_t end) {
+    auto buffer = threadBuffer();
+    auto generation = s_generation.load(std::memory_order_acquire);
+
+    /* The owning thread clears its buffer on its first zone of a new capture. */
+    if (buffer->generation.load(std::memory_order_relaxed) != generation) {
+        buffer->count.store(0, std::memory_order_relaxed);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+        buffer->generation.store(generation, std::memory_order_release);
+    }
+
+    auto index = buffer->count.load(std::memory_order_relaxed);
+
+    if (index >= buffer->events.size()) {
+        buffer->dropped.store(buffer->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    buffer->events[index] = {name, begin, end};
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+double vtrs::Profiler::toSeconds(uint64_t ticks) {
+    return static_cast<double>(ticks) / ticksPerSecond();
+}
+
+void vtrs::Profiler::setThreadCapacity(uint32_t event_count) {
+    s_threadCapacity.store(std::max<uint32_t>(event_count, 1), std::memory_order_relaxed);
+}
+
+void vtrs::Profiler::setThreadName(const std::string& name) {
+    auto buffer = threadBuffer();
+
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+    buffer->threadName = name;
+}
+
+void vtrs::Profiler::beginCapture() {
+    if (s_isCapturing.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    /* Calibrates up front rather than while writing the capture. */
+    ticksPerSecond();
+
+    s_generation.fetch_add(1, std::memory_order_release);
+    s_captureBegin = now();
+    s_isCapturing.store(true, std::memory_order_release);
+}
+
+bool vtrs::Profiler::endCapture(const std::string& path) {
+    if (!s_isCapturing.exchange(false, std::memory_order_acq_rel)) {
+        return false;
+    }
+
+    std::ofstream stream(path, std::ios::out | std::ios::trunc);
+
+    if (!stream.is_open()) {
+        vtrs::Logger::warn("Unable to write profiler capture", path);
+        return false;
+    }
+
+    auto generation = s_generation.load(std::memory_order_acquire);
+    double micros_per_tick = 1000000.0 / ticksPerSecond();
+
+    uint64_t event_count = 0;
+    uint64_t dropped_count = 0;
+    bool is_first = true;
+
+    stream.setf(std::ios::fixed);
+    stream.precision(3);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    std::lock_guard<std::mutex> lock(s_registryMutex);
+
+    for (const auto& buffer : s_buffers) {
+        stream << (is_first ? "\n" : ",\n") << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << buffer->threadId << R"(,"args":{"name":")";
+        writeEscaped(stream, buffer->threadName);
+        stream << "\"}}";
+
+        is_first = false;
+
+        if (buffer->generation.load(std::memory_order_acquire) != generation) {
+            continue;
+        }
+
+        auto count = buffer->count.load(std::memory_order_acquire);
+        dropped_count += buffer->dropped.load(std::memory_order_relaxed);
+
+        for (uint32_t index = 0; index < count; index++) {
+            const auto& event = buffer->events[index];
+
+            /* Zones opened before the capture started are partial, leave them out. */
+            if (event.begin < s_captureBegin) {
+                continue;
+            }
+
+            stream << ",\n" << R"({"name":")";
+            writeEscaped(stream, event.name);
+            stream << R"(","cat":"cpu","ph":"X","pid":1,"tid":)" << buffer->threadId
+                   << ",\"ts\":" << static_cast<double>(event.begin - s_captureBegin) * micros_per_tick
+                   << ",\"dur\":" << static_cast<double>(event.end - event.begin) * micros_per_tick << "}";
+
+            event_count++;
+        }
+    }
+
+    stream << "\n]}\n";
+    stream.close();
+
+    if (dropped_count > 0) {
+        vtrs::Logger::warn("Profiler dropped", dropped_count, "zones, raise the thread capacity.");
+    }
+
+    vtrs::Logger::info("Profiler capture with", event_count, "zones written to", path);
+    return !stream.fail();
+}
+
+void vtrs::Profiler::captureFrames(uint32_t frame_count, const std::string& path) {
+    s_armedFrames = std::max<uint32_t>(frame_count, 1);
+    s_armedPath = path;
+}
+
+void vtrs::Profiler::installSignalTrigger(int signal_number, uint32_t frame_count, const std::string& path) {
+    s_signalFrames = std::max<uint32_t>(frame_count, 1);
+    s_signalPath = path;
+
+    std::signal(signal_number, onSignal);
+}
+
+void vtrs::Profiler::frameMark() {
+    auto tick = now();
+
+    if (s_isCapturing.load(std::memory_order_relaxed) && s_frameBegin >= s_captureBegin) {
+        record_("Frame", s_frameBegin, tick);
+    }
+
+    s_frameBegin = tick;
+
+    if (s_isSignalRaised != 0) {
+        s_isSignalRaised = 0;
+
+        if (s_remainingFrames == 0) {
+            captureFrames(s_signalFrames, s_signalPath);
+        }
+    }
+
+    if (s_remainingFrames > 0) {
+        if (--s_remainingFrames == 0) {
+            endCapture(s_capturePath);
+        }
+
+    } else if (s_armedFrames > 0) {
+        s_remainingFrames = s_armedFrames;
+        s_capturePath = s_armedPath;
+        s_armedFrames = 0;
+
+        beginCapture();
+        s_frameBegin = s_captureBegin;
+    }
+}
+
+bool vtrs::Profiler::isCapturing() {
+    return s_isCapturing.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,183 @@
+/**
+ * profiler.hpp - Scoped CPU zones captured into Chrome trace files.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif // defined(_MSC_VER)
+#define VTRS_PROFILER_USE_TSC 1
+#endif // defined(__x86_64__) || defined(_M_X64)
+
+#define VTRS_PROFILER_CONCAT_INNER_(a, b) a##b
+#define VTRS_PROFILER_CONCAT_(a, b) VTRS_PROFILER_CONCAT_INNER_(a, b)
+
+#if (defined(VTRS_ENABLE_PROFILER) && VTRS_ENABLE_PROFILER == 1)
+#define VTRS_PROFILE_ZONE(name) vtrs::Profiler::Zone VTRS_PROFILER_CONCAT_(vtrs_profiler_zone_, __LINE__) (name)
+#define VTRS_PROFILE_FUNCTION() VTRS_PROFILE_ZONE(__func__)
+#define VTRS_PROFILE_FRAME() vtrs::Profiler::frameMark()
+#define VTRS_PROFILE_THREAD(name) vtrs::Profiler::setThreadName(name)
+
+#else
+#define VTRS_PROFILE_ZONE(name) static_cast<void>(0)
+#define VTRS_PROFILE_FUNCTION() static_cast<void>(0)
+#define VTRS_PROFILE_FRAME() static_cast<void>(0)
+#define VTRS_PROFILE_THREAD(name) static_cast<void>(0)
+
+#endif // (defined(VTRS_ENABLE_PROFILER) && VTRS_ENABLE_PROFILER == 1)
+
+namespace vtrs {
+
+/**
+ * @brief Records CPU zones and writes them as Chrome trace JSON.
+ *
+ * Zones are recorded only while a capture is running. Every thread writes
+ * into its own fixed size buffer, so recording takes no locks; a thread
+ * only locks once, the first time it records. Timestamps come from the
+ * TSC on x86-64, calibrated against the steady clock, and from the steady
+ * clock elsewhere.
+ *
+ * A capture is started and stopped by hand, or armed for a number of
+ * frames with captureFrames or a signal. The written file opens in
+ * chrome://tracing and ui.perfetto.dev.
+ *
+ * Use the VTRS_PROFILE_* macros rather than the class itself. They expand
+ * to nothing unless VTRS_ENABLE_PROFILER is defined to 1, which the CMake
+ * option of the same name does.
+ */
+class Profiler {
+
+private:
+    static std::atomic<bool> s_isCapturing;
+
+    /**
+     * @brief Appends a zone to the buffer of the calling thread.
+     */
+    static void record_(const char* name, uint64_t begin, uint64_t end);
+
+public:
+    /**
+     * @brief Measures the lifetime of a scope.
+     *
+     * The name must outlive the capture, a string literal is the intent.
+     */
+    class Zone {
+
+    private:
+        const char* m_name;
+        uint64_t    m_begin;
+
+    public:
+        explicit Zone(const char* name) : m_name(name), m_begin(s_isCapturing.load(std::memory_order_relaxed) ? now() : 0) {}
+
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+        ~Zone() {
+            if (m_begin != 0) {
+                record_(m_name, m_begin, now());
+            }
+        }
+    };
+
+    /**
+     * @brief Returns the current time in clock ticks.
+     */
+    static inline uint64_t now() {
+#if defined(VTRS_PROFILER_USE_TSC)
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif // defined(VTRS_PROFILER_USE_TSC)
+    }
+
+    /**
+     * @brief Converts clock ticks to seconds.
+     *
+     * The first call calibrates the clock, which takes about ten milliseconds.
+     */
+    static double toSeconds(uint64_t ticks);
+
+    /**
+     * @brief Changes the number of zones each thread keeps per capture.
+     *
+     * Takes effect for buffers created afterwards. Zones past the
+     * capacity are dropped and reported when the capture is written.
+     */
+    static void setThreadCapacity(uint32_t event_count);
+
+    /**
+     * @brief Names the calling thread in the written traces.
+     */
+    static void setThreadName(const std::string& name);
+
+    /**
+     * @brief Starts recording zones.
+     */
+    static void beginCapture();
+
+    /**
+     * @brief Stops recording and writes the captured zones.
+     * @param path Path of the JSON file to write.
+     * @return False if no capture was running or the file could not be written.
+     */
+    static bool endCapture(const std::string& path);
+
+    /**
+     * @brief Arms a capture of the next frames.
+     * @param frame_count Number of frames to capture.
+     * @param path Path of the JSON file written after the last frame.
+     */
+    static void captureFrames(uint32_t frame_count, const std::string& path);
+
+    /**
+     * @brief Arms a frame capture whenever the process receives a signal.
+     * @param signal_number Signal that triggers the capture, such as SIGUSR1.
+     * @param frame_count Number of frames to capture.
+     * @param path Path of the JSON file written after the last frame.
+     *
+     * The handler only raises a flag, the capture starts on the next frameMark.
+     */
+    static void installSignalTrigger(int signal_number, uint32_t frame_count, const std::string& path);
+
+    /**
+     * @brief Marks the start of a frame.
+     *
+     * Call once per frame from the thread driving the frame loop. Starts
+     * and stops armed captures and records each frame as a zone.
+     */
+    static void frameMark();
+
+    /**
+     * @brief Tells whether a capture is running.
+     */
+    static bool isCapturing();
+};
+
+} // namespace vtrs
@@ -0,0 +1,131 @@
+/**
+ * thread_pool.cpp - A fixed set of worker threads for fork-join jobs.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <string>
+#include "platform/profiler.hpp"
+#include "platform/thread_pool.hpp"
+
+void vtrs::ThreadPool::workerLoop_(uint32_t worker) {
+    uint64_t seen_generation = 0;
+    VTRS_PROFILE_THREAD("Worker " + std::to_string(worker));
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        m_wakeCondition.wait(lock, [this, &seen_generation]() {
+            return m_isStopping || m_generation != seen_generation;
+        });
+
+        if (m_isStopping) {
+            return;
+        }
+
+        seen_generation = m_generation;
+
+        /* Pull tasks until the job runs dry, then go back to sleep. */
+        while (m_nextTask < m_taskCount) {
+            uint32_t task = m_nextTask++;
+            std::exception_ptr error = nullptr;
+
+            lock.unlock();
+
+            try {
+                VTRS_PROFILE_ZONE("ThreadPool task");
+                m_job(worker, task);
+
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            lock.lock();
+
+            if (error && !m_error) {
+                m_error = error;
+            }
+
+            if (--m_pendingTasks == 0) {
+                m_doneCondition.notify_all();
+            }
+        }
+    }
+}
+
+void vtrs::ThreadPool::bootstrap_(uint32_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    for (uint32_t worker = 0; worker < thread_count; worker++) {
+        m_workers.emplace_back(&ThreadPool::workerLoop_, this, worker);
+    }
+}
+
+vtrs::ThreadPool* vtrs::ThreadPool::factory(uint32_t thread_count) {
+    auto instance = new ThreadPool();
+    instance->bootstrap_(thread_count);
+
+    return instance;
+}
+
+vtrs::ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isStopping = true;
+    }
+
+    m_wakeCondition.notify_all();
+
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void vtrs::ThreadPool::dispatch(uint32_t task_count, const std::function<void(uint32_t, uint32_t)>& job) {
+    if (task_count == 0) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_job = job;
+    m_error = nullptr;
+    m_taskCount = task_count;
+    m_nextTask = 0;
+    m_pendingTasks = task_count;
+    m_generation++;
+
+    m_wakeCondition.notify_all();
+    m_doneCondition.wait(lock, [this]() { return m_pendingTasks == 0; });
+
+    m_job = nullptr;
+    m_taskCount = 0;
+
+    if (m_error) {
+        auto error = m_error;
+        m_error = nullptr;
+
+        std::rethrow_exception(error);
+    }
+}
+
+uint32_t vtrs::ThreadPool::getThreadCount() const {
+    return static_cast<uint32_t>(m_workers.size());
+}
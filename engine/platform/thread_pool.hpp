@@ -0,0 +1,106 @@
+/**
+ * thread_pool.hpp - A fixed set of worker threads for fork-join jobs.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vtrs {
+
+/**
+ * @brief A fixed set of worker threads that run fork-join jobs.
+ *
+ * Each worker has a stable index in [0, getThreadCount()), so callers can
+ * keep per-thread state, such as command pools, without locking. A job
+ * is split into tasks that the workers pull in order. dispatch blocks
+ * until every task has finished.
+ */
+class ThreadPool {
+
+private:
+    std::vector<std::thread> m_workers {};
+
+    std::mutex              m_mutex {};
+    std::condition_variable m_wakeCondition {};
+    std::condition_variable m_doneCondition {};
+
+    std::function<void(uint32_t, uint32_t)> m_job {};
+    std::exception_ptr m_error = nullptr;
+
+    uint32_t m_taskCount = 0;
+    uint32_t m_nextTask = 0;
+    uint32_t m_pendingTasks = 0;
+    uint64_t m_generation = 0;
+    bool     m_isStopping = false;
+
+    /**
+     * @brief Loop executed by each worker thread.
+     * @param worker Index of the worker.
+     */
+    void workerLoop_(uint32_t worker);
+
+    /**
+     * @brief Starts the worker threads.
+     * @param thread_count Number of threads to start.
+     */
+    void bootstrap_(uint32_t thread_count);
+
+    ThreadPool() = default;
+
+public:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * @brief Creates a pool and starts its threads.
+     * @param thread_count Number of workers, zero picks one per hardware thread.
+     * @return Instance of the thread pool.
+     */
+    static ThreadPool* factory(uint32_t thread_count = 0);
+
+    /**
+     * @brief Stops and joins every worker.
+     */
+    ~ThreadPool();
+
+    /**
+     * @brief Runs a job on the workers and waits for it to complete.
+     * @param task_count Number of tasks in the job.
+     * @param job Called once per task with the worker and task indices.
+     *
+     * The first exception thrown by a task is rethrown here once
+     * all tasks have finished. Jobs must not dispatch recursively.
+     */
+    void dispatch(uint32_t task_count, const std::function<void(uint32_t worker, uint32_t task)>& job);
+
+    /**
+     * @brief Returns the number of worker threads.
+     */
+    [[nodiscard]] uint32_t getThreadCount() const;
+};
+
+} // namespace vtrs
@@ -0,0 +1,262 @@
+/**
+ * bindless_registry.cpp - Global update-after-bind descriptor set.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <array>
+#include "assert.hpp"
+#include "bindless_registry.hpp"
+
+namespace {
+
+const VkDescriptorType SLOT_DESCRIPTOR_TYPES[] = {
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+};
+
+} // namespace
+
+uint32_t vtrs::BindlessRegistry::acquire_(SlotType type) {
+    auto& allocator = m_slots[type];
+
+    if (!allocator.freeSlots.empty()) {
+        uint32_t slot = allocator.freeSlots.back();
+        allocator.freeSlots.pop_back();
+
+        return slot;
+    }
+
+    if (allocator.next == allocator.capacity) {
+        throw vtrs::RendererError("Bindless descriptor array is full.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    return allocator.next++;
+}
+
+void vtrs::BindlessRegistry::write_(SlotType type, uint32_t slot, const VkDescriptorImageInfo* image, const VkDescriptorBufferInfo* buffer) {
+    VkWriteDescriptorSet write {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write.dstSet = m_set;
+    write.dstBinding = static_cast<uint32_t>(type);
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = SLOT_DESCRIPTOR_TYPES[type];
+    write.pImageInfo = image;
+    write.pBufferInfo = buffer;
+
+    vkUpdateDescriptorSets(m_logicalDevice, 1, &write, 0, nullptr);
+}
+
+void vtrs::BindlessRegistry::bootstrap_(const vtrs::RendererGPU* gpu, vtrs::bindless_registry_opts* options) {
+    if (!gpu->isBindlessSupported()) {
+        throw vtrs::RendererError("The GPU does not support bindless descriptors.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+    }
+
+    const auto& limits = gpu->getDescriptorIndexingProperties();
+
+    m_framesInFlight = std::max<uint32_t>(options->framesInFlight, 1);
+
+    m_slots[SLOT_TYPE_TEXTURE].capacity = std::min({options->maxTextures,
+                                                    limits.maxDescriptorSetUpdateAfterBindSampledImages,
+                                                    limits.maxPerStageDescriptorUpdateAfterBindSampledImages});
+
+    m_slots[SLOT_TYPE_SAMPLER].capacity = std::min({options->maxSamplers,
+                                                    limits.maxDescriptorSetUpdateAfterBindSamplers,
+                                                    limits.maxPerStageDescriptorUpdateAfterBindSamplers});
+
+    m_slots[SLOT_TYPE_BUFFER].capacity = std::min({options->maxBuffers,
+                                                   limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                                   limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings {};
+    std::array<VkDescriptorBindingFlags, 3> binding_flags {};
+    std::array<VkDescriptorPoolSize, 3> pool_sizes {};
+
+    for (uint32_t index = 0; index < 3; index++) {
+        bindings[index].binding = index;
+        bindings[index].descriptorType = SLOT_DESCRIPTOR_TYPES[index];
+        bindings[index].descriptorCount = std::max<uint32_t>(m_slots[index].capacity, 1);
+        bindings[index].stageFlags = VK_SHADER_STAGE_ALL;
+
+        /* Unused slots may hold stale or no descriptors, and may be
+         * rewritten while frames using other slots are in flight. */
+        binding_flags[index] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                               VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                               VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+        pool_sizes[index] = {SLOT_DESCRIPTOR_TYPES[index], bindings[index].descriptorCount};
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO};
+    flags_info.bindingCount = static_cast<uint32_t>(binding_flags.size());
+    flags_info.pBindingFlags = binding_flags.data();
+
+    VkDescriptorSetLayoutCreateInfo layout_info {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    layout_info.pNext = &flags_info;
+    layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings = bindings.data();
+
+    auto result = vkCreateDescriptorSetLayout(m_logicalDevice, &layout_info, nullptr, &m_setLayout);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create bindless descriptor set layout.")
+
+    VkDescriptorPoolCreateInfo pool_info {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+
+    result = vkCreateDescriptorPool(m_logicalDevice, &pool_info, nullptr, &m_pool);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create bindless descriptor pool.")
+
+    VkDescriptorSetAllocateInfo alloc_info {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    alloc_info.descriptorPool = m_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &m_setLayout;
+
+    result = vkAllocateDescriptorSets(m_logicalDevice, &alloc_info, &m_set);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to allocate bindless descriptor set.")
+}
+
+vtrs::BindlessRegistry::BindlessRegistry(VkDevice logical_device) : m_logicalDevice(logical_device) {
+
+}
+
+vtrs::BindlessRegistry* vtrs::BindlessRegistry::factory(const vtrs::RendererGPU* gpu, VkDevice logical_device, vtrs::BindlessRegistry::Options* options) {
+    auto instance = new BindlessRegistry(logical_device);
+
+    try {
+        instance->bootstrap_(gpu, options);
+
+    } catch (vtrs::RendererError&) {
+        delete instance;
+        throw;
+    }
+
+    return instance;
+}
+
+vtrs::BindlessRegistry::~BindlessRegistry() {
+    for (auto& entry : m_pipelineLayouts) {
+        vkDestroyPipelineLayout(m_logicalDevice, entry.second, nullptr);
+    }
+
+    if (m_pool != VK_NULL_HANDLE) vkDestroyDescriptorPool(m_logicalDevice, m_pool, nullptr);
+    if (m_setLayout != VK_NULL_HANDLE) vkDestroyDescriptorSetLayout(m_logicalDevice, m_setLayout, nullptr);
+
+    m_pipelineLayouts.clear();
+}
+
+void vtrs::BindlessRegistry::beginFrame() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_frameCounter++;
+
+    /* A slot released in frame N may be read until frame N + framesInFlight begins. */
+    auto expired = std::partition(m_retired.begin(), m_retired.end(), [this](const retired_slot& retired) {
+        return retired.frame + m_framesInFlight > m_frameCounter;
+    });
+
+    for (auto iterator = expired; iterator != m_retired.end(); iterator++) {
+        m_slots[iterator->type].freeSlots.push_back(iterator->slot);
+    }
+
+    m_retired.erase(expired, m_retired.end());
+}
+
+uint32_t vtrs::BindlessRegistry::registerTexture(VkImageView view, VkImageLayout layout) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t slot = acquire_(SLOT_TYPE_TEXTURE);
+    VkDescriptorImageInfo image_info {VK_NULL_HANDLE, view, layout};
+
+    write_(SLOT_TYPE_TEXTURE, slot, &image_info, nullptr);
+    return slot;
+}
+
+uint32_t vtrs::BindlessRegistry::registerSampler(VkSampler sampler) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t slot = acquire_(SLOT_TYPE_SAMPLER);
+    VkDescriptorImageInfo image_info {sampler, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_UNDEFINED};
+
+    write_(SLOT_TYPE_SAMPLER, slot, &image_info, nullptr);
+    return slot;
+}
+
+uint32_t vtrs::BindlessRegistry::registerBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t slot = acquire_(SLOT_TYPE_BUFFER);
+    VkDescriptorBufferInfo buffer_info {buffer, offset, range};
+
+    write_(SLOT_TYPE_BUFFER, slot, nullptr, &buffer_info);
+    return slot;
+}
+
+void vtrs::BindlessRegistry::updateTexture(uint32_t slot, VkImageView view, VkImageLayout layout) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    VkDescriptorImageInfo image_info {VK_NULL_HANDLE, view, layout};
+    write_(SLOT_TYPE_TEXTURE, slot, &image_info, nullptr);
+}
+
+void vtrs::BindlessRegistry::release(SlotType type, uint32_t slot) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_retired.push_back({type, slot, m_frameCounter});
+}
+
+void vtrs::BindlessRegistry::bind(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout layout, uint32_t set_index) const {
+    vkCmdBindDescriptorSets(command_buffer, bind_point, layout, set_index, 1, &m_set, 0, nullptr);
+}
+
+VkPipelineLayout vtrs::BindlessRegistry::getPipelineLayout(uint32_t push_constant_size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto found = m_pipelineLayouts.find(push_constant_size);
+
+    if (found != m_pipelineLayouts.end()) {
+        return found->second;
+    }
+
+    VkPushConstantRange push_range {VK_SHADER_STAGE_ALL, 0, push_constant_size};
+
+    VkPipelineLayoutCreateInfo layout_info {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &m_setLayout;
+    layout_info.pushConstantRangeCount = push_constant_size > 0 ? 1 : 0;
+    layout_info.pPushConstantRanges = &push_range;
+
+    VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+
+    auto result = vkCreatePipelineLayout(m_logicalDevice, &layout_info, nullptr, &pipeline_layout);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create bindless pipeline layout.")
+
+    m_pipelineLayouts[push_constant_size] = pipeline_layout;
+    return pipeline_layout;
+}
+
+VkDescriptorSetLayout vtrs::BindlessRegistry::getSetLayout() const {
+    return m_setLayout;
+}
+
+uint32_t vtrs::BindlessRegistry::getCapacity(SlotType type) const {
+    return m_slots[type].capacity;
+}
@@ -0,0 +1,200 @@
+/**
+ * bindless_registry.hpp - Global update-after-bind descriptor set.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "vulkan_api.hpp"
+#include "renderer_gpu.hpp"
+
+namespace vtrs {
+
+struct bindless_registry_opts {
+    uint32_t framesInFlight = 2;
+
+    /* Requested array sizes, clamped to the update-after-bind limits of the GPU. */
+    uint32_t maxTextures = 16384;
+    uint32_t maxSamplers = 256;
+    uint32_t maxBuffers = 8192;
+};
+
+/**
+ * @brief One global descriptor set indexed by slot instead of bound per draw.
+ *
+ * The set holds three partially bound, update-after-bind arrays:
+ * sampled images at binding 0, samplers at binding 1 and storage buffers
+ * at binding 2. Resources register into a slot and shaders index the
+ * arrays with slots passed in push constants or buffers. The set is bound
+ * once per frame whatever the number of materials.
+ *
+ * Released slots are only reused once every frame in flight that may
+ * still index them has completed. Registration is thread safe.
+ */
+class BindlessRegistry {
+
+public:
+    enum SlotType : int {
+        SLOT_TYPE_TEXTURE = 0,
+        SLOT_TYPE_SAMPLER,
+        SLOT_TYPE_BUFFER
+    };
+
+private:
+    struct slot_allocator {
+        uint32_t capacity = 0;
+        uint32_t next = 0;
+        std::vector<uint32_t> freeSlots {};
+    };
+
+    struct retired_slot {
+        SlotType type;
+        uint32_t slot;
+        uint64_t frame;
+    };
+
+    VkDevice m_logicalDevice = VK_NULL_HANDLE;
+    uint32_t m_framesInFlight = 0;
+    uint64_t m_frameCounter = 0;
+
+    VkDescriptorSetLayout m_setLayout = VK_NULL_HANDLE;
+    VkDescriptorPool      m_pool = VK_NULL_HANDLE;
+    VkDescriptorSet       m_set = VK_NULL_HANDLE;
+
+    std::mutex m_mutex {};
+    slot_allocator m_slots[3] {};
+    std::vector<retired_slot> m_retired {};
+
+    std::unordered_map<uint32_t, VkPipelineLayout> m_pipelineLayouts {};
+
+    /**
+     * @brief Takes a free slot of the given type.
+     * @throws vtrs::RendererError Thrown if every slot is in use.
+     */
+    uint32_t acquire_(SlotType type);
+
+    /**
+     * @brief Writes a single descriptor into the global set.
+     */
+    void write_(SlotType type, uint32_t slot, const VkDescriptorImageInfo* image, const VkDescriptorBufferInfo* buffer);
+
+    /**
+     * @brief Bootstraps the registry.
+     * @param gpu The GPU the logical device was created on.
+     * @param options Bindless registry configuration.
+     *
+     * The boostrap method will:
+     * - Clamp the array sizes to the update-after-bind limits.
+     * - Create the set layout, an update-after-bind pool and the global set.
+     */
+    void bootstrap_(const vtrs::RendererGPU* gpu, struct bindless_registry_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     * @param logical_device Vulkan logical device handle.
+     */
+    explicit BindlessRegistry(VkDevice);
+
+public:
+    typedef struct bindless_registry_opts Options;
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param gpu               The GPU the logical device was created on.
+     * @param logical_device    Vulkan logical device handle.
+     * @param options           Bindless registry configuration.
+     * @return Instance of the bindless registry.
+     * @throws vtrs::RendererError Thrown if the GPU does not support bindless descriptors.
+     *
+     * The logical device must have been created with the descriptor
+     * indexing features checked by RendererGPU::isBindlessSupported.
+     */
+    static BindlessRegistry* factory(const vtrs::RendererGPU*, VkDevice, BindlessRegistry::Options*);
+
+    /**
+     * @brief Destroys the global set, its layout and every pipeline layout handed out.
+     */
+    ~BindlessRegistry();
+
+    /**
+     * @brief Starts a frame and recycles slots no frame in flight can still read.
+     *
+     * Call once per frame, after the fence of the frame has signalled.
+     */
+    void beginFrame();
+
+    /**
+     * @brief Registers an image view for sampling.
+     * @return Index into the texture array.
+     */
+    uint32_t registerTexture(VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    /**
+     * @brief Registers a sampler.
+     * @return Index into the sampler array.
+     */
+    uint32_t registerSampler(VkSampler sampler);
+
+    /**
+     * @brief Registers a storage buffer range.
+     * @return Index into the buffer array.
+     */
+    uint32_t registerBuffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+
+    /**
+     * @brief Points an already registered texture slot at another image view.
+     */
+    void updateTexture(uint32_t slot, VkImageView view, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    /**
+     * @brief Releases a slot once the frames in flight are done with it.
+     */
+    void release(SlotType type, uint32_t slot);
+
+    /**
+     * @brief Binds the global set.
+     * @param command_buffer Command buffer being recorded.
+     * @param bind_point Graphics or compute.
+     * @param layout A pipeline layout with the bindless set layout at set_index.
+     * @param set_index Set number the global set is bound at.
+     */
+    void bind(VkCommandBuffer command_buffer, VkPipelineBindPoint bind_point, VkPipelineLayout layout, uint32_t set_index = 0) const;
+
+    /**
+     * @brief Returns a pipeline layout made of the global set and one push constant range.
+     * @param push_constant_size Size of the push constant block visible to every stage.
+     * @return The pipeline layout, owned by the registry.
+     */
+    VkPipelineLayout getPipelineLayout(uint32_t push_constant_size);
+
+    /**
+     * @brief Returns the layout of the global set.
+     */
+    [[nodiscard]] VkDescriptorSetLayout getSetLayout() const;
+
+    /**
+     * @brief Returns the number of slots available for a type.
+     */
+    [[nodiscard]] uint32_t getCapacity(SlotType type) const;
+};
+
+} // namespace vtrs
@@ -0,0 +1,200 @@
+/**
+ * command_recorder.cpp - Parallel command buffer recording.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include "assert.hpp"
+#include "command_recorder.hpp"
+
+vtrs::CommandRecorder::thread_pools& vtrs::CommandRecorder::poolsOf_(uint32_t thread) {
+    return m_pools.at(m_currentFrame * (m_threadPool->getThreadCount() + 1) + thread);
+}
+
+VkCommandBuffer vtrs::CommandRecorder::acquire_(VkDevice device, thread_pools& pools, VkCommandBufferLevel level) {
+    bool is_primary = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+
+    auto& buffers = is_primary ? pools.primaries : pools.secondaries;
+    auto& used = is_primary ? pools.usedPrimaries : pools.usedSecondaries;
+
+    if (used == buffers.size()) {
+        VkCommandBufferAllocateInfo buffer_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        buffer_info.commandPool = pools.pool;
+        buffer_info.level = level;
+        buffer_info.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+
+        auto result = vkAllocateCommandBuffers(device, &buffer_info, &command_buffer);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to allocate command buffer.")
+
+        buffers.push_back(command_buffer);
+    }
+
+    return buffers.at(used++);
+}
+
+void vtrs::CommandRecorder::bootstrap_(vtrs::command_recorder_opts* options) {
+    m_framesInFlight = std::max<uint32_t>(options->framesInFlight, 1);
+    m_minItemsPerTask = std::max<uint32_t>(options->minItemsPerTask, 1);
+
+    m_queueFamily = options->queueFamily;
+
+    m_pools.resize(m_framesInFlight * (m_threadPool->getThreadCount() + 1));
+    createPools_();
+}
+
+void vtrs::CommandRecorder::createPools_() {
+    VkCommandPoolCreateInfo pool_info {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = m_queueFamily;
+
+    for (auto& pools : m_pools) {
+        if (pools.pool != VK_NULL_HANDLE) {
+            continue;
+        }
+
+        auto result = vkCreateCommandPool(m_logicalDevice, &pool_info, nullptr, &(pools.pool));
+        VTRS_ASSERT_VK_RESULT(result, "Unable to create command pool for recording thread.")
+    }
+}
+
+vtrs::CommandRecorder::CommandRecorder(VkDevice logical_device, vtrs::ThreadPool* thread_pool) :
+        m_logicalDevice(logical_device), m_threadPool(thread_pool) {
+}
+
+vtrs::CommandRecorder* vtrs::CommandRecorder::factory(VkDevice logical_device, vtrs::ThreadPool* thread_pool, vtrs::CommandRecorder::Options* options) {
+    auto instance = new CommandRecorder(logical_device, thread_pool);
+    instance->bootstrap_(options);
+
+    return instance;
+}
+
+vtrs::CommandRecorder::~CommandRecorder() {
+    for (auto& pools : m_pools) {
+        if (pools.pool != VK_NULL_HANDLE) {
+            vkDestroyCommandPool(m_logicalDevice, pools.pool, nullptr);
+        }
+    }
+
+    m_pools.clear();
+}
+
+void vtrs::CommandRecorder::beginFrame(uint32_t frame) {
+    m_currentFrame = frame % m_framesInFlight;
+
+    for (uint32_t thread = 0; thread <= m_threadPool->getThreadCount(); thread++) {
+        auto& pools = poolsOf_(thread);
+
+        if (pools.usedPrimaries == 0 && pools.usedSecondaries == 0) {
+            continue;
+        }
+
+        auto result = vkResetCommandPool(m_logicalDevice, pools.pool, 0);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to reset command pool.")
+
+        pools.usedPrimaries = 0;
+        pools.usedSecondaries = 0;
+    }
+}
+
+VkCommandBuffer vtrs::CommandRecorder::beginPrimary() {
+    auto command_buffer = acquire_(m_logicalDevice, poolsOf_(m_threadPool->getThreadCount()), VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+    VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    auto result = vkBeginCommandBuffer(command_buffer, &begin_info);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to start recording primary command buffer.")
+
+    return command_buffer;
+}
+
+void vtrs::CommandRecorder::recordParallel(VkCommandBuffer primary, const Inheritance& inheritance, uint32_t item_count, const RecordFunction& record) {
+    if (item_count == 0) {
+        return;
+    }
+
+    /* A couple of chunks per worker evens out uneven chunk costs. */
+    uint32_t max_tasks = m_threadPool->getThreadCount() * 2;
+    uint32_t task_count = std::max<uint32_t>(std::min(max_tasks, item_count / m_minItemsPerTask), 1);
+    uint32_t chunk_size = (item_count + task_count - 1) / task_count;
+    task_count = (item_count + chunk_size - 1) / chunk_size;
+
+    VkCommandBufferInheritanceRenderingInfo rendering_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO};
+    rendering_info.colorAttachmentCount = static_cast<uint32_t>(inheritance.colorFormats.size());
+    rendering_info.pColorAttachmentFormats = inheritance.colorFormats.data();
+    rendering_info.depthAttachmentFormat = inheritance.depthFormat;
+    rendering_info.stencilAttachmentFormat = inheritance.stencilFormat;
+    rendering_info.rasterizationSamples = inheritance.samples;
+
+    VkCommandBufferInheritanceInfo inheritance_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+    inheritance_info.renderPass = inheritance.renderPass;
+    inheritance_info.subpass = inheritance.subpass;
+    inheritance_info.framebuffer = inheritance.framebuffer;
+    inheritance_info.pipelineStatistics = inheritance.pipelineStatistics;
+
+    if (inheritance.renderPass == VK_NULL_HANDLE) {
+        inheritance_info.pNext = &rendering_info;
+    }
+
+    std::vector<VkCommandBuffer> secondaries(task_count, VK_NULL_HANDLE);
+
+    m_threadPool->dispatch(task_count, [&](uint32_t worker, uint32_t task) {
+        auto command_buffer = acquire_(m_logicalDevice, poolsOf_(worker), VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+        VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        begin_info.pInheritanceInfo = &inheritance_info;
+
+        auto result = vkBeginCommandBuffer(command_buffer, &begin_info);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to start recording secondary command buffer.")
+
+        uint32_t first = task * chunk_size;
+        record(command_buffer, first, std::min(chunk_size, item_count - first));
+
+        result = vkEndCommandBuffer(command_buffer);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to stop recording secondary command buffer.")
+
+        secondaries.at(task) = command_buffer;
+    });
+
+    vkCmdExecuteCommands(primary, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+}
+
+void vtrs::CommandRecorder::setFramesInFlight(uint32_t frames_in_flight) {
+    frames_in_flight = std::max<uint32_t>(frames_in_flight, 1);
+
+    if (frames_in_flight == m_framesInFlight) {
+        return;
+    }
+
+    /* Pools are laid out frame by frame, so trailing frames can be dropped or appended. */
+    size_t pool_count = frames_in_flight * (m_threadPool->getThreadCount() + 1);
+
+    for (size_t index = pool_count; index < m_pools.size(); index++) {
+        vkDestroyCommandPool(m_logicalDevice, m_pools.at(index).pool, nullptr);
+    }
+
+    m_pools.resize(pool_count);
+    m_framesInFlight = frames_in_flight;
+    m_currentFrame = 0;
+
+    createPools_();
+}
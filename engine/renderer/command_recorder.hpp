@@ -0,0 +1,186 @@
+/**
+ * command_recorder.hpp - Parallel command buffer recording.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "platform/thread_pool.hpp"
+#include "vulkan_api.hpp"
+
+namespace vtrs {
+
+struct command_recorder_opts {
+    uint32_t queueFamily = 0;
+    uint32_t framesInFlight = 2;
+
+    /* Smallest number of items worth handing to a worker. */
+    uint32_t minItemsPerTask = 64;
+};
+
+/**
+ * @brief State inherited by secondary command buffers.
+ *
+ * Fill renderPass and framebuffer when recording inside a render pass.
+ * Leave renderPass empty and list the attachment formats instead when
+ * recording inside vkCmdBeginRendering.
+ */
+struct command_recorder_inheritance {
+    VkRenderPass  renderPass = VK_NULL_HANDLE;
+    uint32_t      subpass = 0;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+
+    std::vector<VkFormat> colorFormats {};
+    VkFormat depthFormat = VK_FORMAT_UNDEFINED;
+    VkFormat stencilFormat = VK_FORMAT_UNDEFINED;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+
+    /* Statistics query active in the primary, see vtrs::GpuProfiler::getStatisticFlags. */
+    VkQueryPipelineStatisticFlags pipelineStatistics = 0;
+};
+
+/**
+ * @brief Records command buffers on several threads.
+ *
+ * Every worker of the thread pool, plus the calling thread, owns one
+ * command pool per frame in flight. Pools are never shared between
+ * threads, so recording needs no locks. Buffers are not reset one by one.
+ * beginFrame resets the whole pools of a frame once its fence has signalled.
+ *
+ * recordParallel splits a draw range into contiguous chunks. Each worker
+ * records its chunks into secondary command buffers. The chunks are then
+ * executed from the primary in range order, which keeps the output
+ * deterministic whatever the thread scheduling.
+ */
+class CommandRecorder {
+
+private:
+    struct thread_pools {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> primaries {};
+        std::vector<VkCommandBuffer> secondaries {};
+        uint32_t usedPrimaries = 0;
+        uint32_t usedSecondaries = 0;
+    };
+
+    VkDevice          m_logicalDevice = VK_NULL_HANDLE;
+    vtrs::ThreadPool* m_threadPool = nullptr;
+
+    uint32_t m_queueFamily = 0;
+    uint32_t m_framesInFlight = 0;
+    uint32_t m_minItemsPerTask = 1;
+    uint32_t m_currentFrame = 0;
+
+    /* Indexed by frame * thread count + thread, the calling thread comes last. */
+    std::vector<thread_pools> m_pools {};
+
+    /**
+     * @brief Returns the pools of a thread for the current frame.
+     * @param thread Worker index, or the worker count for the calling thread.
+     */
+    thread_pools& poolsOf_(uint32_t thread);
+
+    /**
+     * @brief Takes the next free command buffer from a pool, allocating more if needed.
+     */
+    static VkCommandBuffer acquire_(VkDevice device, thread_pools& pools, VkCommandBufferLevel level);
+
+    /**
+     * @brief Creates the command pools that do not exist yet.
+     */
+    void createPools_();
+
+    /**
+     * @brief Bootstraps the command recorder.
+     * @param options Command recorder configuration.
+     *
+     * The boostrap method will:
+     * - Create a transient command pool per thread and per frame in flight.
+     */
+    void bootstrap_(struct command_recorder_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     * @param logical_device Vulkan logical device handle.
+     * @param thread_pool Worker threads used for recording.
+     */
+    CommandRecorder(VkDevice, vtrs::ThreadPool*);
+
+public:
+    typedef struct command_recorder_opts Options;
+    typedef struct command_recorder_inheritance Inheritance;
+    typedef std::function<void(VkCommandBuffer, uint32_t first, uint32_t count)> RecordFunction;
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param logical_device    Vulkan logical device handle.
+     * @param thread_pool       Worker threads used for recording.
+     * @param options           Command recorder configuration.
+     * @return Instance of the command recorder.
+     * @throws vtrs::RendererError Thrown if a command pool could not be created.
+     */
+    static CommandRecorder* factory(VkDevice, vtrs::ThreadPool*, CommandRecorder::Options*);
+
+    /**
+     * @brief Destroys every command pool.
+     */
+    ~CommandRecorder();
+
+    /**
+     * @brief Starts a frame and resets all of its command pools.
+     * @param frame Index of the frame in flight.
+     *
+     * Call only after the fence guarding this frame has signalled.
+     */
+    void beginFrame(uint32_t frame);
+
+    /**
+     * @brief Returns a primary command buffer of the current frame that has begun recording.
+     *
+     * The buffer is begun for one time submission and must be ended by the caller.
+     */
+    VkCommandBuffer beginPrimary();
+
+    /**
+     * @brief Records a draw range on the worker threads and executes it from a primary.
+     * @param primary Primary command buffer inside a render pass or rendering scope.
+     * @param inheritance Render pass or attachment formats the secondaries continue.
+     * @param item_count Number of items, such as draws or triangles, to record.
+     * @param record Records items [first, first + count) into the given secondary.
+     *
+     * The render pass must have been begun with secondary command buffer
+     * contents. Secondaries inherit no dynamic or bound state, so the record
+     * function has to bind its own pipeline, buffers and descriptor sets.
+     */
+    void recordParallel(VkCommandBuffer primary, const Inheritance& inheritance, uint32_t item_count, const RecordFunction& record);
+
+    /**
+     * @brief Changes the number of frames whose pools are kept apart.
+     * @param frames_in_flight New number of frames in flight.
+     * @throws vtrs::RendererError Thrown if a command pool could not be created.
+     *
+     * Call only once every frame in flight has completed. Pools of the
+     * frames that remain are kept, the others are destroyed or created.
+     */
+    void setFramesInFlight(uint32_t frames_in_flight);
+};
+
+} // namespace vtrs
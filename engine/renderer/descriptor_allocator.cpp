@@ -0,0 +1,436 @@
+/**
+ * descriptor_allocator.cpp - Growable descriptor pools with cached sets.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include "assert.hpp"
+#include "descriptor_allocator.hpp"
+
+namespace {
+
+uint64_t hashBytes_(uint64_t hash, const void* data, size_t size) {
+    auto bytes = static_cast<const uint8_t*>(data);
+
+    for (size_t index = 0; index < size; index++) {
+        hash ^= bytes[index];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+template<typename T> uint64_t hashValue_(uint64_t hash, const T& value) {
+    return hashBytes_(hash, &value, sizeof(T));
+}
+
+bool isBufferType_(VkDescriptorType type) {
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+           type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
+bool isTexelType_(VkDescriptorType type) {
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+}
+
+/* Compares only the members a write of its type reads. */
+bool isSameWrite_(const vtrs::descriptor_write& left, const vtrs::descriptor_write& right) {
+    if (left.binding != right.binding || left.type != right.type) {
+        return false;
+    }
+
+    if (isBufferType_(left.type)) {
+        return left.buffer.buffer == right.buffer.buffer && left.buffer.offset == right.buffer.offset && left.buffer.range == right.buffer.range;
+    }
+
+    if (isTexelType_(left.type)) {
+        return left.texelBuffer == right.texelBuffer;
+    }
+
+    return left.image.sampler == right.image.sampler && left.image.imageView == right.image.imageView &&
+           left.image.imageLayout == right.image.imageLayout;
+}
+
+bool refersTo_(const vtrs::descriptor_write& write, uint64_t handle) {
+    if (isBufferType_(write.type)) {
+        return reinterpret_cast<uint64_t>(write.buffer.buffer) == handle;
+    }
+
+    if (isTexelType_(write.type)) {
+        return reinterpret_cast<uint64_t>(write.texelBuffer) == handle;
+    }
+
+    return reinterpret_cast<uint64_t>(write.image.sampler) == handle || reinterpret_cast<uint64_t>(write.image.imageView) == handle;
+}
+
+} // namespace
+
+VkDescriptorPool vtrs::DescriptorAllocator::createPool_(const pool_arena& arena) {
+    uint32_t max_sets = m_setsPerPool;
+
+    /* Doubled one step at a time, so the count never overflows before the clamp. */
+    for (size_t index = 0; index < arena.pools.size() && max_sets < m_maxSetsPerPool; index++) {
+        max_sets = static_cast<uint32_t>(std::min<uint64_t>(static_cast<uint64_t>(max_sets) * 2, m_maxSetsPerPool));
+    }
+
+    std::vector<VkDescriptorPoolSize> pool_sizes {};
+
+    for (const auto& ratio : m_typeRatios) {
+        auto count = static_cast<uint32_t>(std::ceil(ratio.second * static_cast<float>(max_sets)));
+        pool_sizes.push_back({ratio.first, std::max<uint32_t>(count, 1)});
+    }
+
+    VkDescriptorPoolCreateInfo pool_info {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    pool_info.flags = arena.flags;
+    pool_info.maxSets = max_sets;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+
+    auto result = vkCreateDescriptorPool(m_logicalDevice, &pool_info, nullptr, &pool);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create descriptor pool.")
+
+    m_stats.poolCount++;
+    return pool;
+}
+
+VkDescriptorSet vtrs::DescriptorAllocator::allocateFrom_(pool_arena& arena, VkDescriptorSetLayout layout, VkDescriptorPool* pool) {
+    VkDescriptorSetAllocateInfo alloc_info {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &layout;
+
+    /* Pools are tried in order, a fresh pool is the last resort. */
+    while (true) {
+        bool is_fresh = arena.current == arena.pools.size();
+
+        if (is_fresh) {
+            arena.pools.push_back(createPool_(arena));
+        }
+
+        alloc_info.descriptorPool = arena.pools.at(arena.current);
+
+        VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+        auto result = vkAllocateDescriptorSets(m_logicalDevice, &alloc_info, &descriptor_set);
+
+        if (result == VK_SUCCESS) {
+            if (pool != nullptr) {
+                *pool = alloc_info.descriptorPool;
+            }
+
+            return descriptor_set;
+        }
+
+        if (is_fresh || (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)) {
+            VTRS_ASSERT_VK_RESULT(result, "Unable to allocate descriptor set.")
+        }
+
+        arena.current++;
+    }
+}
+
+VkDescriptorUpdateTemplate vtrs::DescriptorAllocator::getTemplate_(VkDescriptorSetLayout layout, const std::vector<Write>& writes) {
+    uint64_t key = hashValue_(14695981039346656037ULL, layout);
+    std::vector<std::pair<uint32_t, VkDescriptorType>> bindings {};
+
+    for (const auto& write : writes) {
+        key = hashValue_(key, write.binding);
+        key = hashValue_(key, write.type);
+        bindings.emplace_back(write.binding, write.type);
+    }
+
+    auto& bucket = m_templates[key];
+
+    for (const auto& cached : bucket) {
+        if (cached.layout == layout && cached.bindings == bindings) {
+            return cached.updateTemplate;
+        }
+    }
+
+    std::vector<VkDescriptorUpdateTemplateEntry> entries {};
+
+    for (size_t index = 0; index < writes.size(); index++) {
+        const auto& write = writes.at(index);
+
+        size_t member = isBufferType_(write.type) ? offsetof(descriptor_write, buffer) :
+                        isTexelType_(write.type)  ? offsetof(descriptor_write, texelBuffer) :
+                                                    offsetof(descriptor_write, image);
+
+        VkDescriptorUpdateTemplateEntry entry {};
+        entry.dstBinding = write.binding;
+        entry.dstArrayElement = 0;
+        entry.descriptorCount = 1;
+        entry.descriptorType = write.type;
+        entry.offset = index * sizeof(descriptor_write) + member;
+        entry.stride = sizeof(descriptor_write);
+
+        entries.push_back(entry);
+    }
+
+    VkDescriptorUpdateTemplateCreateInfo template_info {VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO};
+    template_info.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+    template_info.pDescriptorUpdateEntries = entries.data();
+    template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    template_info.descriptorSetLayout = layout;
+
+    VkDescriptorUpdateTemplate update_template = VK_NULL_HANDLE;
+
+    auto result = vkCreateDescriptorUpdateTemplate(m_logicalDevice, &template_info, nullptr, &update_template);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create descriptor update template.")
+
+    bucket.push_back({layout, bindings, update_template});
+    m_stats.templateCount++;
+
+    return update_template;
+}
+
+vtrs::DescriptorAllocator::DescriptorAllocator(VkDevice logical_device, vtrs::descriptor_allocator_opts* options) :
+        m_logicalDevice(logical_device),
+        m_framesInFlight(std::max<uint32_t>(options->framesInFlight, 1)),
+        m_setsPerPool(std::max<uint32_t>(options->setsPerPool, 1)),
+        m_maxSetsPerPool(std::max(options->maxSetsPerPool, options->setsPerPool)),
+        m_typeRatios(options->typeRatios) {
+
+    m_frameArenas.resize(m_framesInFlight);
+
+    /* Invalidated sets are freed one by one, frame pools are only ever reset. */
+    m_cachedArena.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+}
+
+vtrs::DescriptorAllocator* vtrs::DescriptorAllocator::factory(VkDevice logical_device, vtrs::DescriptorAllocator::Options* options) {
+    return new DescriptorAllocator(logical_device, options);
+}
+
+vtrs::DescriptorAllocator::~DescriptorAllocator() {
+    for (auto& bucket : m_templates) {
+        for (auto& cached : bucket.second) {
+            vkDestroyDescriptorUpdateTemplate(m_logicalDevice, cached.updateTemplate, nullptr);
+        }
+    }
+
+    for (auto pool : m_cachedArena.pools) {
+        vkDestroyDescriptorPool(m_logicalDevice, pool, nullptr);
+    }
+
+    for (auto& arena : m_frameArenas) {
+        for (auto pool : arena.pools) {
+            vkDestroyDescriptorPool(m_logicalDevice, pool, nullptr);
+        }
+    }
+
+    m_templates.clear();
+    m_setCache.clear();
+    m_cachedPools.clear();
+    m_retiredSets.clear();
+}
+
+void vtrs::DescriptorAllocator::invalidate_(uint64_t handle) {
+    if (handle == 0) {
+        return;
+    }
+
+    for (auto bucket = m_setCache.begin(); bucket != m_setCache.end();) {
+        auto& sets = bucket->second;
+
+        for (auto cached = sets.begin(); cached != sets.end();) {
+            bool is_stale = std::any_of(cached->writes.begin(), cached->writes.end(), [handle](const Write& write) {
+                return refersTo_(write, handle);
+            });
+
+            if (!is_stale) {
+                ++cached;
+                continue;
+            }
+
+            auto pool = m_cachedPools.find(cached->set);
+            m_retiredSets.push_back({pool->second, cached->set, m_framesInFlight});
+            m_cachedPools.erase(pool);
+
+            cached = sets.erase(cached);
+            m_stats.cachedSets--;
+            m_stats.invalidatedSets++;
+        }
+
+        bucket = sets.empty() ? m_setCache.erase(bucket) : std::next(bucket);
+    }
+}
+
+void vtrs::DescriptorAllocator::freeRetired_(bool force) {
+    bool has_freed = false;
+
+    for (auto& retired : m_retiredSets) {
+        if (retired.framesLeft > 0) {
+            retired.framesLeft--;
+        }
+
+        if (retired.framesLeft > 0 && !force) {
+            continue;
+        }
+
+        auto result = vkFreeDescriptorSets(m_logicalDevice, retired.pool, 1, &retired.set);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to free descriptor set.")
+
+        retired.set = VK_NULL_HANDLE;
+        has_freed = true;
+    }
+
+    if (!has_freed) {
+        return;
+    }
+
+    m_retiredSets.erase(std::remove_if(m_retiredSets.begin(), m_retiredSets.end(), [](const retired_set& retired) {
+        return retired.set == VK_NULL_HANDLE;
+    }), m_retiredSets.end());
+
+    /* Freed space may be anywhere in the chain, so allocations walk it from the start again. */
+    m_cachedArena.current = 0;
+}
+
+void vtrs::DescriptorAllocator::beginFrame(uint32_t frame) {
+    m_currentFrame = frame % m_framesInFlight;
+    auto& arena = m_frameArenas.at(m_currentFrame);
+
+    /* Only pools that handed out sets last time round need resetting. */
+    for (size_t index = 0; index <= arena.current && index < arena.pools.size(); index++) {
+        auto result = vkResetDescriptorPool(m_logicalDevice, arena.pools.at(index), 0);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to reset descriptor pool.")
+    }
+
+    arena.current = 0;
+    freeRetired_(false);
+}
+
+VkDescriptorSet vtrs::DescriptorAllocator::allocateFrame(VkDescriptorSetLayout layout, const std::vector<Write>& writes) {
+    auto descriptor_set = allocateFrom_(m_frameArenas.at(m_currentFrame), layout);
+
+    if (!writes.empty()) {
+        vkUpdateDescriptorSetWithTemplate(m_logicalDevice, descriptor_set, getTemplate_(layout, writes), writes.data());
+    }
+
+    m_stats.frameSets++;
+    return descriptor_set;
+}
+
+VkDescriptorSet vtrs::DescriptorAllocator::getCached(VkDescriptorSetLayout layout, const std::vector<Write>& writes) {
+    uint64_t key = hashValue_(14695981039346656037ULL, layout);
+
+    for (const auto& write : writes) {
+        key = hashValue_(key, write.binding);
+        key = hashValue_(key, write.type);
+
+        if (isBufferType_(write.type)) {
+            key = hashValue_(key, write.buffer.buffer);
+            key = hashValue_(key, write.buffer.offset);
+            key = hashValue_(key, write.buffer.range);
+
+        } else if (isTexelType_(write.type)) {
+            key = hashValue_(key, write.texelBuffer);
+
+        } else {
+            key = hashValue_(key, write.image.sampler);
+            key = hashValue_(key, write.image.imageView);
+            key = hashValue_(key, write.image.imageLayout);
+        }
+    }
+
+    auto& bucket = m_setCache[key];
+
+    for (const auto& cached : bucket) {
+        if (cached.layout == layout && cached.writes.size() == writes.size() &&
+            std::equal(writes.begin(), writes.end(), cached.writes.begin(), isSameWrite_)) {
+
+            m_stats.cacheHits++;
+            return cached.set;
+        }
+    }
+
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    auto descriptor_set = allocateFrom_(m_cachedArena, layout, &pool);
+
+    if (!writes.empty()) {
+        vkUpdateDescriptorSetWithTemplate(m_logicalDevice, descriptor_set, getTemplate_(layout, writes), writes.data());
+    }
+
+    bucket.push_back({layout, writes, descriptor_set});
+    m_cachedPools[descriptor_set] = pool;
+    m_stats.cachedSets++;
+
+    return descriptor_set;
+}
+
+void vtrs::DescriptorAllocator::invalidate(VkBuffer handle) {
+    invalidate_(reinterpret_cast<uint64_t>(handle));
+}
+
+void vtrs::DescriptorAllocator::invalidate(VkImageView handle) {
+    invalidate_(reinterpret_cast<uint64_t>(handle));
+}
+
+void vtrs::DescriptorAllocator::invalidate(VkBufferView handle) {
+    invalidate_(reinterpret_cast<uint64_t>(handle));
+}
+
+void vtrs::DescriptorAllocator::invalidate(VkSampler handle) {
+    invalidate_(reinterpret_cast<uint64_t>(handle));
+}
+
+vtrs::DescriptorAllocator::Stats vtrs::DescriptorAllocator::getStats() const {
+    return m_stats;
+}
+
+vtrs::DescriptorAllocator::Write vtrs::DescriptorAllocator::bufferWrite(
+        uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+
+    Write write {};
+    write.binding = binding;
+    write.type = type;
+    write.buffer = {buffer, offset, range};
+
+    return write;
+}
+
+vtrs::DescriptorAllocator::Write vtrs::DescriptorAllocator::imageWrite(
+        uint32_t binding, VkDescriptorType type, VkSampler sampler, VkImageView view, VkImageLayout layout) {
+
+    Write write {};
+    write.binding = binding;
+    write.type = type;
+    write.image = {sampler, view, layout};
+
+    return write;
+}
+
+void vtrs::DescriptorAllocator::setFramesInFlight(uint32_t frames_in_flight) {
+    frames_in_flight = std::max<uint32_t>(frames_in_flight, 1);
+
+    for (size_t frame = frames_in_flight; frame < m_frameArenas.size(); frame++) {
+        for (auto pool : m_frameArenas.at(frame).pools) {
+            vkDestroyDescriptorPool(m_logicalDevice, pool, nullptr);
+        }
+    }
+
+    freeRetired_(true);
+
+    m_frameArenas.resize(frames_in_flight);
+    m_framesInFlight = frames_in_flight;
+    m_currentFrame = 0;
+}
@@ -0,0 +1,259 @@
+/**
+ * descriptor_allocator.hpp - Growable descriptor pools with cached sets.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "vulkan_api.hpp"
+
+namespace vtrs {
+
+struct descriptor_allocator_opts {
+    uint32_t framesInFlight = 2;
+
+    /* Sets in the first pool of an arena, later pools double up to maxSetsPerPool. */
+    uint32_t setsPerPool = 64;
+    uint32_t maxSetsPerPool = 4096;
+
+    /* Descriptors of each type reserved per set in a pool. */
+    std::vector<std::pair<VkDescriptorType, float>> typeRatios {
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         1.0f},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         1.0f},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f},
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,          1.0f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          0.5f},
+        {VK_DESCRIPTOR_TYPE_SAMPLER,                0.5f}
+    };
+};
+
+/**
+ * @brief A single descriptor to write into a set.
+ *
+ * Only the info member matching the descriptor type is read. The layout
+ * of this struct is what the update templates are built against.
+ */
+struct descriptor_write {
+    uint32_t binding = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    VkDescriptorBufferInfo buffer {};
+    VkDescriptorImageInfo image {};
+    VkBufferView texelBuffer = VK_NULL_HANDLE;
+};
+
+struct descriptor_allocator_stats {
+    uint32_t poolCount = 0;
+    uint32_t templateCount = 0;
+    uint32_t cachedSets = 0;
+    uint32_t invalidatedSets = 0;
+    uint64_t cacheHits = 0;
+    uint64_t frameSets = 0;
+};
+
+/**
+ * @brief Allocates descriptor sets from chains of pools.
+ *
+ * Sets come from one of two arenas. Frame sets live in the pools of the
+ * current frame in flight. beginFrame resets those pools with a single
+ * vkResetDescriptorPool each, instead of freeing sets one at a time.
+ * Cached sets live in a persistent arena and are keyed by the layout and
+ * the exact descriptors written. Asking again for the same contents
+ * returns the same set without touching the driver. Vulkan reuses the
+ * handle values of destroyed objects, so owners call invalidate before
+ * destroying a buffer, view or sampler that cached sets may refer to.
+ * The sets are dropped from the cache at once and freed after the
+ * frames in flight are done with them.
+ *
+ * When a pool runs out, the next one in the chain is used, so the number
+ * of sets is never fixed up front. All writes go through update templates
+ * that are created once per layout and binding sequence.
+ */
+class DescriptorAllocator {
+
+private:
+    struct pool_arena {
+        std::vector<VkDescriptorPool> pools {};
+        size_t current = 0;
+        VkDescriptorPoolCreateFlags flags = 0;
+    };
+
+    struct cached_set {
+        VkDescriptorSetLayout layout;
+        std::vector<struct descriptor_write> writes;
+        VkDescriptorSet set;
+    };
+
+    struct cached_template {
+        VkDescriptorSetLayout layout;
+        std::vector<std::pair<uint32_t, VkDescriptorType>> bindings;
+        VkDescriptorUpdateTemplate updateTemplate;
+    };
+
+    struct retired_set {
+        VkDescriptorPool pool;
+        VkDescriptorSet set;
+        uint32_t framesLeft;
+    };
+
+    VkDevice m_logicalDevice = VK_NULL_HANDLE;
+
+    uint32_t m_framesInFlight = 0;
+    uint32_t m_currentFrame = 0;
+    uint32_t m_setsPerPool = 0;
+    uint32_t m_maxSetsPerPool = 0;
+    std::vector<std::pair<VkDescriptorType, float>> m_typeRatios {};
+
+    pool_arena m_cachedArena {};
+    std::vector<pool_arena> m_frameArenas {};
+
+    /* Buckets of full keys, a hash alone never identifies a set. */
+    std::unordered_map<uint64_t, std::vector<cached_set>> m_setCache {};
+    std::unordered_map<uint64_t, std::vector<cached_template>> m_templates {};
+    std::vector<retired_set> m_retiredSets {};
+
+    /* Pool each cached set was allocated from, needed to free it. */
+    std::unordered_map<VkDescriptorSet, VkDescriptorPool> m_cachedPools {};
+
+    struct descriptor_allocator_stats m_stats {};
+
+    /**
+     * @brief Creates the next pool of an arena, larger than the one before.
+     */
+    VkDescriptorPool createPool_(const pool_arena& arena);
+
+    /**
+     * @brief Allocates a set from an arena, moving along the pool chain when a pool is full.
+     * @param pool Receives the pool the set came from, may be nullptr.
+     */
+    VkDescriptorSet allocateFrom_(pool_arena& arena, VkDescriptorSetLayout layout, VkDescriptorPool* pool = nullptr);
+
+    /**
+     * @brief Drops every cached set holding a handle and queues the sets to be freed.
+     * @param handle Handle value of a buffer, view or sampler.
+     */
+    void invalidate_(uint64_t handle);
+
+    /**
+     * @brief Frees retired sets no frame in flight can use anymore.
+     * @param force Frees every retired set, for when the device is idle.
+     */
+    void freeRetired_(bool force);
+
+    /**
+     * @brief Returns the update template for a layout and binding sequence, creating it on first use.
+     */
+    VkDescriptorUpdateTemplate getTemplate_(VkDescriptorSetLayout layout, const std::vector<struct descriptor_write>& writes);
+
+    /**
+     * @brief Initialises member variables.
+     * @param logical_device Vulkan logical device handle.
+     * @param options Descriptor allocator configuration.
+     */
+    DescriptorAllocator(VkDevice, struct descriptor_allocator_opts*);
+
+public:
+    typedef struct descriptor_allocator_opts Options;
+    typedef struct descriptor_write Write;
+    typedef struct descriptor_allocator_stats Stats;
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param logical_device Vulkan logical device handle.
+     * @param options Descriptor allocator configuration.
+     * @return Instance of the descriptor allocator.
+     */
+    static DescriptorAllocator* factory(VkDevice, DescriptorAllocator::Options*);
+
+    /**
+     * @brief Destroys every pool and template, which frees all sets handed out.
+     */
+    ~DescriptorAllocator();
+
+    /**
+     * @brief Starts a frame and resets the pools of its frame sets.
+     * @param frame Index of the frame in flight.
+     *
+     * Call only after the fence guarding this frame has signalled.
+     * Invalidated cached sets old enough are freed here too.
+     */
+    void beginFrame(uint32_t frame);
+
+    /**
+     * @brief Allocates and writes a set that is valid until the frame comes round again.
+     * @param layout Layout of the set.
+     * @param writes Descriptors to write.
+     * @return The descriptor set.
+     * @throws vtrs::RendererError Thrown if no pool could satisfy the allocation.
+     */
+    VkDescriptorSet allocateFrame(VkDescriptorSetLayout layout, const std::vector<Write>& writes);
+
+    /**
+     * @brief Returns a set holding exactly these descriptors, writing it only the first time.
+     * @param layout Layout of the set.
+     * @param writes Descriptors to write.
+     * @return The descriptor set, owned by the allocator.
+     *
+     * Cached sets are never updated again, so the resources they refer
+     * to must outlive the allocator or be invalidated before they are destroyed.
+     */
+    VkDescriptorSet getCached(VkDescriptorSetLayout layout, const std::vector<Write>& writes);
+
+    /**
+     * @brief Drops the cached sets that refer to a resource about to be destroyed.
+     * @param handle Buffer, image view, buffer view or sampler.
+     *
+     * Sets already bound stay valid until the frames in flight have
+     * completed, later lookups write a new set.
+     */
+    void invalidate(VkBuffer handle);
+    void invalidate(VkImageView handle);
+    void invalidate(VkBufferView handle);
+    void invalidate(VkSampler handle);
+
+    /**
+     * @brief Returns allocation and cache counters.
+     */
+    [[nodiscard]] Stats getStats() const;
+
+    /**
+     * @brief Builds a write for a buffer descriptor.
+     */
+    static Write bufferWrite(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+
+    /**
+     * @brief Builds a write for an image, sampler or combined image sampler descriptor.
+     */
+    static Write imageWrite(uint32_t binding, VkDescriptorType type, VkSampler sampler, VkImageView view, VkImageLayout layout);
+
+    /**
+     * @brief Changes the number of per-frame arenas.
+     * @param frames_in_flight New number of frames in flight.
+     *
+     * Call only once every frame in flight has completed. Pools of the
+     * dropped frames are destroyed, invalidated sets are freed and the
+     * remaining cached sets are kept.
+     */
+    void setFramesInFlight(uint32_t frames_in_flight);
+};
+
+} // namespace vtrs
@@ -0,0 +1,440 @@
+/**
+ * device_allocator.cpp - Sub-allocates device memory from large blocks.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include "platform/logger.hpp"
+#include "assert.hpp"
+#include "device_allocator.hpp"
+
+static VkDeviceSize alignUp_(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static VkDeviceSize roundPowerOfTwo_(VkDeviceSize value) {
+    VkDeviceSize result = 1;
+
+    while (result < value) {
+        result = result << 1;
+    }
+
+    return result;
+}
+
+uint32_t vtrs::DeviceAllocator::findMemoryType_(uint32_t filter, VkMemoryPropertyFlags flags) const {
+    for (uint32_t index = 0; index < m_memoryProperties.memoryTypeCount; index++) {
+        if ((filter & (1U << index)) && (m_memoryProperties.memoryTypes[index].propertyFlags & flags) == flags) {
+            return index;
+        }
+    }
+
+    throw vtrs::RendererError("Unable to find a memory type with the requested properties.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+}
+
+vtrs::DeviceAllocator::memory_block*
+vtrs::DeviceAllocator::createBlock_(VkDeviceSize size, uint32_t memory_type, const VkMemoryDedicatedAllocateInfo* dedicated) {
+    if (m_deviceAllocationCount >= m_maxAllocationCount) {
+        throw vtrs::RendererError("Device memory allocation count limit has been reached.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    VkMemoryAllocateInfo alloc_info {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+    alloc_info.pNext = dedicated;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = memory_type;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+
+    auto result = vkAllocateMemory(m_logicalDevice, &alloc_info, nullptr, &memory);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to allocate a device memory block.")
+
+    auto block = new memory_block();
+    block->memory = memory;
+    block->size = size;
+    block->memoryType = memory_type;
+
+    if (m_memoryProperties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        void* mapped_data = nullptr;
+        result = vkMapMemory(m_logicalDevice, memory, 0, VK_WHOLE_SIZE, 0, &mapped_data);
+
+        if (result != VK_SUCCESS) {
+            vkFreeMemory(m_logicalDevice, memory, nullptr);
+            delete block;
+
+            throw vtrs::RendererError("Unable to map a host visible memory block.", vtrs::RendererError::E_TYPE_VK_RESULT, result);
+        }
+
+        block->mappedData = static_cast<char*>(mapped_data);
+    }
+
+    m_blocks.push_back(block);
+    m_deviceAllocationCount++;
+
+#if (defined(VTRS_MODE_DEBUG) && VTRS_MODE_DEBUG == 1)
+    vtrs::Logger::debug("Allocated device memory block of", size, "bytes from memory type", memory_type);
+#endif
+
+    return block;
+}
+
+void vtrs::DeviceAllocator::destroyBlock_(vtrs::DeviceAllocator::memory_block* block) {
+    if (block->mappedData != nullptr) {
+        vkUnmapMemory(m_logicalDevice, block->memory);
+    }
+
+    vkFreeMemory(m_logicalDevice, block->memory, nullptr);
+
+    m_blocks.erase(std::remove(m_blocks.begin(), m_blocks.end(), block), m_blocks.end());
+    m_deviceAllocationCount--;
+
+    delete block;
+}
+
+bool vtrs::DeviceAllocator::takeRange_(vtrs::DeviceAllocator::memory_block* block, uint32_t order, VkDeviceSize* offset) {
+    uint32_t found = order;
+
+    while (found <= m_maxOrder && block->freeLists.at(found).empty()) {
+        found++;
+    }
+
+    if (found > m_maxOrder) {
+        return false;
+    }
+
+    VkDeviceSize range_offset = *(block->freeLists.at(found).begin());
+    block->freeLists.at(found).erase(block->freeLists.at(found).begin());
+
+    /* Split the range in halves until it matches the requested order,
+     * putting the upper half of every split back on the free lists. */
+    while (found > order) {
+        found--;
+        block->freeLists.at(found).insert(range_offset + (m_minAllocation << found));
+    }
+
+    block->liveRanges.insert(std::make_pair(range_offset, order));
+    block->usedBytes += m_minAllocation << order;
+
+    *offset = range_offset;
+    return true;
+}
+
+void vtrs::DeviceAllocator::releaseRange_(vtrs::DeviceAllocator::memory_block* block, VkDeviceSize offset) {
+    auto live_range = block->liveRanges.find(offset);
+
+    if (live_range == block->liveRanges.end()) {
+        throw vtrs::RendererError("Attempted to free a range not owned by the memory block.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    uint32_t order = live_range->second;
+    block->liveRanges.erase(live_range);
+    block->usedBytes -= m_minAllocation << order;
+
+    while (order < m_maxOrder) {
+        VkDeviceSize buddy = offset ^ (m_minAllocation << order);
+        auto buddy_range = block->freeLists.at(order).find(buddy);
+
+        if (buddy_range == block->freeLists.at(order).end()) {
+            break;
+        }
+
+        block->freeLists.at(order).erase(buddy_range);
+        offset = std::min(offset, buddy);
+        order++;
+    }
+
+    block->freeLists.at(order).insert(offset);
+}
+
+vtrs::DeviceAllocator::Allocation
+vtrs::DeviceAllocator::allocate_(const VkMemoryRequirements& requirements,
+                                 VkMemoryPropertyFlags flags,
+                                 bool optimal,
+                                 const VkMemoryDedicatedAllocateInfo* dedicated) {
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t memory_type = findMemoryType_(requirements.memoryTypeBits, flags);
+    VkDeviceSize needed = std::max(requirements.size, requirements.alignment);
+
+    uint32_t order = 0;
+    while (order <= m_maxOrder && (m_minAllocation << order) < needed) {
+        order++;
+    }
+
+    Allocation allocation {};
+    allocation.memoryType = memory_type;
+
+    if (dedicated != nullptr || order > m_maxOrder) {
+        auto block = createBlock_(requirements.size, memory_type, dedicated);
+        block->isDedicated = true;
+        block->isOptimal = optimal;
+        block->usedBytes = requirements.size;
+
+        allocation.memory = block->memory;
+        allocation.size = requirements.size;
+        allocation.mappedData = block->mappedData;
+        allocation.blockHandle = block;
+
+        return allocation;
+    }
+
+    bool is_optimal = optimal && m_separateOptimal;
+    VkDeviceSize offset = 0;
+    memory_block* owner = nullptr;
+
+    for (auto block : m_blocks) {
+        if (block->isDedicated || block->memoryType != memory_type || block->isOptimal != is_optimal) {
+            continue;
+        }
+
+        if (takeRange_(block, order, &offset)) {
+            owner = block;
+            break;
+        }
+    }
+
+    if (owner == nullptr) {
+        owner = createBlock_(m_blockSize, memory_type, nullptr);
+        owner->isOptimal = is_optimal;
+        owner->freeLists.resize(m_maxOrder + 1);
+        owner->freeLists.at(m_maxOrder).insert(0);
+
+        takeRange_(owner, order, &offset);
+    }
+
+    allocation.memory = owner->memory;
+    allocation.offset = offset;
+    allocation.size = requirements.size;
+    allocation.mappedData = owner->mappedData != nullptr ? owner->mappedData + offset : nullptr;
+    allocation.blockHandle = owner;
+
+    return allocation;
+}
+
+void vtrs::DeviceAllocator::bootstrap_(vtrs::device_allocator_opts* options) {
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &properties);
+    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);
+
+    VkDeviceSize granularity = properties.limits.bufferImageGranularity;
+
+    m_minAllocation = roundPowerOfTwo_(std::max<VkDeviceSize>(options->minAllocation, 16));
+    m_blockSize = std::max(roundPowerOfTwo_(options->blockSize), m_minAllocation);
+    m_dedicatedThreshold = options->dedicatedThreshold;
+    m_nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+    m_maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+    /* Every buddy range starts and ends on a multiple of the smallest
+     * allocation size. If the granularity fits in it, linear and optimal
+     * resources can never share a page and may live in the same block. */
+    m_separateOptimal = granularity > m_minAllocation;
+
+    m_maxOrder = 0;
+    while ((m_minAllocation << m_maxOrder) < m_blockSize) {
+        m_maxOrder++;
+    }
+}
+
+vtrs::DeviceAllocator::DeviceAllocator(VkPhysicalDevice physical_device, VkDevice logical_device) :
+        m_physicalDevice(physical_device),
+        m_logicalDevice(logical_device) {
+}
+
+vtrs::DeviceAllocator*
+vtrs::DeviceAllocator::factory(VkPhysicalDevice physical_device, VkDevice logical_device, vtrs::DeviceAllocator::Options* options) {
+    auto allocator = new DeviceAllocator(physical_device, logical_device);
+    allocator->bootstrap_(options);
+
+    return allocator;
+}
+
+vtrs::DeviceAllocator::~DeviceAllocator() {
+#if (defined(VTRS_MODE_DEBUG) && VTRS_MODE_DEBUG == 1)
+    for (auto block : m_blocks) {
+        if (!block->isDedicated && !block->liveRanges.empty()) {
+            vtrs::Logger::warn("Device memory block destroyed with", block->liveRanges.size(), "live allocations.");
+        }
+    }
+#endif
+
+    while (!m_blocks.empty()) {
+        destroyBlock_(m_blocks.back());
+    }
+}
+
+vtrs::DeviceAllocator::Allocation vtrs::DeviceAllocator::allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags flags) {
+    VkBufferMemoryRequirementsInfo2 requirements_info {VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2};
+    requirements_info.buffer = buffer;
+
+    VkMemoryDedicatedRequirements dedicated_reqs {VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS};
+    VkMemoryRequirements2 mem_reqs {VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
+    mem_reqs.pNext = &dedicated_reqs;
+
+    vkGetBufferMemoryRequirements2(m_logicalDevice, &requirements_info, &mem_reqs);
+
+    VkMemoryDedicatedAllocateInfo dedicated_info {VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO};
+    dedicated_info.buffer = buffer;
+
+    bool is_dedicated = dedicated_reqs.requiresDedicatedAllocation || dedicated_reqs.prefersDedicatedAllocation ||
+                        mem_reqs.memoryRequirements.size >= m_dedicatedThreshold;
+
+    auto allocation = allocate_(mem_reqs.memoryRequirements, flags, false, is_dedicated ? &dedicated_info : nullptr);
+    auto result = vkBindBufferMemory(m_logicalDevice, buffer, allocation.memory, allocation.offset);
+
+    if (result != VK_SUCCESS) {
+        free(allocation);
+        throw vtrs::RendererError("Unable to bind device memory to buffer.", vtrs::RendererError::E_TYPE_VK_RESULT, result);
+    }
+
+    return allocation;
+}
+
+vtrs::DeviceAllocator::Allocation vtrs::DeviceAllocator::allocateImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags flags) {
+    VkImageMemoryRequirementsInfo2 requirements_info {VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2};
+    requirements_info.image = image;
+
+    VkMemoryDedicatedRequirements dedicated_reqs {VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS};
+    VkMemoryRequirements2 mem_reqs {VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
+    mem_reqs.pNext = &dedicated_reqs;
+
+    vkGetImageMemoryRequirements2(m_logicalDevice, &requirements_info, &mem_reqs);
+
+    VkMemoryDedicatedAllocateInfo dedicated_info {VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO};
+    dedicated_info.image = image;
+
+    bool is_dedicated = dedicated_reqs.requiresDedicatedAllocation || dedicated_reqs.prefersDedicatedAllocation ||
+                        mem_reqs.memoryRequirements.size >= m_dedicatedThreshold;
+
+    auto allocation = allocate_(mem_reqs.memoryRequirements, flags, tiling == VK_IMAGE_TILING_OPTIMAL, is_dedicated ? &dedicated_info : nullptr);
+    auto result = vkBindImageMemory(m_logicalDevice, image, allocation.memory, allocation.offset);
+
+    if (result != VK_SUCCESS) {
+        free(allocation);
+        throw vtrs::RendererError("Unable to bind device memory to image.", vtrs::RendererError::E_TYPE_VK_RESULT, result);
+    }
+
+    return allocation;
+}
+
+vtrs::DeviceAllocator::Allocation vtrs::DeviceAllocator::allocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags flags, bool optimal) {
+    return allocate_(requirements, flags, optimal, nullptr);
+}
+
+void vtrs::DeviceAllocator::free(vtrs::DeviceAllocator::Allocation& allocation) {
+    auto block = static_cast<memory_block*>(allocation.blockHandle);
+
+    if (block == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (block->isDedicated) {
+        destroyBlock_(block);
+
+    } else {
+        releaseRange_(block, allocation.offset);
+
+        /* Keep one empty block around per memory type to avoid
+         * allocating and freeing device memory back to back. */
+        if (block->liveRanges.empty()) {
+            for (auto other : m_blocks) {
+                if (other != block && !other->isDedicated && other->memoryType == block->memoryType && other->isOptimal == block->isOptimal) {
+                    destroyBlock_(block);
+                    break;
+                }
+            }
+        }
+    }
+
+    allocation = Allocation {};
+}
+
+void vtrs::DeviceAllocator::flush(const vtrs::DeviceAllocator::Allocation& allocation, VkDeviceSize offset, VkDeviceSize size) {
+    if (allocation.memory == VK_NULL_HANDLE || isCoherent(allocation)) {
+        return;
+    }
+
+    auto block = static_cast<memory_block*>(allocation.blockHandle);
+
+    if (size == VK_WHOLE_SIZE) {
+        size = allocation.size - offset;
+    }
+
+    VkDeviceSize range_begin = (allocation.offset + offset) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+    VkDeviceSize range_end = std::min(alignUp_(allocation.offset + offset + size, m_nonCoherentAtomSize), block->size);
+
+    VkMappedMemoryRange memory_range {VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE};
+    memory_range.memory = allocation.memory;
+    memory_range.offset = range_begin;
+    memory_range.size = range_end - range_begin;
+
+    auto result = vkFlushMappedMemoryRanges(m_logicalDevice, 1, &memory_range);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to flush mapped memory range.")
+}
+
+bool vtrs::DeviceAllocator::isCoherent(const vtrs::DeviceAllocator::Allocation& allocation) const {
+    return m_memoryProperties.memoryTypes[allocation.memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+std::vector<vtrs::DeviceAllocator::BlockStats> vtrs::DeviceAllocator::getBlockStats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<BlockStats> stats_list {};
+
+    for (auto block : m_blocks) {
+        BlockStats stats {};
+        stats.memoryType = block->memoryType;
+        stats.isDedicated = block->isDedicated;
+        stats.isOptimal = block->isOptimal;
+        stats.blockSize = block->size;
+        stats.usedBytes = block->usedBytes;
+        stats.allocationCount = block->isDedicated ? 1 : static_cast<uint32_t>(block->liveRanges.size());
+
+        for (uint32_t order = 0; order < block->freeLists.size(); order++) {
+            if (!block->freeLists.at(order).empty()) {
+                stats.freeRangeCount += block->freeLists.at(order).size();
+                stats.largestFreeRange = m_minAllocation << order;
+            }
+        }
+
+        stats_list.push_back(stats);
+    }
+
+    return stats_list;
+}
+
+void vtrs::DeviceAllocator::printStats() {
+    auto stats_list = getBlockStats();
+
+    vtrs::Logger::print("");
+    vtrs::Logger::print("Device Memory Blocks");
+    vtrs::Logger::print("********************");
+
+    for (auto& stats : stats_list) {
+        vtrs::Logger::print(stats.isDedicated ? "Dedicated" : (stats.isOptimal ? "Optimal" : "Linear"),
+                            "block, type:", stats.memoryType,
+                            "size:", stats.blockSize,
+                            "used:", stats.usedBytes,
+                            "allocations:", stats.allocationCount,
+                            "free ranges:", stats.freeRangeCount,
+                            "largest free:", stats.largestFreeRange);
+    }
+
+    vtrs::Logger::print("");
+}
@@ -0,0 +1,255 @@
+/**
+ * device_allocator.hpp - Sub-allocates device memory from large blocks.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include "vulkan_api.hpp"
+
+namespace vtrs {
+
+struct device_allocator_opts {
+    VkDeviceSize blockSize = 64 * 1024 * 1024;
+    VkDeviceSize minAllocation = 256;
+    VkDeviceSize dedicatedThreshold = 16 * 1024 * 1024;
+};
+
+struct device_allocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mappedData = nullptr;
+    uint32_t memoryType = 0;
+    void* blockHandle = nullptr;
+};
+
+struct device_block_stats {
+    uint32_t memoryType = 0;
+    bool isDedicated = false;
+    bool isOptimal = false;
+    VkDeviceSize blockSize = 0;
+    VkDeviceSize usedBytes = 0;
+    VkDeviceSize largestFreeRange = 0;
+    uint32_t allocationCount = 0;
+    uint32_t freeRangeCount = 0;
+};
+
+/**
+ * @brief Hands out device memory as sub-ranges of large blocks.
+ *
+ * Memory is allocated from the driver in blocks of a fixed size per
+ * memory type, and each block is split with a buddy allocator. Buffers
+ * and linear images are kept apart from optimal tiling images whenever
+ * the GPU reports a bufferImageGranularity larger than the smallest
+ * sub-allocation. Resources above the dedicated threshold, or those the
+ * driver asks to be dedicated, get a VkDeviceMemory of their own.
+ *
+ * Host visible blocks are mapped once on creation and stay mapped for
+ * their lifetime, so callers never need to call vkMapMemory.
+ */
+class DeviceAllocator {
+
+private:
+    struct memory_block {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memoryType = 0;
+        bool isDedicated = false;
+        bool isOptimal = false;
+        char* mappedData = nullptr;
+
+        /* Free offsets for each buddy order; order zero is the smallest allocation. */
+        std::vector<std::set<VkDeviceSize>> freeLists {};
+
+        /* Order of every live allocation keyed by its offset. */
+        std::map<VkDeviceSize, uint32_t> liveRanges {};
+
+        VkDeviceSize usedBytes = 0;
+    };
+
+    VkPhysicalDevice    m_physicalDevice = VK_NULL_HANDLE;
+    VkDevice            m_logicalDevice = VK_NULL_HANDLE;
+
+    VkPhysicalDeviceMemoryProperties m_memoryProperties {};
+
+    VkDeviceSize m_blockSize = 0;
+    VkDeviceSize m_minAllocation = 0;
+    VkDeviceSize m_dedicatedThreshold = 0;
+    VkDeviceSize m_nonCoherentAtomSize = 1;
+    uint32_t     m_maxOrder = 0;
+    uint32_t     m_maxAllocationCount = 0;
+    bool         m_separateOptimal = false;
+
+    uint32_t m_deviceAllocationCount = 0;
+
+    std::vector<memory_block*> m_blocks {};
+    std::mutex m_mutex;
+
+    /**
+     * @brief Finds a memory type allowed by the filter with the requested flags.
+     * @param filter Memory type bits from the resource requirements.
+     * @param flags Required memory property flags.
+     * @return The memory type index.
+     * @throws vtrs::RendererError Thrown if no memory type matches.
+     */
+    uint32_t findMemoryType_(uint32_t filter, VkMemoryPropertyFlags flags) const;
+
+    /**
+     * @brief Allocates a new VkDeviceMemory object and maps it if host visible.
+     * @param size Size of the block in bytes.
+     * @param memory_type Memory type index.
+     * @param dedicated Dedicated allocation info, or nullptr for a shared block.
+     * @return The new block.
+     * @throws vtrs::RendererError Thrown if the driver allocation fails.
+     */
+    memory_block* createBlock_(VkDeviceSize size, uint32_t memory_type, const VkMemoryDedicatedAllocateInfo* dedicated);
+
+    /**
+     * @brief Releases a block and its device memory.
+     */
+    void destroyBlock_(memory_block* block);
+
+    /**
+     * @brief Carves a range out of a buddy block.
+     * @param block The block to allocate from.
+     * @param order Buddy order of the requested range.
+     * @param offset Receives the offset of the range.
+     * @return True if the block had room for the range.
+     */
+    bool takeRange_(memory_block* block, uint32_t order, VkDeviceSize* offset);
+
+    /**
+     * @brief Returns a range to a buddy block and merges free buddies.
+     */
+    void releaseRange_(memory_block* block, VkDeviceSize offset);
+
+    /**
+     * @brief Allocates memory satisfying the given requirements.
+     * @param requirements Size, alignment and memory type bits of the resource.
+     * @param flags Required memory property flags.
+     * @param optimal True for optimal tiling images.
+     * @param dedicated Dedicated allocation info, or nullptr to sub-allocate.
+     * @return The new allocation.
+     * @throws vtrs::RendererError Thrown if no memory could be allocated.
+     */
+    struct device_allocation allocate_(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags flags,
+                                       bool optimal, const VkMemoryDedicatedAllocateInfo* dedicated);
+
+    /**
+     * @brief Bootstraps the allocator.
+     * @param options Allocator configuration.
+     */
+    void bootstrap_(struct device_allocator_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     * @param physicalDevice Vulkan physical device handle.
+     * @param logicalDevice Vulkan logical device handle.
+     */
+    explicit DeviceAllocator(VkPhysicalDevice, VkDevice);
+
+public:
+    typedef struct device_allocator_opts Options;
+    typedef struct device_allocation Allocation;
+    typedef struct device_block_stats BlockStats;
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param physical_device   Vulkan physical device handle.
+     * @param logical_device    Vulkan logical device handle.
+     * @param options           Allocator configuration.
+     * @return Instance of the device allocator.
+     */
+    static DeviceAllocator* factory(VkPhysicalDevice, VkDevice, DeviceAllocator::Options*);
+
+    /**
+     * @brief Frees every block still owned by the allocator.
+     */
+    ~DeviceAllocator();
+
+    /**
+     * @brief Allocates memory for a buffer and binds it.
+     * @param buffer The buffer to back with memory.
+     * @param flags Required memory property flags.
+     * @return The allocation bound to the buffer.
+     * @throws vtrs::RendererError Thrown if allocation or binding fails.
+     */
+    Allocation allocateBuffer(VkBuffer buffer, VkMemoryPropertyFlags flags);
+
+    /**
+     * @brief Allocates memory for an image and binds it.
+     * @param image The image to back with memory.
+     * @param tiling Tiling the image was created with.
+     * @param flags Required memory property flags.
+     * @return The allocation bound to the image.
+     * @throws vtrs::RendererError Thrown if allocation or binding fails.
+     */
+    Allocation allocateImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags flags);
+
+    /**
+     * @brief Allocates memory without binding it to a resource.
+     * @param requirements Combined requirements of the resources that will share the range.
+     * @param flags Required memory property flags.
+     * @param optimal True if optimal tiling images will be bound to the range.
+     * @return The unbound allocation.
+     * @throws vtrs::RendererError Thrown if no memory could be allocated.
+     *
+     * Used for resources that alias each other over the same range.
+     */
+    Allocation allocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags flags, bool optimal);
+
+    /**
+     * @brief Returns an allocation to its block.
+     * @param allocation The allocation to release. Reset on return.
+     *
+     * The resource bound to the allocation must be destroyed first.
+     */
+    void free(Allocation& allocation);
+
+    /**
+     * @brief Flushes a host write when the memory is not host coherent.
+     * @param allocation The allocation that was written.
+     * @param offset Offset relative to the allocation.
+     * @param size Number of bytes written, or VK_WHOLE_SIZE.
+     */
+    void flush(const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size);
+
+    /**
+     * @brief Tells whether an allocation lives in host coherent memory.
+     */
+    [[nodiscard]] bool isCoherent(const Allocation& allocation) const;
+
+    /**
+     * @brief Returns usage statistics of every live block.
+     * @return A vector with one entry per block.
+     */
+    std::vector<BlockStats> getBlockStats();
+
+    /**
+     * @brief Prints block statistics to the console.
+     */
+    void printStats();
+};
+
+} // namespace vtrs
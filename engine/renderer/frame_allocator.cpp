@@ -0,0 +1,159 @@
+/**
+ * frame_allocator.cpp - Per-frame transient memory from a persistently mapped ring.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include "assert.hpp"
+#include "frame_allocator.hpp"
+
+static VkDeviceSize alignUp_(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void vtrs::FrameAllocator::bootstrap_(VkPhysicalDevice physical_device, vtrs::frame_allocator_opts* options) {
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    m_uniformAlignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+    m_storageAlignment = std::max<VkDeviceSize>(properties.limits.minStorageBufferOffsetAlignment, 1);
+    m_nonCoherentAtomSize = std::max<VkDeviceSize>(properties.limits.nonCoherentAtomSize, 1);
+
+    /* Segments start on an atom boundary so flushing one frame
+     * never touches bytes that belong to another frame in flight. */
+    VkDeviceSize segment_alignment = std::max({m_uniformAlignment, m_storageAlignment, m_nonCoherentAtomSize});
+
+    m_framesInFlight = std::max<uint32_t>(options->framesInFlight, 1);
+    m_frameCapacity = alignUp_(options->frameCapacity, segment_alignment);
+    m_usage = options->usage;
+
+    createBuffer_();
+}
+
+void vtrs::FrameAllocator::createBuffer_() {
+    VkBufferCreateInfo buffer_info {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size = m_frameCapacity * m_framesInFlight;
+    buffer_info.usage = m_usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    auto result = vkCreateBuffer(m_logicalDevice, &buffer_info, nullptr, &m_buffer);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create frame allocator buffer.")
+
+    m_allocation = m_deviceAllocator->allocateBuffer(m_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+    m_isCoherent = m_deviceAllocator->isCoherent(m_allocation);
+}
+
+vtrs::FrameAllocator::FrameAllocator(VkDevice logical_device, vtrs::DeviceAllocator* allocator) :
+        m_logicalDevice(logical_device),
+        m_deviceAllocator(allocator) {
+}
+
+vtrs::FrameAllocator*
+vtrs::FrameAllocator::factory(
+        VkPhysicalDevice physical_device,
+        VkDevice logical_device,
+        vtrs::DeviceAllocator* allocator,
+        vtrs::FrameAllocator::Options* options) {
+
+    auto frame_allocator = new FrameAllocator(logical_device, allocator);
+    frame_allocator->bootstrap_(physical_device, options);
+
+    return frame_allocator;
+}
+
+vtrs::FrameAllocator::~FrameAllocator() {
+    vkDestroyBuffer(m_logicalDevice, m_buffer, nullptr);
+    m_deviceAllocator->free(m_allocation);
+}
+
+void vtrs::FrameAllocator::beginFrame(uint32_t frame) {
+    flush();
+
+    m_currentFrame = frame % m_framesInFlight;
+    m_frameHead = 0;
+
+    m_dirtyBegin = m_currentFrame * m_frameCapacity;
+    m_dirtyEnd = m_dirtyBegin;
+}
+
+vtrs::FrameAllocator::Allocation vtrs::FrameAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+    VkDeviceSize offset = alignUp_(m_frameHead, std::max<VkDeviceSize>(alignment, 1));
+
+    if (offset + size > m_frameCapacity) {
+        throw vtrs::RendererError("Frame allocator ran out of space for the current frame.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    m_frameHead = offset + size;
+
+    Allocation allocation {};
+    allocation.buffer = m_buffer;
+    allocation.offset = m_currentFrame * m_frameCapacity + offset;
+    allocation.size = size;
+    allocation.mappedData = static_cast<char*>(m_allocation.mappedData) + allocation.offset;
+
+    m_dirtyEnd = std::max(m_dirtyEnd, allocation.offset + size);
+
+    return allocation;
+}
+
+vtrs::FrameAllocator::Allocation vtrs::FrameAllocator::allocateUniform(VkDeviceSize size) {
+    return allocate(size, m_uniformAlignment);
+}
+
+vtrs::FrameAllocator::Allocation vtrs::FrameAllocator::allocateStorage(VkDeviceSize size) {
+    return allocate(size, m_storageAlignment);
+}
+
+void vtrs::FrameAllocator::flush() {
+    if (m_isCoherent || m_dirtyEnd <= m_dirtyBegin) {
+        m_dirtyBegin = m_dirtyEnd;
+        return;
+    }
+
+    m_deviceAllocator->flush(m_allocation, m_dirtyBegin, m_dirtyEnd - m_dirtyBegin);
+    m_dirtyBegin = m_dirtyEnd;
+}
+
+void vtrs::FrameAllocator::setFramesInFlight(uint32_t frames_in_flight) {
+    frames_in_flight = std::max<uint32_t>(frames_in_flight, 1);
+
+    if (frames_in_flight == m_framesInFlight) {
+        return;
+    }
+
+    vkDestroyBuffer(m_logicalDevice, m_buffer, nullptr);
+    m_deviceAllocator->free(m_allocation);
+
+    m_buffer = VK_NULL_HANDLE;
+    m_framesInFlight = frames_in_flight;
+    m_currentFrame = 0;
+    m_frameHead = 0;
+    m_dirtyBegin = 0;
+    m_dirtyEnd = 0;
+
+    createBuffer_();
+}
+
+VkBuffer vtrs::FrameAllocator::getBuffer() const {
+    return m_buffer;
+}
+
+VkDeviceSize vtrs::FrameAllocator::getFrameCapacity() const {
+    return m_frameCapacity;
+}
@@ -0,0 +1,192 @@
+/**
+ * frame_allocator.hpp - Per-frame transient memory from a persistently mapped ring.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <cstring>
+#include <vector>
+#include "vulkan_api.hpp"
+#include "device_allocator.hpp"
+
+namespace vtrs {
+
+struct frame_allocator_opts {
+    VkDeviceSize frameCapacity = 4 * 1024 * 1024;
+    uint32_t framesInFlight = 2;
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                               VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+};
+
+struct frame_allocation {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    void* mappedData = nullptr;
+};
+
+/**
+ * @brief Hands out short-lived buffer ranges that live for a single frame.
+ *
+ * A single host visible buffer is split into one segment per frame in
+ * flight. Each segment is a bump allocator that is rewound by beginFrame,
+ * which must only be called once the fence of that frame has signalled.
+ * Ranges are bound using dynamic offsets into the shared buffer.
+ *
+ * Writes into non-coherent memory are tracked and flushed with a single
+ * vkFlushMappedMemoryRanges call per frame.
+ */
+class FrameAllocator {
+
+private:
+    VkDevice                m_logicalDevice = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator*  m_deviceAllocator = nullptr;
+
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator::Allocation m_allocation {};
+
+    VkDeviceSize m_frameCapacity = 0;
+    VkDeviceSize m_uniformAlignment = 1;
+    VkDeviceSize m_storageAlignment = 1;
+    VkDeviceSize m_nonCoherentAtomSize = 1;
+    uint32_t     m_framesInFlight = 0;
+    bool         m_isCoherent = true;
+    VkBufferUsageFlags m_usage = 0;
+
+    uint32_t     m_currentFrame = 0;
+    VkDeviceSize m_frameHead = 0;
+
+    /* Range written since the last flush, relative to the buffer. */
+    VkDeviceSize m_dirtyBegin = 0;
+    VkDeviceSize m_dirtyEnd = 0;
+
+    /**
+     * @brief Creates the shared buffer with one segment per frame in flight.
+     */
+    void createBuffer_();
+
+    /**
+     * @brief Bootstraps the frame allocator.
+     * @param physical_device Vulkan physical device handle.
+     * @param options Frame allocator configuration.
+     *
+     * The boostrap method will:
+     * - Create one buffer large enough for every frame in flight.
+     * - Back it with persistently mapped host visible memory.
+     */
+    void bootstrap_(VkPhysicalDevice physical_device, struct frame_allocator_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     * @param logicalDevice Vulkan logical device handle.
+     * @param allocator Device allocator providing the backing memory.
+     */
+    explicit FrameAllocator(VkDevice, vtrs::DeviceAllocator*);
+
+public:
+    typedef struct frame_allocator_opts Options;
+    typedef struct frame_allocation Allocation;
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param physical_device   Vulkan physical device handle.
+     * @param logical_device    Vulkan logical device handle.
+     * @param allocator         Device allocator providing the backing memory.
+     * @param options           Frame allocator configuration.
+     * @return Instance of the frame allocator.
+     * @throws vtrs::RendererError Thrown if the buffer could not be created.
+     */
+    static FrameAllocator* factory(VkPhysicalDevice, VkDevice, vtrs::DeviceAllocator*, FrameAllocator::Options*);
+
+    /**
+     * @brief Cleans up when an instance is destroyed.
+     */
+    ~FrameAllocator();
+
+    /**
+     * @brief Starts a new frame and reclaims its segment.
+     * @param frame Index of the frame in flight.
+     *
+     * Call only after the fence guarding this frame has signalled,
+     * as every range handed out for it earlier becomes invalid.
+     */
+    void beginFrame(uint32_t frame);
+
+    /**
+     * @brief Allocates an aligned range from the current frame segment.
+     * @param size Number of bytes needed.
+     * @param alignment Required alignment of the range offset.
+     * @return The allocated range.
+     * @throws vtrs::RendererError Thrown if the frame segment is exhausted.
+     */
+    Allocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+    /**
+     * @brief Allocates a range suitable for a dynamic uniform buffer binding.
+     */
+    Allocation allocateUniform(VkDeviceSize size);
+
+    /**
+     * @brief Allocates a range suitable for a dynamic storage buffer binding.
+     */
+    Allocation allocateStorage(VkDeviceSize size);
+
+    /**
+     * @brief Copies data into a new uniform range.
+     * @param data The value to copy.
+     * @return The allocated range.
+     */
+    template<typename T> Allocation pushUniform(const T& data) {
+        auto allocation = allocateUniform(sizeof(T));
+        std::memcpy(allocation.mappedData, &data, sizeof(T));
+
+        return allocation;
+    }
+
+    /**
+     * @brief Flushes everything written since the last flush.
+     *
+     * Does nothing on host coherent memory. Call once before submitting
+     * the command buffers that read from the current frame.
+     */
+    void flush();
+
+    /**
+     * @brief Changes the number of frame segments.
+     * @param frames_in_flight New number of frames in flight.
+     * @throws vtrs::RendererError Thrown if the new buffer could not be created.
+     *
+     * Call only once every frame in flight has completed. The buffer is
+     * replaced, so descriptor sets that refer to it must be written again.
+     */
+    void setFramesInFlight(uint32_t frames_in_flight);
+
+    /**
+     * @brief Returns the buffer shared by all frame segments.
+     */
+    [[nodiscard]] VkBuffer getBuffer() const;
+
+    /**
+     * @brief Returns the size of a single frame segment.
+     */
+    [[nodiscard]] VkDeviceSize getFrameCapacity() const;
+};
+
+} // namespace vtrs
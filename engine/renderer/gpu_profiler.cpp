@@ -0,0 +1,360 @@
+/**
+ * gpu_profiler.cpp - Measures GPU time and pipeline statistics of scopes.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "platform/logger.hpp"
+#include "assert.hpp"
+#include "gpu_profiler.hpp"
+
+/* Pipeline statistics collected, in the order the driver writes them out. */
+#define VTRS_GPU_PROFILER_STATISTICS \
+    (VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT | \
+     VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT)
+
+#define VTRS_GPU_PROFILER_STATISTICS_COUNT 6
+
+void vtrs::GpuProfiler::createQueries_(frame_queries& frame) {
+    VkQueryPoolCreateInfo timestamp_info {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    timestamp_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    timestamp_info.queryCount = m_maxScopes * 2;
+
+    auto result = vkCreateQueryPool(m_logicalDevice, &timestamp_info, nullptr, &frame.timestamps);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create timestamp query pool.")
+
+    if (!m_hasStatistics) {
+        return;
+    }
+
+    VkQueryPoolCreateInfo statistics_info {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    statistics_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    statistics_info.queryCount = m_maxScopes;
+    statistics_info.pipelineStatistics = m_statisticFlags;
+
+    result = vkCreateQueryPool(m_logicalDevice, &statistics_info, nullptr, &frame.statistics);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create pipeline statistics query pool.")
+}
+
+void vtrs::GpuProfiler::collect_(frame_queries& frame) {
+    if (frame.scopes.empty()) {
+        return;
+    }
+
+    auto scope_count = static_cast<uint32_t>(frame.scopes.size());
+
+    /* Every query is followed by its availability word. Without the wait flag a
+     * query that is not ready yet reports zero availability instead of blocking. */
+    std::vector<uint64_t> timestamps(scope_count * 2 * 2, 0);
+
+    vkGetQueryPoolResults(m_logicalDevice, frame.timestamps, 0, scope_count * 2,
+                          timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t) * 2,
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    const uint32_t statistics_stride = VTRS_GPU_PROFILER_STATISTICS_COUNT + 1;
+    std::vector<uint64_t> statistics {};
+
+    if (frame.statisticsCount > 0) {
+        statistics.resize(frame.statisticsCount * statistics_stride, 0);
+
+        vkGetQueryPoolResults(m_logicalDevice, frame.statistics, 0, frame.statisticsCount,
+                              statistics.size() * sizeof(uint64_t), statistics.data(), sizeof(uint64_t) * statistics_stride,
+                              VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    }
+
+    for (uint32_t index = 0; index < scope_count; index++) {
+        const auto& scope = frame.scopes[index];
+        const uint64_t* begin = &timestamps[index * 4];
+        const uint64_t* end = &timestamps[index * 4 + 2];
+
+        if (!scope.isClosed || begin[1] == 0 || end[1] == 0) {
+            continue;
+        }
+
+        auto ticks = (end[0] - begin[0]) & m_timestampMask;
+        auto& history = m_histories[scope.nameIndex];
+
+        history.samples.push_back(static_cast<double>(ticks) * m_timestampPeriod / 1000000.0);
+
+        while (history.samples.size() > m_historySize) {
+            history.samples.pop_front();
+        }
+
+        if (scope.statisticsQuery == UINT32_MAX) {
+            continue;
+        }
+
+        const uint64_t* values = &statistics[scope.statisticsQuery * statistics_stride];
+
+        if (values[VTRS_GPU_PROFILER_STATISTICS_COUNT] != 0) {
+            history.statistics.assign(values, values + VTRS_GPU_PROFILER_STATISTICS_COUNT);
+        }
+    }
+}
+
+void vtrs::GpuProfiler::bootstrap_(VkPhysicalDevice physical_device, vtrs::gpu_profiler_opts* options) {
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    VkPhysicalDeviceFeatures features {};
+    vkGetPhysicalDeviceFeatures(physical_device, &features);
+
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families.data());
+
+    uint32_t valid_bits = options->queueFamily < family_count ? families[options->queueFamily].timestampValidBits : 0;
+
+    if (valid_bits == 0) {
+        vtrs::Logger::warn("Queue family", options->queueFamily, "can not write timestamps, GPU profiling is disabled.");
+        return;
+    }
+
+    m_timestampPeriod = static_cast<double>(properties.limits.timestampPeriod);
+    m_timestampMask = valid_bits >= 64 ? UINT64_MAX : (1ULL << valid_bits) - 1;
+    m_maxScopes = std::max(options->maxScopes, 1U);
+    m_historySize = std::max(options->historySize, 1U);
+    m_hasStatistics = options->enableStatistics && features.pipelineStatisticsQuery == VK_TRUE && features.inheritedQueries == VK_TRUE;
+    m_statisticFlags = m_hasStatistics ? VTRS_GPU_PROFILER_STATISTICS : 0;
+
+    m_frames.resize(std::max(options->framesInFlight, 1U));
+
+    for (auto& frame : m_frames) {
+        createQueries_(frame);
+    }
+}
+
+vtrs::GpuProfiler::GpuProfiler(VkDevice logical_device) : m_logicalDevice(logical_device) {
+
+}
+
+vtrs::GpuProfiler* vtrs::GpuProfiler::factory(VkPhysicalDevice physical_device, VkDevice logical_device, vtrs::GpuProfiler::Options* options) {
+    auto profiler = new GpuProfiler(logical_device);
+    profiler->bootstrap_(physical_device, options);
+
+    return profiler;
+}
+
+vtrs::GpuProfiler::~GpuProfiler() {
+    for (auto& frame : m_frames) {
+        vkDestroyQueryPool(m_logicalDevice, frame.timestamps, nullptr);
+
+        if (frame.statistics != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(m_logicalDevice, frame.statistics, nullptr);
+        }
+    }
+}
+
+void vtrs::GpuProfiler::beginFrame(uint32_t frame, VkCommandBuffer command_buffer) {
+    if (m_frames.empty()) {
+        return;
+    }
+
+    m_currentFrame = frame % static_cast<uint32_t>(m_frames.size());
+    m_statisticsScope = UINT32_MAX;
+
+    auto& queries = m_frames[m_currentFrame];
+    collect_(queries);
+
+    queries.scopes.clear();
+    queries.statisticsCount = 0;
+
+    vkCmdResetQueryPool(command_buffer, queries.timestamps, 0, m_maxScopes * 2);
+
+    if (queries.statistics != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(command_buffer, queries.statistics, 0, m_maxScopes);
+    }
+}
+
+uint32_t vtrs::GpuProfiler::beginScope(VkCommandBuffer command_buffer, const char* name) {
+    if (m_frames.empty()) {
+        return UINT32_MAX;
+    }
+
+    auto& queries = m_frames[m_currentFrame];
+
+    if (queries.scopes.size() >= m_maxScopes) {
+        return UINT32_MAX;
+    }
+
+    auto found = m_nameIndices.find(name);
+    scope_record scope {};
+
+    if (found == m_nameIndices.end()) {
+        scope.nameIndex = static_cast<uint32_t>(m_names.size());
+
+        m_nameIndices.emplace(name, scope.nameIndex);
+        m_names.emplace_back(name);
+        m_histories.emplace_back();
+
+    } else {
+        scope.nameIndex = found->second;
+    }
+
+    auto index = static_cast<uint32_t>(queries.scopes.size());
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries.timestamps, index * 2);
+
+    if (m_hasStatistics && m_statisticsScope == UINT32_MAX) {
+        scope.statisticsQuery = queries.statisticsCount++;
+        m_statisticsScope = index;
+
+        vkCmdBeginQuery(command_buffer, queries.statistics, scope.statisticsQuery, 0);
+    }
+
+    queries.scopes.push_back(scope);
+    return index;
+}
+
+void vtrs::GpuProfiler::endScope(VkCommandBuffer command_buffer, uint32_t scope) {
+    if (m_frames.empty() || scope == UINT32_MAX) {
+        return;
+    }
+
+    auto& queries = m_frames[m_currentFrame];
+
+    if (scope >= queries.scopes.size() || queries.scopes[scope].isClosed) {
+        return;
+    }
+
+    auto& record = queries.scopes[scope];
+
+    if (m_statisticsScope == scope) {
+        vkCmdEndQuery(command_buffer, queries.statistics, record.statisticsQuery);
+        m_statisticsScope = UINT32_MAX;
+    }
+
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries.timestamps, scope * 2 + 1);
+    record.isClosed = true;
+}
+
+std::vector<vtrs::GpuProfiler::ScopeStats> vtrs::GpuProfiler::getStats() const {
+    std::vector<ScopeStats> stats {};
+    stats.reserve(m_names.size());
+
+    for (size_t index = 0; index < m_names.size(); index++) {
+        const auto& history = m_histories[index];
+
+        if (history.samples.empty()) {
+            continue;
+        }
+
+        ScopeStats scope {};
+        scope.name = m_names[index];
+        scope.sampleCount = static_cast<uint32_t>(history.samples.size());
+
+        std::vector<double> samples(history.samples.begin(), history.samples.end());
+        double total = 0.0;
+
+        for (auto sample : samples) {
+            total += sample;
+        }
+
+        auto rank = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(samples.size()))) - 1;
+        std::nth_element(samples.begin(), samples.begin() + static_cast<long>(rank), samples.end());
+
+        scope.p99Time = samples[rank];
+        scope.minTime = *std::min_element(samples.begin(), samples.end());
+        scope.meanTime = total / static_cast<double>(samples.size());
+
+        if (history.statistics.size() == VTRS_GPU_PROFILER_STATISTICS_COUNT) {
+            scope.inputVertices = history.statistics[0];
+            scope.inputPrimitives = history.statistics[1];
+            scope.vertexInvocations = history.statistics[2];
+            scope.clippingPrimitives = history.statistics[3];
+            scope.fragmentInvocations = history.statistics[4];
+            scope.computeInvocations = history.statistics[5];
+        }
+
+        stats.push_back(scope);
+    }
+
+    return stats;
+}
+
+VkQueryPipelineStatisticFlags vtrs::GpuProfiler::getStatisticFlags() const {
+    return m_statisticFlags;
+}
+
+void vtrs::GpuProfiler::printStats() const {
+    vtrs::Logger::print("");
+    vtrs::Logger::print("GPU Profiler");
+    vtrs::Logger::print("************");
+
+    for (const auto& scope : getStats()) {
+        vtrs::Logger::print(scope.name, "samples:", scope.sampleCount,
+                            "min (ms):", scope.minTime, "mean (ms):", scope.meanTime, "p99 (ms):", scope.p99Time);
+
+        if (m_hasStatistics && scope.inputVertices + scope.computeInvocations > 0) {
+            vtrs::Logger::print("  vertices:", scope.inputVertices, "primitives:", scope.inputPrimitives,
+                                "vs:", scope.vertexInvocations, "clipped:", scope.clippingPrimitives,
+                                "fs:", scope.fragmentInvocations, "cs:", scope.computeInvocations);
+        }
+    }
+
+    vtrs::Logger::print("");
+}
+
+void vtrs::GpuProfiler::setFramesInFlight(uint32_t frames_in_flight) {
+    if (m_frames.empty()) {
+        return;
+    }
+
+    frames_in_flight = std::max<uint32_t>(frames_in_flight, 1);
+
+    for (auto& frame : m_frames) {
+        collect_(frame);
+
+        frame.scopes.clear();
+        frame.statisticsCount = 0;
+    }
+
+    for (size_t index = frames_in_flight; index < m_frames.size(); index++) {
+        vkDestroyQueryPool(m_logicalDevice, m_frames[index].timestamps, nullptr);
+
+        if (m_frames[index].statistics != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(m_logicalDevice, m_frames[index].statistics, nullptr);
+        }
+    }
+
+    auto previous_count = m_frames.size();
+    m_frames.resize(frames_in_flight);
+
+    for (size_t index = previous_count; index < m_frames.size(); index++) {
+        createQueries_(m_frames[index]);
+    }
+
+    m_currentFrame = 0;
+    m_statisticsScope = UINT32_MAX;
+}
+
+vtrs::GpuProfiler::Scope::Scope(GpuProfiler* profiler, VkCommandBuffer command_buffer, const char* name)
+    : m_profiler(profiler), m_commandBuffer(command_buffer), m_scope(profiler->beginScope(command_buffer, name)) {
+
+}
+
+vtrs::GpuProfiler::Scope::~Scope() {
+    m_profiler->endScope(m_commandBuffer, m_scope);
+}
@@ -0,0 +1,234 @@
+/**
+ * gpu_profiler.hpp - Measures GPU time and pipeline statistics of scopes.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include "vulkan_api.hpp"
+
+namespace vtrs {
+
+struct gpu_profiler_opts {
+    uint32_t queueFamily = 0;
+    uint32_t framesInFlight = 2;
+
+    /* Most scopes a single frame may record. */
+    uint32_t maxScopes = 128;
+
+    /* Number of samples kept per scope for the rolling statistics. */
+    uint32_t historySize = 240;
+
+    /* Also count vertices, primitives and shader invocations, needs the pipelineStatisticsQuery and inheritedQueries features enabled. */
+    bool enableStatistics = true;
+};
+
+struct gpu_scope_stats {
+    std::string name {};
+
+    /* GPU time of the scope in milliseconds over the recorded history. */
+    double minTime = 0.0;
+    double meanTime = 0.0;
+    double p99Time = 0.0;
+    uint32_t sampleCount = 0;
+
+    /* Pipeline statistics of the latest sample, all zero without statistics queries. */
+    uint64_t inputVertices = 0;
+    uint64_t inputPrimitives = 0;
+    uint64_t vertexInvocations = 0;
+    uint64_t clippingPrimitives = 0;
+    uint64_t fragmentInvocations = 0;
+    uint64_t computeInvocations = 0;
+};
+
+/**
+ * @brief Times scopes of a frame on the GPU with query pools.
+ *
+ * Every frame in flight owns a timestamp query pool and, when the GPU
+ * supports pipeline statistics, a statistics query pool. Scopes write a
+ * timestamp at their start and end. Outermost scopes also run a
+ * statistics query, because queries of one type can not be nested.
+ *
+ * Results are read in beginFrame without waiting. By then the caller
+ * has waited on the frame's fence, so every query of the frame is
+ * available. Timestamps are converted with the timestampPeriod limit and
+ * kept in a rolling history per scope name.
+ *
+ * When the queue family can not write timestamps, every call is a no-op.
+ *
+ * Scopes must be recorded on one thread, into primary command buffers.
+ * Statistics around vkCmdExecuteCommands also need the inheritedQueries
+ * feature, with the secondaries inheriting getStatisticFlags.
+ */
+class GpuProfiler {
+
+private:
+    struct scope_record {
+        uint32_t nameIndex = 0;
+        uint32_t statisticsQuery = UINT32_MAX;
+        bool     isClosed = false;
+    };
+
+    struct frame_queries {
+        VkQueryPool timestamps = VK_NULL_HANDLE;
+        VkQueryPool statistics = VK_NULL_HANDLE;
+        std::vector<scope_record> scopes {};
+        uint32_t statisticsCount = 0;
+    };
+
+    struct scope_history {
+        std::deque<double> samples {};
+        std::vector<uint64_t> statistics {};
+    };
+
+    VkDevice m_logicalDevice = VK_NULL_HANDLE;
+
+    double   m_timestampPeriod = 1.0;
+    uint64_t m_timestampMask = 0;
+    uint32_t m_maxScopes = 0;
+    uint32_t m_historySize = 0;
+    uint32_t m_currentFrame = 0;
+    bool     m_hasStatistics = false;
+    VkQueryPipelineStatisticFlags m_statisticFlags = 0;
+
+    /* Scope holding the active statistics query of the current frame. */
+    uint32_t m_statisticsScope = UINT32_MAX;
+
+    std::vector<frame_queries> m_frames {};
+    std::vector<std::string> m_names {};
+    std::map<std::string, uint32_t> m_nameIndices {};
+    std::vector<scope_history> m_histories {};
+
+    /**
+     * @brief Creates the query pools of one frame.
+     */
+    void createQueries_(frame_queries& frame);
+
+    /**
+     * @brief Reads the results of a frame and adds them to the histories.
+     */
+    void collect_(frame_queries& frame);
+
+    /**
+     * @brief Bootstraps the profiler.
+     * @param physical_device Vulkan physical device handle.
+     * @param options Profiler configuration.
+     *
+     * The boostrap method will:
+     * - Read the timestamp period and the valid bits of the queue family.
+     * - Create the query pools of every frame in flight.
+     */
+    void bootstrap_(VkPhysicalDevice physical_device, struct gpu_profiler_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     * @param logical_device Vulkan logical device handle.
+     */
+    explicit GpuProfiler(VkDevice);
+
+public:
+    typedef struct gpu_profiler_opts Options;
+    typedef struct gpu_scope_stats ScopeStats;
+
+    /**
+     * @brief Closes a profiler scope when it goes out of scope.
+     */
+    class Scope {
+
+    private:
+        GpuProfiler*    m_profiler;
+        VkCommandBuffer m_commandBuffer;
+        uint32_t        m_scope;
+
+    public:
+        Scope(GpuProfiler* profiler, VkCommandBuffer command_buffer, const char* name);
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope();
+    };
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param physical_device   Vulkan physical device handle.
+     * @param logical_device    Vulkan logical device handle.
+     * @param options           Profiler configuration.
+     * @return Instance of the profiler.
+     */
+    static GpuProfiler* factory(VkPhysicalDevice, VkDevice, GpuProfiler::Options*);
+
+    /**
+     * @brief Destroys every query pool.
+     */
+    ~GpuProfiler();
+
+    /**
+     * @brief Collects the previous results of a frame and resets its queries.
+     * @param frame Index of the frame in flight.
+     * @param command_buffer Primary command buffer of the frame, outside any render pass.
+     *
+     * Call only after the fence guarding this frame has signalled and
+     * before any scope of the frame is recorded.
+     */
+    void beginFrame(uint32_t frame, VkCommandBuffer command_buffer);
+
+    /**
+     * @brief Writes the start timestamp of a scope.
+     * @param command_buffer Command buffer the scope is recorded in.
+     * @param name Name the results are grouped under.
+     * @return Handle passed to endScope, or UINT32_MAX when the frame is out of scopes.
+     */
+    uint32_t beginScope(VkCommandBuffer command_buffer, const char* name);
+
+    /**
+     * @brief Writes the end timestamp of a scope.
+     */
+    void endScope(VkCommandBuffer command_buffer, uint32_t scope);
+
+    /**
+     * @brief Returns the rolling statistics of every scope seen so far.
+     */
+    [[nodiscard]] std::vector<ScopeStats> getStats() const;
+
+    /**
+     * @brief Returns the statistics a secondary command buffer must inherit, zero without statistics.
+     */
+    [[nodiscard]] VkQueryPipelineStatisticFlags getStatisticFlags() const;
+
+    /**
+     * @brief Prints the scope statistics to the console.
+     */
+    void printStats() const;
+
+    /**
+     * @brief Changes the number of per-frame query pools.
+     * @param frames_in_flight New number of frames in flight.
+     *
+     * Call only once every frame in flight has completed. Pending results
+     * are collected first, so the histories carry over.
+     */
+    void setFramesInFlight(uint32_t frames_in_flight);
+};
+
+} // namespace vtrs
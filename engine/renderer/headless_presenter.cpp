@@ -0,0 +1,200 @@
+/**
+ * headless_presenter.cpp - Presents into a ring of offscreen images.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include "assert.hpp"
+#include "headless_presenter.hpp"
+
+void vtrs::HeadlessPresenter::bootstrap_(struct headless_presenter_opts* options) {
+    if (options->imageCount == 0) {
+        throw vtrs::RendererError("Headless presenter needs at least one image.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    m_imageFormat = options->format;
+    m_imageExtend = options->extent;
+
+    vkGetDeviceQueue(m_logicalDevice, options->queueFamily, 0, &m_queue);
+
+    m_imageChain.resize(options->imageCount, VK_NULL_HANDLE);
+    m_imageMemory.resize(options->imageCount);
+    m_presentValues.resize(options->imageCount, 0);
+
+    for (uint32_t index = 0; index < options->imageCount; index++) {
+        VkImageCreateInfo image_info {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = m_imageFormat;
+        image_info.extent = {m_imageExtend.width, m_imageExtend.height, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        auto result = vkCreateImage(m_logicalDevice, &image_info, nullptr, &(m_imageChain.at(index)));
+        VTRS_ASSERT_VK_RESULT(result, "Unable to create headless presenter image.")
+
+        m_imageMemory.at(index) = m_deviceAllocator->allocateImage(
+                m_imageChain.at(index), VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    createViews_();
+
+    VkSemaphoreTypeCreateInfo type_info {VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    semaphore_info.pNext = &type_info;
+
+    auto result = vkCreateSemaphore(m_logicalDevice, &semaphore_info, nullptr, &m_timeline);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create headless presenter timeline semaphore.")
+}
+
+vtrs::HeadlessPresenter::HeadlessPresenter(VkDevice logical_device, vtrs::DeviceAllocator* device_allocator) :
+        Presenter(logical_device),
+        m_deviceAllocator(device_allocator) {
+}
+
+vtrs::HeadlessPresenter*
+vtrs::HeadlessPresenter::factory(
+        VkDevice logical_device,
+        vtrs::DeviceAllocator* device_allocator,
+        HeadlessPresenter::Options* options) {
+
+    auto presenter = new HeadlessPresenter(logical_device, device_allocator);
+
+    try {
+        presenter->bootstrap_(options);
+
+    } catch (vtrs::RendererError&) {
+        delete presenter;
+        throw;
+    }
+
+    return presenter;
+}
+
+vtrs::HeadlessPresenter::~HeadlessPresenter() {
+    if (m_timeline != VK_NULL_HANDLE) {
+        wait();
+        vkDestroySemaphore(m_logicalDevice, m_timeline, nullptr);
+    }
+
+    destroyViews_();
+
+    for (size_t index = 0; index < m_imageChain.size(); index++) {
+        if (m_imageChain.at(index) == VK_NULL_HANDLE) {
+            continue;
+        }
+
+        vkDestroyImage(m_logicalDevice, m_imageChain.at(index), nullptr);
+
+        if (m_imageMemory.at(index).memory != VK_NULL_HANDLE) {
+            m_deviceAllocator->free(m_imageMemory.at(index));
+        }
+    }
+
+    m_imageChain.clear();
+    m_imageMemory.clear();
+}
+
+VkResult vtrs::HeadlessPresenter::acquire(VkSemaphore signal_semaphore, uint32_t* image_index) {
+    uint32_t index = m_nextImage;
+    m_nextImage = (m_nextImage + 1) % static_cast<uint32_t>(m_imageChain.size());
+
+    /* The image is free again once the frame last presented from it has finished rendering. */
+    uint64_t present_value = m_presentValues.at(index);
+
+    if (present_value > 0) {
+        VkSemaphoreWaitInfo wait_info {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &m_timeline;
+        wait_info.pValues = &present_value;
+
+        auto result = vkWaitSemaphores(m_logicalDevice, &wait_info, UINT64_MAX);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to wait for headless presenter image.")
+    }
+
+    /* Nothing else holds the image, so the acquire semaphore can be signalled right away. */
+    if (signal_semaphore != VK_NULL_HANDLE) {
+        VkSubmitInfo submit_info {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &signal_semaphore;
+
+        auto result = vkQueueSubmit(m_queue, 1, &submit_info, VK_NULL_HANDLE);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to signal headless presenter acquire semaphore.")
+    }
+
+    *image_index = index;
+    return VK_SUCCESS;
+}
+
+VkResult vtrs::HeadlessPresenter::present(VkQueue queue, uint32_t image_index, VkSemaphore wait_semaphore) {
+    uint64_t signal_value = ++m_timelineValue;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &signal_value;
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkSubmitInfo submit_info {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.pNext = &timeline_info;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &m_timeline;
+
+    if (wait_semaphore != VK_NULL_HANDLE) {
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = &wait_semaphore;
+        submit_info.pWaitDstStageMask = &wait_stage;
+    }
+
+    auto result = vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to present headless image.")
+
+    m_presentValues.at(image_index) = signal_value;
+    m_lastPresented = image_index;
+
+    return VK_SUCCESS;
+}
+
+VkImageLayout vtrs::HeadlessPresenter::getPresentLayout() const {
+    return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+}
+
+void vtrs::HeadlessPresenter::wait() {
+    if (m_timelineValue == 0) {
+        return;
+    }
+
+    VkSemaphoreWaitInfo wait_info {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &m_timeline;
+    wait_info.pValues = &m_timelineValue;
+
+    auto result = vkWaitSemaphores(m_logicalDevice, &wait_info, UINT64_MAX);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to wait for headless presenter.")
+}
+
+uint32_t vtrs::HeadlessPresenter::getLastPresented() const {
+    return m_lastPresented;
+}
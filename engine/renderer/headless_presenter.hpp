@@ -0,0 +1,119 @@
+/**
+ * headless_presenter.hpp - Presents into a ring of offscreen images.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <vector>
+#include "vulkan_api.hpp"
+#include "presenter.hpp"
+#include "device_allocator.hpp"
+
+namespace vtrs {
+
+struct headless_presenter_opts {
+    VkExtent2D extent {800, 600};
+    VkFormat format = VK_FORMAT_B8G8R8A8_SRGB;
+    uint32_t imageCount = 3;
+    uint32_t queueFamily = 0;
+};
+
+/**
+ * @brief Presents into a ring of device local images with no surface.
+ *
+ * Used where no display server is present, and no headless surface
+ * extension either. Images are handed out round robin. Presenting an
+ * image signals a timeline semaphore, and acquiring the same image
+ * again waits for that value on the host, so at most imageCount frames
+ * are queued. Presented images stay in the transfer source layout and
+ * can be read back with getLastPresented.
+ */
+class HeadlessPresenter : public Presenter {
+
+private:
+    vtrs::DeviceAllocator* m_deviceAllocator = nullptr;
+
+    VkQueue     m_queue = VK_NULL_HANDLE;
+    VkSemaphore m_timeline = VK_NULL_HANDLE;
+    uint64_t    m_timelineValue = 0;
+
+    uint32_t m_nextImage = 0;
+    uint32_t m_lastPresented = UINT32_MAX;
+
+    std::vector<vtrs::DeviceAllocator::Allocation> m_imageMemory {};
+
+    /* Timeline value signalled when each image was last presented. */
+    std::vector<uint64_t> m_presentValues {};
+
+    /**
+     * @brief Bootstraps the presenter.
+     * @param options Headless presenter configuration.
+     *
+     * The boostrap method will:
+     * - Create the image ring and bind it to device memory.
+     * - Create a view for every image.
+     * - Create the timeline semaphore used to throttle the ring.
+     */
+    void bootstrap_(struct headless_presenter_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     * @param logical_device Vulkan logical device handle.
+     * @param device_allocator Allocator backing the images.
+     */
+    explicit HeadlessPresenter(VkDevice, vtrs::DeviceAllocator*);
+
+public:
+    typedef struct headless_presenter_opts Options;
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param logical_device    Vulkan logical device handle.
+     * @param device_allocator  Allocator backing the images.
+     * @param options           Headless presenter configuration.
+     * @return Instance of the headless presenter.
+     * @throws vtrs::RendererError Thrown if the factory method fails.
+     */
+    static HeadlessPresenter* factory(VkDevice, vtrs::DeviceAllocator*, HeadlessPresenter::Options*);
+
+    /**
+     * @brief Waits for the ring to go idle and releases the images.
+     */
+    ~HeadlessPresenter() override;
+
+    VkResult acquire(VkSemaphore signal_semaphore, uint32_t* image_index) override;
+
+    VkResult present(VkQueue queue, uint32_t image_index, VkSemaphore wait_semaphore) override;
+
+    [[nodiscard]] VkImageLayout getPresentLayout() const override;
+
+    /**
+     * @brief Blocks until every presented image has finished rendering.
+     */
+    void wait();
+
+    /**
+     * @brief Returns the index of the most recently presented image.
+     * @return The image index, or UINT32_MAX if nothing was presented yet.
+     */
+    [[nodiscard]] uint32_t getLastPresented() const;
+};
+
+} // namespace vtrs
@@ -0,0 +1,493 @@
+/**
+ * ktx2_texture.cpp - KTX2 texture import with GPU format transcoding.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "third_party/zstd/zstd.h"
+#include "platform/except.hpp"
+#include "assert.hpp"
+#include "ktx2_texture.hpp"
+
+/* Fixed part of the header: identifier, nine header words, the index and the level index. */
+#define VTRS_KTX2_IDENTIFIER_SIZE 12
+#define VTRS_KTX2_LEVEL_INDEX_OFFSET 80
+#define VTRS_KTX2_LEVEL_INDEX_STRIDE 24
+
+/* Khronos data format descriptor values used to tell Basis codecs apart. */
+#define VTRS_KTX2_DF_MODEL_ETC1S 163
+#define VTRS_KTX2_DF_MODEL_UASTC 166
+#define VTRS_KTX2_DF_TRANSFER_SRGB 2
+#define VTRS_KTX2_DF_CHANNEL_ETC1S_AAA 15
+#define VTRS_KTX2_DF_CHANNEL_UASTC_RGBA 3
+#define VTRS_KTX2_DF_CHANNEL_UASTC_RRRG 5
+
+/* Offsets of transcoded images are kept aligned for any block format. */
+#define VTRS_KTX2_DECODED_ALIGNMENT 16
+
+namespace {
+
+const uint8_t s_identifier[VTRS_KTX2_IDENTIFIER_SIZE] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+uint32_t readU32(const uint8_t* bytes, size_t offset) {
+    uint32_t value = 0;
+    std::memcpy(&value, bytes + offset, sizeof(value));
+
+    return value;
+}
+
+uint64_t readU64(const uint8_t* bytes, size_t offset) {
+    uint64_t value = 0;
+    std::memcpy(&value, bytes + offset, sizeof(value));
+
+    return value;
+}
+
+bool isSampleable(VkPhysicalDevice physical_device, VkFormat format) {
+    VkFormatProperties properties {};
+    vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+
+    return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+/**
+ * The most bytes one image of a level can take in a format. Compressed
+ * formats store at most 16 bytes per block of at least 4x4 texels, and
+ * no other format stores more than 32 bytes per texel.
+ */
+uint64_t levelLimit(VkFormat format, uint32_t width, uint32_t height) {
+    uint64_t block_count = static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4);
+
+    if (format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+        return block_count * 16;
+    }
+
+    return static_cast<uint64_t>(width) * height * 32;
+}
+
+/* Tells whether a range given by the file lies within it, written so that the sum can not wrap. */
+bool isWithin(uint64_t offset, uint64_t length, uint64_t size) {
+    return length <= size && offset <= size - length;
+}
+
+} // namespace
+
+void vtrs::Ktx2Texture::readDescriptor_(const uint8_t* bytes, size_t size, uint32_t offset, uint32_t length) {
+    /* The total size word, then the basic block header of 24 bytes. */
+    if (length < 28 || !isWithin(offset, length, size)) {
+        throw vtrs::RendererError("KTX2 file " + m_file->getPath() + " has no data format descriptor.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    const uint8_t* block = bytes + offset + 4;
+
+    uint32_t block_size = readU32(block, 4) >> 16;
+    uint32_t color_model = block[8];
+    uint32_t transfer_function = block[10];
+
+    m_isSrgb = transfer_function == VTRS_KTX2_DF_TRANSFER_SRGB;
+
+    if (color_model == VTRS_KTX2_DF_MODEL_ETC1S) {
+        m_codec = CODEC_ETC1S;
+
+    } else if (color_model == VTRS_KTX2_DF_MODEL_UASTC) {
+        m_codec = CODEC_UASTC;
+    }
+
+    block_size = std::min<uint32_t>(block_size, length - 4);
+
+    for (uint32_t sample = 24; sample + 16 <= block_size; sample += 16) {
+        uint32_t channel = block[sample + 3] & 0x0F;
+
+        if ((m_codec == CODEC_ETC1S && channel == VTRS_KTX2_DF_CHANNEL_ETC1S_AAA) ||
+            (m_codec == CODEC_UASTC && (channel == VTRS_KTX2_DF_CHANNEL_UASTC_RGBA || channel == VTRS_KTX2_DF_CHANNEL_UASTC_RRRG))) {
+            m_hasAlpha = true;
+        }
+    }
+}
+
+VkFormat vtrs::Ktx2Texture::selectTarget_(VkPhysicalDevice physical_device, bool prefer_bc7) const {
+    VkFormat bc7 = m_isSrgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+    VkFormat fallback = m_hasAlpha
+        ? (m_isSrgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK)
+        : (m_isSrgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+
+    std::vector<VkFormat> candidates = prefer_bc7 ? std::vector<VkFormat> {bc7, fallback} : std::vector<VkFormat> {fallback, bc7};
+
+    for (auto format : candidates) {
+        if (isSampleable(physical_device, format)) {
+            return format;
+        }
+    }
+
+    return m_isSrgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+}
+
+void vtrs::Ktx2Texture::mapRegions_(const std::vector<level_index>& levels) {
+    uint32_t image_count = m_layerCount * m_faceCount;
+    uint64_t base = UINT64_MAX;
+    uint64_t end = 0;
+
+    for (const auto& level : levels) {
+        base = std::min(base, level.byteOffset);
+        end = std::max(end, level.byteOffset + level.byteLength);
+    }
+
+    m_mappedOffset = base;
+    m_mappedSize = end - base;
+
+    for (uint32_t level = 0; level < m_levelCount; level++) {
+        uint64_t image_size = levels[level].byteLength / image_count;
+
+        for (uint32_t image = 0; image < image_count; image++) {
+            VkBufferImageCopy region {};
+            region.bufferOffset = levels[level].byteOffset - base + image * image_size;
+            region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, image, 1};
+            region.imageExtent = {std::max(m_extent.width >> level, 1U), std::max(m_extent.height >> level, 1U), 1};
+
+            m_regions.push_back(region);
+            m_regionSizes.push_back(image_size);
+        }
+    }
+}
+
+void vtrs::Ktx2Texture::levelRange_(uint32_t base_level, VkDeviceSize* offset, VkDeviceSize* size) const {
+    VkDeviceSize begin = UINT64_MAX;
+    VkDeviceSize end = 0;
+
+    /* Levels are stored smallest first in the file and largest first once decoded,
+     * either way a level and the ones below it are contiguous. */
+    for (size_t index = 0; index < m_regions.size(); index++) {
+        if (m_regions[index].imageSubresource.mipLevel < base_level) {
+            continue;
+        }
+
+        begin = std::min(begin, m_regions[index].bufferOffset);
+        end = std::max(end, m_regions[index].bufferOffset + m_regionSizes[index]);
+    }
+
+    *offset = begin;
+    *size = end - begin;
+}
+
+void vtrs::Ktx2Texture::decode_(const std::vector<level_index>& levels, const uint8_t* global_data, size_t global_size, vtrs::ktx2_texture_opts* options) {
+    auto bytes = static_cast<const uint8_t*>(m_file->getData());
+    bool is_inflated = m_supercompression == SUPERCOMPRESSION_ZSTD || m_supercompression == SUPERCOMPRESSION_ZLIB;
+
+    auto decompressor = options->decompressor;
+
+    /* Zstandard is built in. One context serves every level of the file. */
+    if (!decompressor && m_supercompression == SUPERCOMPRESSION_ZSTD) {
+        std::shared_ptr<ZSTD_DCtx> context(ZSTD_createDCtx(), ZSTD_freeDCtx);
+
+        if (context == nullptr) {
+            throw vtrs::RendererError("Unable to create a Zstandard context for " + m_file->getPath(), vtrs::RendererError::E_TYPE_GENERAL);
+        }
+
+        decompressor = [context](int, const uint8_t* data, size_t size, uint8_t* output, size_t output_size) {
+            size_t result = ZSTD_decompressDCtx(context.get(), output, output_size, data, size);
+            return !ZSTD_isError(result) && result == output_size;
+        };
+    }
+
+    if (is_inflated && !decompressor) {
+        throw vtrs::RendererError("KTX2 file " + m_file->getPath() + " is ZLIB supercompressed and no decompressor was given.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+    }
+
+    if (m_codec != CODEC_NONE && !options->transcoder) {
+        throw vtrs::RendererError("KTX2 file " + m_file->getPath() + " holds Basis data and no transcoder was given.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+    }
+
+    uint32_t image_count = m_layerCount * m_faceCount;
+    std::vector<uint8_t> inflated {};
+    std::vector<uint8_t> transcoded {};
+
+    for (uint32_t level = 0; level < m_levelCount; level++) {
+        const uint8_t* level_data = bytes + levels[level].byteOffset;
+        size_t level_size = levels[level].byteLength;
+
+        uint32_t width = std::max(m_extent.width >> level, 1U);
+        uint32_t height = std::max(m_extent.height >> level, 1U);
+
+        if (is_inflated) {
+            /* The size comes from the file, so it is held to what the extent allows before anything is allocated.
+             * UASTC is always 16 bytes per 4x4 block, m_format being the transcode target. */
+            uint64_t image_limit = m_codec == CODEC_UASTC ? levelLimit(VK_FORMAT_BC7_UNORM_BLOCK, width, height) : levelLimit(m_format, width, height);
+
+            if (levels[level].uncompressedByteLength == 0 || levels[level].uncompressedByteLength / image_count > image_limit) {
+                throw vtrs::RendererError("KTX2 file " + m_file->getPath() + " has a level larger than its extent allows.", vtrs::RendererError::E_TYPE_GENERAL);
+            }
+
+            inflated.resize(levels[level].uncompressedByteLength);
+
+            if (!decompressor(m_supercompression, level_data, level_size, inflated.data(), inflated.size())) {
+                throw vtrs::RendererError("Unable to inflate level " + std::to_string(level) + " of " + m_file->getPath(), vtrs::RendererError::E_TYPE_GENERAL);
+            }
+
+            level_data = inflated.data();
+            level_size = inflated.size();
+        }
+
+        for (uint32_t image = 0; image < image_count; image++) {
+            const uint8_t* image_data = level_data + (level_size / image_count) * image;
+            size_t image_size = level_size / image_count;
+
+            if (m_codec != CODEC_NONE) {
+                TranscodeRequest request {};
+                request.codec = m_codec;
+                request.targetFormat = m_format;
+                request.hasAlpha = m_hasAlpha;
+                request.level = level;
+                request.layer = image / m_faceCount;
+                request.face = image % m_faceCount;
+                request.imageIndex = level * image_count + image;
+                request.imageCount = m_levelCount * image_count;
+                request.width = width;
+                request.height = height;
+                request.globalData = global_data;
+                request.globalSize = global_size;
+
+                /* BasisLZ images are located through the global data, so the whole level goes along. */
+                request.data = m_codec == CODEC_ETC1S ? level_data : image_data;
+                request.size = m_codec == CODEC_ETC1S ? level_size : image_size;
+
+                transcoded.clear();
+
+                if (!options->transcoder(request, transcoded) || transcoded.empty()) {
+                    throw vtrs::RendererError("Unable to transcode level " + std::to_string(level) + " of " + m_file->getPath(), vtrs::RendererError::E_TYPE_GENERAL);
+                }
+
+                image_data = transcoded.data();
+                image_size = transcoded.size();
+            }
+
+            VkBufferImageCopy region {};
+            region.bufferOffset = m_decoded.size();
+            region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, image, 1};
+            region.imageExtent = {width, height, 1};
+
+            m_regions.push_back(region);
+            m_regionSizes.push_back(image_size);
+
+            size_t aligned_size = (image_size + VTRS_KTX2_DECODED_ALIGNMENT - 1) & ~static_cast<size_t>(VTRS_KTX2_DECODED_ALIGNMENT - 1);
+            m_decoded.insert(m_decoded.end(), image_data, image_data + image_size);
+            m_decoded.resize(m_decoded.size() + aligned_size - image_size, 0);
+        }
+    }
+}
+
+void vtrs::Ktx2Texture::bootstrap_(VkPhysicalDevice physical_device, vtrs::ktx2_texture_opts* options) {
+    auto bytes = static_cast<const uint8_t*>(m_file->getData());
+    size_t size = m_file->getSize();
+    const std::string& path = m_file->getPath();
+
+    if (!isKtx2(bytes, size) || size < VTRS_KTX2_LEVEL_INDEX_OFFSET) {
+        throw vtrs::RendererError("File " + path + " is not a KTX2 texture.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    auto vk_format = static_cast<VkFormat>(readU32(bytes, 12));
+    m_extent = {readU32(bytes, 20), std::max(readU32(bytes, 24), 1U)};
+    m_layerCount = std::max(readU32(bytes, 32), 1U);
+    m_faceCount = std::max(readU32(bytes, 36), 1U);
+    m_levelCount = readU32(bytes, 40);
+    m_supercompression = static_cast<int>(readU32(bytes, 44));
+
+    if (readU32(bytes, 28) > 1) {
+        throw vtrs::RendererError("KTX2 file " + path + " is a volume texture, which is not supported.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+    }
+
+    if (m_extent.width == 0 || (m_faceCount != 1 && m_faceCount != 6)) {
+        throw vtrs::RendererError("KTX2 file " + path + " has an invalid header.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    uint32_t max_dimension = m_faceCount == 6 ? properties.limits.maxImageDimensionCube : properties.limits.maxImageDimension2D;
+
+    if (m_extent.width > max_dimension || m_extent.height > max_dimension || m_layerCount > properties.limits.maxImageArrayLayers) {
+        throw vtrs::RendererError("KTX2 file " + path + " is larger than the GPU supports.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+    }
+
+    /* A level count of zero asks the loader to generate the chain from level 0. */
+    m_isMipGenerationRequested = m_levelCount == 0;
+    m_levelCount = std::max(m_levelCount, 1U);
+
+    if (VTRS_KTX2_LEVEL_INDEX_OFFSET + static_cast<size_t>(m_levelCount) * VTRS_KTX2_LEVEL_INDEX_STRIDE > size) {
+        throw vtrs::RendererError("KTX2 file " + path + " is truncated.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    std::vector<level_index> levels(m_levelCount);
+
+    for (uint32_t level = 0; level < m_levelCount; level++) {
+        size_t entry = VTRS_KTX2_LEVEL_INDEX_OFFSET + level * VTRS_KTX2_LEVEL_INDEX_STRIDE;
+
+        levels[level].byteOffset = readU64(bytes, entry);
+        levels[level].byteLength = readU64(bytes, entry + 8);
+        levels[level].uncompressedByteLength = readU64(bytes, entry + 16);
+
+        if (levels[level].byteLength == 0 || !isWithin(levels[level].byteOffset, levels[level].byteLength, size)) {
+            throw vtrs::RendererError("KTX2 file " + path + " has a level outside the file.", vtrs::RendererError::E_TYPE_GENERAL);
+        }
+    }
+
+    readDescriptor_(bytes, size, readU32(bytes, 48), readU32(bytes, 52));
+
+    uint64_t global_offset = readU64(bytes, 64);
+    uint64_t global_size = readU64(bytes, 72);
+
+    if (!isWithin(global_offset, global_size, size)) {
+        throw vtrs::RendererError("KTX2 file " + path + " has global data outside the file.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    if (vk_format != VK_FORMAT_UNDEFINED) {
+        m_codec = CODEC_NONE;
+        m_format = vk_format;
+
+        if (!isSampleable(physical_device, m_format)) {
+            throw vtrs::RendererError("KTX2 file " + path + " is stored in a format the GPU can not sample.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+        }
+
+    } else if (m_codec == CODEC_NONE) {
+        throw vtrs::RendererError("KTX2 file " + path + " has no format and no Basis data.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+
+    } else {
+        m_format = selectTarget_(physical_device, options->preferBC7);
+    }
+
+    if (m_codec == CODEC_NONE && m_supercompression == SUPERCOMPRESSION_NONE) {
+        mapRegions_(levels);
+
+    } else {
+        decode_(levels, bytes + global_offset, global_size, options);
+    }
+}
+
+vtrs::Ktx2Texture::Ktx2Texture(vtrs::MappedFile* file) : m_file(file) {
+
+}
+
+vtrs::Ktx2Texture* vtrs::Ktx2Texture::factory(VkPhysicalDevice physical_device, const std::string& path, vtrs::Ktx2Texture::Options* options) {
+    vtrs::MappedFile* file;
+
+    try {
+        file = vtrs::MappedFile::factory(path);
+
+    } catch (vtrs::PlatformError& error) {
+        throw vtrs::RendererError(error.what(), vtrs::RendererError::E_TYPE_GENERAL, error.getCode());
+    }
+
+    Options default_options {};
+    std::unique_ptr<Ktx2Texture> texture(new Ktx2Texture(file));
+
+    texture->bootstrap_(physical_device, options != nullptr ? options : &default_options);
+
+    return texture.release();
+}
+
+bool vtrs::Ktx2Texture::isKtx2(const void* data, size_t size) {
+    return data != nullptr && size >= VTRS_KTX2_IDENTIFIER_SIZE && std::memcmp(data, s_identifier, VTRS_KTX2_IDENTIFIER_SIZE) == 0;
+}
+
+void vtrs::Ktx2Texture::upload(vtrs::UploadQueue* upload_queue, VkImage image, vtrs::UploadQueue::ImageTarget target, uint32_t base_level) const {
+    base_level = std::min(base_level, m_levelCount - 1);
+    target.range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_levelCount - base_level, 0, getArrayLayers()};
+
+    const uint8_t* source = m_decoded.empty() ? static_cast<const uint8_t*>(m_file->getData()) + m_mappedOffset : m_decoded.data();
+
+    if (base_level == 0) {
+        VkDeviceSize size = m_decoded.empty() ? m_mappedSize : m_decoded.size();
+        upload_queue->uploadImage(image, source, size, m_regions, target);
+        return;
+    }
+
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    levelRange_(base_level, &offset, &size);
+
+    std::vector<VkBufferImageCopy> regions {};
+
+    for (auto region : m_regions) {
+        if (region.imageSubresource.mipLevel < base_level) {
+            continue;
+        }
+
+        region.bufferOffset -= offset;
+        region.imageSubresource.mipLevel -= base_level;
+        regions.push_back(region);
+    }
+
+    upload_queue->uploadImage(image, source + offset, size, regions, target);
+}
+
+VkFormat vtrs::Ktx2Texture::getFormat() const {
+    return m_format;
+}
+
+VkExtent2D vtrs::Ktx2Texture::getExtent() const {
+    return m_extent;
+}
+
+uint32_t vtrs::Ktx2Texture::getLevelCount() const {
+    return m_levelCount;
+}
+
+uint32_t vtrs::Ktx2Texture::getLayerCount() const {
+    return m_layerCount;
+}
+
+uint32_t vtrs::Ktx2Texture::getArrayLayers() const {
+    return m_layerCount * m_faceCount;
+}
+
+int vtrs::Ktx2Texture::getCodec() const {
+    return m_codec;
+}
+
+VkImageCreateFlags vtrs::Ktx2Texture::getImageCreateFlags() const {
+    return m_faceCount == 6 ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+}
+
+bool vtrs::Ktx2Texture::isMipGenerationRequested() const {
+    return m_isMipGenerationRequested;
+}
+
+VkDeviceSize vtrs::Ktx2Texture::getSize(uint32_t base_level) const {
+    if (base_level == 0) {
+        return m_decoded.empty() ? m_mappedSize : m_decoded.size();
+    }
+
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    levelRange_(std::min(base_level, m_levelCount - 1), &offset, &size);
+
+    return size;
+}
+
+const uint8_t* vtrs::Ktx2Texture::getLevelData(uint32_t level, VkDeviceSize* size) const {
+    level = std::min(level, m_levelCount - 1);
+
+    const uint8_t* source = m_decoded.empty() ? static_cast<const uint8_t*>(m_file->getData()) + m_mappedOffset : m_decoded.data();
+
+    /* Regions are laid out level by level, each starting with its first image. */
+    size_t index = static_cast<size_t>(level) * getArrayLayers();
+    *size = m_regionSizes.at(index);
+
+    return source + m_regions.at(index).bufferOffset;
+}
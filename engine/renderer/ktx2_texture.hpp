@@ -0,0 +1,246 @@
+/**
+ * ktx2_texture.hpp - KTX2 texture import with GPU format transcoding.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "platform/mapped_file.hpp"
+#include "vulkan_api.hpp"
+#include "upload_queue.hpp"
+
+namespace vtrs {
+
+/**
+ * @brief One image of a Basis Universal texture to be transcoded.
+ *
+ * For ETC1S, globalData holds the BasisLZ global data of the file and
+ * imageIndex picks one of its imageCount image descriptors. UASTC images arrive
+ * already inflated when the file was Zstandard supercompressed.
+ */
+struct ktx2_transcode_request {
+    int codec = 0;
+    VkFormat targetFormat = VK_FORMAT_UNDEFINED;
+    bool hasAlpha = false;
+
+    uint32_t level = 0;
+    uint32_t layer = 0;
+    uint32_t face = 0;
+    uint32_t imageIndex = 0;
+    uint32_t imageCount = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const uint8_t* globalData = nullptr;
+    size_t globalSize = 0;
+};
+
+struct ktx2_texture_opts {
+    /* Transcodes one Basis image into the target format, returns false on failure. Required for Basis files. */
+    std::function<bool(const struct ktx2_transcode_request&, std::vector<uint8_t>&)> transcoder {};
+
+    /* Inflates a supercompressed level into a buffer of its exact size. Replaces the built in Zstandard decoder, required for ZLIB. */
+    std::function<bool(int scheme, const uint8_t* data, size_t size, uint8_t* output, size_t output_size)> decompressor {};
+
+    /* Transcode to BC7 when supported; otherwise BC1 or BC3 are tried first. */
+    bool preferBC7 = true;
+};
+
+/**
+ * @brief A KTX2 texture ready to be uploaded with its mip chain.
+ *
+ * The file is memory mapped. Textures stored in a Vulkan format without
+ * supercompression are uploaded straight from the mapping.
+ *
+ * Basis Universal textures, ETC1S or UASTC, are transcoded to the best BC
+ * format the GPU can sample: BC7, then BC3 with alpha or BC1 without,
+ * then RGBA8. Zstandard levels are inflated by the zstd decoder in
+ * lib/third_party. Basis transcoding is not built into the engine, it
+ * is plugged in through the transcoder hook of the options, for example
+ * with the basisu transcoder. ZLIB needs a decompressor hook.
+ */
+class Ktx2Texture {
+
+public:
+    enum Codec : int {
+        CODEC_NONE = 0,
+        CODEC_ETC1S,
+        CODEC_UASTC
+    };
+
+    enum Supercompression : int {
+        SUPERCOMPRESSION_NONE = 0,
+        SUPERCOMPRESSION_BASIS_LZ,
+        SUPERCOMPRESSION_ZSTD,
+        SUPERCOMPRESSION_ZLIB
+    };
+
+private:
+    struct level_index {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    std::unique_ptr<vtrs::MappedFile> m_file {};
+
+    VkFormat   m_format = VK_FORMAT_UNDEFINED;
+    VkExtent2D m_extent {0, 0};
+    uint32_t   m_levelCount = 1;
+    uint32_t   m_layerCount = 1;
+    uint32_t   m_faceCount = 1;
+    bool       m_isMipGenerationRequested = false;
+    bool       m_isSrgb = false;
+    bool       m_hasAlpha = false;
+    int        m_codec = CODEC_NONE;
+    int        m_supercompression = SUPERCOMPRESSION_NONE;
+
+    /* Decoded texels when the mapping can not be uploaded as is. */
+    std::vector<uint8_t> m_decoded {};
+    std::vector<VkBufferImageCopy> m_regions {};
+    std::vector<VkDeviceSize> m_regionSizes {};
+
+    /* Range of the mapping uploaded as is, from the first to the last level. */
+    VkDeviceSize m_mappedOffset = 0;
+    VkDeviceSize m_mappedSize = 0;
+
+    /**
+     * @brief Reads the data format descriptor for the codec, colour space and alpha.
+     */
+    void readDescriptor_(const uint8_t* bytes, size_t size, uint32_t offset, uint32_t length);
+
+    /**
+     * @brief Picks the format Basis images are transcoded to.
+     */
+    VkFormat selectTarget_(VkPhysicalDevice physical_device, bool prefer_bc7) const;
+
+    /**
+     * @brief Lays out the copy regions over the mapping.
+     */
+    void mapRegions_(const std::vector<level_index>& levels);
+
+    /**
+     * @brief Finds the bytes holding a level and every smaller one.
+     * @param base_level First level of the range.
+     * @param offset Receives the offset relative to the uploaded data.
+     * @param size Receives the size of the range.
+     */
+    void levelRange_(uint32_t base_level, VkDeviceSize* offset, VkDeviceSize* size) const;
+
+    /**
+     * @brief Inflates or transcodes every image into the decoded buffer.
+     */
+    void decode_(const std::vector<level_index>& levels, const uint8_t* global_data, size_t global_size, struct ktx2_texture_opts* options);
+
+    /**
+     * @brief Bootstraps the texture.
+     * @param physical_device Vulkan physical device handle.
+     * @param options Import configuration.
+     *
+     * The boostrap method will:
+     * - Validate the KTX2 header, level index and data format descriptor.
+     * - Select the GPU format and decode the levels if needed.
+     * - Build one copy region per level, layer and face.
+     */
+    void bootstrap_(VkPhysicalDevice physical_device, struct ktx2_texture_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     * @param file The mapped KTX2 file.
+     */
+    explicit Ktx2Texture(vtrs::MappedFile*);
+
+public:
+    typedef struct ktx2_texture_opts Options;
+    typedef struct ktx2_transcode_request TranscodeRequest;
+
+    Ktx2Texture(const Ktx2Texture&) = delete;
+    Ktx2Texture& operator=(const Ktx2Texture&) = delete;
+
+    /**
+     * @brief Maps and imports a KTX2 file.
+     * @param physical_device   Vulkan physical device handle, used to query format support.
+     * @param path              Path to the .ktx2 file.
+     * @param options           Import configuration, nullptr for no hooks.
+     * @return Instance of the texture.
+     * @throws vtrs::RendererError Thrown if the file is malformed, or E_TYPE_INCOMPATIBLE if
+     *                             it can not be decoded for this GPU with the given hooks.
+     */
+    static Ktx2Texture* factory(VkPhysicalDevice, const std::string& path, Ktx2Texture::Options* options = nullptr);
+
+    /**
+     * @brief Tells whether a file starts with the KTX2 identifier.
+     */
+    static bool isKtx2(const void* data, size_t size);
+
+    /**
+     * @brief Records the upload of every level, layer and face.
+     * @param upload_queue Queue the copies are recorded into.
+     * @param image Image created with getImageCreateFlags, the format and the counts of this texture.
+     * @param target Layout and stages the image ends up in, the range is filled in here.
+     * @param base_level Level uploaded as level 0 of the image, finer levels are skipped.
+     */
+    void upload(vtrs::UploadQueue* upload_queue, VkImage image, vtrs::UploadQueue::ImageTarget target, uint32_t base_level = 0) const;
+
+    [[nodiscard]] VkFormat getFormat() const;
+
+    [[nodiscard]] VkExtent2D getExtent() const;
+
+    [[nodiscard]] uint32_t getLevelCount() const;
+
+    [[nodiscard]] uint32_t getLayerCount() const;
+
+    /**
+     * @brief Returns the number of array layers of the image, six per cube.
+     */
+    [[nodiscard]] uint32_t getArrayLayers() const;
+
+    [[nodiscard]] int getCodec() const;
+
+    /**
+     * @brief Returns the cube compatible flag for cube maps, zero otherwise.
+     */
+    [[nodiscard]] VkImageCreateFlags getImageCreateFlags() const;
+
+    /**
+     * @brief Tells whether the file asked for its mip levels to be generated at load.
+     */
+    [[nodiscard]] bool isMipGenerationRequested() const;
+
+    /**
+     * @brief Returns the number of bytes uploaded from a level down, which is the GPU size of the texture.
+     */
+    [[nodiscard]] VkDeviceSize getSize(uint32_t base_level = 0) const;
+
+    /**
+     * @brief Returns the texels of the first layer and face of a level.
+     * @param level Level of the chain, clamped to the smallest one.
+     * @param size Receives the number of bytes.
+     * @return Pointer into the mapping or the decoded texels, valid while the texture lives.
+     */
+    [[nodiscard]] const uint8_t* getLevelData(uint32_t level, VkDeviceSize* size) const;
+};
+
+} // namespace vtrs
@@ -0,0 +1,495 @@
+/**
+ * mip_generator.cpp - Builds mip chains of uploaded images on the GPU.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <array>
+#include "assert.hpp"
+#include "mip_generator.hpp"
+
+/* Work group edge of shaders/mip_downsample.comp. */
+#define VTRS_MIP_DOWNSAMPLE_GROUP_SIZE 8
+
+namespace {
+
+struct downsample_constants {
+    int32_t targetWidth;
+    int32_t targetHeight;
+    int32_t isSrgb;
+};
+
+/* UNORM alias the compute fallback writes through, undefined if it can not. */
+VkFormat storageFormat(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_R8G8B8A8_UNORM:
+            return VK_FORMAT_R8G8B8A8_UNORM;
+
+        default:
+            return VK_FORMAT_UNDEFINED;
+    }
+}
+
+VkImageMemoryBarrier levelBarrier(VkImage image, uint32_t base_level, uint32_t level_count, uint32_t layer_count,
+                                  VkImageLayout old_layout, VkImageLayout new_layout,
+                                  VkAccessFlags src_access, VkAccessFlags dst_access) {
+
+    VkImageMemoryBarrier barrier {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, base_level, level_count, 0, layer_count};
+
+    return barrier;
+}
+
+} // namespace
+
+void vtrs::MipGenerator::reclaim_(bool wait_all) {
+    while (!m_pendingBatches.empty()) {
+        auto batch = m_pendingBatches.front();
+
+        if (wait_all) {
+            vkWaitForFences(m_logicalDevice, 1, &(batch->fence), VK_TRUE, UINT64_MAX);
+
+        } else if (vkGetFenceStatus(m_logicalDevice, batch->fence) != VK_SUCCESS) {
+            break;
+        }
+
+        for (auto view : batch->views) {
+            vkDestroyImageView(m_logicalDevice, view, nullptr);
+        }
+
+        if (batch->descriptorPool != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(m_logicalDevice, batch->descriptorPool, nullptr);
+        }
+
+        vkDestroyFence(m_logicalDevice, batch->fence, nullptr);
+        vkFreeCommandBuffers(m_logicalDevice, m_commandPool, 1, &(batch->commands));
+
+        m_pendingBatches.pop_front();
+        delete batch;
+    }
+}
+
+void vtrs::MipGenerator::recordBlit_(VkCommandBuffer command_buffer, const vtrs::mip_generator_target& target) {
+    if (target.levelCount <= 1) {
+        auto barrier = levelBarrier(target.image, 0, 1, target.layerCount,
+            target.baseLayout, target.finalLayout, VK_ACCESS_TRANSFER_WRITE_BIT, target.dstAccess);
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, target.dstStage, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+        return;
+    }
+
+    std::vector<VkImageMemoryBarrier> barriers {};
+
+    if (target.baseLayout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+        barriers.push_back(levelBarrier(target.image, 0, 1, target.layerCount,
+            target.baseLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT));
+    }
+
+    barriers.push_back(levelBarrier(target.image, 1, target.levelCount - 1, target.layerCount,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT));
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    int32_t width = static_cast<int32_t>(target.extent.width);
+    int32_t height = static_cast<int32_t>(target.extent.height);
+
+    for (uint32_t level = 1; level < target.levelCount; level++) {
+        int32_t next_width = std::max(width / 2, 1);
+        int32_t next_height = std::max(height / 2, 1);
+
+        VkImageBlit blit {};
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, target.layerCount};
+        blit.srcOffsets[1] = {width, height, 1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, target.layerCount};
+        blit.dstOffsets[1] = {next_width, next_height, 1};
+
+        vkCmdBlitImage(command_buffer,
+            target.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            target.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit, VK_FILTER_LINEAR);
+
+        /* The level just written is the source of the next one. */
+        auto barrier = levelBarrier(target.image, level, 1, target.layerCount,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+
+        width = next_width;
+        height = next_height;
+    }
+
+    auto barrier = levelBarrier(target.image, 0, target.levelCount, target.layerCount,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target.finalLayout, VK_ACCESS_TRANSFER_WRITE_BIT, target.dstAccess);
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, target.dstStage, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void vtrs::MipGenerator::recordCompute_(VkCommandBuffer command_buffer, mip_batch* batch, const vtrs::mip_generator_target& target) {
+    std::vector<VkImageMemoryBarrier> barriers {};
+
+    /* Level 0 was last written by a copy, made visible here rather than relying on the semaphore wait alone. */
+    barriers.push_back(levelBarrier(target.image, 0, 1, target.layerCount,
+        target.baseLayout, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+
+    barriers.push_back(levelBarrier(target.image, 1, target.levelCount - 1, target.layerCount,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT));
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_downsamplePipeline);
+
+    /* Sampled views decode sRGB on read; storage views must not claim storage for the sRGB format. */
+    VkImageViewUsageCreateInfo sampled_usage {VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO};
+    sampled_usage.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    VkImageViewUsageCreateInfo storage_usage {VK_STRUCTURE_TYPE_IMAGE_VIEW_USAGE_CREATE_INFO};
+    storage_usage.usage = VK_IMAGE_USAGE_STORAGE_BIT;
+
+    downsample_constants constants {};
+    constants.isSrgb = target.format != storageFormat(target.format) ? 1 : 0;
+
+    uint32_t width = target.extent.width;
+    uint32_t height = target.extent.height;
+
+    for (uint32_t level = 1; level < target.levelCount; level++) {
+        width = std::max(width / 2, 1U);
+        height = std::max(height / 2, 1U);
+
+        constants.targetWidth = static_cast<int32_t>(width);
+        constants.targetHeight = static_cast<int32_t>(height);
+
+        for (uint32_t layer = 0; layer < target.layerCount; layer++) {
+            VkImageViewCreateInfo view_info {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+            view_info.pNext = &sampled_usage;
+            view_info.image = target.image;
+            view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_info.format = target.format;
+            view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 1, layer, 1};
+
+            VkImageView source_view = VK_NULL_HANDLE;
+            auto result = vkCreateImageView(m_logicalDevice, &view_info, nullptr, &source_view);
+            VTRS_ASSERT_VK_RESULT(result, "Unable to create mip source view.")
+
+            batch->views.push_back(source_view);
+
+            view_info.pNext = &storage_usage;
+            view_info.format = storageFormat(target.format);
+            view_info.subresourceRange.baseMipLevel = level;
+
+            VkImageView target_view = VK_NULL_HANDLE;
+            result = vkCreateImageView(m_logicalDevice, &view_info, nullptr, &target_view);
+            VTRS_ASSERT_VK_RESULT(result, "Unable to create mip target view.")
+
+            batch->views.push_back(target_view);
+
+            VkDescriptorSetAllocateInfo alloc_info {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+            alloc_info.descriptorPool = batch->descriptorPool;
+            alloc_info.descriptorSetCount = 1;
+            alloc_info.pSetLayouts = &m_downsampleSetLayout;
+
+            VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+            result = vkAllocateDescriptorSets(m_logicalDevice, &alloc_info, &descriptor_set);
+            VTRS_ASSERT_VK_RESULT(result, "Unable to allocate mip descriptor set.")
+
+            VkDescriptorImageInfo source_info {m_downsampleSampler, source_view, VK_IMAGE_LAYOUT_GENERAL};
+            VkDescriptorImageInfo target_info {VK_NULL_HANDLE, target_view, VK_IMAGE_LAYOUT_GENERAL};
+
+            std::array<VkWriteDescriptorSet, 2> writes {};
+            writes[0] = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+            writes[0].dstSet = descriptor_set;
+            writes[0].dstBinding = 0;
+            writes[0].descriptorCount = 1;
+            writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            writes[0].pImageInfo = &source_info;
+
+            writes[1] = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+            writes[1].dstSet = descriptor_set;
+            writes[1].dstBinding = 1;
+            writes[1].descriptorCount = 1;
+            writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[1].pImageInfo = &target_info;
+
+            vkUpdateDescriptorSets(m_logicalDevice, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+
+            vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_downsampleLayout, 0, 1, &descriptor_set, 0, nullptr);
+            vkCmdPushConstants(command_buffer, m_downsampleLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+            vkCmdDispatch(command_buffer,
+                (width + VTRS_MIP_DOWNSAMPLE_GROUP_SIZE - 1) / VTRS_MIP_DOWNSAMPLE_GROUP_SIZE,
+                (height + VTRS_MIP_DOWNSAMPLE_GROUP_SIZE - 1) / VTRS_MIP_DOWNSAMPLE_GROUP_SIZE, 1);
+        }
+
+        auto barrier = levelBarrier(target.image, level, 1, target.layerCount,
+            VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+            0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    auto barrier = levelBarrier(target.image, 0, target.levelCount, target.layerCount,
+        VK_IMAGE_LAYOUT_GENERAL, target.finalLayout, VK_ACCESS_SHADER_WRITE_BIT, target.dstAccess);
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, target.dstStage, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+void vtrs::MipGenerator::createPipeline_(vtrs::ShaderLibrary* shader_library, const vtrs::mip_generator_opts* options) {
+    if (shader_library == nullptr) {
+        throw vtrs::RendererError("Mip downsample shader needs the shader library it was loaded from.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    auto shader = options->downsampleShader;
+
+    if (shader->stage != VK_SHADER_STAGE_COMPUTE_BIT) {
+        throw vtrs::RendererError("Mip downsample shader " + shader->name + " is not a compute shader.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+    }
+
+    auto layout = shader_library->getPipelineLayout({shader});
+
+    if (layout.setLayouts.empty()) {
+        throw vtrs::RendererError("Mip downsample shader " + shader->name + " declares no descriptor set.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+    }
+
+    m_downsampleLayout = layout.layout;
+    m_downsampleSetLayout = layout.setLayouts.front();
+
+    VkComputePipelineCreateInfo pipeline_info {VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = shader->module;
+    pipeline_info.stage.pName = shader->entryPoint.c_str();
+    pipeline_info.layout = m_downsampleLayout;
+
+    auto result = vkCreateComputePipelines(m_logicalDevice, options->pipelineCache, 1, &pipeline_info, nullptr, &m_downsamplePipeline);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create mip downsample pipeline.")
+
+    VkSamplerCreateInfo sampler_info {VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    sampler_info.magFilter = VK_FILTER_LINEAR;
+    sampler_info.minFilter = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    result = vkCreateSampler(m_logicalDevice, &sampler_info, nullptr, &m_downsampleSampler);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create mip downsample sampler.")
+}
+
+void vtrs::MipGenerator::bootstrap_(vtrs::ShaderLibrary* shader_library, vtrs::mip_generator_opts* options) {
+    VkCommandPoolCreateInfo pool_info {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = options->queueFamily;
+
+    auto result = vkCreateCommandPool(m_logicalDevice, &pool_info, nullptr, &m_commandPool);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create mip generator command pool.")
+
+    if (options->downsampleShader != nullptr) {
+        createPipeline_(shader_library, options);
+    }
+}
+
+vtrs::MipGenerator::MipGenerator(VkPhysicalDevice physical_device, VkDevice logical_device)
+    : m_logicalDevice(logical_device), m_physicalDevice(physical_device) {
+
+}
+
+vtrs::MipGenerator* vtrs::MipGenerator::factory(VkPhysicalDevice physical_device, VkDevice logical_device, vtrs::ShaderLibrary* shader_library, vtrs::MipGenerator::Options* options) {
+    auto generator = new MipGenerator(physical_device, logical_device);
+    generator->bootstrap_(shader_library, options);
+
+    return generator;
+}
+
+uint32_t vtrs::MipGenerator::getLevelCount(uint32_t width, uint32_t height) {
+    uint32_t levels = 1;
+    uint32_t edge = std::max(width, height);
+
+    while (edge > 1) {
+        edge /= 2;
+        levels++;
+    }
+
+    return levels;
+}
+
+bool vtrs::MipGenerator::isBlitSupported(VkPhysicalDevice physical_device, VkFormat format) {
+    VkFormatProperties properties {};
+    vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & required) == required;
+}
+
+vtrs::MipGenerator::~MipGenerator() {
+    reclaim_(true);
+
+    if (m_downsamplePipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(m_logicalDevice, m_downsamplePipeline, nullptr);
+        vkDestroySampler(m_logicalDevice, m_downsampleSampler, nullptr);
+    }
+
+    vkDestroyCommandPool(m_logicalDevice, m_commandPool, nullptr);
+}
+
+VkImageUsageFlags vtrs::MipGenerator::getImageUsage(VkFormat format) const {
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+    if (!isBlitSupported(m_physicalDevice, format)) {
+        usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+
+    return usage;
+}
+
+VkImageCreateFlags vtrs::MipGenerator::getImageFlags(VkFormat format) const {
+    if (isBlitSupported(m_physicalDevice, format) || storageFormat(format) == format) {
+        return 0;
+    }
+
+    /* Storage goes through a UNORM view, which the sRGB format itself need not support. */
+    return VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+}
+
+void vtrs::MipGenerator::enqueue(const vtrs::MipGenerator::Target& target) {
+    bool can_blit = isBlitSupported(m_physicalDevice, target.format);
+
+    if (!can_blit && (m_downsamplePipeline == VK_NULL_HANDLE || storageFormat(target.format) == VK_FORMAT_UNDEFINED)) {
+        throw vtrs::RendererError("Mip levels can neither be blitted nor computed for this format.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+    }
+
+    m_targets.push_back(target);
+}
+
+void vtrs::MipGenerator::record(VkCommandBuffer command_buffer) {
+    for (const auto& target : m_targets) {
+        if (target.levelCount > 1 && !isBlitSupported(m_physicalDevice, target.format)) {
+            throw vtrs::RendererError("Mip levels of this format need MipGenerator::submit.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+        }
+    }
+
+    for (const auto& target : m_targets) {
+        recordBlit_(command_buffer, target);
+    }
+
+    m_targets.clear();
+}
+
+void vtrs::MipGenerator::submit(VkQueue queue, VkSemaphore wait_semaphore, uint64_t wait_value) {
+    reclaim_(false);
+
+    if (m_targets.empty()) {
+        return;
+    }
+
+    auto batch = new mip_batch();
+    uint32_t set_count = 0;
+
+    for (const auto& target : m_targets) {
+        if (target.levelCount > 1 && !isBlitSupported(m_physicalDevice, target.format)) {
+            set_count += (target.levelCount - 1) * target.layerCount;
+        }
+    }
+
+    if (set_count > 0) {
+        std::array<VkDescriptorPoolSize, 2> pool_sizes {};
+        pool_sizes[0] = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, set_count};
+        pool_sizes[1] = {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, set_count};
+
+        VkDescriptorPoolCreateInfo pool_info {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+        pool_info.maxSets = set_count;
+        pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+        pool_info.pPoolSizes = pool_sizes.data();
+
+        auto result = vkCreateDescriptorPool(m_logicalDevice, &pool_info, nullptr, &(batch->descriptorPool));
+        VTRS_ASSERT_VK_RESULT(result, "Unable to create mip descriptor pool.")
+    }
+
+    VkCommandBufferAllocateInfo alloc_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    alloc_info.commandPool = m_commandPool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
+
+    auto result = vkAllocateCommandBuffers(m_logicalDevice, &alloc_info, &(batch->commands));
+    VTRS_ASSERT_VK_RESULT(result, "Unable to allocate mip command buffer.")
+
+    VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    result = vkBeginCommandBuffer(batch->commands, &begin_info);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to begin mip command buffer.")
+
+    for (const auto& target : m_targets) {
+        if (target.levelCount <= 1 || isBlitSupported(m_physicalDevice, target.format)) {
+            recordBlit_(batch->commands, target);
+
+        } else {
+            recordCompute_(batch->commands, batch, target);
+        }
+    }
+
+    m_targets.clear();
+
+    result = vkEndCommandBuffer(batch->commands);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to end mip command buffer.")
+
+    VkFenceCreateInfo fence_info {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    result = vkCreateFence(m_logicalDevice, &fence_info, nullptr, &(batch->fence));
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create mip fence.")
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timeline_info.waitSemaphoreValueCount = 1;
+    timeline_info.pWaitSemaphoreValues = &wait_value;
+
+    VkSubmitInfo submit_info {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &(batch->commands);
+
+    if (wait_semaphore != VK_NULL_HANDLE) {
+        submit_info.pNext = &timeline_info;
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = &wait_semaphore;
+        submit_info.pWaitDstStageMask = &wait_stage;
+    }
+
+    result = vkQueueSubmit(queue, 1, &submit_info, batch->fence);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to submit mip generation.")
+
+    m_pendingBatches.push_back(batch);
+}
+
+void vtrs::MipGenerator::wait() {
+    reclaim_(true);
+}
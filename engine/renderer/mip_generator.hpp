@@ -0,0 +1,204 @@
+/**
+ * mip_generator.hpp - Builds mip chains of uploaded images on the GPU.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include "vulkan_api.hpp"
+#include "shader_library.hpp"
+
+namespace vtrs {
+
+struct mip_generator_opts {
+    /* Graphics queue family, blits need graphics and the fallback needs compute. */
+    uint32_t queueFamily = 0;
+
+    /* Compute shader used when a format can not be blitted, see shaders/mip_downsample.comp. */
+    const vtrs::ShaderLibrary::Module* downsampleShader = nullptr;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+};
+
+struct mip_generator_target {
+    VkImage    image = VK_NULL_HANDLE;
+    VkFormat   format = VK_FORMAT_R8G8B8A8_SRGB;
+    VkExtent2D extent {0, 0};
+    uint32_t   levelCount = 1;
+    uint32_t   layerCount = 1;
+
+    /* Layout level 0 is in when generation starts, every other level is undefined. */
+    VkImageLayout baseLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    /* Where every level ends up. */
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    VkAccessFlags dstAccess = VK_ACCESS_SHADER_READ_BIT;
+};
+
+/**
+ * @brief Fills the mip levels of images from their first level.
+ *
+ * Formats that support linear blits are downsampled with vkCmdBlitImage,
+ * one level from the one above it. Blits filter sRGB formats in linear
+ * space, so the result is gamma correct.
+ *
+ * Other formats fall back to a compute shader. It samples the level
+ * above through an sRGB view, which decodes to linear, and encodes back
+ * before writing through a UNORM storage view. Such images need the usage
+ * and flags returned by getImageUsage and getImageFlags. The fallback only
+ * handles 8 bit RGBA formats.
+ *
+ * Images are queued with enqueue and generated together by submit, in
+ * one command buffer and one submission.
+ */
+class MipGenerator {
+
+private:
+    struct mip_batch {
+        VkCommandBuffer commands = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+        std::vector<VkImageView> views {};
+    };
+
+    VkDevice         m_logicalDevice = VK_NULL_HANDLE;
+    VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+
+    VkCommandPool m_commandPool = VK_NULL_HANDLE;
+
+    VkPipeline m_downsamplePipeline = VK_NULL_HANDLE;
+    VkPipelineLayout m_downsampleLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_downsampleSetLayout = VK_NULL_HANDLE;
+    VkSampler m_downsampleSampler = VK_NULL_HANDLE;
+
+    std::vector<struct mip_generator_target> m_targets {};
+    std::deque<mip_batch*> m_pendingBatches {};
+
+    /**
+     * @brief Frees the views and descriptors of batches whose fence has signalled.
+     * @param wait_all Blocks on every pending batch first.
+     */
+    void reclaim_(bool wait_all);
+
+    /**
+     * @brief Records the blits of one image.
+     */
+    void recordBlit_(VkCommandBuffer command_buffer, const struct mip_generator_target& target);
+
+    /**
+     * @brief Records the compute downsample of one image.
+     */
+    void recordCompute_(VkCommandBuffer command_buffer, mip_batch* batch, const struct mip_generator_target& target);
+
+    /**
+     * @brief Creates the downsample pipeline and its sampler.
+     */
+    void createPipeline_(vtrs::ShaderLibrary* shader_library, const struct mip_generator_opts* options);
+
+    /**
+     * @brief Bootstraps the mip generator.
+     * @param shader_library Library the downsample shader was loaded from.
+     * @param options Mip generator configuration.
+     *
+     * The boostrap method will:
+     * - Create a command pool on the given queue family.
+     * - Create the compute downsample pipeline when a shader is given.
+     */
+    void bootstrap_(vtrs::ShaderLibrary* shader_library, struct mip_generator_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     * @param physical_device Vulkan physical device handle.
+     * @param logical_device Vulkan logical device handle.
+     */
+    MipGenerator(VkPhysicalDevice, VkDevice);
+
+public:
+    typedef struct mip_generator_opts Options;
+    typedef struct mip_generator_target Target;
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param physical_device   Vulkan physical device handle.
+     * @param logical_device    Vulkan logical device handle.
+     * @param shader_library    Library the downsample shader was loaded from, may be nullptr without one.
+     * @param options           Mip generator configuration.
+     * @return Instance of the mip generator.
+     * @throws vtrs::RendererError Thrown if the command pool or pipeline could not be created.
+     */
+    static MipGenerator* factory(VkPhysicalDevice, VkDevice, vtrs::ShaderLibrary*, MipGenerator::Options*);
+
+    /**
+     * @brief Returns the number of levels of a full mip chain.
+     */
+    static uint32_t getLevelCount(uint32_t width, uint32_t height);
+
+    /**
+     * @brief Tells whether a format can be downsampled with linear blits.
+     */
+    static bool isBlitSupported(VkPhysicalDevice physical_device, VkFormat format);
+
+    /**
+     * @brief Waits for pending batches and cleans up.
+     */
+    ~MipGenerator();
+
+    /**
+     * @brief Returns the usage an image of the format needs for generation.
+     */
+    [[nodiscard]] VkImageUsageFlags getImageUsage(VkFormat format) const;
+
+    /**
+     * @brief Returns the create flags an image of the format needs for generation.
+     */
+    [[nodiscard]] VkImageCreateFlags getImageFlags(VkFormat format) const;
+
+    /**
+     * @brief Queues an image for the next submit.
+     * @throws vtrs::RendererError Thrown if the format can neither be blitted nor downsampled in compute.
+     */
+    void enqueue(const Target& target);
+
+    /**
+     * @brief Records the mip chains of queued images into a command buffer.
+     * @param command_buffer Command buffer outside any render pass, on the generator's queue family.
+     *
+     * Only blit capable formats can be recorded here, as the compute path
+     * keeps views alive until its own submission completes.
+     * @throws vtrs::RendererError Thrown if a queued format needs the compute path.
+     */
+    void record(VkCommandBuffer command_buffer);
+
+    /**
+     * @brief Generates every queued image in one submission.
+     * @param queue Queue of the generator's family.
+     * @param wait_semaphore Timeline semaphore to wait on first, such as the upload queue's.
+     * @param wait_value Value of the timeline to wait for.
+     */
+    void submit(VkQueue queue, VkSemaphore wait_semaphore = VK_NULL_HANDLE, uint64_t wait_value = 0);
+
+    /**
+     * @brief Blocks until every submission has completed.
+     */
+    void wait();
+};
+
+} // namespace vtrs
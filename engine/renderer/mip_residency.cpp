@@ -0,0 +1,141 @@
+/**
+ * mip_residency.cpp - Screen-space driven mip residency for streamed textures.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "platform/profiler.hpp"
+#include "mip_residency.hpp"
+
+vtrs::MipResidency::MipResidency(vtrs::TextureStreamer* streamer, vtrs::mip_residency_opts* options) :
+    m_streamer(streamer), m_options(*options) {}
+
+vtrs::MipResidency* vtrs::MipResidency::factory(vtrs::TextureStreamer* streamer, vtrs::MipResidency::Options* options) {
+    vtrs::MipResidency::Options residency_options = options != nullptr ? *options : vtrs::MipResidency::Options {};
+    return new MipResidency(streamer, &residency_options);
+}
+
+void vtrs::MipResidency::track(vtrs::TextureStreamer::Handle handle) {
+    tracked_texture texture {};
+    texture.baseLevel = m_streamer->getBaseLevel(handle);
+    texture.lastReport = m_frame;
+
+    m_textures.emplace(handle, texture);
+}
+
+void vtrs::MipResidency::untrack(vtrs::TextureStreamer::Handle handle) {
+    m_textures.erase(handle);
+}
+
+void vtrs::MipResidency::report(vtrs::TextureStreamer::Handle handle, float screen_size, float uv_span) {
+    auto iter = m_textures.find(handle);
+
+    if (iter == m_textures.end()) {
+        return;
+    }
+
+    tracked_texture& texture = iter->second;
+    texture.lastReport = m_frame;
+
+    /* Nothing is known about the texture until its file has been decoded. */
+    VkExtent2D extent = m_streamer->getExtent(handle);
+
+    if (extent.width == 0 || extent.height == 0) {
+        return;
+    }
+
+    uint32_t max_level = m_streamer->getMaxBaseLevel(handle);
+    uint32_t level = max_level;
+
+    /* The sampler picks the level where one texel covers about one pixel. */
+    if (screen_size > 0.0f) {
+        float texels = static_cast<float>(std::max(extent.width, extent.height)) * uv_span;
+        float lod = std::floor(std::log2(texels / screen_size) + m_options.lodBias);
+
+        level = lod > 0.0f ? std::min(static_cast<uint32_t>(lod), max_level) : 0;
+    }
+
+    texture.neededLevel = std::min(texture.neededLevel, level);
+}
+
+void vtrs::MipResidency::update() {
+    VTRS_PROFILE_FUNCTION();
+
+    m_frame++;
+
+    for (auto& pair : m_textures) {
+        tracked_texture& texture = pair.second;
+
+        uint32_t needed_level = texture.neededLevel;
+        texture.neededLevel = UINT32_MAX;
+
+        if (needed_level == UINT32_MAX) {
+            if (m_frame - texture.lastReport < m_options.unusedDelay) {
+                continue;
+            }
+
+            needed_level = m_streamer->getMaxBaseLevel(pair.first);
+        }
+
+        if (needed_level < texture.baseLevel) {
+            texture.baseLevel = needed_level;
+            texture.dropLevel = UINT32_MAX;
+            texture.dropCount = 0;
+
+            m_streamer->setBaseLevel(pair.first, needed_level);
+            continue;
+        }
+
+        if (needed_level == texture.baseLevel) {
+            texture.dropLevel = UINT32_MAX;
+            texture.dropCount = 0;
+            continue;
+        }
+
+        /* Levels are dropped down to the finest one needed while waiting. */
+        texture.dropLevel = std::min(texture.dropLevel, needed_level);
+        texture.dropCount++;
+
+        if (texture.dropCount < m_options.dropDelay) {
+            continue;
+        }
+
+        texture.baseLevel = texture.dropLevel;
+        texture.dropLevel = UINT32_MAX;
+        texture.dropCount = 0;
+
+        m_streamer->setBaseLevel(pair.first, texture.baseLevel);
+    }
+}
+
+uint32_t vtrs::MipResidency::getBaseLevel(vtrs::TextureStreamer::Handle handle) const {
+    auto iter = m_textures.find(handle);
+    return iter != m_textures.end() ? iter->second.baseLevel : 0;
+}
+
+float vtrs::MipResidency::getScreenSize(float radius, float distance, float fov_y, float viewport_height) {
+    /* Inside the sphere, the texture may cover the whole viewport. */
+    if (distance <= radius) {
+        return viewport_height;
+    }
+
+    float angular_size = std::asin(radius / distance);
+    return viewport_height * std::tan(angular_size) / std::tan(fov_y * 0.5f);
+}
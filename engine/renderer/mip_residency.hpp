@@ -0,0 +1,142 @@
+/**
+ * mip_residency.hpp - Screen-space driven mip residency for streamed textures.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <unordered_map>
+#include "vulkan_api.hpp"
+#include "texture_streamer.hpp"
+
+namespace vtrs {
+
+struct mip_residency_opts {
+    /* Added to the estimated level, negative keeps sharper levels for anisotropic filtering. */
+    float lodBias = 0.0f;
+
+    /* Updates a texture has to need coarser levels for before the finer ones are dropped. */
+    uint32_t dropDelay = 60;
+
+    /* Updates without a report after which a texture falls back to its coarsest level. */
+    uint32_t unusedDelay = 300;
+};
+
+/**
+ * @brief Streams each texture from the finest level it is drawn at.
+ *
+ * Every frame the renderer reports how many pixels each visible texture
+ * covers on screen. update turns the reports into the finest mip level
+ * a sampler would read, the log2 of texels per pixel, and streams the
+ * texture from that base level. Finer levels are requested at once.
+ * Coarser ones have to be needed for a number of updates first, so a
+ * camera moving back and forth does not stream the same levels twice.
+ * Textures that are not reported for long fall back to their smallest
+ * level. Device memory then follows what is visible rather than what
+ * was loaded.
+ *
+ * The estimate is made from the reported screen size, there is no GPU
+ * feedback of the levels actually sampled. Budget limits set through
+ * TextureStreamer::setMinBaseLevel still apply on top.
+ */
+class MipResidency {
+
+private:
+    struct tracked_texture {
+        /* Level last handed to the streamer. */
+        uint32_t baseLevel = 0;
+
+        /* Finest level reported since the last update, UINT32_MAX if none. */
+        uint32_t neededLevel = UINT32_MAX;
+
+        /* Finest level needed while waiting to drop levels, and for how long. */
+        uint32_t dropLevel = UINT32_MAX;
+        uint32_t dropCount = 0;
+
+        uint64_t lastReport = 0;
+    };
+
+    vtrs::TextureStreamer* m_streamer = nullptr;
+
+    struct mip_residency_opts m_options {};
+
+    std::unordered_map<vtrs::TextureStreamer::Handle, tracked_texture> m_textures {};
+    uint64_t m_frame = 0;
+
+    /**
+     * @brief Initialises member variables.
+     */
+    MipResidency(vtrs::TextureStreamer*, struct mip_residency_opts*);
+
+public:
+    typedef struct mip_residency_opts Options;
+
+    /**
+     * @brief Creates a residency tracker for a streamer.
+     * @param streamer Streamer whose base levels are driven.
+     * @param options Residency configuration.
+     * @return Instance of the residency tracker.
+     */
+    static MipResidency* factory(vtrs::TextureStreamer* streamer, MipResidency::Options* options);
+
+    /**
+     * @brief Starts driving the base level of a texture.
+     */
+    void track(vtrs::TextureStreamer::Handle handle);
+
+    /**
+     * @brief Stops driving the base level of a texture, which keeps its current one.
+     */
+    void untrack(vtrs::TextureStreamer::Handle handle);
+
+    /**
+     * @brief Reports a draw of a texture for the current frame.
+     * @param handle Texture being drawn.
+     * @param screen_size Pixels covered on screen by the texture coordinate span.
+     * @param uv_span Span of texture coordinates across the surface, above 1 when the texture repeats.
+     *
+     * A texture drawn several times keeps the finest level reported.
+     * Reports of textures that are not tracked are ignored.
+     */
+    void report(vtrs::TextureStreamer::Handle handle, float screen_size, float uv_span = 1.0f);
+
+    /**
+     * @brief Turns the reports of the frame into base levels for the streamer.
+     *
+     * Call once per frame, before TextureStreamer::update.
+     */
+    void update();
+
+    /**
+     * @brief Returns the base level last requested for a texture.
+     */
+    [[nodiscard]] uint32_t getBaseLevel(vtrs::TextureStreamer::Handle handle) const;
+
+    /**
+     * @brief Estimates the pixels covered by a sphere on screen.
+     * @param radius Radius of the bounding sphere.
+     * @param distance Distance from the camera to the centre of the sphere.
+     * @param fov_y Vertical field of view in radians.
+     * @param viewport_height Height of the viewport in pixels.
+     * @return Projected diameter in pixels.
+     */
+    static float getScreenSize(float radius, float distance, float fov_y, float viewport_height);
+};
+
+} // namespace vtrs
@@ -0,0 +1,330 @@
+/**
+ * pipeline_cache.cpp - Persistent Vulkan pipeline cache.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include <sys/stat.h>
+#include "platform/logger.hpp"
+#include "assert.hpp"
+#include "pipeline_cache.hpp"
+
+#define VTRS_PIPELINE_CACHE_MAGIC 0x43505456U
+#define VTRS_PIPELINE_CACHE_HEADER_VERSION 1U
+
+static void makeDirectories_(const std::string& path) {
+    for (size_t position = path.find('/', 1); ; position = path.find('/', position + 1)) {
+        std::string partial = path.substr(0, position);
+
+        if (!partial.empty()) {
+            mkdir(partial.c_str(), 0755);
+        }
+
+        if (position == std::string::npos) {
+            break;
+        }
+    }
+}
+
+uint64_t vtrs::PipelineCache::checksum_(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t index = 0; index < size; index++) {
+        hash ^= static_cast<uint8_t>(data[index]);
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+bool vtrs::PipelineCache::readBlob_(std::string& blob) const {
+    std::ifstream file(m_filePath, std::ios::binary | std::ios::ate);
+
+    if (!file.is_open()) {
+        return false;
+    }
+
+    auto file_size = static_cast<size_t>(file.tellg());
+
+    if (file_size < sizeof(cache_file_header)) {
+        vtrs::Logger::warn("Pipeline cache file is truncated, ignoring it.");
+        return false;
+    }
+
+    cache_file_header header {};
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    if (header.magic != VTRS_PIPELINE_CACHE_MAGIC || header.headerVersion != VTRS_PIPELINE_CACHE_HEADER_VERSION) {
+        vtrs::Logger::warn("Pipeline cache file has an unknown format, ignoring it.");
+        return false;
+    }
+
+    if (header.vendorID != m_properties.vendorID ||
+        header.deviceID != m_properties.deviceID ||
+        header.driverVersion != m_properties.driverVersion ||
+        std::memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+
+        vtrs::Logger::info("Pipeline cache was written by another GPU or driver, starting afresh.");
+        return false;
+    }
+
+    if (header.dataSize != file_size - sizeof(cache_file_header)) {
+        vtrs::Logger::warn("Pipeline cache file is truncated, ignoring it.");
+        return false;
+    }
+
+    blob.resize(static_cast<size_t>(header.dataSize));
+    file.read(&blob[0], static_cast<std::streamsize>(blob.size()));
+
+    if (!file || checksum_(blob.data(), blob.size()) != header.checksum) {
+        vtrs::Logger::warn("Pipeline cache checksum mismatch, ignoring it.");
+        return false;
+    }
+
+    /* The driver validates its own header too, but a mismatch there is
+     * reported silently, so it is cheaper to reject the blob up front. */
+    VkPipelineCacheHeaderVersionOne vk_header {};
+
+    if (blob.size() < sizeof(vk_header)) {
+        return false;
+    }
+
+    std::memcpy(&vk_header, blob.data(), sizeof(vk_header));
+
+    return vk_header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           vk_header.vendorID == m_properties.vendorID &&
+           vk_header.deviceID == m_properties.deviceID &&
+           std::memcmp(vk_header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void vtrs::PipelineCache::record_(const VkPipelineCreationFeedback& feedback, double millis) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)) {
+        m_stats.unknownCount++;
+        m_stats.unknownMillis += millis;
+
+    } else if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) {
+        m_stats.hitCount++;
+        m_stats.hitMillis += millis;
+
+    } else {
+        m_stats.missCount++;
+        m_stats.missMillis += millis;
+    }
+}
+
+void vtrs::PipelineCache::bootstrap_(VkPhysicalDevice physical_device, vtrs::pipeline_cache_opts* options) {
+    vkGetPhysicalDeviceProperties(physical_device, &m_properties);
+
+    m_hasFeedback = m_properties.apiVersion >= VK_API_VERSION_1_3;
+    m_saveOnDestroy = options->saveOnDestroy;
+    m_directory = options->directory;
+    m_filePath = m_directory.empty() ? options->fileName : m_directory + "/" + options->fileName;
+
+    std::string blob {};
+
+    if (options->loadFromDisk && readBlob_(blob)) {
+        m_stats.isLoaded = true;
+        m_stats.loadedBytes = blob.size();
+    } else {
+        blob.clear();
+    }
+
+    VkPipelineCacheCreateInfo cache_info {VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+    cache_info.initialDataSize = blob.size();
+    cache_info.pInitialData = blob.empty() ? nullptr : blob.data();
+
+    auto result = vkCreatePipelineCache(m_logicalDevice, &cache_info, nullptr, &m_cache);
+
+    if (result != VK_SUCCESS && !blob.empty()) {
+        vtrs::Logger::warn("Driver rejected the pipeline cache blob, starting afresh.");
+
+        m_stats = {};
+        cache_info.initialDataSize = 0;
+        cache_info.pInitialData = nullptr;
+
+        result = vkCreatePipelineCache(m_logicalDevice, &cache_info, nullptr, &m_cache);
+    }
+
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create pipeline cache.")
+}
+
+vtrs::PipelineCache::PipelineCache(VkDevice logical_device) : m_logicalDevice(logical_device) {
+
+}
+
+vtrs::PipelineCache* vtrs::PipelineCache::factory(VkPhysicalDevice physical_device, VkDevice logical_device, vtrs::PipelineCache::Options* options) {
+    auto cache = new PipelineCache(logical_device);
+    cache->bootstrap_(physical_device, options);
+
+    return cache;
+}
+
+vtrs::PipelineCache::~PipelineCache() {
+    if (m_saveOnDestroy) {
+        try {
+            save();
+
+        } catch (vtrs::RendererError& error) {
+            vtrs::Logger::warn("Unable to save pipeline cache:", error.what());
+        }
+    }
+
+    vkDestroyPipelineCache(m_logicalDevice, m_cache, nullptr);
+}
+
+VkPipelineCache vtrs::PipelineCache::getHandle() const {
+    return m_cache;
+}
+
+void vtrs::PipelineCache::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo* create_info, VkPipeline* pipeline) {
+    VkPipelineCreationFeedback feedback {};
+
+    VkPipelineCreationFeedbackCreateInfo feedback_info {VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO};
+    feedback_info.pNext = create_info->pNext;
+    feedback_info.pPipelineCreationFeedback = &feedback;
+
+    VkGraphicsPipelineCreateInfo pipeline_info = *create_info;
+
+    if (m_hasFeedback) {
+        pipeline_info.pNext = &feedback_info;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    auto result = vkCreateGraphicsPipelines(m_logicalDevice, m_cache, 1, &pipeline_info, nullptr, pipeline);
+    auto end_time = std::chrono::steady_clock::now();
+
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create graphics pipeline.")
+
+    record_(feedback, std::chrono::duration<double, std::milli>(end_time - start_time).count());
+}
+
+void vtrs::PipelineCache::createComputePipeline(const VkComputePipelineCreateInfo* create_info, VkPipeline* pipeline) {
+    VkPipelineCreationFeedback feedback {};
+
+    VkPipelineCreationFeedbackCreateInfo feedback_info {VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO};
+    feedback_info.pNext = create_info->pNext;
+    feedback_info.pPipelineCreationFeedback = &feedback;
+
+    VkComputePipelineCreateInfo pipeline_info = *create_info;
+
+    if (m_hasFeedback) {
+        pipeline_info.pNext = &feedback_info;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    auto result = vkCreateComputePipelines(m_logicalDevice, m_cache, 1, &pipeline_info, nullptr, pipeline);
+    auto end_time = std::chrono::steady_clock::now();
+
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create compute pipeline.")
+
+    record_(feedback, std::chrono::duration<double, std::milli>(end_time - start_time).count());
+}
+
+VkPipelineCache vtrs::PipelineCache::createWorkerCache() {
+    VkPipelineCacheCreateInfo cache_info {VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+    VkPipelineCache worker_cache = VK_NULL_HANDLE;
+
+    auto result = vkCreatePipelineCache(m_logicalDevice, &cache_info, nullptr, &worker_cache);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create worker pipeline cache.")
+
+    return worker_cache;
+}
+
+void vtrs::PipelineCache::mergeWorkerCache(VkPipelineCache worker_cache) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto result = vkMergePipelineCaches(m_logicalDevice, m_cache, 1, &worker_cache);
+    vkDestroyPipelineCache(m_logicalDevice, worker_cache, nullptr);
+
+    VTRS_ASSERT_VK_RESULT(result, "Unable to merge worker pipeline cache.")
+}
+
+void vtrs::PipelineCache::save() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t data_size = 0;
+    auto result = vkGetPipelineCacheData(m_logicalDevice, m_cache, &data_size, nullptr);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to query pipeline cache size.")
+
+    std::vector<char> data(data_size);
+    result = vkGetPipelineCacheData(m_logicalDevice, m_cache, &data_size, data.data());
+    VTRS_ASSERT_VK_RESULT(result, "Unable to read pipeline cache data.")
+
+    cache_file_header header {};
+    header.magic = VTRS_PIPELINE_CACHE_MAGIC;
+    header.headerVersion = VTRS_PIPELINE_CACHE_HEADER_VERSION;
+    header.vendorID = m_properties.vendorID;
+    header.deviceID = m_properties.deviceID;
+    header.driverVersion = m_properties.driverVersion;
+    header.dataSize = data_size;
+    header.checksum = checksum_(data.data(), data_size);
+    std::memcpy(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    if (!m_directory.empty()) {
+        makeDirectories_(m_directory);
+    }
+
+    std::string temp_path = m_filePath + ".tmp";
+
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(data.data(), static_cast<std::streamsize>(data_size));
+        file.flush();
+
+        if (!file) {
+            std::remove(temp_path.c_str());
+            throw vtrs::RendererError("Unable to write pipeline cache file.", vtrs::RendererError::E_TYPE_GENERAL);
+        }
+    }
+
+    if (std::rename(temp_path.c_str(), m_filePath.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        throw vtrs::RendererError("Unable to replace pipeline cache file.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+}
+
+vtrs::PipelineCache::Stats vtrs::PipelineCache::getStats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void vtrs::PipelineCache::printStats() {
+    auto stats = getStats();
+
+    vtrs::Logger::print("");
+    vtrs::Logger::print("Pipeline Cache");
+    vtrs::Logger::print("**************");
+    vtrs::Logger::print("Loaded from disk:", stats.isLoaded ? "yes" : "no", "bytes:", stats.loadedBytes);
+    vtrs::Logger::print("Hits:", stats.hitCount, "time (ms):", stats.hitMillis);
+    vtrs::Logger::print("Misses:", stats.missCount, "time (ms):", stats.missMillis);
+
+    if (stats.unknownCount > 0) {
+        vtrs::Logger::print("Unclassified:", stats.unknownCount, "time (ms):", stats.unknownMillis);
+    }
+
+    vtrs::Logger::print("");
+}
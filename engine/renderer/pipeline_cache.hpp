@@ -0,0 +1,195 @@
+/**
+ * pipeline_cache.hpp - Persistent Vulkan pipeline cache.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <string>
+#include <mutex>
+#include "vulkan_api.hpp"
+
+namespace vtrs {
+
+struct pipeline_cache_opts {
+    std::string directory = "cache";
+    std::string fileName = "pipelines.bin";
+    bool loadFromDisk = true;
+    bool saveOnDestroy = true;
+};
+
+struct pipeline_cache_stats {
+    size_t   loadedBytes = 0;
+    bool     isLoaded = false;
+    uint32_t hitCount = 0;
+    uint32_t missCount = 0;
+    uint32_t unknownCount = 0;
+    double   hitMillis = 0.0;
+    double   missMillis = 0.0;
+    double   unknownMillis = 0.0;
+};
+
+/**
+ * @brief A pipeline cache that survives application restarts.
+ *
+ * The cache blob is stored behind a small header holding the vendor,
+ * device, driver version and pipeline cache UUID of the GPU that wrote
+ * it. A blob written by any other GPU or driver is discarded on load.
+ *
+ * Pipelines created through this class are timed and, when creation
+ * feedback is available, classified as cache hits or misses.
+ */
+class PipelineCache {
+
+private:
+    struct cache_file_header {
+        uint32_t magic;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+        uint64_t checksum;
+    };
+
+    VkDevice            m_logicalDevice = VK_NULL_HANDLE;
+    VkPipelineCache     m_cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties m_properties {};
+
+    std::string m_filePath {};
+    std::string m_directory {};
+    bool        m_saveOnDestroy = true;
+    bool        m_hasFeedback = false;
+
+    struct pipeline_cache_stats m_stats {};
+    std::mutex m_mutex;
+
+    /**
+     * @brief Computes a FNV-1a checksum used to detect truncated blobs.
+     */
+    static uint64_t checksum_(const char* data, size_t size);
+
+    /**
+     * @brief Reads the cache file and returns its blob if it is valid for this GPU.
+     * @param blob Receives the Vulkan pipeline cache data.
+     * @return True if a usable blob was found.
+     */
+    bool readBlob_(std::string& blob) const;
+
+    /**
+     * @brief Records timing and feedback of a pipeline creation.
+     */
+    void record_(const VkPipelineCreationFeedback& feedback, double millis);
+
+    /**
+     * @brief Bootstraps the pipeline cache.
+     * @param physical_device Vulkan physical device handle.
+     * @param options Pipeline cache configuration.
+     *
+     * The boostrap method will:
+     * - Load and validate the cache blob from disk.
+     * - Create the Vulkan pipeline cache seeded with the blob.
+     */
+    void bootstrap_(VkPhysicalDevice physical_device, struct pipeline_cache_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     * @param logicalDevice Vulkan logical device handle.
+     */
+    explicit PipelineCache(VkDevice);
+
+public:
+    typedef struct pipeline_cache_opts Options;
+    typedef struct pipeline_cache_stats Stats;
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param physical_device   Vulkan physical device handle.
+     * @param logical_device    Vulkan logical device handle.
+     * @param options           Pipeline cache configuration.
+     * @return Instance of the pipeline cache.
+     * @throws vtrs::RendererError Thrown if the Vulkan pipeline cache could not be created.
+     */
+    static PipelineCache* factory(VkPhysicalDevice, VkDevice, PipelineCache::Options*);
+
+    /**
+     * @brief Saves the cache if configured to and destroys it.
+     */
+    ~PipelineCache();
+
+    /**
+     * @brief Returns the Vulkan pipeline cache handle.
+     */
+    [[nodiscard]] VkPipelineCache getHandle() const;
+
+    /**
+     * @brief Creates a graphics pipeline through the cache.
+     * @param create_info Pipeline create info; its pNext chain is preserved.
+     * @param pipeline Receives the pipeline handle.
+     * @throws vtrs::RendererError Thrown if the pipeline could not be created.
+     */
+    void createGraphicsPipeline(const VkGraphicsPipelineCreateInfo* create_info, VkPipeline* pipeline);
+
+    /**
+     * @brief Creates a compute pipeline through the cache.
+     * @param create_info Pipeline create info; its pNext chain is preserved.
+     * @param pipeline Receives the pipeline handle.
+     * @throws vtrs::RendererError Thrown if the pipeline could not be created.
+     */
+    void createComputePipeline(const VkComputePipelineCreateInfo* create_info, VkPipeline* pipeline);
+
+    /**
+     * @brief Creates an empty cache for a worker thread.
+     * @return A cache to be handed back through mergeWorkerCache.
+     *
+     * Worker caches avoid contention on the shared cache while many
+     * threads compile pipelines at once.
+     */
+    VkPipelineCache createWorkerCache();
+
+    /**
+     * @brief Merges a worker cache into this cache and destroys it.
+     * @param worker_cache Cache returned by createWorkerCache.
+     *
+     * Must not race with pipeline creation that uses the shared cache.
+     */
+    void mergeWorkerCache(VkPipelineCache worker_cache);
+
+    /**
+     * @brief Writes the cache blob to disk.
+     *
+     * The blob is written to a temporary file which is then renamed over
+     * the cache file, so a crash never leaves a half written cache behind.
+     * @throws vtrs::RendererError Thrown if the blob could not be written.
+     */
+    void save();
+
+    /**
+     * @brief Returns load and creation statistics.
+     */
+    [[nodiscard]] Stats getStats();
+
+    /**
+     * @brief Prints the statistics using logger.
+     */
+    void printStats();
+};
+
+} // namespace vtrs
@@ -0,0 +1,78 @@
+/**
+ * presenter.cpp - Common interface of swapchain and offscreen presenters.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include "assert.hpp"
+#include "presenter.hpp"
+
+vtrs::Presenter::Presenter(VkDevice logical_device) : m_logicalDevice(logical_device) {
+
+}
+
+void vtrs::Presenter::createViews_() {
+    m_viewsChain.resize(m_imageChain.size());
+
+    for (size_t index = 0; index < m_imageChain.size(); index++) {
+        VkImageViewCreateInfo image_view_info {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+        image_view_info.image = m_imageChain.at(index);
+        image_view_info.format = m_imageFormat;
+        image_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        image_view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+        image_view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+        image_view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+        image_view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+        image_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        image_view_info.subresourceRange.baseMipLevel = 0;
+        image_view_info.subresourceRange.levelCount = 1;
+        image_view_info.subresourceRange.layerCount = 1;
+        image_view_info.subresourceRange.baseArrayLayer = 0;
+
+        auto result = vkCreateImageView(m_logicalDevice, &image_view_info, nullptr, &(m_viewsChain.at(index)));
+        VTRS_ASSERT_VK_RESULT(result, "Unable to create image view for image.")
+    }
+}
+
+void vtrs::Presenter::destroyViews_() {
+    for (auto image_view : m_viewsChain) {
+        vkDestroyImageView(m_logicalDevice, image_view, nullptr);
+    }
+
+    m_viewsChain.clear();
+}
+
+VkFormat vtrs::Presenter::getImageFormat() const {
+    return m_imageFormat;
+}
+
+VkExtent2D vtrs::Presenter::getImageExtent() const {
+    return m_imageExtend;
+}
+
+uint32_t vtrs::Presenter::getImageCount() const {
+    return static_cast<uint32_t>(m_imageChain.size());
+}
+
+VkImage vtrs::Presenter::getImage(uint32_t index) const {
+    return m_imageChain.at(index);
+}
+
+VkImageView vtrs::Presenter::getImageView(uint32_t index) const {
+    return m_viewsChain.at(index);
+}
@@ -0,0 +1,104 @@
+/**
+ * presenter.hpp - Common interface of swapchain and offscreen presenters.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <vector>
+#include "vulkan_api.hpp"
+
+namespace vtrs {
+
+/**
+ * @brief A ring of images that frames are rendered into and handed off.
+ *
+ * The acquire and present calls follow vkAcquireNextImageKHR and
+ * vkQueuePresentKHR. acquire signals a binary semaphore once the image
+ * may be written. present waits on one before the image is handed off.
+ * Both return VK_ERROR_OUT_OF_DATE_KHR and VK_SUBOPTIMAL_KHR as results
+ * rather than throwing, so callers can rebuild and carry on.
+ *
+ * Images must be in the layout returned by getPresentLayout when they
+ * are presented.
+ */
+class Presenter {
+
+protected:
+    VkDevice    m_logicalDevice = VK_NULL_HANDLE;
+    VkFormat    m_imageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    VkExtent2D  m_imageExtend {};
+
+    std::vector<VkImage>        m_imageChain {};
+    std::vector<VkImageView>    m_viewsChain {};
+
+    /**
+     * @brief Creates a colour view for every image in the chain.
+     */
+    void createViews_();
+
+    /**
+     * @brief Destroys the views of the chain.
+     */
+    void destroyViews_();
+
+    explicit Presenter(VkDevice);
+
+public:
+    Presenter(const Presenter&) = delete;
+    Presenter& operator=(const Presenter&) = delete;
+
+    virtual ~Presenter() = default;
+
+    /**
+     * @brief Picks the next image to render into.
+     * @param signal_semaphore Signalled once the image may be written.
+     * @param image_index Receives the index of the image.
+     * @return VK_SUCCESS, VK_SUBOPTIMAL_KHR or VK_ERROR_OUT_OF_DATE_KHR.
+     * @throws vtrs::RendererError Thrown on any other failure.
+     */
+    virtual VkResult acquire(VkSemaphore signal_semaphore, uint32_t* image_index) = 0;
+
+    /**
+     * @brief Hands a rendered image off.
+     * @param queue Queue the frame was rendered on.
+     * @param image_index Index returned by acquire.
+     * @param wait_semaphore Signalled by the submission that rendered the image.
+     * @return VK_SUCCESS, VK_SUBOPTIMAL_KHR or VK_ERROR_OUT_OF_DATE_KHR.
+     * @throws vtrs::RendererError Thrown on any other failure.
+     */
+    virtual VkResult present(VkQueue queue, uint32_t image_index, VkSemaphore wait_semaphore) = 0;
+
+    /**
+     * @brief Returns the layout images must be in when presented.
+     */
+    [[nodiscard]] virtual VkImageLayout getPresentLayout() const = 0;
+
+    [[nodiscard]] VkFormat getImageFormat() const;
+
+    [[nodiscard]] VkExtent2D getImageExtent() const;
+
+    [[nodiscard]] uint32_t getImageCount() const;
+
+    [[nodiscard]] VkImage getImage(uint32_t index) const;
+
+    [[nodiscard]] VkImageView getImageView(uint32_t index) const;
+};
+
+} // namespace vtrs
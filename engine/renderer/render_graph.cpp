@@ -0,0 +1,720 @@
+/**
+ * render_graph.cpp - Frame graph with automatic barriers and transient aliasing.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <map>
+#include "assert.hpp"
+#include "render_graph.hpp"
+
+namespace {
+
+struct access_info {
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;
+    VkImageUsageFlags usage;
+};
+
+const VkAccessFlags2 WRITE_ACCESS_MASK = VK_ACCESS_2_SHADER_WRITE_BIT |
+                                         VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+                                         VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+                                         VK_ACCESS_2_TRANSFER_WRITE_BIT |
+                                         VK_ACCESS_2_MEMORY_WRITE_BIT |
+                                         VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+access_info accessInfo_(vtrs::RenderGraph::AccessType type, VkPipelineStageFlags2 stages) {
+    switch (type) {
+        case vtrs::RenderGraph::ACCESS_COLOR_ATTACHMENT:
+            return {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT};
+
+        case vtrs::RenderGraph::ACCESS_DEPTH_ATTACHMENT:
+            return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT};
+
+        case vtrs::RenderGraph::ACCESS_DEPTH_READ:
+            return {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT | (stages ? stages : VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT),
+                    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                    VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT};
+
+        case vtrs::RenderGraph::ACCESS_SAMPLED:
+            return {stages ? stages : VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT};
+
+        case vtrs::RenderGraph::ACCESS_STORAGE_READ:
+            return {stages ? stages : VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT};
+
+        case vtrs::RenderGraph::ACCESS_STORAGE_WRITE:
+            return {stages ? stages : VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                    VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT};
+
+        case vtrs::RenderGraph::ACCESS_TRANSFER_SRC:
+            return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT};
+
+        case vtrs::RenderGraph::ACCESS_TRANSFER_DST:
+            return {VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT};
+
+        case vtrs::RenderGraph::ACCESS_VERTEX_BUFFER:
+            return {VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0};
+
+        case vtrs::RenderGraph::ACCESS_INDEX_BUFFER:
+            return {VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0};
+
+        case vtrs::RenderGraph::ACCESS_UNIFORM_BUFFER:
+            return {stages ? stages : VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_2_UNIFORM_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0};
+
+        case vtrs::RenderGraph::ACCESS_INDIRECT_BUFFER:
+            return {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, 0};
+    }
+
+    return {VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, 0};
+}
+
+VkImageAspectFlags aspectOf_(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+
+        case VK_FORMAT_S8_UINT:
+            return VK_IMAGE_ASPECT_STENCIL_BIT;
+
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+}
+
+uint64_t hashValue_(uint64_t hash, uint64_t value) {
+    for (int index = 0; index < 8; index++) {
+        hash ^= (value >> (index * 8)) & 0xFFU;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+struct resource_state {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags2 writeStage = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+    VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+    VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+};
+
+} // namespace
+
+vtrs::RenderGraph::PassBuilder::PassBuilder(vtrs::RenderGraph* graph, uint32_t pass) : m_graph(graph), m_pass(pass) {
+
+}
+
+vtrs::RenderGraph::PassBuilder& vtrs::RenderGraph::PassBuilder::read(Resource resource, AccessType access, VkPipelineStageFlags2 stages) {
+    m_graph->addAccess_(m_pass, resource, access, stages, false);
+    return *this;
+}
+
+vtrs::RenderGraph::PassBuilder& vtrs::RenderGraph::PassBuilder::write(Resource resource, AccessType access, VkPipelineStageFlags2 stages) {
+    m_graph->addAccess_(m_pass, resource, access, stages, true);
+    return *this;
+}
+
+vtrs::RenderGraph::PassBuilder& vtrs::RenderGraph::PassBuilder::setSideEffect() {
+    m_graph->m_passes.at(m_pass).hasSideEffect = true;
+    return *this;
+}
+
+void vtrs::RenderGraph::addAccess_(uint32_t pass, Resource resource, AccessType access, VkPipelineStageFlags2 stages, bool is_write) {
+    if (resource >= m_resources.size()) {
+        throw vtrs::RendererError("Render graph pass refers to an unknown resource.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    m_passes.at(pass).accesses.push_back({resource, access, stages, is_write});
+}
+
+uint64_t vtrs::RenderGraph::topologyHash_() const {
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (const auto& resource : m_resources) {
+        hash = hashValue_(hash, resource.isImage);
+        hash = hashValue_(hash, resource.isImported);
+        hash = hashValue_(hash, resource.desc.format);
+        hash = hashValue_(hash, resource.desc.extent.width);
+        hash = hashValue_(hash, resource.desc.extent.height);
+        hash = hashValue_(hash, resource.desc.usage);
+        hash = hashValue_(hash, resource.desc.samples);
+        hash = hashValue_(hash, resource.initialLayout);
+        hash = hashValue_(hash, resource.finalLayout);
+        hash = hashValue_(hash, resource.initialStage);
+    }
+
+    for (const auto& pass : m_passes) {
+        for (char character : pass.name) {
+            hash = hashValue_(hash, static_cast<uint8_t>(character));
+        }
+
+        hash = hashValue_(hash, pass.hasSideEffect);
+
+        for (const auto& access : pass.accesses) {
+            hash = hashValue_(hash, access.resource);
+            hash = hashValue_(hash, access.type);
+            hash = hashValue_(hash, access.stages);
+            hash = hashValue_(hash, access.isWrite);
+        }
+    }
+
+    return hash;
+}
+
+std::vector<bool> vtrs::RenderGraph::findLivePasses_() const {
+    std::vector<bool> live(m_passes.size(), false);
+    std::vector<bool> needed(m_resources.size(), false);
+
+    /* Walking backwards, a pass lives if it has side effects, writes
+     * something that leaves the graph, or feeds a pass that lives. */
+    for (size_t index = m_passes.size(); index-- > 0;) {
+        const auto& pass = m_passes.at(index);
+        bool is_live = pass.hasSideEffect;
+
+        for (const auto& access : pass.accesses) {
+            if (access.isWrite && (m_resources.at(access.resource).isImported || needed.at(access.resource))) {
+                is_live = true;
+            }
+        }
+
+        if (!is_live) {
+            continue;
+        }
+
+        live.at(index) = true;
+
+        for (const auto& access : pass.accesses) {
+            if (!access.isWrite) {
+                needed.at(access.resource) = true;
+            }
+        }
+    }
+
+    return live;
+}
+
+void vtrs::RenderGraph::allocateTransients_(const std::vector<uint32_t>& schedule) {
+    struct transient_candidate {
+        Resource resource;
+        VkMemoryRequirements requirements;
+        uint32_t first;
+        uint32_t last;
+    };
+
+    struct memory_slot {
+        VkMemoryRequirements requirements;
+        std::vector<std::pair<uint32_t, uint32_t>> lifetimes;
+    };
+
+    std::vector<uint32_t> first_use(m_resources.size(), UINT32_MAX);
+    std::vector<uint32_t> last_use(m_resources.size(), 0);
+    std::vector<VkImageUsageFlags> usage(m_resources.size(), 0);
+
+    for (uint32_t position = 0; position < schedule.size(); position++) {
+        for (const auto& access : m_passes.at(schedule.at(position)).accesses) {
+            first_use.at(access.resource) = std::min(first_use.at(access.resource), position);
+            last_use.at(access.resource) = std::max(last_use.at(access.resource), position);
+            usage.at(access.resource) |= accessInfo_(access.type, access.stages).usage;
+        }
+    }
+
+    uint32_t transient_count = 0;
+
+    for (const auto& resource : m_resources) {
+        transient_count += resource.isImported ? 0 : 1;
+    }
+
+    m_transients.assign(transient_count, {VK_NULL_HANDLE, VK_NULL_HANDLE, UINT32_MAX});
+
+    std::vector<transient_candidate> candidates {};
+    VkDeviceSize unaliased_bytes = 0;
+
+    for (Resource index = 0; index < m_resources.size(); index++) {
+        const auto& resource = m_resources.at(index);
+
+        if (resource.isImported || first_use.at(index) == UINT32_MAX) {
+            continue;
+        }
+
+        VkImageCreateInfo image_info {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = resource.desc.format;
+        image_info.extent = {resource.desc.extent.width, resource.desc.extent.height, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = resource.desc.samples;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = resource.desc.usage | usage.at(index);
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        auto& transient = m_transients.at(resource.transient);
+
+        auto result = vkCreateImage(m_logicalDevice, &image_info, nullptr, &(transient.image));
+        VTRS_ASSERT_VK_RESULT(result, "Unable to create transient image " + resource.name)
+
+        VkMemoryRequirements requirements {};
+        vkGetImageMemoryRequirements(m_logicalDevice, transient.image, &requirements);
+
+        unaliased_bytes += requirements.size;
+        candidates.push_back({index, requirements, first_use.at(index), last_use.at(index)});
+    }
+
+    /* Largest first, each transient goes into the first slot whose
+     * occupants are all dead by the time it is first used. */
+    std::sort(candidates.begin(), candidates.end(), [](const transient_candidate& left, const transient_candidate& right) {
+        return left.requirements.size > right.requirements.size;
+    });
+
+    std::vector<memory_slot> slots {};
+
+    for (const auto& candidate : candidates) {
+        uint32_t chosen = UINT32_MAX;
+
+        for (uint32_t slot_index = 0; slot_index < slots.size() && chosen == UINT32_MAX; slot_index++) {
+            auto& slot = slots.at(slot_index);
+
+            if ((slot.requirements.memoryTypeBits & candidate.requirements.memoryTypeBits) == 0) {
+                continue;
+            }
+
+            bool overlaps = std::any_of(slot.lifetimes.begin(), slot.lifetimes.end(), [&candidate](const std::pair<uint32_t, uint32_t>& lifetime) {
+                return candidate.first <= lifetime.second && lifetime.first <= candidate.last;
+            });
+
+            if (!overlaps) {
+                chosen = slot_index;
+            }
+        }
+
+        if (chosen == UINT32_MAX) {
+            chosen = static_cast<uint32_t>(slots.size());
+            slots.push_back({candidate.requirements, {}});
+
+        } else {
+            auto& requirements = slots.at(chosen).requirements;
+            requirements.size = std::max(requirements.size, candidate.requirements.size);
+            requirements.alignment = std::max(requirements.alignment, candidate.requirements.alignment);
+            requirements.memoryTypeBits &= candidate.requirements.memoryTypeBits;
+        }
+
+        slots.at(chosen).lifetimes.emplace_back(candidate.first, candidate.last);
+        m_transients.at(m_resources.at(candidate.resource).transient).slot = chosen;
+    }
+
+    m_stats.transientBytes = 0;
+
+    for (const auto& slot : slots) {
+        m_slots.push_back(m_deviceAllocator->allocateMemory(slot.requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true));
+        m_stats.transientBytes += slot.requirements.size;
+    }
+
+    m_stats.aliasedBytes = unaliased_bytes - m_stats.transientBytes;
+    m_stats.transientCount = static_cast<uint32_t>(candidates.size());
+
+    for (const auto& candidate : candidates) {
+        const auto& resource = m_resources.at(candidate.resource);
+        auto& transient = m_transients.at(resource.transient);
+        const auto& slot = m_slots.at(transient.slot);
+
+        auto result = vkBindImageMemory(m_logicalDevice, transient.image, slot.memory, slot.offset);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to bind memory to transient image " + resource.name)
+
+        VkImageViewCreateInfo view_info {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+        view_info.image = transient.image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = resource.desc.format;
+        view_info.subresourceRange = {aspectOf_(resource.desc.format), 0, 1, 0, 1};
+
+        result = vkCreateImageView(m_logicalDevice, &view_info, nullptr, &(transient.view));
+        VTRS_ASSERT_VK_RESULT(result, "Unable to create view of transient image " + resource.name)
+    }
+}
+
+void vtrs::RenderGraph::placeBarriers_(const std::vector<uint32_t>& schedule) {
+    std::vector<resource_state> states(m_resources.size());
+
+    /* Every occupant of a memory slot, from this frame or the previous
+     * one, may still be in flight when a transient is first used. */
+    std::vector<VkPipelineStageFlags2> slot_stages(m_slots.size(), VK_PIPELINE_STAGE_2_NONE);
+    std::vector<VkAccessFlags2> slot_access(m_slots.size(), VK_ACCESS_2_NONE);
+
+    for (auto pass_index : schedule) {
+        for (const auto& access : m_passes.at(pass_index).accesses) {
+            const auto& resource = m_resources.at(access.resource);
+
+            if (!resource.isImported) {
+                auto slot = m_transients.at(resource.transient).slot;
+                auto info = accessInfo_(access.type, access.stages);
+
+                slot_stages.at(slot) |= info.stages;
+                slot_access.at(slot) |= info.access & WRITE_ACCESS_MASK;
+            }
+        }
+    }
+
+    for (Resource index = 0; index < m_resources.size(); index++) {
+        const auto& resource = m_resources.at(index);
+        auto& state = states.at(index);
+
+        if (resource.isImported) {
+            state.layout = resource.initialLayout;
+            state.writeStage = resource.isImage ? resource.initialStage : VK_PIPELINE_STAGE_2_NONE;
+
+        } else if (m_transients.at(resource.transient).slot != UINT32_MAX) {
+            auto slot = m_transients.at(resource.transient).slot;
+            state.writeStage = slot_stages.at(slot);
+            state.writeAccess = slot_access.at(slot);
+        }
+    }
+
+    m_schedule.clear();
+    m_stats.barrierCount = 0;
+
+    for (auto pass_index : schedule) {
+        compiled_pass compiled {pass_index, {}};
+
+        /* Accesses of one pass to the same resource are merged into one. */
+        std::map<Resource, access_info> merged {};
+        std::map<Resource, bool> writes {};
+
+        for (const auto& access : m_passes.at(pass_index).accesses) {
+            auto info = accessInfo_(access.type, access.stages);
+            auto found = merged.find(access.resource);
+
+            if (found == merged.end()) {
+                merged[access.resource] = info;
+
+            } else if (m_resources.at(access.resource).isImage && found->second.layout != info.layout) {
+                throw vtrs::RendererError("Pass " + m_passes.at(pass_index).name + " uses an image in two layouts.", vtrs::RendererError::E_TYPE_GENERAL);
+
+            } else {
+                found->second.stages |= info.stages;
+                found->second.access |= info.access;
+            }
+
+            writes[access.resource] = writes[access.resource] || access.isWrite;
+        }
+
+        for (const auto& entry : merged) {
+            auto& state = states.at(entry.first);
+            const auto& info = entry.second;
+
+            bool is_image = m_resources.at(entry.first).isImage;
+            bool is_write = writes[entry.first];
+            bool layout_change = is_image && state.layout != info.layout;
+
+            /* Nothing to wait for only when no write or transition has happened. A transition
+             * leaves its stages as the source scope, so readers in other stages still wait on it. */
+            if (!is_write && !layout_change) {
+                bool is_visible = state.writeStage == VK_PIPELINE_STAGE_2_NONE ||
+                                  ((state.visibleStages & info.stages) == info.stages && (state.visibleAccess & info.access) == info.access);
+
+                if (!is_visible) {
+                    compiled.barriers.push_back({entry.first, state.writeStage, state.writeAccess, info.stages, info.access, state.layout, state.layout});
+                    state.visibleStages |= info.stages;
+                    state.visibleAccess |= info.access;
+                }
+
+                state.readStages |= info.stages;
+                continue;
+            }
+
+            compiled.barriers.push_back({entry.first, state.writeStage | state.readStages, state.writeAccess,
+                                         info.stages, info.access, state.layout, is_image ? info.layout : state.layout});
+
+            if (is_write) {
+                state.writeStage = info.stages;
+                state.writeAccess = info.access & WRITE_ACCESS_MASK;
+                state.readStages = VK_PIPELINE_STAGE_2_NONE;
+                state.visibleStages = VK_PIPELINE_STAGE_2_NONE;
+                state.visibleAccess = VK_ACCESS_2_NONE;
+
+            } else {
+                /* A layout transition is a write made visible to its own destination scope. It has
+                 * no access of its own left to make available, later readers chain on its stages. */
+                state.writeStage = info.stages;
+                state.writeAccess = VK_ACCESS_2_NONE;
+                state.readStages = info.stages;
+                state.visibleStages = info.stages;
+                state.visibleAccess = info.access;
+            }
+
+            if (is_image) {
+                state.layout = info.layout;
+            }
+        }
+
+        m_stats.barrierCount += static_cast<uint32_t>(compiled.barriers.size());
+        m_schedule.push_back(compiled);
+    }
+
+    m_finalBarriers.clear();
+
+    for (Resource index = 0; index < m_resources.size(); index++) {
+        const auto& resource = m_resources.at(index);
+        const auto& state = states.at(index);
+
+        if (!resource.isImported || !resource.isImage || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || resource.finalLayout == state.layout) {
+            continue;
+        }
+
+        bool is_present = resource.finalLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        m_finalBarriers.push_back({index, state.writeStage | state.readStages, state.writeAccess,
+                                   is_present ? VK_PIPELINE_STAGE_2_NONE : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                                   is_present ? VK_ACCESS_2_NONE : VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT,
+                                   state.layout, resource.finalLayout});
+    }
+
+    m_stats.barrierCount += static_cast<uint32_t>(m_finalBarriers.size());
+}
+
+void vtrs::RenderGraph::retireTransients_() {
+    if (m_transients.empty() && m_slots.empty()) {
+        return;
+    }
+
+    m_retired.push_back({m_framesInFlight, m_transients, m_slots});
+    m_transients.clear();
+    m_slots.clear();
+}
+
+void vtrs::RenderGraph::collectRetired_(bool force) {
+    for (auto& retired : m_retired) {
+        if (retired.framesLeft > 0) {
+            retired.framesLeft--;
+        }
+
+        if (retired.framesLeft > 0 && !force) {
+            continue;
+        }
+
+        for (auto& transient : retired.images) {
+            if (transient.view != VK_NULL_HANDLE) vkDestroyImageView(m_logicalDevice, transient.view, nullptr);
+            if (transient.image != VK_NULL_HANDLE) vkDestroyImage(m_logicalDevice, transient.image, nullptr);
+        }
+
+        for (auto& slot : retired.slots) {
+            m_deviceAllocator->free(slot);
+        }
+
+        retired.images.clear();
+        retired.slots.clear();
+    }
+
+    m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(), [](const retired_objects& retired) {
+        return retired.images.empty() && retired.slots.empty();
+    }), m_retired.end());
+}
+
+vtrs::RenderGraph::RenderGraph(VkDevice logical_device, vtrs::DeviceAllocator* allocator, vtrs::render_graph_opts* options) :
+        m_logicalDevice(logical_device),
+        m_deviceAllocator(allocator),
+        m_framesInFlight(std::max<uint32_t>(options->framesInFlight, 1)) {
+}
+
+vtrs::RenderGraph* vtrs::RenderGraph::factory(VkDevice logical_device, vtrs::DeviceAllocator* allocator, vtrs::RenderGraph::Options* options) {
+    return new RenderGraph(logical_device, allocator, options);
+}
+
+vtrs::RenderGraph::~RenderGraph() {
+    retireTransients_();
+    collectRetired_(true);
+}
+
+void vtrs::RenderGraph::reset() {
+    m_passes.clear();
+    m_resources.clear();
+}
+
+vtrs::RenderGraph::Resource vtrs::RenderGraph::importImage(
+        const std::string& name, VkImage image, VkImageView view, const vtrs::RenderGraph::ImageDesc& desc,
+        VkImageLayout initial_layout, VkImageLayout final_layout, VkPipelineStageFlags2 initial_stage) {
+
+    graph_resource resource {name, true, true, desc, image, view, VK_NULL_HANDLE, 0, initial_layout, final_layout, initial_stage, UINT32_MAX};
+    resource.desc.usage = 0;
+
+    m_resources.push_back(resource);
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+
+vtrs::RenderGraph::Resource vtrs::RenderGraph::importBuffer(const std::string& name, VkBuffer buffer, VkDeviceSize size) {
+    graph_resource resource {name, false, true, {}, VK_NULL_HANDLE, VK_NULL_HANDLE, buffer, size,
+                             VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE, UINT32_MAX};
+
+    m_resources.push_back(resource);
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+
+vtrs::RenderGraph::Resource vtrs::RenderGraph::createImage(const std::string& name, const vtrs::RenderGraph::ImageDesc& desc) {
+    uint32_t transient = 0;
+
+    for (const auto& resource : m_resources) {
+        transient += resource.isImported ? 0 : 1;
+    }
+
+    graph_resource resource {name, true, false, desc, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, 0,
+                             VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_2_NONE, transient};
+
+    m_resources.push_back(resource);
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+
+vtrs::RenderGraph::PassBuilder vtrs::RenderGraph::addPass(const std::string& name, std::function<void(VkCommandBuffer)> execute) {
+    m_passes.push_back({name, std::move(execute), {}, false});
+    return {this, static_cast<uint32_t>(m_passes.size() - 1)};
+}
+
+void vtrs::RenderGraph::compile() {
+    collectRetired_(false);
+
+    uint64_t hash = topologyHash_();
+
+    if (m_isCompiled && hash == m_compiledHash) {
+        m_stats.reuseCount++;
+        return;
+    }
+
+    retireTransients_();
+
+    auto live = findLivePasses_();
+    std::vector<uint32_t> schedule {};
+
+    for (uint32_t index = 0; index < m_passes.size(); index++) {
+        if (live.at(index)) {
+            schedule.push_back(index);
+        }
+    }
+
+    allocateTransients_(schedule);
+    placeBarriers_(schedule);
+
+    m_compiledHash = hash;
+    m_isCompiled = true;
+
+    m_stats.passCount = static_cast<uint32_t>(schedule.size());
+    m_stats.culledCount = static_cast<uint32_t>(m_passes.size() - schedule.size());
+    m_stats.compileCount++;
+}
+
+void vtrs::RenderGraph::execute(VkCommandBuffer command_buffer) {
+    std::vector<VkImageMemoryBarrier2> image_barriers {};
+    std::vector<VkBufferMemoryBarrier2> buffer_barriers {};
+
+    auto emit = [&](const std::vector<compiled_barrier>& barriers) {
+        image_barriers.clear();
+        buffer_barriers.clear();
+
+        for (const auto& barrier : barriers) {
+            const auto& resource = m_resources.at(barrier.resource);
+
+            if (resource.isImage) {
+                VkImageMemoryBarrier2 image_barrier {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+                image_barrier.srcStageMask = barrier.srcStage;
+                image_barrier.srcAccessMask = barrier.srcAccess;
+                image_barrier.dstStageMask = barrier.dstStage;
+                image_barrier.dstAccessMask = barrier.dstAccess;
+                image_barrier.oldLayout = barrier.oldLayout;
+                image_barrier.newLayout = barrier.newLayout;
+                image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                image_barrier.image = getImage(barrier.resource);
+                image_barrier.subresourceRange = {aspectOf_(resource.desc.format), 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+
+                image_barriers.push_back(image_barrier);
+
+            } else {
+                VkBufferMemoryBarrier2 buffer_barrier {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2};
+                buffer_barrier.srcStageMask = barrier.srcStage;
+                buffer_barrier.srcAccessMask = barrier.srcAccess;
+                buffer_barrier.dstStageMask = barrier.dstStage;
+                buffer_barrier.dstAccessMask = barrier.dstAccess;
+                buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                buffer_barrier.buffer = resource.buffer;
+                buffer_barrier.offset = 0;
+                buffer_barrier.size = VK_WHOLE_SIZE;
+
+                buffer_barriers.push_back(buffer_barrier);
+            }
+        }
+
+        if (image_barriers.empty() && buffer_barriers.empty()) {
+            return;
+        }
+
+        VkDependencyInfo dependency_info {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+        dependency_info.imageMemoryBarrierCount = static_cast<uint32_t>(image_barriers.size());
+        dependency_info.pImageMemoryBarriers = image_barriers.data();
+        dependency_info.bufferMemoryBarrierCount = static_cast<uint32_t>(buffer_barriers.size());
+        dependency_info.pBufferMemoryBarriers = buffer_barriers.data();
+
+        vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+    };
+
+    for (const auto& compiled : m_schedule) {
+        emit(compiled.barriers);
+
+        const auto& pass = m_passes.at(compiled.pass);
+
+        if (pass.execute) {
+            pass.execute(command_buffer);
+        }
+    }
+
+    emit(m_finalBarriers);
+}
+
+VkImage vtrs::RenderGraph::getImage(Resource resource) const {
+    const auto& entry = m_resources.at(resource);
+    return entry.isImported ? entry.image : m_transients.at(entry.transient).image;
+}
+
+VkImageView vtrs::RenderGraph::getImageView(Resource resource) const {
+    const auto& entry = m_resources.at(resource);
+    return entry.isImported ? entry.view : m_transients.at(entry.transient).view;
+}
+
+VkBuffer vtrs::RenderGraph::getBuffer(Resource resource) const {
+    return m_resources.at(resource).buffer;
+}
+
+vtrs::RenderGraph::Stats vtrs::RenderGraph::getStats() const {
+    return m_stats;
+}
@@ -0,0 +1,349 @@
+/**
+ * render_graph.hpp - Frame graph with automatic barriers and transient aliasing.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "vulkan_api.hpp"
+#include "device_allocator.hpp"
+
+namespace vtrs {
+
+struct render_graph_opts {
+    uint32_t framesInFlight = 2;
+};
+
+struct render_graph_image_desc {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent {};
+    VkImageUsageFlags usage = 0;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+};
+
+struct render_graph_stats {
+    uint32_t passCount = 0;
+    uint32_t culledCount = 0;
+    uint32_t barrierCount = 0;
+    uint32_t transientCount = 0;
+    VkDeviceSize transientBytes = 0;
+    VkDeviceSize aliasedBytes = 0;
+    uint32_t compileCount = 0;
+    uint32_t reuseCount = 0;
+};
+
+/**
+ * @brief Schedules passes and places the barriers between them.
+ *
+ * Every frame the passes and resources are declared again, each pass
+ * stating what it reads and writes. Compiling the graph culls passes whose
+ * output nobody consumes, works out the layout transitions and memory
+ * dependencies between the rest, and emits them as one batched
+ * vkCmdPipelineBarrier2 call in front of each pass.
+ *
+ * Transient images live only inside the graph. Transients whose lifetimes
+ * do not overlap share the same device memory.
+ *
+ * The compiled schedule is cached and reused for as long as the declared
+ * topology is unchanged. Imported handles, such as the swapchain image,
+ * may change from frame to frame without forcing a recompile.
+ */
+class RenderGraph {
+
+public:
+    typedef uint32_t Resource;
+    typedef struct render_graph_opts Options;
+    typedef struct render_graph_image_desc ImageDesc;
+    typedef struct render_graph_stats Stats;
+
+    enum AccessType : int {
+        ACCESS_COLOR_ATTACHMENT = 0,
+        ACCESS_DEPTH_ATTACHMENT,
+        ACCESS_DEPTH_READ,
+        ACCESS_SAMPLED,
+        ACCESS_STORAGE_READ,
+        ACCESS_STORAGE_WRITE,
+        ACCESS_TRANSFER_SRC,
+        ACCESS_TRANSFER_DST,
+        ACCESS_VERTEX_BUFFER,
+        ACCESS_INDEX_BUFFER,
+        ACCESS_UNIFORM_BUFFER,
+        ACCESS_INDIRECT_BUFFER
+    };
+
+    /**
+     * @brief Declares the resource accesses of a pass.
+     */
+    class PassBuilder {
+        friend class RenderGraph;
+
+    private:
+        RenderGraph* m_graph;
+        uint32_t m_pass;
+
+        PassBuilder(RenderGraph* graph, uint32_t pass);
+
+    public:
+        /**
+         * @brief Declares a read of a resource.
+         * @param resource Resource handle.
+         * @param access How the resource is read.
+         * @param stages Shader stages for shader accesses, or 0 for the default.
+         */
+        PassBuilder& read(Resource resource, AccessType access, VkPipelineStageFlags2 stages = 0);
+
+        /**
+         * @brief Declares a write of a resource.
+         * @param resource Resource handle.
+         * @param access How the resource is written.
+         * @param stages Shader stages for shader accesses, or 0 for the default.
+         */
+        PassBuilder& write(Resource resource, AccessType access, VkPipelineStageFlags2 stages = 0);
+
+        /**
+         * @brief Keeps the pass even if none of its outputs is consumed.
+         */
+        PassBuilder& setSideEffect();
+    };
+
+private:
+    struct graph_access {
+        Resource resource;
+        AccessType type;
+        VkPipelineStageFlags2 stages;
+        bool isWrite;
+    };
+
+    struct graph_pass {
+        std::string name;
+        std::function<void(VkCommandBuffer)> execute;
+        std::vector<graph_access> accesses;
+        bool hasSideEffect;
+    };
+
+    struct graph_resource {
+        std::string name;
+        bool isImage;
+        bool isImported;
+        ImageDesc desc;
+        VkImage image;
+        VkImageView view;
+        VkBuffer buffer;
+        VkDeviceSize size;
+        VkImageLayout initialLayout;
+        VkImageLayout finalLayout;
+        VkPipelineStageFlags2 initialStage;
+        uint32_t transient;
+    };
+
+    struct compiled_barrier {
+        Resource resource;
+        VkPipelineStageFlags2 srcStage;
+        VkAccessFlags2 srcAccess;
+        VkPipelineStageFlags2 dstStage;
+        VkAccessFlags2 dstAccess;
+        VkImageLayout oldLayout;
+        VkImageLayout newLayout;
+    };
+
+    struct compiled_pass {
+        uint32_t pass;
+        std::vector<compiled_barrier> barriers;
+    };
+
+    struct transient_image {
+        VkImage image;
+        VkImageView view;
+        uint32_t slot;
+    };
+
+    struct retired_objects {
+        /* Counted down by compile() calls, which happen once per frame, not by recompiles. */
+        uint32_t framesLeft;
+        std::vector<transient_image> images;
+        std::vector<vtrs::DeviceAllocator::Allocation> slots;
+    };
+
+    VkDevice                m_logicalDevice = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator*  m_deviceAllocator = nullptr;
+    uint32_t                m_framesInFlight = 2;
+
+    std::vector<graph_pass> m_passes {};
+    std::vector<graph_resource> m_resources {};
+
+    uint64_t m_compiledHash = 0;
+    bool     m_isCompiled = false;
+
+    std::vector<compiled_pass> m_schedule {};
+    std::vector<compiled_barrier> m_finalBarriers {};
+    std::vector<transient_image> m_transients {};
+    std::vector<vtrs::DeviceAllocator::Allocation> m_slots {};
+    std::vector<retired_objects> m_retired {};
+
+    struct render_graph_stats m_stats {};
+
+    /**
+     * @brief Hashes everything that shapes the compiled schedule.
+     */
+    [[nodiscard]] uint64_t topologyHash_() const;
+
+    /**
+     * @brief Marks the passes that contribute to an imported resource or have side effects.
+     */
+    [[nodiscard]] std::vector<bool> findLivePasses_() const;
+
+    /**
+     * @brief Creates transient images and packs them into shared memory slots.
+     * @param schedule Indices of live passes in execution order.
+     */
+    void allocateTransients_(const std::vector<uint32_t>& schedule);
+
+    /**
+     * @brief Computes the barriers in front of every live pass.
+     * @param schedule Indices of live passes in execution order.
+     */
+    void placeBarriers_(const std::vector<uint32_t>& schedule);
+
+    /**
+     * @brief Moves the physical transients to the retire list.
+     */
+    void retireTransients_();
+
+    /**
+     * @brief Destroys retired transients that no frame in flight can use anymore.
+     * @param force Destroys every retired transient regardless of its frame count.
+     *
+     * Each call counts as one frame, since compile() runs once per frame.
+     */
+    void collectRetired_(bool force);
+
+    /**
+     * @brief Adds an access to a pass.
+     */
+    void addAccess_(uint32_t pass, Resource resource, AccessType access, VkPipelineStageFlags2 stages, bool is_write);
+
+    /**
+     * @brief Initialises member variables.
+     * @param logicalDevice Vulkan logical device handle.
+     * @param allocator Device allocator backing transient images.
+     * @param options Render graph configuration.
+     */
+    RenderGraph(VkDevice, vtrs::DeviceAllocator*, struct render_graph_opts*);
+
+public:
+    /**
+     * @brief Creates and returns a new instance.
+     * @param logical_device    Vulkan logical device handle.
+     * @param allocator         Device allocator backing transient images.
+     * @param options           Render graph configuration.
+     * @return Instance of the render graph.
+     */
+    static RenderGraph* factory(VkDevice, vtrs::DeviceAllocator*, RenderGraph::Options*);
+
+    /**
+     * @brief Destroys transient images and their memory.
+     *
+     * The device must be idle, or at least done with the graph's work.
+     */
+    ~RenderGraph();
+
+    /**
+     * @brief Forgets the passes and resources declared for the previous frame.
+     */
+    void reset();
+
+    /**
+     * @brief Imports an image owned outside the graph.
+     * @param name Debug name.
+     * @param image Image handle.
+     * @param view Image view handle.
+     * @param desc Image description; usage is ignored.
+     * @param initial_layout Layout the image is in when the graph starts.
+     * @param final_layout Layout to leave the image in, or undefined to leave it as is.
+     * @param initial_stage Stage that last touched the image before the graph.
+     * @return Resource handle.
+     */
+    Resource importImage(const std::string& name, VkImage image, VkImageView view, const ImageDesc& desc,
+                         VkImageLayout initial_layout, VkImageLayout final_layout,
+                         VkPipelineStageFlags2 initial_stage = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+
+    /**
+     * @brief Imports a buffer owned outside the graph.
+     * @param name Debug name.
+     * @param buffer Buffer handle.
+     * @param size Size of the buffer.
+     * @return Resource handle.
+     */
+    Resource importBuffer(const std::string& name, VkBuffer buffer, VkDeviceSize size);
+
+    /**
+     * @brief Declares an image that only lives while the graph executes.
+     * @param name Debug name.
+     * @param desc Image description; usage flags implied by the accesses are added.
+     * @return Resource handle.
+     */
+    Resource createImage(const std::string& name, const ImageDesc& desc);
+
+    /**
+     * @brief Adds a pass to the graph.
+     * @param name Pass name.
+     * @param execute Records the pass; called with the graph's command buffer.
+     * @return Builder for the accesses of the pass.
+     */
+    PassBuilder addPass(const std::string& name, std::function<void(VkCommandBuffer)> execute);
+
+    /**
+     * @brief Compiles the declared graph, or reuses the previous compilation.
+     * @throws vtrs::RendererError Thrown if transients cannot be created.
+     *
+     * Must be called once per frame, after the frame's fence has signalled.
+     */
+    void compile();
+
+    /**
+     * @brief Records every live pass with its barriers.
+     * @param command_buffer Command buffer in the recording state.
+     */
+    void execute(VkCommandBuffer command_buffer);
+
+    /**
+     * @brief Returns the image behind a resource.
+     */
+    [[nodiscard]] VkImage getImage(Resource resource) const;
+
+    /**
+     * @brief Returns the image view behind a resource.
+     */
+    [[nodiscard]] VkImageView getImageView(Resource resource) const;
+
+    /**
+     * @brief Returns the buffer behind a resource.
+     */
+    [[nodiscard]] VkBuffer getBuffer(Resource resource) const;
+
+    /**
+     * @brief Returns statistics of the last compilation.
+     */
+    [[nodiscard]] Stats getStats() const;
+};
+
+} // namespace vtrs
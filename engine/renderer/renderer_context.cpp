@@ -19,6 +19,7 @@
  * ========================================================================
  */
 
+#include <cstring>
 #include "renderer_context.hpp"
 #include "assert.hpp"
 
@@ -70,6 +71,21 @@ void vtrs::RendererContext::initialise() {
 #endif
     };
 
+    uint32_t available_count = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &available_count, nullptr);
+
+    std::vector<VkExtensionProperties> available(available_count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &available_count, available.data());
+
+    /* Headless surfaces let the renderer present with no display server. */
+    for (auto& properties : available) {
+        if (strcmp(properties.extensionName, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME) == 0) {
+            extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+            s_isHeadlessSurfaceSupported = true;
+            break;
+        }
+    }
+
     initVulkan_(extensions);
     s_isInitialised = true;
 
@@ -87,6 +103,8 @@ void vtrs::RendererContext::destroy() {
 
     s_gpuList.clear();
     vkDestroyInstance(s_instance, nullptr);
+
+    s_isHeadlessSurfaceSupported = false;
 }
 
 std::vector<vtrs::RendererGPU*> vtrs::RendererContext::getGPUList() {
@@ -108,3 +126,7 @@ VkInstance vtrs::RendererContext::getInstanceHandle() {
 
     return s_instance;
 }
+
+bool vtrs::RendererContext::isHeadlessSurfaceSupported() {
+    return s_isHeadlessSurfaceSupported;
+}
\ No newline at end of file
@@ -38,6 +38,7 @@ class RendererContext {
 
 private:
     static inline bool s_isInitialised = false;
+    static inline bool s_isHeadlessSurfaceSupported = false;
     static inline VkInstance s_instance {};
     static inline std::map<uint32_t, RendererGPU*> s_gpuList {};
 
@@ -84,6 +85,12 @@ public:
      * @return Vulkan instance handle.
      */
     static VkInstance getInstanceHandle();
+
+    /**
+     * @brief Tells whether VK_EXT_headless_surface was enabled on the instance.
+     * @return True if headless surfaces can be created.
+     */
+    static bool isHeadlessSurfaceSupported();
 };
 
 } // namespace vtrs
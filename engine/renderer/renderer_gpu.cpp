@@ -19,6 +19,7 @@
  * ========================================================================
  */
 #include <cstdlib>
+#include <cstring>
 #include "platform/logger.hpp"
 #include "renderer_gpu.hpp"
 #include "assert.hpp"
@@ -29,6 +30,25 @@ uint32_t vtrs::RendererGPU::recordCapabilities_() {
     vkGetPhysicalDeviceProperties(m_device, m_properties);
     vkGetPhysicalDeviceFeatures(m_device, m_features);
 
+    if (m_properties->apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceFeatures2 features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+        features.pNext = &m_vulkan12Features;
+
+        if (m_properties->apiVersion >= VK_API_VERSION_1_3) {
+            m_vulkan12Features.pNext = &m_vulkan13Features;
+        }
+
+        vkGetPhysicalDeviceFeatures2(m_device, &features);
+
+        VkPhysicalDeviceProperties2 properties {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+        properties.pNext = &m_indexingProperties;
+
+        vkGetPhysicalDeviceProperties2(m_device, &properties);
+
+        m_vulkan12Features.pNext = nullptr;
+        m_indexingProperties.pNext = nullptr;
+    }
+
     switch (m_properties->deviceType) {
         case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
             score = score + 1000;
@@ -71,6 +91,11 @@ void vtrs::RendererGPU::mapQueueFamilies_() {
         if (family.queueFlags & VK_QUEUE_TRANSFER_BIT)
             m_qFamilyIndices.insert(std::make_pair(RendererGPU::QUEUE_FAMILY_INDEX_TRANSFER, family_index));
 
+        /* A transfer-only family usually maps to a dedicated copy engine,
+         * so it is preferred over the first transfer capable family. */
+        if ((family.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            m_qFamilyIndices[RendererGPU::QUEUE_FAMILY_INDEX_TRANSFER] = family_index;
+
         if (family.queueFlags & VK_QUEUE_SPARSE_BINDING_BIT)
             m_qFamilyIndices.insert(std::make_pair(RendererGPU::QUEUE_FAMILY_INDEX_SPARSE_B, family_index));
 
@@ -89,6 +114,55 @@ void vtrs::RendererGPU::queryDeviceExtensions_() {
 
     m_deviceExtensions.resize(extension_count);
     vkEnumerateDeviceExtensionProperties(m_device, nullptr, &extension_count, m_deviceExtensions.data());
+
+    int present_extensions = 0;
+    bool has_min_lod = false;
+
+    for (auto& extension : m_deviceExtensions) {
+        if (strcmp(extension.extensionName, VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0 ||
+            strcmp(extension.extensionName, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0) {
+            present_extensions++;
+        }
+
+        if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+            m_isMemoryBudgetSupported = true;
+        }
+
+        if (strcmp(extension.extensionName, VK_EXT_IMAGE_VIEW_MIN_LOD_EXTENSION_NAME) == 0) {
+            has_min_lod = true;
+        }
+    }
+
+    if (m_properties->apiVersion < VK_API_VERSION_1_2) {
+        return;
+    }
+
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR};
+    VkPhysicalDevicePresentIdFeaturesKHR present_id {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR};
+    present_id.pNext = &present_wait;
+
+    VkPhysicalDeviceImageViewMinLodFeaturesEXT min_lod {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_VIEW_MIN_LOD_FEATURES_EXT};
+
+    VkPhysicalDeviceFeatures2 features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    features.pNext = nullptr;
+
+    /* Feature structures of extensions the device lacks must not be chained. */
+    if (present_extensions >= 2) {
+        features.pNext = &present_id;
+    }
+
+    if (has_min_lod) {
+        min_lod.pNext = features.pNext;
+        features.pNext = &min_lod;
+    }
+
+    if (features.pNext == nullptr) {
+        return;
+    }
+
+    vkGetPhysicalDeviceFeatures2(m_device, &features);
+    m_isPresentWaitSupported = present_extensions >= 2 && present_id.presentId && present_wait.presentWait;
+    m_isMinLodSupported = has_min_lod && min_lod.minLod;
 }
 
 
@@ -152,6 +226,42 @@ uint32_t vtrs::RendererGPU::getScore() const {
     return m_score;
 }
 
+const VkPhysicalDeviceVulkan12Features& vtrs::RendererGPU::getVulkan12Features() const {
+    return m_vulkan12Features;
+}
+
+uint32_t vtrs::RendererGPU::getApiVersion() const {
+    return m_properties->apiVersion;
+}
+
+const VkPhysicalDeviceVulkan13Features& vtrs::RendererGPU::getVulkan13Features() const {
+    return m_vulkan13Features;
+}
+
+const VkPhysicalDeviceDescriptorIndexingProperties& vtrs::RendererGPU::getDescriptorIndexingProperties() const {
+    return m_indexingProperties;
+}
+
+bool vtrs::RendererGPU::isBindlessSupported() const {
+    const auto& features = m_vulkan12Features;
+
+    return features.descriptorIndexing && features.runtimeDescriptorArray && features.descriptorBindingPartiallyBound &&
+           features.descriptorBindingSampledImageUpdateAfterBind && features.descriptorBindingStorageBufferUpdateAfterBind &&
+           features.descriptorBindingUpdateUnusedWhilePending && features.shaderSampledImageArrayNonUniformIndexing;
+}
+
+bool vtrs::RendererGPU::isPresentWaitSupported() const {
+    return m_isPresentWaitSupported;
+}
+
+bool vtrs::RendererGPU::isMemoryBudgetSupported() const {
+    return m_isMemoryBudgetSupported;
+}
+
+bool vtrs::RendererGPU::isMinLodSupported() const {
+    return m_isMinLodSupported;
+}
+
 uint32_t vtrs::RendererGPU::getQueueFamilyCount() const {
     return m_qFamilyCount;
 }
@@ -49,6 +49,13 @@ private:
 
     VkPhysicalDeviceProperties* m_properties;
     VkPhysicalDeviceFeatures* m_features;
+
+    VkPhysicalDeviceVulkan12Features m_vulkan12Features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    VkPhysicalDeviceVulkan13Features m_vulkan13Features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+    VkPhysicalDeviceDescriptorIndexingProperties m_indexingProperties {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES};
+    bool m_isPresentWaitSupported = false;
+    bool m_isMemoryBudgetSupported = false;
+    bool m_isMinLodSupported = false;
     uint32_t m_qFamilyCount = 0;
     std::map<int, uint32_t> m_qFamilyIndices;
     std::vector<VkExtensionProperties> m_deviceExtensions;
@@ -58,6 +65,8 @@ private:
      * @return A GPU score based on the capabilities.
      *
      * This method will query the device properties and features.
+     * Vulkan 1.2 and 1.3 features and the descriptor indexing limits
+     * are queried as well when the device supports those versions.
      * A score is calculated and returned based on the above parameters.
      */
     uint32_t recordCapabilities_();
@@ -71,6 +80,9 @@ private:
 
     /**
      * @brief Populates the GPU extension properties.
+     *
+     * The present id and present wait features are queried here, as
+     * their structures may only be chained once the extensions are known.
      */
     void queryDeviceExtensions_();
 
@@ -145,6 +157,48 @@ public:
      */
     std::vector<const char*> getExtensionNames();
 
+    /**
+     * @brief Returns the highest Vulkan version the GPU supports.
+     */
+    [[nodiscard]] uint32_t getApiVersion() const;
+
+    /**
+     * @brief Returns the Vulkan 1.2 features, all false on older devices.
+     */
+    [[nodiscard]] const VkPhysicalDeviceVulkan12Features& getVulkan12Features() const;
+
+    /**
+     * @brief Returns the Vulkan 1.3 features, all false on older devices.
+     */
+    [[nodiscard]] const VkPhysicalDeviceVulkan13Features& getVulkan13Features() const;
+
+    /**
+     * @brief Returns the update-after-bind descriptor limits.
+     */
+    [[nodiscard]] const VkPhysicalDeviceDescriptorIndexingProperties& getDescriptorIndexingProperties() const;
+
+    /**
+     * @brief Tells whether the GPU can use one global update-after-bind descriptor set.
+     * @return True if runtime arrays of partially bound sampled images,
+     *         samplers and storage buffers can be updated after bind.
+     */
+    [[nodiscard]] bool isBindlessSupported() const;
+
+    /**
+     * @brief Tells whether VK_KHR_present_id and VK_KHR_present_wait can be enabled.
+     */
+    [[nodiscard]] bool isPresentWaitSupported() const;
+
+    /**
+     * @brief Tells whether VK_EXT_memory_budget can be enabled.
+     */
+    [[nodiscard]] bool isMemoryBudgetSupported() const;
+
+    /**
+     * @brief Tells whether VK_EXT_image_view_min_lod and its minLod feature can be enabled.
+     */
+    [[nodiscard]] bool isMinLodSupported() const;
+
     template<typename T> T getGPULimit(const std::string& name) {
         if (name == "maxSamplerAnisotropy") {
             return m_properties->limits.maxSamplerAnisotropy;
@@ -20,13 +20,16 @@
  */
 
 #include <set>
+#include <algorithm>
 #include <cstring>
 #include "except.hpp"
 #include "assert.hpp"
+#include "renderer_context.hpp"
 #include "service_provider.hpp"
 
 void vtrs::ServiceProvider::bootstrap_(vtrs::service_provider_opts* options) {
     float queue_priority = 1.0f;
+    m_framesInFlight = std::max<uint32_t>(options->framesInFlight, 1);
 
     std::vector<VkDeviceQueueCreateInfo> queue_info {};
 
@@ -39,12 +42,93 @@ void vtrs::ServiceProvider::bootstrap_(vtrs::service_provider_opts* options) {
         queue_info.push_back(info);
     }
 
+    VkPhysicalDeviceFeatures supported_features {};
+    vkGetPhysicalDeviceFeatures(m_rendererGPU->getDeviceHandle(), &supported_features);
+
     VkPhysicalDeviceFeatures gpu_features {};
     gpu_features.samplerAnisotropy = options->enableAnisotropy;
 
+    /* Block compressed formats are sampled whenever the GPU has them, see vtrs::Ktx2Texture. */
+    gpu_features.textureCompressionBC = supported_features.textureCompressionBC;
+
+    if (options->enablePipelineStatistics == VK_TRUE) {
+        gpu_features.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+        gpu_features.inheritedQueries = supported_features.inheritedQueries;
+
+        /* The query stays active around secondary command buffers, which is only valid with inherited queries. */
+        m_isStatisticsEnabled = supported_features.pipelineStatisticsQuery == VK_TRUE && supported_features.inheritedQueries == VK_TRUE;
+    }
+
+    VkPhysicalDeviceVulkan12Features vulkan12_features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    vulkan12_features.timelineSemaphore = VK_TRUE;
+
+    VkPhysicalDeviceVulkan13Features vulkan13_features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+    vulkan13_features.synchronization2 = m_rendererGPU->getVulkan13Features().synchronization2;
+    vulkan13_features.dynamicRendering = m_rendererGPU->getVulkan13Features().dynamicRendering;
+    m_isSynchronization2Enabled = vulkan13_features.synchronization2 == VK_TRUE;
+
+    if (options->enableBindless) {
+        if (!m_rendererGPU->isBindlessSupported()) {
+            throw vtrs::RendererError("The GPU does not support bindless descriptors.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+        }
+
+        vulkan12_features.descriptorIndexing = VK_TRUE;
+        vulkan12_features.runtimeDescriptorArray = VK_TRUE;
+        vulkan12_features.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan12_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        vulkan12_features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        vulkan12_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+        vulkan12_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        vulkan12_features.shaderStorageBufferArrayNonUniformIndexing = m_rendererGPU->getVulkan12Features().shaderStorageBufferArrayNonUniformIndexing;
+        m_isBindlessEnabled = true;
+    }
+
     std::vector<const char*> req_extensions {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR};
+    VkPhysicalDevicePresentIdFeaturesKHR present_id_features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR};
+
+    /* Lets surface presenters measure and cap the number of queued presents. */
+    if (m_rendererGPU->isPresentWaitSupported()) {
+        req_extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        req_extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+
+        present_id_features.presentId = VK_TRUE;
+        present_wait_features.presentWait = VK_TRUE;
+        present_id_features.pNext = &present_wait_features;
+        vulkan13_features.pNext = &present_id_features;
+
+        m_isPresentWaitEnabled = true;
+    }
+
+    /* Lets texture caches size themselves against what the driver can keep resident. */
+    if (m_rendererGPU->isMemoryBudgetSupported()) {
+        req_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        m_isMemoryBudgetEnabled = true;
+    }
+
+    VkPhysicalDeviceImageViewMinLodFeaturesEXT min_lod_features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_VIEW_MIN_LOD_FEATURES_EXT};
+
+    /* Lets streamed textures be sampled while their finer levels are still uploading. */
+    if (m_rendererGPU->isMinLodSupported()) {
+        req_extensions.push_back(VK_EXT_IMAGE_VIEW_MIN_LOD_EXTENSION_NAME);
+
+        min_lod_features.minLod = VK_TRUE;
+        min_lod_features.pNext = vulkan13_features.pNext;
+        vulkan13_features.pNext = &min_lod_features;
+
+        m_isMinLodEnabled = true;
+    }
+
+    /* Extension features hang off the Vulkan 1.3 features, which only a 1.3 device may be given. */
+    vulkan12_features.pNext = vulkan13_features.pNext;
+
+    if (m_rendererGPU->getApiVersion() >= VK_API_VERSION_1_3) {
+        vulkan12_features.pNext = &vulkan13_features;
+    }
+
     VkDeviceCreateInfo device_info {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
+    device_info.pNext = &vulkan12_features;
     device_info.pQueueCreateInfos = queue_info.data();
     device_info.queueCreateInfoCount = queue_info.size();
     device_info.ppEnabledExtensionNames = req_extensions.data();
@@ -53,6 +137,9 @@ void vtrs::ServiceProvider::bootstrap_(vtrs::service_provider_opts* options) {
 
     auto result = vkCreateDevice(m_rendererGPU->getDeviceHandle(), &device_info, nullptr, &m_logicalDevice);
     VTRS_ASSERT_VK_RESULT(result, "Could not bootstrap service provider.")
+
+    m_deviceAllocator = vtrs::DeviceAllocator::factory(m_rendererGPU->getDeviceHandle(), m_logicalDevice, &(options->allocatorOptions));
+    m_pipelineCache = vtrs::PipelineCache::factory(m_rendererGPU->getDeviceHandle(), m_logicalDevice, &(options->pipelineCacheOptions));
 }
 
 vtrs::ServiceProvider::ServiceProvider(RendererGPU* renderer_gpu) : m_rendererGPU(renderer_gpu) {
@@ -60,6 +147,8 @@ vtrs::ServiceProvider::ServiceProvider(RendererGPU* renderer_gpu) : m_rendererGP
 }
 
 vtrs::ServiceProvider::~ServiceProvider() {
+    delete m_pipelineCache;
+    delete m_deviceAllocator;
     vkDestroyDevice(m_logicalDevice, nullptr);
 }
 
@@ -70,7 +159,7 @@ vtrs::ServiceProvider *vtrs::ServiceProvider::from(vtrs::RendererGPU* hardware,
     return provider;
 }
 
-vtrs::SurfacePresenter* vtrs::ServiceProvider::createSurfacePresenter(vtrs::WindowSurface* surface) {
+vtrs::SurfacePresenter* vtrs::ServiceProvider::createSurfacePresenter(vtrs::WindowSurface* surface, vtrs::SurfacePresenter::Options* options) {
     /* Checking if required extensions for swapchain are supported by the GPU. */
     int extension_flag = 0;
     std::vector<const char*> extension_names = m_rendererGPU->getExtensionNames();
@@ -88,9 +177,153 @@ vtrs::SurfacePresenter* vtrs::ServiceProvider::createSurfacePresenter(vtrs::Wind
         throw vtrs::RendererError("GPU does not provide presentation support.", vtrs::RendererError::E_TYPE_GENERAL);
     }
 
-    vtrs::SurfacePresenter::Options options {};
-    options.graphicsQueueFamily = m_rendererGPU->getQueueFamilyIndex(vtrs::RendererGPU::QUEUE_FAMILY_INDEX_GRAPHICS);
-    options.surfaceQueueFamily = m_rendererGPU->getQueueFamilyIndex(surface->getSurfaceHandle());
+    vtrs::SurfacePresenter::Options presenter_options {};
+    presenter_options.framesInFlight = m_framesInFlight;
+
+    if (options != nullptr) {
+        presenter_options = *options;
+    }
+
+    presenter_options.graphicsQueueFamily = m_rendererGPU->getQueueFamilyIndex(vtrs::RendererGPU::QUEUE_FAMILY_INDEX_GRAPHICS);
+    presenter_options.surfaceQueueFamily = m_rendererGPU->getQueueFamilyIndex(surface->getSurfaceHandle());
+    presenter_options.enablePresentWait = m_isPresentWaitEnabled;
+
+    return vtrs::SurfacePresenter::factory(m_rendererGPU->getDeviceHandle(), m_logicalDevice, surface, &presenter_options);
+}
+
+vtrs::Presenter* vtrs::ServiceProvider::createHeadlessPresenter(vtrs::HeadlessPresenter::Options* options) {
+    vtrs::HeadlessPresenter::Options headless_options = options != nullptr ? *options : vtrs::HeadlessPresenter::Options {};
+    headless_options.queueFamily = m_rendererGPU->getQueueFamilyIndex(vtrs::RendererGPU::QUEUE_FAMILY_INDEX_GRAPHICS);
+
+    bool has_swapchain = false;
+    std::vector<const char*> extension_names = m_rendererGPU->getExtensionNames();
+
+    for(auto& name : extension_names) {
+        if (strcmp(name, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) {
+            has_swapchain = true;
+            break;
+        }
+    }
+
+    if (!has_swapchain || !vtrs::RendererContext::isHeadlessSurfaceSupported()) {
+        return vtrs::HeadlessPresenter::factory(m_logicalDevice, m_deviceAllocator, &headless_options);
+    }
+
+    VkInstance instance = vtrs::RendererContext::getInstanceHandle();
+    auto create_surface = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+            vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT"));
+
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    VkHeadlessSurfaceCreateInfoEXT surface_info {VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT};
+
+    if (create_surface == nullptr || create_surface(instance, &surface_info, nullptr, &surface) != VK_SUCCESS) {
+        return vtrs::HeadlessPresenter::factory(m_logicalDevice, m_deviceAllocator, &headless_options);
+    }
+
+    VkBool32 is_supported = VK_FALSE;
+    vkGetPhysicalDeviceSurfaceSupportKHR(m_rendererGPU->getDeviceHandle(), headless_options.queueFamily, surface, &is_supported);
+
+    if (is_supported != VK_TRUE) {
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+        return vtrs::HeadlessPresenter::factory(m_logicalDevice, m_deviceAllocator, &headless_options);
+    }
+
+    vtrs::SurfacePresenter::Options surface_options {};
+    surface_options.graphicsQueueFamily = headless_options.queueFamily;
+    surface_options.surfaceQueueFamily = headless_options.queueFamily;
+    surface_options.fallbackExtent = headless_options.extent;
+    surface_options.preferredFormat = headless_options.format;
+    surface_options.imageCount = headless_options.imageCount;
+    surface_options.framesInFlight = m_framesInFlight;
+    surface_options.ownsSurface = true;
+
+    /* Frames are read back by copying the acquired image before it is presented. */
+    surface_options.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+    try {
+        return vtrs::SurfacePresenter::factory(m_rendererGPU->getDeviceHandle(), m_logicalDevice, surface, &surface_options);
+
+    } catch (vtrs::RendererError&) {
+        /* The presenter destroys the surface it owns when bootstrapping fails. */
+        return vtrs::HeadlessPresenter::factory(m_logicalDevice, m_deviceAllocator, &headless_options);
+    }
+}
+
+vtrs::FrameAllocator* vtrs::ServiceProvider::createFrameAllocator(vtrs::FrameAllocator::Options* options) {
+    return vtrs::FrameAllocator::factory(m_rendererGPU->getDeviceHandle(), m_logicalDevice, m_deviceAllocator, options);
+}
+
+vtrs::UploadQueue* vtrs::ServiceProvider::createUploadQueue(VkDeviceSize staging_capacity) {
+    vtrs::UploadQueue::Options options {};
+    options.transferFamily = m_rendererGPU->getQueueFamilyIndex(vtrs::RendererGPU::QUEUE_FAMILY_INDEX_TRANSFER);
+    options.graphicsFamily = m_rendererGPU->getQueueFamilyIndex(vtrs::RendererGPU::QUEUE_FAMILY_INDEX_GRAPHICS);
+    options.stagingCapacity = staging_capacity;
+
+    return vtrs::UploadQueue::factory(m_rendererGPU->getDeviceHandle(), m_logicalDevice, m_deviceAllocator, &options);
+}
+
+vtrs::RenderGraph* vtrs::ServiceProvider::createRenderGraph(vtrs::RenderGraph::Options* options) {
+    if (!m_isSynchronization2Enabled) {
+        throw vtrs::RendererError("The GPU does not support synchronization2, which the render graph records barriers with.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+    }
+
+    return vtrs::RenderGraph::factory(m_logicalDevice, m_deviceAllocator, options);
+}
+
+vtrs::CommandRecorder* vtrs::ServiceProvider::createCommandRecorder(vtrs::ThreadPool* thread_pool, uint32_t frames_in_flight) {
+    vtrs::CommandRecorder::Options options {};
+    options.queueFamily = m_rendererGPU->getQueueFamilyIndex(vtrs::RendererGPU::QUEUE_FAMILY_INDEX_GRAPHICS);
+    options.framesInFlight = frames_in_flight > 0 ? frames_in_flight : m_framesInFlight;
+
+    return vtrs::CommandRecorder::factory(m_logicalDevice, thread_pool, &options);
+}
+
+vtrs::DescriptorAllocator* vtrs::ServiceProvider::createDescriptorAllocator(vtrs::DescriptorAllocator::Options* options) {
+    return vtrs::DescriptorAllocator::factory(m_logicalDevice, options);
+}
+
+vtrs::BindlessRegistry* vtrs::ServiceProvider::createBindlessRegistry(vtrs::BindlessRegistry::Options* options) {
+    if (!m_isBindlessEnabled) {
+        throw vtrs::RendererError("Bindless descriptors were not enabled on the service provider.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    return vtrs::BindlessRegistry::factory(m_rendererGPU, m_logicalDevice, options);
+}
+
+vtrs::GpuProfiler* vtrs::ServiceProvider::createGpuProfiler(vtrs::GpuProfiler::Options* options) {
+    vtrs::GpuProfiler::Options profiler_options = options != nullptr ? *options : vtrs::GpuProfiler::Options {};
+    profiler_options.queueFamily = m_rendererGPU->getQueueFamilyIndex(vtrs::RendererGPU::QUEUE_FAMILY_INDEX_GRAPHICS);
+    profiler_options.enableStatistics = profiler_options.enableStatistics && m_isStatisticsEnabled;
+
+    if (options == nullptr) {
+        profiler_options.framesInFlight = m_framesInFlight;
+    }
+
+    return vtrs::GpuProfiler::factory(m_rendererGPU->getDeviceHandle(), m_logicalDevice, &profiler_options);
+}
+
+vtrs::TextureStreamer* vtrs::ServiceProvider::createTextureStreamer(vtrs::UploadQueue* upload_queue, vtrs::TextureStreamer::Options* options) {
+    vtrs::TextureStreamer::Options streamer_options = options != nullptr ? *options : vtrs::TextureStreamer::Options {};
+    streamer_options.useMinLod = m_isMinLodEnabled;
+
+    return vtrs::TextureStreamer::factory(m_rendererGPU->getDeviceHandle(), m_logicalDevice, m_deviceAllocator, upload_queue, &streamer_options);
+}
+
+vtrs::TextureCache* vtrs::ServiceProvider::createTextureCache(vtrs::TextureStreamer* streamer, vtrs::TextureCache::Options* options) {
+    vtrs::TextureCache::Options cache_options = options != nullptr ? *options : vtrs::TextureCache::Options {};
+    cache_options.useMemoryBudget = m_isMemoryBudgetEnabled;
+
+    return vtrs::TextureCache::factory(m_rendererGPU->getDeviceHandle(), m_logicalDevice, streamer, &cache_options);
+}
+
+uint32_t vtrs::ServiceProvider::getFramesInFlight() const {
+    return m_framesInFlight;
+}
+
+vtrs::DeviceAllocator* vtrs::ServiceProvider::getDeviceAllocator() const {
+    return m_deviceAllocator;
+}
 
-    return vtrs::SurfacePresenter::factory(m_rendererGPU->getDeviceHandle(), m_logicalDevice, surface, &options);
+vtrs::PipelineCache* vtrs::ServiceProvider::getPipelineCache() const {
+    return m_pipelineCache;
 }
@@ -25,12 +25,34 @@
 #include "vulkan_api.hpp"
 #include "renderer_gpu.hpp"
 #include "surface_presenter.hpp"
+#include "headless_presenter.hpp"
+#include "device_allocator.hpp"
+#include "frame_allocator.hpp"
+#include "upload_queue.hpp"
+#include "pipeline_cache.hpp"
+#include "render_graph.hpp"
+#include "command_recorder.hpp"
+#include "descriptor_allocator.hpp"
+#include "bindless_registry.hpp"
+#include "gpu_profiler.hpp"
+#include "texture_cache.hpp"
 
 namespace vtrs {
 
 struct service_provider_opts {
     std::set<uint32_t> queueFamilyIndices {};
     VkBool32 enableAnisotropy = VK_TRUE;
+
+    /* Default number of frames recorded ahead, used by presenters and recorders created without one. */
+    uint32_t framesInFlight = 2;
+
+    /* Enables the descriptor indexing features needed by vtrs::BindlessRegistry. */
+    VkBool32 enableBindless = VK_FALSE;
+
+    /* Enables pipeline statistics and inherited queries for vtrs::GpuProfiler when the GPU supports them. */
+    VkBool32 enablePipelineStatistics = VK_FALSE;
+    vtrs::DeviceAllocator::Options allocatorOptions {};
+    vtrs::PipelineCache::Options pipelineCacheOptions {};
 };
 
 class ServiceProvider {
@@ -39,12 +61,31 @@ private:
     VkDevice            m_logicalDevice = VK_NULL_HANDLE;
     vtrs::RendererGPU*  m_rendererGPU = nullptr;
 
+    vtrs::DeviceAllocator* m_deviceAllocator = nullptr;
+    vtrs::PipelineCache* m_pipelineCache = nullptr;
+    bool m_isBindlessEnabled = false;
+    bool m_isSynchronization2Enabled = false;
+    bool m_isPresentWaitEnabled = false;
+    bool m_isStatisticsEnabled = false;
+    bool m_isMemoryBudgetEnabled = false;
+    bool m_isMinLodEnabled = false;
+    uint32_t m_framesInFlight = 2;
+
     /**
      * @brief Bootstraps the service provider.
      * @param options Service provider configuration.
      *
      * The boostrap method will:
-     * - Create a Vulkan logical device.
+     * - Create a Vulkan logical device with timeline semaphores enabled.
+     * - Enable synchronization2 when the GPU supports it.
+     * - Enable dynamic rendering when the GPU supports it.
+     * - Enable present id and present wait when the GPU supports them.
+     * - Enable descriptor indexing when bindless descriptors are requested.
+     * - Enable pipeline statistics queries when requested and supported.
+     * - Enable BC texture compression when supported.
+     * - Enable the memory budget extension when supported.
+     * - Create the device memory allocator.
+     * - Load the persistent pipeline cache.
      */
     void bootstrap_(struct service_provider_opts* options);
 
@@ -70,7 +111,130 @@ public:
      */
     static ServiceProvider* from(RendererGPU*, ServiceProvider::Options*);
 
-    SurfacePresenter* createSurfacePresenter(vtrs::WindowSurface* surface);
+    /**
+     * @brief Creates a swapchain presenter on a window surface.
+     * @param surface Window surface to present to.
+     * @param options Pacing configuration, or nullptr for the defaults.
+     * @return Instance of the surface presenter.
+     *
+     * Queue families and present wait support are filled in by the provider.
+     * Without options, the provider's frames in flight is used.
+     */
+    SurfacePresenter* createSurfacePresenter(vtrs::WindowSurface* surface, vtrs::SurfacePresenter::Options* options = nullptr);
+
+    /**
+     * @brief Creates a presenter that needs no window or display server.
+     * @param options Extent, format and image count of the presenter, or nullptr for the defaults.
+     * @return Instance of the presenter.
+     *
+     * A swapchain on a VK_EXT_headless_surface is used when the instance
+     * and GPU support it, and a vtrs::HeadlessPresenter image ring otherwise.
+     * The queue family is always the graphics family, and the frames in
+     * flight are the provider's. Swapchain images can be copied from, but
+     * go back to the presentation engine once presented, so a frame is
+     * read back by copying getImage before presenting it. Only the image
+     * ring keeps presented frames for getLastPresented.
+     */
+    Presenter* createHeadlessPresenter(vtrs::HeadlessPresenter::Options* options = nullptr);
+
+    /**
+     * @brief Creates a transient per-frame allocator backed by the device allocator.
+     * @param options Frame allocator configuration.
+     * @return Instance of the frame allocator.
+     */
+    FrameAllocator* createFrameAllocator(vtrs::FrameAllocator::Options* options);
+
+    /**
+     * @brief Creates an upload queue on the transfer queue family.
+     * @param staging_capacity Size of the staging ring in bytes.
+     * @return Instance of the upload queue.
+     *
+     * Both the transfer and graphics queue families must be listed in
+     * the queue family indices the provider was created with.
+     */
+    UploadQueue* createUploadQueue(VkDeviceSize staging_capacity = 32 * 1024 * 1024);
+
+    /**
+     * @brief Creates a render graph whose transient images live in the device allocator.
+     * @param options Render graph configuration.
+     * @return Instance of the render graph.
+     * @throws vtrs::RendererError Thrown if synchronization2 is not enabled.
+     */
+    RenderGraph* createRenderGraph(vtrs::RenderGraph::Options* options);
+
+    /**
+     * @brief Creates a command recorder on the graphics queue family.
+     * @param thread_pool Worker threads used for recording.
+     * @param frames_in_flight Number of frames whose pools are kept apart, zero for the provider's default.
+     * @return Instance of the command recorder.
+     */
+    CommandRecorder* createCommandRecorder(vtrs::ThreadPool* thread_pool, uint32_t frames_in_flight = 0);
+
+    /**
+     * @brief Creates a descriptor allocator on the logical device.
+     * @param options Descriptor allocator configuration.
+     * @return Instance of the descriptor allocator.
+     */
+    DescriptorAllocator* createDescriptorAllocator(vtrs::DescriptorAllocator::Options* options);
+
+    /**
+     * @brief Creates the global bindless descriptor set.
+     * @param options Bindless registry configuration.
+     * @return Instance of the bindless registry.
+     * @throws vtrs::RendererError Thrown if the provider was created without enableBindless.
+     */
+    BindlessRegistry* createBindlessRegistry(vtrs::BindlessRegistry::Options* options);
+
+    /**
+     * @brief Creates a GPU profiler for the graphics queue family.
+     * @param options Profiler configuration, nullptr for the defaults.
+     * @return Instance of the GPU profiler.
+     *
+     * Statistics are left out unless the provider was created with
+     * enablePipelineStatistics on a GPU that supports them.
+     */
+    GpuProfiler* createGpuProfiler(vtrs::GpuProfiler::Options* options = nullptr);
+
+    /**
+     * @brief Creates a texture streamer backed by the provider's device allocator.
+     * @param upload_queue Queue the texel uploads are recorded into.
+     * @param options Streamer configuration, or nullptr for the defaults.
+     * @return Instance of the texture streamer.
+     *
+     * Views of partly uploaded textures are clamped with minLod whenever
+     * the provider could enable VK_EXT_image_view_min_lod.
+     */
+    TextureStreamer* createTextureStreamer(vtrs::UploadQueue* upload_queue, vtrs::TextureStreamer::Options* options = nullptr);
+
+    /**
+     * @brief Creates a texture cache on top of a texture streamer.
+     * @param streamer Streamer that loads the textures.
+     * @param options Cache configuration, nullptr for the defaults.
+     * @return Instance of the texture cache.
+     *
+     * Device heaps are kept within VK_EXT_memory_budget whenever the
+     * provider could enable it.
+     */
+    TextureCache* createTextureCache(vtrs::TextureStreamer* streamer, vtrs::TextureCache::Options* options = nullptr);
+
+    /**
+     * @brief Returns the default number of frames in flight.
+     */
+    [[nodiscard]] uint32_t getFramesInFlight() const;
+
+    /**
+     * @brief Returns the device memory allocator owned by this provider.
+     * @return The device allocator instance.
+     */
+    [[nodiscard]] DeviceAllocator* getDeviceAllocator() const;
+
+    /**
+     * @brief Returns the persistent pipeline cache owned by this provider.
+     * @return The pipeline cache instance.
+     *
+     * The cache is written back to disk when the provider is deleted.
+     */
+    [[nodiscard]] PipelineCache* getPipelineCache() const;
 };
 
 } // namespace vtrs
\ No newline at end of file
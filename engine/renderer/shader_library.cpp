@@ -0,0 +1,830 @@
+/**
+ * shader_library.cpp - SPIR-V loading, reflection and layout deduplication.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include "platform/mapped_file.hpp"
+#include "platform/except.hpp"
+#include "assert.hpp"
+#include "shader_library.hpp"
+
+#define VTRS_SPIRV_MAGIC 0x07230203U
+#define VTRS_SPIRV_HEADER_WORDS 5
+#define VTRS_SPIRV_MAX_MEMBERS 16383U
+
+#define VTRS_SHADER_BUNDLE_MAGIC 0x42485356U
+#define VTRS_SHADER_BUNDLE_VERSION 1U
+
+namespace {
+
+/* Opcodes, decorations and storage classes from the SPIR-V specification
+ * that take part in reflection. */
+enum SpvOp : uint32_t {
+    OP_ENTRY_POINT = 15,
+    OP_TYPE_INT = 21,
+    OP_TYPE_FLOAT = 22,
+    OP_TYPE_VECTOR = 23,
+    OP_TYPE_MATRIX = 24,
+    OP_TYPE_IMAGE = 25,
+    OP_TYPE_SAMPLER = 26,
+    OP_TYPE_SAMPLED_IMAGE = 27,
+    OP_TYPE_ARRAY = 28,
+    OP_TYPE_RUNTIME_ARRAY = 29,
+    OP_TYPE_STRUCT = 30,
+    OP_TYPE_POINTER = 32,
+    OP_CONSTANT = 43,
+    OP_VARIABLE = 59,
+    OP_DECORATE = 71,
+    OP_MEMBER_DECORATE = 72
+};
+
+enum SpvDecoration : uint32_t {
+    DECORATION_BUFFER_BLOCK = 3,
+    DECORATION_ARRAY_STRIDE = 6,
+    DECORATION_MATRIX_STRIDE = 7,
+    DECORATION_BUILT_IN = 11,
+    DECORATION_LOCATION = 30,
+    DECORATION_BINDING = 33,
+    DECORATION_DESCRIPTOR_SET = 34,
+    DECORATION_OFFSET = 35
+};
+
+enum SpvStorageClass : uint32_t {
+    STORAGE_UNIFORM_CONSTANT = 0,
+    STORAGE_INPUT = 1,
+    STORAGE_UNIFORM = 2,
+    STORAGE_PUSH_CONSTANT = 9,
+    STORAGE_STORAGE_BUFFER = 12
+};
+
+enum SpvDim : uint32_t {
+    DIM_BUFFER = 5,
+    DIM_SUBPASS_DATA = 6
+};
+
+struct spirv_type {
+    uint32_t opcode = 0;
+    uint32_t element = 0;
+    uint32_t count = 0;
+    uint32_t width = 0;
+    uint32_t signedness = 0;
+    uint32_t dim = 0;
+    uint32_t sampled = 0;
+    std::vector<uint32_t> members {};
+};
+
+struct spirv_decoration {
+    uint32_t set = 0;
+    uint32_t binding = 0;
+    uint32_t location = 0;
+    uint32_t arrayStride = 0;
+    bool hasBinding = false;
+    bool hasLocation = false;
+    bool isBuiltIn = false;
+    bool isBufferBlock = false;
+};
+
+struct spirv_member_decoration {
+    uint32_t offset = 0;
+    uint32_t matrixStride = 0;
+};
+
+struct spirv_variable {
+    uint32_t type;
+    uint32_t id;
+    uint32_t storageClass;
+};
+
+struct spirv_module {
+    std::unordered_map<uint32_t, spirv_type> types {};
+    std::unordered_map<uint32_t, uint32_t> constants {};
+    std::unordered_map<uint32_t, spirv_decoration> decorations {};
+    std::unordered_map<uint32_t, std::vector<spirv_member_decoration>> members {};
+    std::vector<spirv_variable> variables {};
+};
+
+uint32_t typeSize_(const spirv_module& spirv, uint32_t type_id, uint32_t matrix_stride) {
+    auto found = spirv.types.find(type_id);
+
+    if (found == spirv.types.end()) {
+        return 0;
+    }
+
+    const auto& type = found->second;
+
+    switch (type.opcode) {
+        case OP_TYPE_INT:
+        case OP_TYPE_FLOAT:
+            return type.width / 8;
+
+        case OP_TYPE_VECTOR:
+            return type.count * typeSize_(spirv, type.element, 0);
+
+        case OP_TYPE_MATRIX:
+            return type.count * (matrix_stride > 0 ? matrix_stride : typeSize_(spirv, type.element, 0));
+
+        case OP_TYPE_ARRAY: {
+            auto length = spirv.constants.find(type.count);
+            auto decoration = spirv.decorations.find(type_id);
+
+            uint32_t stride = decoration != spirv.decorations.end() ? decoration->second.arrayStride : 0;
+            stride = stride > 0 ? stride : typeSize_(spirv, type.element, matrix_stride);
+
+            return length != spirv.constants.end() ? length->second * stride : 0;
+        }
+
+        case OP_TYPE_STRUCT: {
+            uint32_t size = 0;
+            auto decorations = spirv.members.find(type_id);
+
+            for (size_t index = 0; index < type.members.size(); index++) {
+                spirv_member_decoration member {};
+
+                if (decorations != spirv.members.end() && index < decorations->second.size()) {
+                    member = decorations->second.at(index);
+                }
+
+                size = std::max(size, member.offset + typeSize_(spirv, type.members.at(index), member.matrixStride));
+            }
+
+            return size;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+VkFormat vertexFormat_(const spirv_module& spirv, uint32_t type_id, const std::string& name) {
+    auto found = spirv.types.find(type_id);
+
+    if (found == spirv.types.end()) {
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    uint32_t count = 1;
+    const spirv_type* scalar = &found->second;
+
+    if (scalar->opcode == OP_TYPE_VECTOR) {
+        auto element = spirv.types.find(scalar->element);
+
+        if (element == spirv.types.end()) {
+            throw vtrs::RendererError("Shader " + name + " has a vector of an undeclared type.", vtrs::RendererError::E_TYPE_GENERAL);
+        }
+
+        count = scalar->count;
+        scalar = &element->second;
+    }
+
+    if (scalar->width != 32 || count < 1 || count > 4) {
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    static const VkFormat float_formats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    static const VkFormat sint_formats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+    static const VkFormat uint_formats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+    if (scalar->opcode == OP_TYPE_FLOAT) {
+        return float_formats[count - 1];
+    }
+
+    if (scalar->opcode == OP_TYPE_INT) {
+        return scalar->signedness ? sint_formats[count - 1] : uint_formats[count - 1];
+    }
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+/* Operand words each reflected opcode reads, result id included. */
+uint32_t operandCount_(uint32_t opcode) {
+    switch (opcode) {
+        case OP_TYPE_SAMPLER:
+        case OP_TYPE_STRUCT: return 1;
+        case OP_TYPE_FLOAT:
+        case OP_TYPE_RUNTIME_ARRAY:
+        case OP_TYPE_SAMPLED_IMAGE:
+        case OP_DECORATE: return 2;
+        case OP_TYPE_INT:
+        case OP_TYPE_VECTOR:
+        case OP_TYPE_MATRIX:
+        case OP_TYPE_ARRAY:
+        case OP_TYPE_POINTER:
+        case OP_CONSTANT:
+        case OP_VARIABLE:
+        case OP_MEMBER_DECORATE: return 3;
+        case OP_TYPE_IMAGE: return 7;
+        default: return 0;
+    }
+}
+
+uint64_t hashCombine_(uint64_t seed, uint64_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+} // namespace
+
+void vtrs::ShaderLibrary::validate_(const std::string& name, const void* data, size_t size) {
+    if (size < VTRS_SPIRV_HEADER_WORDS * sizeof(uint32_t) || size % sizeof(uint32_t) != 0) {
+        throw vtrs::RendererError("Shader " + name + " is not a whole number of SPIR-V words.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    if (reinterpret_cast<uintptr_t>(data) % alignof(uint32_t) != 0) {
+        throw vtrs::RendererError("Shader " + name + " is not aligned to a word boundary.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    uint32_t magic = *static_cast<const uint32_t*>(data);
+
+    if (magic != VTRS_SPIRV_MAGIC) {
+        throw vtrs::RendererError("Shader " + name + " does not start with the SPIR-V magic number.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+}
+
+void vtrs::ShaderLibrary::reflect_(const uint32_t* words, size_t word_count, vtrs::shader_module* module) {
+    spirv_module spirv {};
+    bool has_entry_point = false;
+
+    for (size_t position = VTRS_SPIRV_HEADER_WORDS; position < word_count;) {
+        uint32_t opcode = words[position] & 0xFFFFU;
+        uint32_t length = words[position] >> 16U;
+
+        if (length == 0 || position + length > word_count) {
+            throw vtrs::RendererError("Shader " + module->name + " has a malformed instruction.", vtrs::RendererError::E_TYPE_GENERAL);
+        }
+
+        if (length - 1 < operandCount_(opcode)) {
+            throw vtrs::RendererError("Shader " + module->name + " has an instruction with missing operands.", vtrs::RendererError::E_TYPE_GENERAL);
+        }
+
+        const uint32_t* operands = words + position + 1;
+
+        switch (opcode) {
+            case OP_ENTRY_POINT:
+                /* Only the first entry point is reflected. */
+                if (!has_entry_point && length >= 4) {
+                    static const VkShaderStageFlagBits stages[] = {
+                        VK_SHADER_STAGE_VERTEX_BIT,
+                        VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+                        VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT,
+                        VK_SHADER_STAGE_GEOMETRY_BIT,
+                        VK_SHADER_STAGE_FRAGMENT_BIT,
+                        VK_SHADER_STAGE_COMPUTE_BIT
+                    };
+
+                    if (operands[0] >= sizeof(stages) / sizeof(stages[0])) {
+                        throw vtrs::RendererError("Shader " + module->name + " has an unsupported execution model.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+                    }
+
+                    module->stage = stages[operands[0]];
+                    module->entryPoint = std::string(reinterpret_cast<const char*>(operands + 2),
+                                                     strnlen(reinterpret_cast<const char*>(operands + 2), (length - 3) * sizeof(uint32_t)));
+                    has_entry_point = true;
+                }
+                break;
+
+            case OP_TYPE_INT:
+                spirv.types[operands[0]].opcode = opcode;
+                spirv.types[operands[0]].width = operands[1];
+                spirv.types[operands[0]].signedness = operands[2];
+                break;
+
+            case OP_TYPE_FLOAT:
+                spirv.types[operands[0]].opcode = opcode;
+                spirv.types[operands[0]].width = operands[1];
+                break;
+
+            case OP_TYPE_VECTOR:
+            case OP_TYPE_MATRIX:
+            case OP_TYPE_ARRAY:
+                spirv.types[operands[0]].opcode = opcode;
+                spirv.types[operands[0]].element = operands[1];
+                spirv.types[operands[0]].count = operands[2];
+                break;
+
+            case OP_TYPE_RUNTIME_ARRAY:
+            case OP_TYPE_SAMPLED_IMAGE:
+                spirv.types[operands[0]].opcode = opcode;
+                spirv.types[operands[0]].element = operands[1];
+                break;
+
+            case OP_TYPE_IMAGE:
+                spirv.types[operands[0]].opcode = opcode;
+                spirv.types[operands[0]].dim = operands[2];
+                spirv.types[operands[0]].sampled = operands[6];
+                break;
+
+            case OP_TYPE_SAMPLER:
+                spirv.types[operands[0]].opcode = opcode;
+                break;
+
+            case OP_TYPE_STRUCT:
+                spirv.types[operands[0]].opcode = opcode;
+                spirv.types[operands[0]].members.assign(operands + 1, operands + length - 1);
+                break;
+
+            case OP_TYPE_POINTER:
+                spirv.types[operands[0]].opcode = opcode;
+                spirv.types[operands[0]].element = operands[2];
+                break;
+
+            case OP_CONSTANT:
+                spirv.constants[operands[1]] = operands[2];
+                break;
+
+            case OP_VARIABLE:
+                spirv.variables.push_back({operands[0], operands[1], operands[2]});
+                break;
+
+            case OP_DECORATE: {
+                auto& decoration = spirv.decorations[operands[0]];
+                uint32_t value = length > 3 ? operands[2] : 0;
+
+                switch (operands[1]) {
+                    case DECORATION_ARRAY_STRIDE:
+                    case DECORATION_LOCATION:
+                    case DECORATION_BINDING:
+                    case DECORATION_DESCRIPTOR_SET:
+                        if (length < 4) {
+                            throw vtrs::RendererError("Shader " + module->name + " has a decoration without its value.", vtrs::RendererError::E_TYPE_GENERAL);
+                        }
+                        break;
+
+                    default: break;
+                }
+
+                switch (operands[1]) {
+                    case DECORATION_BUFFER_BLOCK: decoration.isBufferBlock = true; break;
+                    case DECORATION_ARRAY_STRIDE: decoration.arrayStride = value; break;
+                    case DECORATION_BUILT_IN: decoration.isBuiltIn = true; break;
+                    case DECORATION_LOCATION: decoration.location = value; decoration.hasLocation = true; break;
+                    case DECORATION_BINDING: decoration.binding = value; decoration.hasBinding = true; break;
+                    case DECORATION_DESCRIPTOR_SET: decoration.set = value; break;
+                    default: break;
+                }
+                break;
+            }
+
+            case OP_MEMBER_DECORATE: {
+                auto& members = spirv.members[operands[0]];
+
+                /* SPIR-V caps a struct at 16383 members. */
+                if (operands[1] >= VTRS_SPIRV_MAX_MEMBERS) {
+                    throw vtrs::RendererError("Shader " + module->name + " decorates a member out of range.", vtrs::RendererError::E_TYPE_GENERAL);
+                }
+
+                if ((operands[2] == DECORATION_OFFSET || operands[2] == DECORATION_MATRIX_STRIDE) && length < 5) {
+                    throw vtrs::RendererError("Shader " + module->name + " has a decoration without its value.", vtrs::RendererError::E_TYPE_GENERAL);
+                }
+
+                if (members.size() <= operands[1]) {
+                    members.resize(operands[1] + 1);
+                }
+
+                if (operands[2] == DECORATION_OFFSET) members.at(operands[1]).offset = operands[3];
+                if (operands[2] == DECORATION_MATRIX_STRIDE) members.at(operands[1]).matrixStride = operands[3];
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        position += length;
+    }
+
+    if (!has_entry_point) {
+        throw vtrs::RendererError("Shader " + module->name + " has no entry point.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    for (const auto& variable : spirv.variables) {
+        auto pointer = spirv.types.find(variable.type);
+
+        if (pointer == spirv.types.end()) {
+            continue;
+        }
+
+        uint32_t pointee_id = pointer->second.element;
+        const auto& decoration = spirv.decorations[variable.id];
+
+        if (variable.storageClass == STORAGE_PUSH_CONSTANT) {
+            uint32_t begin = UINT32_MAX;
+            uint32_t end = 0;
+
+            auto members = spirv.members.find(pointee_id);
+            const auto& block = spirv.types[pointee_id];
+
+            for (size_t index = 0; index < block.members.size(); index++) {
+                spirv_member_decoration member {};
+
+                if (members != spirv.members.end() && index < members->second.size()) {
+                    member = members->second.at(index);
+                }
+
+                begin = std::min(begin, member.offset);
+                end = std::max(end, member.offset + typeSize_(spirv, block.members.at(index), member.matrixStride));
+            }
+
+            if (end > begin) {
+                module->pushConstants.push_back({static_cast<VkShaderStageFlags>(module->stage), begin, end - begin});
+            }
+
+            continue;
+        }
+
+        if (variable.storageClass == STORAGE_INPUT) {
+            if (module->stage == VK_SHADER_STAGE_VERTEX_BIT && decoration.hasLocation && !decoration.isBuiltIn) {
+                module->vertexInputs.push_back({decoration.location, vertexFormat_(spirv, pointee_id, module->name)});
+            }
+
+            continue;
+        }
+
+        if (!decoration.hasBinding) {
+            continue;
+        }
+
+        vtrs::shader_binding binding {};
+        binding.set = decoration.set;
+        binding.binding = decoration.binding;
+        binding.stages = module->stage;
+
+        /* Peel arrays off to find the descriptor type and count. */
+        const spirv_type* type = &spirv.types[pointee_id];
+        uint32_t type_id = pointee_id;
+
+        while (type->opcode == OP_TYPE_ARRAY || type->opcode == OP_TYPE_RUNTIME_ARRAY) {
+            if (type->opcode == OP_TYPE_RUNTIME_ARRAY) {
+                binding.count = 0;
+            } else {
+                auto length = spirv.constants.find(type->count);
+                binding.count *= length != spirv.constants.end() ? length->second : 1;
+            }
+
+            type_id = type->element;
+            type = &spirv.types[type_id];
+        }
+
+        switch (variable.storageClass) {
+            case STORAGE_UNIFORM:
+                binding.type = spirv.decorations[type_id].isBufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                break;
+
+            case STORAGE_STORAGE_BUFFER:
+                binding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                break;
+
+            case STORAGE_UNIFORM_CONSTANT:
+                if (type->opcode == OP_TYPE_SAMPLED_IMAGE) {
+                    binding.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+                } else if (type->opcode == OP_TYPE_SAMPLER) {
+                    binding.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+
+                } else if (type->opcode == OP_TYPE_IMAGE && type->dim == DIM_BUFFER) {
+                    binding.type = type->sampled == 1 ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+
+                } else if (type->opcode == OP_TYPE_IMAGE && type->dim == DIM_SUBPASS_DATA) {
+                    binding.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+
+                } else if (type->opcode == OP_TYPE_IMAGE) {
+                    binding.type = type->sampled == 1 ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+                } else {
+                    continue;
+                }
+                break;
+
+            default:
+                continue;
+        }
+
+        module->bindings.push_back(binding);
+    }
+
+    std::sort(module->bindings.begin(), module->bindings.end(), [](const vtrs::shader_binding& left, const vtrs::shader_binding& right) {
+        return left.set != right.set ? left.set < right.set : left.binding < right.binding;
+    });
+
+    std::sort(module->vertexInputs.begin(), module->vertexInputs.end(), [](const vtrs::shader_vertex_input& left, const vtrs::shader_vertex_input& right) {
+        return left.location < right.location;
+    });
+}
+
+const vtrs::shader_module* vtrs::ShaderLibrary::create_(const std::string& name, const void* data, size_t size) {
+    validate_(name, data, size);
+
+    auto module = new vtrs::shader_module();
+    module->name = name;
+
+    try {
+        reflect_(static_cast<const uint32_t*>(data), size / sizeof(uint32_t), module);
+
+    } catch (vtrs::RendererError&) {
+        delete module;
+        throw;
+    }
+
+    /* The driver reads the words straight out of the mapping. */
+    VkShaderModuleCreateInfo module_info {VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+    module_info.codeSize = size;
+    module_info.pCode = static_cast<const uint32_t*>(data);
+
+    auto result = vkCreateShaderModule(m_logicalDevice, &module_info, nullptr, &(module->module));
+
+    if (result != VK_SUCCESS) {
+        delete module;
+        VTRS_ASSERT_VK_RESULT(result, "Unable to create shader module " + name)
+    }
+
+    m_modules[name] = module;
+    return module;
+}
+
+vtrs::ShaderLibrary::ShaderLibrary(VkDevice logical_device) : m_logicalDevice(logical_device) {
+
+}
+
+vtrs::ShaderLibrary* vtrs::ShaderLibrary::factory(VkDevice logical_device) {
+    return new ShaderLibrary(logical_device);
+}
+
+vtrs::ShaderLibrary::~ShaderLibrary() {
+    for (auto& bucket : m_pipelineLayouts) {
+        for (auto& cached : bucket.second) {
+            vkDestroyPipelineLayout(m_logicalDevice, cached.layout, nullptr);
+        }
+    }
+
+    for (auto& bucket : m_setLayouts) {
+        for (auto& cached : bucket.second) {
+            vkDestroyDescriptorSetLayout(m_logicalDevice, cached.layout, nullptr);
+        }
+    }
+
+    for (auto& entry : m_modules) {
+        vkDestroyShaderModule(m_logicalDevice, entry.second->module, nullptr);
+        delete entry.second;
+    }
+}
+
+const vtrs::ShaderLibrary::Module* vtrs::ShaderLibrary::load(const std::string& path) {
+    auto found = m_modules.find(path);
+
+    if (found != m_modules.end()) {
+        return found->second;
+    }
+
+    std::unique_ptr<vtrs::MappedFile> file;
+
+    try {
+        file.reset(vtrs::MappedFile::factory(path));
+
+    } catch (vtrs::PlatformError& error) {
+        throw vtrs::RendererError(error.what(), vtrs::RendererError::E_TYPE_GENERAL, error.getCode());
+    }
+
+    return create_(path, file->getData(), file->getSize());
+}
+
+void vtrs::ShaderLibrary::loadBundle(const std::string& path) {
+    struct bundle_header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t reserved;
+    };
+
+    struct bundle_entry {
+        char     name[56];
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    std::unique_ptr<vtrs::MappedFile> file;
+
+    try {
+        file.reset(vtrs::MappedFile::factory(path));
+
+    } catch (vtrs::PlatformError& error) {
+        throw vtrs::RendererError(error.what(), vtrs::RendererError::E_TYPE_GENERAL, error.getCode());
+    }
+
+    auto bytes = static_cast<const char*>(file->getData());
+    size_t size = file->getSize();
+
+    bundle_header header {};
+
+    if (size < sizeof(header)) {
+        throw vtrs::RendererError("Shader bundle " + path + " is truncated.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    std::memcpy(&header, bytes, sizeof(header));
+
+    if (header.magic != VTRS_SHADER_BUNDLE_MAGIC || header.version != VTRS_SHADER_BUNDLE_VERSION) {
+        throw vtrs::RendererError("Shader bundle " + path + " has an unknown format.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    if (sizeof(header) + static_cast<size_t>(header.entryCount) * sizeof(bundle_entry) > size) {
+        throw vtrs::RendererError("Shader bundle " + path + " is truncated.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    for (uint32_t index = 0; index < header.entryCount; index++) {
+        bundle_entry entry {};
+        std::memcpy(&entry, bytes + sizeof(header) + index * sizeof(bundle_entry), sizeof(entry));
+
+        std::string name(entry.name, strnlen(entry.name, sizeof(entry.name)));
+
+        if (static_cast<size_t>(entry.offset) + entry.size > size) {
+            throw vtrs::RendererError("Shader bundle entry " + name + " lies outside the bundle.", vtrs::RendererError::E_TYPE_GENERAL);
+        }
+
+        if (m_modules.count(name) == 0) {
+            create_(name, bytes + entry.offset, entry.size);
+        }
+    }
+}
+
+const vtrs::ShaderLibrary::Module* vtrs::ShaderLibrary::get(const std::string& name) const {
+    auto found = m_modules.find(name);
+
+    if (found == m_modules.end()) {
+        throw vtrs::RendererError("Shader " + name + " has not been loaded.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    return found->second;
+}
+
+VkDescriptorSetLayout vtrs::ShaderLibrary::getSetLayout(
+        const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+        const std::vector<VkDescriptorBindingFlags>& flags,
+        VkDescriptorSetLayoutCreateFlags create_flags) {
+
+    uint64_t hash = hashCombine_(create_flags, bindings.size());
+
+    for (const auto& binding : bindings) {
+        hash = hashCombine_(hash, binding.binding);
+        hash = hashCombine_(hash, binding.descriptorType);
+        hash = hashCombine_(hash, binding.descriptorCount);
+        hash = hashCombine_(hash, binding.stageFlags);
+    }
+
+    for (auto flag : flags) {
+        hash = hashCombine_(hash, flag);
+    }
+
+    auto& bucket = m_setLayouts[hash];
+
+    for (const auto& cached : bucket) {
+        bool is_same = cached.createFlags == create_flags &&
+                       cached.flags == flags &&
+                       cached.bindings.size() == bindings.size() &&
+                       std::equal(bindings.begin(), bindings.end(), cached.bindings.begin(),
+                           [](const VkDescriptorSetLayoutBinding& left, const VkDescriptorSetLayoutBinding& right) {
+                               return left.binding == right.binding && left.descriptorType == right.descriptorType &&
+                                      left.descriptorCount == right.descriptorCount && left.stageFlags == right.stageFlags &&
+                                      left.pImmutableSamplers == right.pImmutableSamplers;
+                           });
+
+        if (is_same) {
+            return cached.layout;
+        }
+    }
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO};
+    flags_info.bindingCount = static_cast<uint32_t>(flags.size());
+    flags_info.pBindingFlags = flags.data();
+
+    VkDescriptorSetLayoutCreateInfo layout_info {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    layout_info.pNext = flags.empty() ? nullptr : &flags_info;
+    layout_info.flags = create_flags;
+    layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_info.pBindings = bindings.data();
+
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+
+    auto result = vkCreateDescriptorSetLayout(m_logicalDevice, &layout_info, nullptr, &layout);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create descriptor set layout.")
+
+    bucket.push_back({bindings, flags, create_flags, layout});
+
+    return layout;
+}
+
+vtrs::ShaderLibrary::PipelineLayout vtrs::ShaderLibrary::getPipelineLayout(
+        const std::vector<const Module*>& stages,
+        const std::set<std::pair<uint32_t, uint32_t>>& dynamic_bindings) {
+
+    /* Bindings are merged across stages, keyed by set and binding. */
+    std::map<std::pair<uint32_t, uint32_t>, VkDescriptorSetLayoutBinding> merged {};
+    std::vector<VkPushConstantRange> push_constants {};
+    uint32_t set_count = 0;
+
+    for (auto stage : stages) {
+        for (const auto& binding : stage->bindings) {
+            auto key = std::make_pair(binding.set, binding.binding);
+            auto type = binding.type;
+
+            if (dynamic_bindings.count(key) > 0) {
+                if (type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+                if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+            }
+
+            if (binding.count == 0) {
+                throw vtrs::RendererError("Shader " + stage->name + " binds a runtime sized array, its set layout belongs to the BindlessRegistry.",
+                                          vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+            }
+
+            auto found = merged.find(key);
+
+            if (found == merged.end()) {
+                merged[key] = {binding.binding, type, binding.count, binding.stages, nullptr};
+
+            } else if (found->second.descriptorType != type || found->second.descriptorCount != binding.count) {
+                throw vtrs::RendererError("Shader " + stage->name + " disagrees with another stage on a binding.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+
+            } else {
+                found->second.stageFlags |= binding.stages;
+            }
+
+            set_count = std::max(set_count, binding.set + 1);
+        }
+
+        for (const auto& range : stage->pushConstants) {
+            push_constants.push_back(range);
+        }
+    }
+
+    PipelineLayout pipeline_layout {};
+    pipeline_layout.setLayouts.resize(set_count);
+
+    for (uint32_t set = 0; set < set_count; set++) {
+        std::vector<VkDescriptorSetLayoutBinding> bindings {};
+
+        for (const auto& entry : merged) {
+            if (entry.first.first == set) {
+                bindings.push_back(entry.second);
+            }
+        }
+
+        pipeline_layout.setLayouts.at(set) = getSetLayout(bindings);
+    }
+
+    uint64_t hash = hashCombine_(set_count, push_constants.size());
+
+    for (auto layout : pipeline_layout.setLayouts) {
+        hash = hashCombine_(hash, reinterpret_cast<uint64_t>(layout));
+    }
+
+    for (const auto& range : push_constants) {
+        hash = hashCombine_(hash, range.stageFlags);
+        hash = hashCombine_(hash, range.offset);
+        hash = hashCombine_(hash, range.size);
+    }
+
+    auto& bucket = m_pipelineLayouts[hash];
+
+    for (const auto& cached : bucket) {
+        bool is_same = cached.setLayouts == pipeline_layout.setLayouts &&
+                       cached.pushConstants.size() == push_constants.size() &&
+                       std::equal(push_constants.begin(), push_constants.end(), cached.pushConstants.begin(),
+                           [](const VkPushConstantRange& left, const VkPushConstantRange& right) {
+                               return left.stageFlags == right.stageFlags && left.offset == right.offset && left.size == right.size;
+                           });
+
+        if (is_same) {
+            pipeline_layout.layout = cached.layout;
+            return pipeline_layout;
+        }
+    }
+
+    VkPipelineLayoutCreateInfo layout_info {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    layout_info.setLayoutCount = static_cast<uint32_t>(pipeline_layout.setLayouts.size());
+    layout_info.pSetLayouts = pipeline_layout.setLayouts.data();
+    layout_info.pushConstantRangeCount = static_cast<uint32_t>(push_constants.size());
+    layout_info.pPushConstantRanges = push_constants.data();
+
+    auto result = vkCreatePipelineLayout(m_logicalDevice, &layout_info, nullptr, &(pipeline_layout.layout));
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create pipeline layout.")
+
+    bucket.push_back({pipeline_layout.setLayouts, push_constants, pipeline_layout.layout});
+
+    return pipeline_layout;
+}
@@ -0,0 +1,190 @@
+/**
+ * shader_library.hpp - SPIR-V loading, reflection and layout deduplication.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include "vulkan_api.hpp"
+
+namespace vtrs {
+
+struct shader_binding {
+    uint32_t set = 0;
+    uint32_t binding = 0;
+    VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+
+    /* Zero for runtime sized arrays, which only a bindless layout can hold. */
+    uint32_t count = 1;
+    VkShaderStageFlags stages = 0;
+};
+
+struct shader_vertex_input {
+    uint32_t location = 0;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+};
+
+struct shader_module {
+    std::string name {};
+    VkShaderModule module = VK_NULL_HANDLE;
+    VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+    std::string entryPoint {};
+    std::vector<struct shader_binding> bindings {};
+    std::vector<VkPushConstantRange> pushConstants {};
+    std::vector<struct shader_vertex_input> vertexInputs {};
+};
+
+struct shader_pipeline_layout {
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSetLayout> setLayouts {};
+};
+
+/**
+ * @brief Loads SPIR-V shaders and derives pipeline layouts from them.
+ *
+ * Shader files are memory mapped and handed to the driver straight from
+ * the mapping. Descriptor bindings, push constant ranges and vertex inputs
+ * are reflected from the SPIR-V words, so layouts no longer need to be
+ * written by hand.
+ *
+ * Descriptor set layouts and pipeline layouts are deduplicated by hash,
+ * so shaders sharing an interface also share the Vulkan objects. Every
+ * object handed out is owned by the library.
+ *
+ * A shader bundle packs several modules in one file: a 16 byte header
+ * holding the magic "VSHB", a version and the entry count, followed by
+ * 64 byte entries of a 56 byte name, an offset and a size. Offsets and
+ * sizes must be multiples of four.
+ */
+class ShaderLibrary {
+
+private:
+    struct cached_set_layout {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorBindingFlags> flags;
+        VkDescriptorSetLayoutCreateFlags createFlags;
+        VkDescriptorSetLayout layout;
+    };
+
+    struct cached_pipeline_layout {
+        std::vector<VkDescriptorSetLayout> setLayouts;
+        std::vector<VkPushConstantRange> pushConstants;
+        VkPipelineLayout layout;
+    };
+
+    VkDevice m_logicalDevice = VK_NULL_HANDLE;
+
+    std::map<std::string, struct shader_module*> m_modules {};
+    std::unordered_map<uint64_t, std::vector<cached_set_layout>> m_setLayouts {};
+    std::unordered_map<uint64_t, std::vector<cached_pipeline_layout>> m_pipelineLayouts {};
+
+    /**
+     * @brief Checks the SPIR-V header of a word stream.
+     * @throws vtrs::RendererError Thrown if the words are not valid SPIR-V.
+     */
+    static void validate_(const std::string& name, const void* data, size_t size);
+
+    /**
+     * @brief Reflects the interface of a module from its SPIR-V words.
+     * @param words SPIR-V words, header included.
+     * @param word_count Number of words.
+     * @param module Receives stage, entry point, bindings and inputs.
+     * @throws vtrs::RendererError Thrown if the words are malformed.
+     */
+    static void reflect_(const uint32_t* words, size_t word_count, struct shader_module* module);
+
+    /**
+     * @brief Validates, reflects and creates a module from mapped words.
+     */
+    const struct shader_module* create_(const std::string& name, const void* data, size_t size);
+
+    /**
+     * @brief Initialises member variables.
+     * @param logicalDevice Vulkan logical device handle.
+     */
+    explicit ShaderLibrary(VkDevice);
+
+public:
+    typedef struct shader_module Module;
+    typedef struct shader_binding Binding;
+    typedef struct shader_pipeline_layout PipelineLayout;
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param logical_device Vulkan logical device handle.
+     * @return Instance of the shader library.
+     */
+    static ShaderLibrary* factory(VkDevice);
+
+    /**
+     * @brief Destroys every module and layout created by the library.
+     */
+    ~ShaderLibrary();
+
+    /**
+     * @brief Loads a SPIR-V file, or returns it if already loaded.
+     * @param path Path to the .spv file; also used as the module name.
+     * @return The reflected module.
+     * @throws vtrs::RendererError Thrown if the file is not valid SPIR-V.
+     */
+    const Module* load(const std::string& path);
+
+    /**
+     * @brief Loads every module of a shader bundle.
+     * @param path Path to the bundle.
+     * @throws vtrs::RendererError Thrown if the bundle or a module is malformed.
+     */
+    void loadBundle(const std::string& path);
+
+    /**
+     * @brief Returns a previously loaded module.
+     * @param name Path of a loaded file, or entry name in a loaded bundle.
+     * @throws vtrs::RendererError Thrown if no such module was loaded.
+     */
+    const Module* get(const std::string& name) const;
+
+    /**
+     * @brief Returns a descriptor set layout for the bindings, creating it once.
+     * @param bindings Layout bindings.
+     * @param flags Per binding flags, empty or one per binding.
+     * @param create_flags Layout create flags.
+     */
+    VkDescriptorSetLayout getSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+                                       const std::vector<VkDescriptorBindingFlags>& flags = {},
+                                       VkDescriptorSetLayoutCreateFlags create_flags = 0);
+
+    /**
+     * @brief Returns the pipeline layout reflected from a set of stages.
+     * @param stages Modules that make up the pipeline.
+     * @param dynamic_bindings Set and binding pairs promoted to dynamic buffers.
+     * @return Pipeline layout and the descriptor set layout of each set.
+     * @throws vtrs::RendererError Thrown if two stages disagree on a binding,
+     *         or if a stage binds a runtime sized array.
+     */
+    PipelineLayout getPipelineLayout(const std::vector<const Module*>& stages,
+                                     const std::set<std::pair<uint32_t, uint32_t>>& dynamic_bindings = {});
+};
+
+} // namespace vtrs
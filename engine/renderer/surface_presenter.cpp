@@ -19,7 +19,12 @@
  * ========================================================================
  */
 
+#include <limits>
+#include <thread>
+#include <cmath>
+#include <algorithm>
 #include "assert.hpp"
+#include "renderer_context.hpp"
 #include "surface_presenter.hpp"
 
 struct vtrs::swapchain_support_bundle
@@ -61,7 +66,7 @@ void vtrs::SurfacePresenter::createSwapchain_(VkSurfaceKHR surface, struct vtrs:
     m_imageColors = support_bundle.surfaceFormats.at(0).colorSpace;
 
     for (auto& this_format : support_bundle.surfaceFormats) {
-        if (this_format.format == VK_FORMAT_B8G8R8A8_SRGB && this_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+        if (this_format.format == options->preferredFormat && this_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
             m_imageFormat = this_format.format;
             m_imageColors = this_format.colorSpace;
             break;
@@ -72,8 +77,7 @@ void vtrs::SurfacePresenter::createSwapchain_(VkSurfaceKHR surface, struct vtrs:
     m_imageExtend.height = support_bundle.surfaceCaps.currentExtent.height;
 
     if (support_bundle.surfaceCaps.currentExtent.width == std::numeric_limits<uint32_t>::max()) {
-        m_imageExtend.width = 800;
-        m_imageExtend.height = 600;
+        m_imageExtend = options->fallbackExtent;
     }
 
     VkSwapchainCreateInfoKHR swapchain_info {VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR};
@@ -81,35 +85,43 @@ void vtrs::SurfacePresenter::createSwapchain_(VkSurfaceKHR surface, struct vtrs:
     swapchain_info.surface = surface;
     swapchain_info.minImageCount = support_bundle.surfaceCaps.minImageCount + 1;
 
+    if (options->imageCount > 0)
+        swapchain_info.minImageCount = std::max(options->imageCount, support_bundle.surfaceCaps.minImageCount);
+
     if (support_bundle.surfaceCaps.maxImageCount > 0 && swapchain_info.minImageCount > support_bundle.surfaceCaps.maxImageCount)
         swapchain_info.minImageCount = support_bundle.surfaceCaps.maxImageCount;
 
     swapchain_info.imageFormat = m_imageFormat;
     swapchain_info.imageColorSpace = m_imageColors;
 
-    swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    if ((support_bundle.surfaceCaps.supportedUsageFlags & options->imageUsage) != options->imageUsage) {
+        throw vtrs::RendererError("Surface does not support the requested swapchain image usage.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+    }
+
+    swapchain_info.imageUsage = options->imageUsage;
 
     /* The imageArrayLayers specifies the amount of layers each
      * image consists of. This is always 1 unless we are developing
      * a stereoscopic 3D application.  */
     swapchain_info.imageArrayLayers = 1;
 
-    if (options->graphicsQueueFamily.value() == options->surfaceQueueFamily.value()) {
+    uint32_t family_indices[] = {options->surfaceQueueFamily.value(), options->graphicsQueueFamily.value()};
+
+    if (family_indices[0] == family_indices[1]) {
         swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
         swapchain_info.queueFamilyIndexCount = 0;
         swapchain_info.pQueueFamilyIndices = nullptr;
 
     } else {
-        uint32_t family_indices[] = {options->surfaceQueueFamily.value(), options->graphicsQueueFamily.value()};
-
-        swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        swapchain_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
         swapchain_info.queueFamilyIndexCount = 2;
         swapchain_info.pQueueFamilyIndices = family_indices;
     }
 
     swapchain_info.preTransform = support_bundle.surfaceCaps.currentTransform;
     swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapchain_info.presentMode = static_cast<VkPresentModeKHR>(options->presenterMode);
+    m_presentMode = selectPresentMode_(support_bundle.presentModes);
+    swapchain_info.presentMode = m_presentMode;
     swapchain_info.clipped = VK_TRUE;
     swapchain_info.oldSwapchain = m_swapchain;
     swapchain_info.imageExtent = m_imageExtend;
@@ -129,36 +141,191 @@ void vtrs::SurfacePresenter::obtainSwapViews_() {
     m_imageChain.resize(image_count);
     vkGetSwapchainImagesKHR(m_logicalDevice, m_swapchain, &image_count, m_imageChain.data());
 
-    m_viewsChain.resize(m_imageChain.size());
+    createViews_();
+}
+
+VkPresentModeKHR vtrs::SurfacePresenter::selectPresentMode_(const std::vector<VkPresentModeKHR>& modes) const {
+    std::vector<VkPresentModeKHR> preferred {};
+
+    switch (m_options.pacingMode) {
+        case PACING_MODE_MAILBOX:
+            preferred = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+            break;
+
+        case PACING_MODE_IMMEDIATE:
+            preferred = {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR};
+            break;
+
+        case PACING_MODE_FIFO_RELAXED:
+            preferred = {VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+            break;
+
+        default:
+            break;
+    }
+
+    for (auto mode : preferred) {
+        if (std::find(modes.begin(), modes.end(), mode) != modes.end()) {
+            return mode;
+        }
+    }
+
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void vtrs::SurfacePresenter::limitFrameRate_() {
+    if (m_options.targetFrameTime <= 0.0) {
+        return;
+    }
+
+    auto frame_time = std::chrono::duration_cast<clock_type::duration>(
+            std::chrono::duration<double, std::milli>(m_options.targetFrameTime));
+
+    auto now = clock_type::now();
+
+    if (now < m_nextFrameTime) {
+        std::this_thread::sleep_until(m_nextFrameTime);
+        now = m_nextFrameTime;
+    }
+
+    /* A frame that ran more than a frame late restarts the schedule rather than rushing the next ones. */
+    if (now - m_nextFrameTime > frame_time) {
+        m_nextFrameTime = now + frame_time;
+
+    } else {
+        m_nextFrameTime += frame_time;
+    }
+}
+
+void vtrs::SurfacePresenter::waitForQueuedPresents_() {
+    if (m_waitForPresent == nullptr) {
+        return;
+    }
+
+    uint64_t max_queued = m_options.maxQueuedPresents;
+
+    if (max_queued == 0 && m_options.pacingMode == PACING_MODE_FIFO_LOW_LATENCY) {
+        max_queued = 1;
+    }
+
+    while (m_completedId < m_presentId) {
+        uint64_t next_id = m_completedId + 1;
+
+        if (next_id < m_swapchainFirstId) {
+            m_completedId = next_id;
+            continue;
+        }
+
+        /* Block only while the new frame would exceed the cap, otherwise just poll. */
+        bool must_wait = max_queued > 0 && m_presentId - m_completedId >= max_queued;
+        uint64_t timeout = must_wait ? 1000000000 : 0;
+
+        auto result = m_waitForPresent(m_logicalDevice, m_swapchain, next_id, timeout);
 
-    for (size_t index = 0; index < m_imageChain.size(); index++) {
-        VkImageViewCreateInfo image_view_info {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
-        image_view_info.image = m_imageChain.at(index);
-        image_view_info.format = m_imageFormat;
-        image_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        image_view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        image_view_info.subresourceRange.baseMipLevel = 0;
-        image_view_info.subresourceRange.levelCount = 1;
-        image_view_info.subresourceRange.layerCount = 1;
-        image_view_info.subresourceRange.baseArrayLayer = 0;
+        if (result == VK_TIMEOUT) {
+            break;
+        }
 
-        result = vkCreateImageView(m_logicalDevice, &image_view_info, nullptr, &(m_viewsChain.at(index)));
-        VTRS_ASSERT_VK_RESULT(result, "Unable to create image view for image.")
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_ERROR_SURFACE_LOST_KHR) {
+            m_isRebuildPending = true;
+            m_completedId = m_presentId;
+            break;
+        }
+
+        if (result != VK_SUBOPTIMAL_KHR) {
+            VTRS_ASSERT_VK_RESULT(result, "Unable to wait for present.")
+        }
+
+        m_completedId = next_id;
+        recordInterval_(clock_type::now());
     }
 }
 
+void vtrs::SurfacePresenter::recordInterval_(clock_type::time_point time) {
+    if (m_lastPresentTime != clock_type::time_point {}) {
+        m_intervals.push_back(std::chrono::duration<double, std::milli>(time - m_lastPresentTime).count());
+
+        if (m_intervals.size() > 120) {
+            m_intervals.pop_front();
+        }
+    }
+
+    m_lastPresentTime = time;
+}
+
+void vtrs::SurfacePresenter::flushDeletions_(bool force) {
+    while (!m_deletionQueue.empty()) {
+        auto& deletion = m_deletionQueue.front();
+
+        if (!force && deletion.frameNumber + m_options.framesInFlight > m_frameNumber) {
+            break;
+        }
+
+        deletion.deleter();
+        m_deletionQueue.pop_front();
+    }
+}
+
+bool vtrs::SurfacePresenter::rebuild_() {
+    VkSurfaceCapabilitiesKHR surface_caps {};
+    auto result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physicalDevice, m_surface, &surface_caps);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to query surface capabilities of selected GPU.")
+
+    /* A minimised window has no area to present to. */
+    if (surface_caps.currentExtent.width == 0 || surface_caps.currentExtent.height == 0) {
+        return false;
+    }
+
+    VkDevice logical_device = m_logicalDevice;
+    VkSwapchainKHR old_swapchain = m_swapchain;
+    std::vector<VkImageView> old_views = m_viewsChain;
+
+    m_viewsChain.clear();
+
+    /* Images already acquired from the old swapchain can still be presented. */
+    createSwapchain_(m_surface, &m_options);
+
+    defer([logical_device, old_swapchain, old_views]() {
+        for (auto image_view : old_views) {
+            vkDestroyImageView(logical_device, image_view, nullptr);
+        }
+
+        vkDestroySwapchainKHR(logical_device, old_swapchain, nullptr);
+    });
+
+    obtainSwapViews_();
+
+    /* Presents to the old swapchain are no longer waited on, and the rebuild gap is not an interval. */
+    m_swapchainFirstId = m_presentId + 1;
+    m_completedId = m_presentId;
+    m_lastPresentTime = clock_type::time_point {};
+
+    m_isRebuildPending = false;
+    m_generation++;
+
+    return true;
+}
+
 void vtrs::SurfacePresenter::bootstrap_(VkSurfaceKHR surface, vtrs::surface_presenter_opts* options) {
+    if (options->framesInFlight == 0) {
+        throw vtrs::RendererError("Surface presenter needs at least one frame in flight.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    m_surface = surface;
+    m_ownsSurface = options->ownsSurface;
+    m_options = *options;
+
+    if (options->enablePresentWait) {
+        m_waitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(m_logicalDevice, "vkWaitForPresentKHR"));
+    }
+
     createSwapchain_(surface, options);
     obtainSwapViews_();
 }
 
 vtrs::SurfacePresenter::SurfacePresenter(VkPhysicalDevice physical_device, VkDevice logical_device) :
-        m_physicalDevice(physical_device),
-        m_logicalDevice(logical_device) {
+        Presenter(logical_device),
+        m_physicalDevice(physical_device) {
 }
 
 vtrs::SurfacePresenter*
@@ -168,19 +335,188 @@ vtrs::SurfacePresenter::factory(
         vtrs::WindowSurface* surface,
         SurfacePresenter::Options* options) {
 
+    return factory(physical_device, logical_device, surface->getSurfaceHandle(), options);
+}
+
+vtrs::SurfacePresenter*
+vtrs::SurfacePresenter::factory(
+        VkPhysicalDevice physical_device,
+        VkDevice logical_device,
+        VkSurfaceKHR surface,
+        SurfacePresenter::Options* options) {
+
     auto presenter = new SurfacePresenter(physical_device, logical_device);
-    presenter->bootstrap_(surface->getSurfaceHandle(), options);
+
+    try {
+        presenter->bootstrap_(surface, options);
+
+    } catch (vtrs::RendererError&) {
+        delete presenter;
+        throw;
+    }
 
     return presenter;
 }
 
 vtrs::SurfacePresenter::~SurfacePresenter() {
-    vkDestroySwapchainKHR(m_logicalDevice, m_swapchain, nullptr);
+    flushDeletions_(true);
 
-    for (auto image_view : m_viewsChain) {
-        vkDestroyImageView(m_logicalDevice, image_view, nullptr);
+    destroyViews_();
+
+    if (m_swapchain != VK_NULL_HANDLE) {
+        vkDestroySwapchainKHR(m_logicalDevice, m_swapchain, nullptr);
+    }
+
+    if (m_ownsSurface) {
+        vkDestroySurfaceKHR(vtrs::RendererContext::getInstanceHandle(), m_surface, nullptr);
     }
 
-    m_viewsChain.clear();
     m_imageChain.clear();
 }
+
+VkResult vtrs::SurfacePresenter::acquire(VkSemaphore signal_semaphore, uint32_t* image_index) {
+    limitFrameRate_();
+    waitForQueuedPresents_();
+
+    auto result = vkAcquireNextImageKHR(m_logicalDevice, m_swapchain, UINT64_MAX, signal_semaphore, VK_NULL_HANDLE, image_index);
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        m_isRebuildPending = true;
+
+    } else {
+        VTRS_ASSERT_VK_RESULT(result, "Unable to acquire swapchain image.")
+    }
+
+    return result;
+}
+
+VkResult vtrs::SurfacePresenter::present(VkQueue queue, uint32_t image_index, VkSemaphore wait_semaphore) {
+    VkPresentInfoKHR present_info {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
+    present_info.waitSemaphoreCount = wait_semaphore != VK_NULL_HANDLE ? 1 : 0;
+    present_info.pWaitSemaphores = &wait_semaphore;
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = &m_swapchain;
+    present_info.pImageIndices = &image_index;
+
+    uint64_t present_id = m_presentId + 1;
+
+    VkPresentIdKHR present_id_info {VK_STRUCTURE_TYPE_PRESENT_ID_KHR};
+    present_id_info.swapchainCount = 1;
+    present_id_info.pPresentIds = &present_id;
+
+    if (m_waitForPresent != nullptr) {
+        present_info.pNext = &present_id_info;
+    }
+
+    auto result = vkQueuePresentKHR(queue, &present_info);
+    m_presentQueue = queue;
+    m_presentId = present_id;
+    m_presentCount++;
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        m_isRebuildPending = true;
+
+    } else {
+        VTRS_ASSERT_VK_RESULT(result, "Unable to present swapchain image.")
+    }
+
+    /* An out of date present never completes, so it must not be waited on. */
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        m_completedId = m_presentId;
+    }
+
+    if (m_waitForPresent == nullptr) {
+        recordInterval_(clock_type::now());
+    }
+
+    return result;
+}
+
+VkImageLayout vtrs::SurfacePresenter::getPresentLayout() const {
+    return VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+void vtrs::SurfacePresenter::requestRebuild() {
+    m_isRebuildPending = true;
+}
+
+bool vtrs::SurfacePresenter::beginFrame(uint64_t frame_number) {
+    m_frameNumber = frame_number;
+    flushDeletions_(false);
+
+    if (!m_isRebuildPending) {
+        return false;
+    }
+
+    return rebuild_();
+}
+
+void vtrs::SurfacePresenter::defer(std::function<void()> deleter) {
+    m_deletionQueue.push_back({m_frameNumber, std::move(deleter)});
+}
+
+bool vtrs::SurfacePresenter::isRebuildPending() const {
+    return m_isRebuildPending;
+}
+
+uint64_t vtrs::SurfacePresenter::getGeneration() const {
+    return m_generation;
+}
+
+void vtrs::SurfacePresenter::setFramesInFlight(uint32_t frames_in_flight) {
+    frames_in_flight = std::max<uint32_t>(frames_in_flight, 1);
+
+    /* Frame fences do not cover presentation, a retired swapchain may still
+     * have a present queued. Waiting on the present queue settles those. */
+    if (m_presentQueue != VK_NULL_HANDLE) {
+        auto result = vkQueueWaitIdle(m_presentQueue);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to wait for queued presents.")
+    }
+
+    flushDeletions_(true);
+    m_options.framesInFlight = frames_in_flight;
+}
+
+void vtrs::SurfacePresenter::setImageCount(uint32_t image_count) {
+    m_options.imageCount = image_count;
+    requestRebuild();
+}
+
+void vtrs::SurfacePresenter::setPacingMode(vtrs::SurfacePresenter::PacingMode mode) {
+    m_options.pacingMode = mode;
+    requestRebuild();
+}
+
+void vtrs::SurfacePresenter::setTargetFrameTime(double frame_time) {
+    m_options.targetFrameTime = frame_time;
+    m_nextFrameTime = clock_type::time_point {};
+}
+
+vtrs::SurfacePresenter::PacingStats vtrs::SurfacePresenter::getPacingStats() const {
+    PacingStats stats {};
+    stats.presentMode = m_presentMode;
+    stats.presentCount = m_presentCount;
+    stats.queuedPresents = m_waitForPresent != nullptr ? static_cast<uint32_t>(m_presentId - m_completedId) : 0;
+
+    if (m_intervals.empty()) {
+        return stats;
+    }
+
+    double sum = 0.0;
+
+    for (auto interval : m_intervals) {
+        sum += interval;
+    }
+
+    stats.frameTime = sum / static_cast<double>(m_intervals.size());
+
+    double variance = 0.0;
+
+    for (auto interval : m_intervals) {
+        variance += (interval - stats.frameTime) * (interval - stats.frameTime);
+    }
+
+    stats.jitter = std::sqrt(variance / static_cast<double>(m_intervals.size()));
+
+    return stats;
+}
@@ -22,16 +22,75 @@
 #pragma once
 
 #include <vector>
+#include <deque>
+#include <chrono>
 #include <optional>
+#include <functional>
 #include "vulkan_api.hpp"
+#include "presenter.hpp"
 #include "window_surface.hpp"
 
 namespace vtrs {
 
+/**
+ * @brief Trade-off between latency, tearing and power.
+ *
+ * Modes the surface does not offer fall back to FIFO, which is
+ * always available. The low latency mode presents with FIFO but keeps
+ * at most one present queued when present wait is available.
+ */
+enum surface_pacing_mode : int {
+    PACING_MODE_FIFO = 0,
+    PACING_MODE_FIFO_RELAXED = 1,
+    PACING_MODE_MAILBOX = 2,
+    PACING_MODE_IMMEDIATE = 3,
+    PACING_MODE_FIFO_LOW_LATENCY = 4
+};
+
 struct surface_presenter_opts {
-    uint32_t presenterMode = VK_PRESENT_MODE_FIFO_KHR;
+    surface_pacing_mode pacingMode = PACING_MODE_FIFO;
+
+    /* Minimum time between frames in milliseconds, zero turns the frame limiter off. */
+    double targetFrameTime = 0.0;
+
+    /* Set only when VK_KHR_present_id and VK_KHR_present_wait are enabled on the device. */
+    bool enablePresentWait = false;
+
+    /* Presents allowed to queue up ahead of the display, zero for no cap. Needs present wait. */
+    uint32_t maxQueuedPresents = 0;
+
     std::optional<uint32_t> surfaceQueueFamily;
     std::optional<uint32_t> graphicsQueueFamily;
+
+    /* Used when the surface leaves the extent up to the swapchain, as headless surfaces do. */
+    VkExtent2D fallbackExtent {800, 600};
+
+    /* Destroy the surface along with the presenter. */
+    bool ownsSurface = false;
+
+    /* Number of frames recorded ahead, retired swapchains outlive this many frames. */
+    uint32_t framesInFlight = 2;
+
+    /* Swapchain images to ask for, clamped to the surface limits. Zero asks for one above the minimum. */
+    uint32_t imageCount = 0;
+
+    /* Format used when the surface offers it with sRGB colours, otherwise the first one offered. */
+    VkFormat preferredFormat = VK_FORMAT_B8G8R8A8_SRGB;
+
+    /* Usage of the swapchain images, every bit has to be supported by the surface. */
+    VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+};
+
+struct surface_pacing_stats {
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+    /* Mean and standard deviation of the present-to-present interval, in milliseconds. */
+    double frameTime = 0.0;
+    double jitter = 0.0;
+
+    /* Presents submitted but not yet shown, only measured with present wait. */
+    uint32_t queuedPresents = 0;
+    uint64_t presentCount = 0;
 };
 
 struct swapchain_support_bundle {
@@ -40,19 +99,60 @@ struct swapchain_support_bundle {
     std::vector<VkPresentModeKHR> presentModes;
 };
 
-class SurfacePresenter {
+/**
+ * @brief Presents through a swapchain created on a window or headless surface.
+ *
+ * Rebuilds never wait for the device to go idle. A rebuild requested by
+ * the window system, or flagged by an out of date or suboptimal result,
+ * is carried out once at the start of the next frame. The new swapchain
+ * is created with the current one as its oldSwapchain, and the retired
+ * swapchain and views go into a per-frame deletion queue. They are
+ * destroyed once framesInFlight more frames have begun, by which point
+ * every frame that could have used them has finished. Frames are counted
+ * by an absolute frame number, so a frame that is started again after an
+ * out of date acquire does not run the deleters its own rebuild queued.
+ */
+class SurfacePresenter : public Presenter {
 
 private:
+    typedef std::chrono::steady_clock clock_type;
+
     VkPhysicalDevice    m_physicalDevice = VK_NULL_HANDLE;
-    VkDevice            m_logicalDevice = VK_NULL_HANDLE;
     VkSwapchainKHR      m_swapchain = VK_NULL_HANDLE;
+    VkSurfaceKHR        m_surface = VK_NULL_HANDLE;
+    VkQueue             m_presentQueue = VK_NULL_HANDLE;
+    bool                m_ownsSurface = false;
 
-    VkColorSpaceKHR m_imageColors = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
-    VkFormat        m_imageFormat = VK_FORMAT_B8G8R8A8_SRGB;
-    VkExtent2D      m_imageExtend {};
+    struct surface_presenter_opts m_options {};
 
-    std::vector<VkImage>        m_imageChain {};
-    std::vector<VkImageView>    m_viewsChain {};
+    struct deferred_deletion {
+        uint64_t frameNumber;
+        std::function<void()> deleter;
+    };
+
+    bool     m_isRebuildPending = false;
+    uint64_t m_frameNumber = 0;
+    uint64_t m_generation = 0;
+
+    /* Deleters in the order they were queued, tagged with the frame that queued them. */
+    std::deque<deferred_deletion> m_deletionQueue {};
+
+    VkPresentModeKHR m_presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    PFN_vkWaitForPresentKHR m_waitForPresent = nullptr;
+
+    /* Present ids increase across swapchains, ids before the first one of the current swapchain are never waited on. */
+    uint64_t m_presentId = 0;
+    uint64_t m_completedId = 0;
+    uint64_t m_swapchainFirstId = 1;
+    uint64_t m_presentCount = 0;
+
+    clock_type::time_point m_nextFrameTime {};
+    clock_type::time_point m_lastPresentTime {};
+
+    /* Recent present-to-present intervals in milliseconds. */
+    std::deque<double> m_intervals {};
+
+    VkColorSpaceKHR m_imageColors = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
 
     /**
      * @brief Retrieves swapchain support details before creating a swapchain.
@@ -79,6 +179,42 @@ private:
      */
     void obtainSwapViews_();
 
+    /**
+     * @brief Picks the present mode for the configured pacing mode.
+     * @param modes Present modes supported by the surface.
+     */
+    [[nodiscard]] VkPresentModeKHR selectPresentMode_(const std::vector<VkPresentModeKHR>& modes) const;
+
+    /**
+     * @brief Sleeps until the target frame time has passed since the previous frame.
+     */
+    void limitFrameRate_();
+
+    /**
+     * @brief Waits with present wait until no more than the allowed presents are queued.
+     *
+     * Completed presents are also polled without blocking, so the queue
+     * depth is known even when it is not capped.
+     */
+    void waitForQueuedPresents_();
+
+    /**
+     * @brief Adds a present-to-present interval to the measured window.
+     */
+    void recordInterval_(clock_type::time_point time);
+
+    /**
+     * @brief Runs the deleters no frame in flight can depend on anymore.
+     * @param force Runs every queued deleter, for when the device is idle.
+     */
+    void flushDeletions_(bool force);
+
+    /**
+     * @brief Replaces the swapchain, retiring the old one into the deletion queue.
+     * @return False if the surface has no area, the rebuild then stays pending.
+     */
+    bool rebuild_();
+
     /**
      * @brief Bootstraps the surface presenter instance.
      * @param options Surface presenter configuration.
@@ -98,6 +234,8 @@ private:
 
 public:
     typedef struct surface_presenter_opts Options;
+    typedef struct surface_pacing_stats PacingStats;
+    typedef enum surface_pacing_mode PacingMode;
 
     /**
      * @brief Creates and returns a new instance.
@@ -110,10 +248,95 @@ public:
      */
     static SurfacePresenter* factory(VkPhysicalDevice, VkDevice, WindowSurface*, SurfacePresenter::Options*);
 
+    /**
+     * @brief Creates and returns a new instance on a raw surface handle.
+     * @param physical_device   Vulkan physical device handle.
+     * @param logical_device    Vulkan logical device handle.
+     * @param surface           Surface for presenting, destroyed with the presenter if options->ownsSurface is set.
+     * @param options           Surface presenter configuration.
+     * @return Instance of surface presenter.
+     * @throws vtrs::RendererError Thrown if the factory method fails.
+     */
+    static SurfacePresenter* factory(VkPhysicalDevice, VkDevice, VkSurfaceKHR, SurfacePresenter::Options*);
+
     /**
      * @brief Cleans up when an instance is destroyed.
      */
-    ~SurfacePresenter();
+    ~SurfacePresenter() override;
+
+    VkResult acquire(VkSemaphore signal_semaphore, uint32_t* image_index) override;
+
+    VkResult present(VkQueue queue, uint32_t image_index, VkSemaphore wait_semaphore) override;
+
+    [[nodiscard]] VkImageLayout getPresentLayout() const override;
+
+    /**
+     * @brief Asks for the swapchain to be rebuilt at the start of the next frame.
+     *
+     * Any number of requests between two frames result in one rebuild,
+     * so this can be called on every expose or resize event.
+     */
+    void requestRebuild();
+
+    /**
+     * @brief Starts a frame and carries out a pending rebuild.
+     * @param frame_number Absolute number of the frame, advanced once per submitted frame.
+     * @return True if the swapchain was rebuilt and size dependent resources must be recreated.
+     * @throws vtrs::RendererError Thrown if the swapchain could not be rebuilt.
+     *
+     * The caller must have waited for frame frame_number - framesInFlight.
+     * Deleters queued by that frame or earlier are run first. A frame that
+     * was not submitted is started again with the same number.
+     */
+    bool beginFrame(uint64_t frame_number);
+
+    /**
+     * @brief Queues a deleter to run once framesInFlight more frames have begun.
+     * @param deleter Destroys resources that in-flight frames may still use.
+     */
+    void defer(std::function<void()> deleter);
+
+    [[nodiscard]] bool isRebuildPending() const;
+
+    /**
+     * @brief Returns a counter that is incremented by every rebuild.
+     */
+    [[nodiscard]] uint64_t getGeneration() const;
+
+    /**
+     * @brief Changes the number of frame slots.
+     * @param frames_in_flight New number of frames in flight.
+     *
+     * Call only once every frame in flight has completed. The queue of the
+     * last present is waited on, then everything in the deletion queue is
+     * destroyed right away.
+     */
+    void setFramesInFlight(uint32_t frames_in_flight);
+
+    /**
+     * @brief Changes the number of swapchain images, the swapchain is rebuilt on the next frame.
+     * @param image_count Images to ask for, zero for one above the surface minimum.
+     */
+    void setImageCount(uint32_t image_count);
+
+    /**
+     * @brief Changes the pacing mode, the swapchain is rebuilt on the next frame.
+     */
+    void setPacingMode(PacingMode mode);
+
+    /**
+     * @brief Changes the frame limiter target.
+     * @param frame_time Minimum time between frames in milliseconds, zero to turn the limiter off.
+     */
+    void setTargetFrameTime(double frame_time);
+
+    /**
+     * @brief Returns the present mode in use and the measured pacing.
+     *
+     * Intervals are taken from present wait completions when present
+     * wait is enabled, and from the present calls otherwise.
+     */
+    [[nodiscard]] struct surface_pacing_stats getPacingStats() const;
 };
 
 } // namespace vtrs
\ No newline at end of file
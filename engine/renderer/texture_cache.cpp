@@ -0,0 +1,471 @@
+/**
+ * texture_cache.cpp - Shared textures with reference counts and a memory budget.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include "platform/except.hpp"
+#include "platform/logger.hpp"
+#include "platform/mapped_file.hpp"
+#include "platform/profiler.hpp"
+#include "assert.hpp"
+#include "texture_cache.hpp"
+
+namespace {
+
+uint64_t hashValue(uint64_t hash, uint64_t value) {
+    hash ^= value;
+    hash *= 1099511628211ULL;
+
+    return hash;
+}
+
+/* The MurmurHash3 64-bit finaliser, every input bit reaches every output bit. */
+uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+/**
+ * Hashes whole words, so a file is hashed at memory speed rather than a
+ * byte at a time. A multiply only carries bits upwards, so the high bits
+ * are folded back down after each word before the next one comes in.
+ */
+uint64_t hashBytes(const uint8_t* data, size_t size) {
+    uint64_t hash = mix(size);
+    size_t word_count = size / sizeof(uint64_t);
+
+    for (size_t index = 0; index < word_count; index++) {
+        uint64_t word;
+        std::memcpy(&word, data + index * sizeof(uint64_t), sizeof(uint64_t));
+
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+
+    uint64_t tail = 0;
+    size_t tail_size = size - word_count * sizeof(uint64_t);
+
+    if (tail_size > 0) {
+        std::memcpy(&tail, data + word_count * sizeof(uint64_t), tail_size);
+    }
+
+    return mix(hash ^ mix(tail));
+}
+
+/* Tells whether a file holds exactly these bytes, false if it can not be read anymore. */
+bool isSameContents(const std::string& path, const uint8_t* data, size_t size) {
+    std::unique_ptr<vtrs::MappedFile> file {};
+
+    try {
+        file.reset(vtrs::MappedFile::factory(path));
+
+    } catch (vtrs::PlatformError&) {
+        return false;
+    }
+
+    return file->getSize() == size && (size == 0 || std::memcmp(file->getData(), data, size) == 0);
+}
+
+uint64_t hashSampler(const vtrs::TextureCache::SamplerState& state) {
+    uint32_t anisotropy;
+    std::memcpy(&anisotropy, &state.maxAnisotropy, sizeof(anisotropy));
+
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hashValue(hash, state.filter);
+    hash = hashValue(hash, state.mipmapMode);
+    hash = hashValue(hash, state.addressMode);
+    hash = hashValue(hash, anisotropy);
+
+    return hash;
+}
+
+} // namespace
+
+uint64_t vtrs::TextureCache::findContents_(const std::string& path) {
+    auto iter = m_pathKeys.find(path);
+
+    if (iter != m_pathKeys.end()) {
+        return iter->second;
+    }
+
+    VTRS_PROFILE_ZONE("Hash texture file");
+    std::unique_ptr<vtrs::MappedFile> file {};
+
+    try {
+        file.reset(vtrs::MappedFile::factory(path));
+
+    } catch (vtrs::PlatformError& error) {
+        throw vtrs::RendererError(error.what(), vtrs::RendererError::E_TYPE_GENERAL, error.getCode());
+    }
+
+    auto data = static_cast<const uint8_t*>(file->getData());
+    size_t size = file->getSize();
+    uint64_t key = hashBytes(data, size);
+
+    /* The hash only picks a slot. Contents are compared before a texture is shared,
+     * and a colliding file probes on to the next key. */
+    while (true) {
+        auto image = m_images.find(key);
+
+        if (image == m_images.end()) {
+            cache_image fresh {};
+            fresh.path = path;
+            fresh.size = size;
+
+            m_images.emplace(key, fresh);
+            break;
+        }
+
+        if (image->second.size == size && (image->second.path == path || isSameContents(image->second.path, data, size))) {
+            break;
+        }
+
+        key = mix(key + 1);
+    }
+
+    m_pathKeys.emplace(path, key);
+    return key;
+}
+
+VkSampler vtrs::TextureCache::getSampler_(const vtrs::texture_sampler_state& state, uint64_t key) {
+    auto iter = m_samplers.find(key);
+
+    if (iter != m_samplers.end()) {
+        return iter->second;
+    }
+
+    VkSamplerCreateInfo sampler_info {VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    sampler_info.magFilter = state.filter;
+    sampler_info.minFilter = state.filter;
+    sampler_info.mipmapMode = state.mipmapMode;
+    sampler_info.addressModeU = state.addressMode;
+    sampler_info.addressModeV = state.addressMode;
+    sampler_info.addressModeW = state.addressMode;
+    sampler_info.anisotropyEnable = state.maxAnisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+    sampler_info.maxAnisotropy = std::max(state.maxAnisotropy, 1.0f);
+    sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+    sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
+    sampler_info.minLod = 0.0f;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+    VkSampler sampler;
+
+    auto result = vkCreateSampler(m_logicalDevice, &sampler_info, nullptr, &sampler);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create texture sampler.")
+
+    m_samplers.emplace(key, sampler);
+    return sampler;
+}
+
+VkDeviceSize vtrs::TextureCache::queryBudget_(VkDeviceSize resident_bytes) const {
+    VkDeviceSize budget = m_options.budget == 0 ? UINT64_MAX : m_options.budget;
+
+    if (!m_options.useMemoryBudget) {
+        return budget;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT memory_budget {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT};
+
+    VkPhysicalDeviceMemoryProperties2 properties {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2};
+    properties.pNext = &memory_budget;
+
+    vkGetPhysicalDeviceMemoryProperties2(m_physicalDevice, &properties);
+
+    VkDeviceSize allowed = 0;
+    VkDeviceSize used = 0;
+
+    for (uint32_t heap = 0; heap < properties.memoryProperties.memoryHeapCount; heap++) {
+        if (!(properties.memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+            continue;
+        }
+
+        allowed += static_cast<VkDeviceSize>(static_cast<double>(memory_budget.heapBudget[heap]) * m_options.heapBudgetFraction);
+        used += memory_budget.heapUsage[heap];
+    }
+
+    /* Memory held by everything else stays where it is, textures get what is left. */
+    VkDeviceSize other_bytes = used > resident_bytes ? used - resident_bytes : 0;
+    VkDeviceSize heap_budget = allowed > other_bytes ? allowed - other_bytes : 0;
+
+    return std::min(budget, heap_budget);
+}
+
+void vtrs::TextureCache::enforceBudget_() {
+    VkDeviceSize resident_bytes = 0;
+    uint32_t texture_count = 0;
+
+    std::vector<cache_image*> idle {};
+    std::vector<cache_image*> busy {};
+
+    for (auto& pair : m_images) {
+        cache_image& image = pair.second;
+
+        if (!image.isLoaded) {
+            continue;
+        }
+
+        if (image.refCount > 0) {
+            image.lastUse = m_frame;
+            busy.push_back(&image);
+
+        } else {
+            idle.push_back(&image);
+        }
+
+        VkDeviceSize size = m_streamer->getResidentSize(image.texture);
+
+        /* A trimmed texture keeps its old image until the coarser one is on display. It counts
+         * as the size it is heading for, or every frame until then would trim another texture. */
+        if (image.trimmedSize > 0) {
+            int state = m_streamer->getState(image.texture);
+            bool is_landed = state == vtrs::TextureStreamer::STATE_RESIDENT && m_streamer->getResidentBaseLevel(image.texture) >= image.baseLevel;
+
+            if (is_landed || state == vtrs::TextureStreamer::STATE_FAILED) {
+                image.trimmedSize = 0;
+
+            } else {
+                size = std::min(size, image.trimmedSize);
+            }
+        }
+
+        resident_bytes += size;
+        texture_count++;
+    }
+
+    VkDeviceSize budget = queryBudget_(resident_bytes);
+
+    m_stats.residentBytes = resident_bytes;
+    m_stats.textureCount = texture_count;
+    m_stats.budget = budget;
+
+    auto can_change = [this](const cache_image* image) {
+        return m_streamer->getState(image->texture) == vtrs::TextureStreamer::STATE_RESIDENT;
+    };
+
+    if (resident_bytes > budget) {
+        std::sort(idle.begin(), idle.end(), [](const cache_image* left, const cache_image* right) {
+            return left->lastUse < right->lastUse;
+        });
+
+        for (auto image : idle) {
+            if (resident_bytes <= budget) {
+                break;
+            }
+
+            VkDeviceSize size = m_streamer->getResidentSize(image->texture);
+            resident_bytes -= std::min(resident_bytes, image->trimmedSize > 0 ? std::min(size, image->trimmedSize) : size);
+
+            m_streamer->release(image->texture);
+            image->isLoaded = false;
+            image->baseLevel = 0;
+            image->trimmedSize = 0;
+
+            m_stats.evictionCount++;
+        }
+    }
+
+    /* Textures still in use give up their top mip, largest first. */
+    std::sort(busy.begin(), busy.end(), [this](const cache_image* left, const cache_image* right) {
+        return m_streamer->getResidentSize(left->texture) > m_streamer->getResidentSize(right->texture);
+    });
+
+    if (resident_bytes > budget) {
+        for (auto image : busy) {
+            if (resident_bytes <= budget) {
+                break;
+            }
+
+            if (!can_change(image)) {
+                continue;
+            }
+
+            uint32_t base_level = m_streamer->getResidentBaseLevel(image->texture) + 1;
+            VkExtent2D extent = m_streamer->getExtent(image->texture);
+
+            if (base_level > m_streamer->getMaxBaseLevel(image->texture) ||
+                (std::max(extent.width, extent.height) >> base_level) < m_options.minExtent) {
+                continue;
+            }
+
+            /* The next level down holds about a quarter of the texels. */
+            VkDeviceSize size = m_streamer->getResidentSize(image->texture);
+            resident_bytes -= std::min(resident_bytes, size - size / 4);
+
+            image->trimmedSize = std::max<VkDeviceSize>(size / 4, 1);
+            image->baseLevel = base_level;
+            m_streamer->setMinBaseLevel(image->texture, base_level);
+
+            m_stats.trimCount++;
+        }
+
+        return;
+    }
+
+    /* One trimmed texture per frame gets a level back, smallest first, while
+     * it fits with an eighth of the budget to spare so it is not trimmed again. */
+    for (auto iter = busy.rbegin(); iter != busy.rend(); ++iter) {
+        cache_image* image = *iter;
+
+        if (image->baseLevel == 0 || !can_change(image)) {
+            continue;
+        }
+
+        VkDeviceSize grown_bytes = resident_bytes + m_streamer->getResidentSize(image->texture) * 3;
+
+        if (budget != UINT64_MAX && grown_bytes > budget - budget / 8) {
+            break;
+        }
+
+        image->baseLevel--;
+        image->trimmedSize = 0;
+        m_streamer->setMinBaseLevel(image->texture, image->baseLevel);
+        break;
+    }
+}
+
+vtrs::TextureCache::TextureCache(
+        VkPhysicalDevice physical_device, VkDevice logical_device, vtrs::TextureStreamer* streamer, vtrs::texture_cache_opts* options) :
+    m_physicalDevice(physical_device), m_logicalDevice(logical_device), m_streamer(streamer), m_options(*options) {}
+
+vtrs::TextureCache*
+vtrs::TextureCache::factory(
+        VkPhysicalDevice physical_device,
+        VkDevice logical_device,
+        vtrs::TextureStreamer* streamer,
+        vtrs::TextureCache::Options* options) {
+
+    return new TextureCache(physical_device, logical_device, streamer, options);
+}
+
+vtrs::TextureCache::~TextureCache() {
+    for (auto& pair : m_images) {
+        if (pair.second.isLoaded) {
+            m_streamer->release(pair.second.texture);
+        }
+    }
+
+    for (auto& pair : m_samplers) {
+        vkDestroySampler(m_logicalDevice, pair.second, nullptr);
+    }
+}
+
+vtrs::TextureCache::Handle vtrs::TextureCache::acquire(const std::string& path, const SamplerState& sampler, int priority) {
+    uint64_t content_hash = findContents_(path);
+    uint64_t sampler_key = hashSampler(sampler);
+
+    cache_image& image = m_images.at(content_hash);
+
+    if (image.isLoaded) {
+        m_stats.hitCount++;
+
+    } else {
+        image.texture = m_streamer->request(path, priority, image.baseLevel);
+        image.isLoaded = true;
+
+        m_stats.missCount++;
+    }
+
+    image.refCount++;
+    image.lastUse = m_frame;
+
+    auto key = std::make_pair(content_hash, sampler_key);
+    auto iter = m_entryIndex.find(key);
+    Handle handle;
+
+    if (iter == m_entryIndex.end()) {
+        cache_entry entry {};
+        entry.contentHash = content_hash;
+        entry.sampler = getSampler_(sampler, sampler_key);
+
+        handle = static_cast<Handle>(m_entries.size());
+        m_entries.push_back(entry);
+        m_entryIndex.emplace(key, handle);
+
+    } else {
+        handle = iter->second;
+    }
+
+    m_entries.at(handle).refCount++;
+    return handle;
+}
+
+void vtrs::TextureCache::release(vtrs::TextureCache::Handle handle) {
+    cache_entry& entry = m_entries.at(handle);
+
+    if (entry.refCount == 0) {
+        return;
+    }
+
+    entry.refCount--;
+    m_images.at(entry.contentHash).refCount--;
+}
+
+bool vtrs::TextureCache::update() {
+    VTRS_PROFILE_FUNCTION();
+
+    m_frame++;
+
+    bool has_changed = m_streamer->update();
+    enforceBudget_();
+
+    return has_changed;
+}
+
+VkImageView vtrs::TextureCache::getView(vtrs::TextureCache::Handle handle) const {
+    const cache_image& image = m_images.at(m_entries.at(handle).contentHash);
+    return m_streamer->getView(image.texture);
+}
+
+VkSampler vtrs::TextureCache::getSampler(vtrs::TextureCache::Handle handle) const {
+    return m_entries.at(handle).sampler;
+}
+
+vtrs::TextureStreamer::Handle vtrs::TextureCache::getTexture(vtrs::TextureCache::Handle handle) const {
+    return m_images.at(m_entries.at(handle).contentHash).texture;
+}
+
+uint32_t vtrs::TextureCache::getBudgetBaseLevel(vtrs::TextureCache::Handle handle) const {
+    return m_images.at(m_entries.at(handle).contentHash).baseLevel;
+}
+
+void vtrs::TextureCache::setBudget(VkDeviceSize budget) {
+    m_options.budget = budget;
+}
+
+vtrs::TextureCache::Stats vtrs::TextureCache::getStats() const {
+    return m_stats;
+}
+
+void vtrs::TextureCache::printStats() const {
+    vtrs::Logger::print("");
+    vtrs::Logger::print("Texture Cache");
+    vtrs::Logger::print("*************");
+    vtrs::Logger::print("Hits:", m_stats.hitCount, "misses:", m_stats.missCount);
+    vtrs::Logger::print("Evicted:", m_stats.evictionCount, "trimmed:", m_stats.trimCount);
+    vtrs::Logger::print("Resident textures:", m_stats.textureCount, "bytes:", m_stats.residentBytes, "budget:", m_stats.budget);
+    vtrs::Logger::print("");
+}
@@ -0,0 +1,246 @@
+/**
+ * texture_cache.hpp - Shared textures with reference counts and a memory budget.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include "vulkan_api.hpp"
+#include "texture_streamer.hpp"
+
+namespace vtrs {
+
+struct texture_sampler_state {
+    VkFilter             filter = VK_FILTER_LINEAR;
+    VkSamplerMipmapMode  mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+
+    /* Anisotropic filtering is enabled above 1. */
+    float maxAnisotropy = 1.0f;
+};
+
+struct texture_cache_opts {
+    /* Bytes of device memory textures may hold, zero for no fixed limit. */
+    VkDeviceSize budget = 256 * 1024 * 1024;
+
+    /* Also keep device local heaps within their VK_EXT_memory_budget share, the extension must be enabled. */
+    bool useMemoryBudget = false;
+
+    /* Fraction of each device local heap budget the application may use. */
+    float heapBudgetFraction = 0.9f;
+
+    /* Referenced textures keep at least this many texels along their larger side. */
+    uint32_t minExtent = 64;
+};
+
+struct texture_cache_stats {
+    uint32_t hitCount = 0;
+    uint32_t missCount = 0;
+    uint32_t evictionCount = 0;
+    uint32_t trimCount = 0;
+    uint32_t textureCount = 0;
+    VkDeviceSize residentBytes = 0;
+    VkDeviceSize budget = 0;
+};
+
+/**
+ * @brief Shares streamed textures between their users within a memory budget.
+ *
+ * Textures are keyed by their file contents, so the same image is
+ * decoded and uploaded once however many paths or models name it. The
+ * contents are hashed to find a texture and compared byte for byte
+ * before one is shared between two paths.
+ * Each acquire of a content and sampler state pair returns a handle that
+ * holds a reference until it is released. Samplers are shared by state.
+ *
+ * Once per frame, update measures the device memory held by resident
+ * textures against the budget. When it is exceeded, unreferenced textures
+ * are evicted, least recently used first. If that is not enough, the top
+ * mip of the largest referenced textures is dropped by raising their
+ * minimum base level, and restored once memory frees up. The base level
+ * itself is left to whoever decides what is visible, see MipResidency.
+ */
+class TextureCache {
+
+private:
+    struct cache_image {
+        /* First path the contents were read from, and their size. */
+        std::string path {};
+        size_t size = 0;
+
+        vtrs::TextureStreamer::Handle texture = 0;
+        uint32_t refCount = 0;
+        uint64_t lastUse = 0;
+        bool     isLoaded = false;
+
+        /* Coarsest level the budget forced on this texture. */
+        uint32_t baseLevel = 0;
+
+        /* Expected size once a trim has landed, zero when no trim is in flight. */
+        VkDeviceSize trimmedSize = 0;
+    };
+
+    struct cache_entry {
+        uint64_t  contentHash = 0;
+        VkSampler sampler = VK_NULL_HANDLE;
+        uint32_t  refCount = 0;
+    };
+
+    VkPhysicalDevice        m_physicalDevice = VK_NULL_HANDLE;
+    VkDevice                m_logicalDevice = VK_NULL_HANDLE;
+    vtrs::TextureStreamer*  m_streamer = nullptr;
+
+    struct texture_cache_opts m_options {};
+    struct texture_cache_stats m_stats {};
+
+    std::unordered_map<std::string, uint64_t> m_pathKeys {};
+    std::unordered_map<uint64_t, cache_image> m_images {};
+    std::unordered_map<uint64_t, VkSampler> m_samplers {};
+
+    std::vector<cache_entry> m_entries {};
+    std::map<std::pair<uint64_t, uint64_t>, uint32_t> m_entryIndex {};
+
+    uint64_t m_frame = 0;
+
+    /**
+     * @brief Returns the key of the image holding a file's contents, adding the image if it is new.
+     * @throws vtrs::RendererError Thrown if the file can not be read.
+     *
+     * Each path is read once. Its contents are hashed, and compared with
+     * any other file of the same hash before the key is shared.
+     */
+    uint64_t findContents_(const std::string& path);
+
+    /**
+     * @brief Returns the shared sampler for a state, creating it when needed.
+     */
+    VkSampler getSampler_(const struct texture_sampler_state& state, uint64_t key);
+
+    /**
+     * @brief Returns the number of bytes textures may hold this frame.
+     * @param resident_bytes Bytes held by textures right now.
+     */
+    VkDeviceSize queryBudget_(VkDeviceSize resident_bytes) const;
+
+    /**
+     * @brief Evicts and trims textures until the budget is met, or restores trimmed ones.
+     */
+    void enforceBudget_();
+
+    /**
+     * @brief Initialises member variables.
+     */
+    TextureCache(VkPhysicalDevice, VkDevice, vtrs::TextureStreamer*, struct texture_cache_opts*);
+
+public:
+    typedef struct texture_cache_opts Options;
+    typedef struct texture_sampler_state SamplerState;
+    typedef struct texture_cache_stats Stats;
+    typedef uint32_t Handle;
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    /**
+     * @brief Creates a texture cache on top of a streamer.
+     * @param physical_device   Vulkan physical device handle, used to query the memory budget.
+     * @param logical_device    Vulkan logical device handle.
+     * @param streamer          Streamer that loads the textures.
+     * @param options           Cache configuration.
+     * @return Instance of the texture cache.
+     */
+    static TextureCache* factory(VkPhysicalDevice, VkDevice, vtrs::TextureStreamer*, TextureCache::Options*);
+
+    /**
+     * @brief Releases every texture from the streamer and destroys the samplers.
+     *
+     * The GPU must be done with every sampler handed out.
+     */
+    ~TextureCache();
+
+    /**
+     * @brief Takes a reference to a texture, loading it on a miss.
+     * @param path Path of the texture file.
+     * @param sampler Sampler state the texture is read with.
+     * @param priority Streaming priority on a miss.
+     * @return Handle that stays valid until released.
+     * @throws vtrs::RendererError Thrown if the file can not be read.
+     *
+     * The first acquire of a path maps and hashes the whole file on the
+     * calling thread, decoding is left to the streamer. Acquire textures
+     * while loading a scene rather than in the middle of a frame.
+     */
+    Handle acquire(const std::string& path, const SamplerState& sampler = {}, int priority = 0);
+
+    /**
+     * @brief Drops a reference taken by acquire.
+     *
+     * The texture stays resident until the budget needs its memory.
+     */
+    void release(Handle handle);
+
+    /**
+     * @brief Updates the streamer and keeps resident textures within the budget.
+     * @return True if any view changed and descriptors need to be refreshed.
+     *
+     * Call once per frame, after waiting for the frame's fence.
+     */
+    bool update();
+
+    /**
+     * @brief Returns the view to sample, the streamer's placeholder until resident.
+     */
+    [[nodiscard]] VkImageView getView(Handle handle) const;
+
+    /**
+     * @brief Returns the shared sampler of a handle.
+     */
+    [[nodiscard]] VkSampler getSampler(Handle handle) const;
+
+    /**
+     * @brief Returns the streamer handle behind a cache handle.
+     */
+    [[nodiscard]] vtrs::TextureStreamer::Handle getTexture(Handle handle) const;
+
+    /**
+     * @brief Returns the coarsest base level the budget allows for a texture.
+     */
+    [[nodiscard]] uint32_t getBudgetBaseLevel(Handle handle) const;
+
+    /**
+     * @brief Changes the fixed budget, zero for no fixed limit.
+     */
+    void setBudget(VkDeviceSize budget);
+
+    /**
+     * @brief Returns the counters and the memory held by resident textures.
+     */
+    [[nodiscard]] Stats getStats() const;
+
+    /**
+     * @brief Prints the cache statistics to the console.
+     */
+    void printStats() const;
+};
+
+} // namespace vtrs
@@ -0,0 +1,967 @@
+/**
+ * texture_streamer.cpp - Background texture decoding with budgeted uploads.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include "platform/logger.hpp"
+#include "platform/profiler.hpp"
+#include "assert.hpp"
+#include "texture_streamer.hpp"
+
+/* Handles keep the slot in the low bits and its generation in the rest. */
+#define VTRS_STREAMER_SLOT_BITS 20U
+#define VTRS_STREAMER_SLOT_MASK ((1U << VTRS_STREAMER_SLOT_BITS) - 1U)
+#define VTRS_STREAMER_MAX_GENERATION (UINT32_MAX >> VTRS_STREAMER_SLOT_BITS)
+
+namespace {
+
+bool isKtx2Path(const std::string& path) {
+    return path.size() > 5 && path.compare(path.size() - 5, 5, ".ktx2") == 0;
+}
+
+float toLinear(uint8_t value) {
+    static const std::array<float, 256> s_table = []() {
+        std::array<float, 256> table {};
+
+        for (size_t index = 0; index < table.size(); index++) {
+            float srgb = static_cast<float>(index) / 255.0f;
+            table[index] = srgb <= 0.04045f ? srgb / 12.92f : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+        }
+
+        return table;
+    }();
+
+    return s_table[value];
+}
+
+uint8_t toSrgb(float value) {
+    float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint8_t>(std::clamp(srgb * 255.0f + 0.5f, 0.0f, 255.0f));
+}
+
+/**
+ * Box filters RGBA8 pixels down to a smaller extent in place. Colour is
+ * averaged in linear space for sRGB data, alpha is always linear.
+ */
+void downsamplePixels(std::vector<uint8_t>& pixels, uint32_t width, uint32_t height, uint32_t out_width, uint32_t out_height, bool is_srgb) {
+    std::vector<uint8_t> output(static_cast<size_t>(out_width) * out_height * 4);
+
+    for (uint32_t out_y = 0; out_y < out_height; out_y++) {
+        uint32_t y_begin = out_y * height / out_height;
+        uint32_t y_end = std::max((out_y + 1) * height / out_height, y_begin + 1);
+
+        for (uint32_t out_x = 0; out_x < out_width; out_x++) {
+            uint32_t x_begin = out_x * width / out_width;
+            uint32_t x_end = std::max((out_x + 1) * width / out_width, x_begin + 1);
+
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+            for (uint32_t y = y_begin; y < y_end; y++) {
+                const uint8_t* texel = pixels.data() + (static_cast<size_t>(y) * width + x_begin) * 4;
+
+                for (uint32_t x = x_begin; x < x_end; x++, texel += 4) {
+                    for (uint32_t channel = 0; channel < 3; channel++) {
+                        sum[channel] += is_srgb ? toLinear(texel[channel]) : texel[channel] / 255.0f;
+                    }
+
+                    sum[3] += texel[3] / 255.0f;
+                }
+            }
+
+            float count = static_cast<float>((x_end - x_begin) * (y_end - y_begin));
+            uint8_t* target = output.data() + (static_cast<size_t>(out_y) * out_width + out_x) * 4;
+
+            for (uint32_t channel = 0; channel < 3; channel++) {
+                float value = sum[channel] / count;
+                target[channel] = is_srgb ? toSrgb(value) : static_cast<uint8_t>(std::clamp(value * 255.0f + 0.5f, 0.0f, 255.0f));
+            }
+
+            target[3] = static_cast<uint8_t>(std::clamp(sum[3] / count * 255.0f + 0.5f, 0.0f, 255.0f));
+        }
+    }
+
+    pixels.swap(output);
+}
+
+} // namespace
+
+vtrs::TextureStreamer::stream_texture* vtrs::TextureStreamer::texture_(vtrs::TextureStreamer::Handle handle) const {
+    uint32_t slot = handle & VTRS_STREAMER_SLOT_MASK;
+
+    if (slot >= m_textures.size() || m_textures[slot]->generation != handle >> VTRS_STREAMER_SLOT_BITS) {
+        return nullptr;
+    }
+
+    return m_textures[slot].get();
+}
+
+void vtrs::TextureStreamer::freeSlot_(vtrs::TextureStreamer::Handle handle) {
+    uint32_t slot = handle & VTRS_STREAMER_SLOT_MASK;
+
+    /* A slot whose generations are used up is retired, reusing it would bring back the handles of its first texture. */
+    if (m_textures[slot]->generation < VTRS_STREAMER_MAX_GENERATION) {
+        m_freeSlots.push_back(slot);
+    }
+}
+
+void vtrs::TextureStreamer::workerLoop_(uint32_t worker) {
+    VTRS_PROFILE_THREAD("Texture decode " + std::to_string(worker));
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        m_wakeCondition.wait(lock, [this]() {
+            return m_isStopping || !m_decodeQueue.empty();
+        });
+
+        if (m_isStopping) {
+            return;
+        }
+
+        auto entry = m_decodeQueue.top();
+        m_decodeQueue.pop();
+
+        stream_texture* texture = texture_(std::get<2>(entry));
+
+        /* Entries left behind by setPriority, release and reused slots are skipped. */
+        if (texture == nullptr || texture->state != STATE_QUEUED || texture->priority != std::get<0>(entry)) {
+            continue;
+        }
+
+        texture->state = STATE_DECODING;
+
+        std::string path = texture->path;
+        uint32_t base_level = getTargetLevel_(texture);
+
+        lock.unlock();
+
+        decoded_texture decoded {};
+        VkExtent2D extent {0, 0};
+        uint32_t max_base_level = 0;
+        bool is_decoded = true;
+
+        try {
+            VTRS_PROFILE_ZONE("Decode texture");
+            decode_(path, base_level, decoded, &extent, &max_base_level);
+
+        } catch (vtrs::RuntimeError& error) {
+            vtrs::Logger::warn("Unable to stream texture", path, ":", error.what());
+            is_decoded = false;
+
+        } catch (std::exception& error) {
+            /* Out of memory, or whatever the decoder hook throws, must not end the thread. */
+            vtrs::Logger::warn("Unable to stream texture", path, ":", error.what());
+            is_decoded = false;
+
+        } catch (...) {
+            vtrs::Logger::warn("Unable to stream texture", path, ": the decoder threw an unknown exception.");
+            is_decoded = false;
+        }
+
+        lock.lock();
+
+        if (texture->isReleased) {
+            texture->state = STATE_RELEASED;
+            freeSlot_(std::get<2>(entry));
+            continue;
+        }
+
+        if (!is_decoded) {
+            texture->state = texture->isResident ? STATE_RESIDENT : STATE_FAILED;
+            continue;
+        }
+
+        texture->extent = extent;
+        texture->maxBaseLevel = max_base_level;
+        texture->decoded = std::move(decoded);
+        texture->state = STATE_DECODED;
+
+        m_decoded.push_back(std::get<2>(entry));
+    }
+}
+
+void vtrs::TextureStreamer::decode_(
+        const std::string& path, uint32_t base_level, decoded_texture& decoded, VkExtent2D* extent, uint32_t* max_base_level) {
+
+    bool can_generate = m_options.mipGenerator != nullptr;
+
+    auto append_level = [&decoded](const uint8_t* data, VkDeviceSize size, VkExtent2D level_extent) {
+        decoded_level level {};
+        level.offset = decoded.texels.size();
+        level.size = size;
+        level.extent = level_extent;
+
+        decoded.texels.insert(decoded.texels.end(), data, data + size);
+        decoded.levels.push_back(level);
+    };
+
+    if (isKtx2Path(path)) {
+        std::unique_ptr<vtrs::Ktx2Texture> ktx2(vtrs::Ktx2Texture::factory(m_physicalDevice, path, &m_options.ktx2Options));
+
+        if (ktx2->getArrayLayers() != 1) {
+            throw vtrs::RendererError("Only 2D textures can be streamed.", vtrs::RendererError::E_TYPE_INCOMPATIBLE);
+        }
+
+        /* Block compressed levels can not be filtered here, so only stored levels can be the base. */
+        *extent = ktx2->getExtent();
+        *max_base_level = ktx2->getLevelCount() - 1;
+
+        decoded.baseLevel = std::min(base_level, *max_base_level);
+        decoded.format = ktx2->getFormat();
+        decoded.extent = {std::max(extent->width >> decoded.baseLevel, 1U), std::max(extent->height >> decoded.baseLevel, 1U)};
+
+        decoded.generateMips = can_generate && ktx2->isMipGenerationRequested() &&
+                               vtrs::MipGenerator::isBlitSupported(m_physicalDevice, decoded.format);
+
+        decoded.levelCount = decoded.generateMips ?
+            vtrs::MipGenerator::getLevelCount(decoded.extent.width, decoded.extent.height) : ktx2->getLevelCount() - decoded.baseLevel;
+
+        /* Levels are copied out so the file can be unmapped before the upload. */
+        uint32_t end_level = decoded.generateMips ? decoded.baseLevel + 1 : ktx2->getLevelCount();
+
+        for (uint32_t level = decoded.baseLevel; level < end_level; level++) {
+            VkDeviceSize size = 0;
+            const uint8_t* data = ktx2->getLevelData(level, &size);
+
+            append_level(data, size, {std::max(extent->width >> level, 1U), std::max(extent->height >> level, 1U)});
+        }
+
+        return;
+    }
+
+    if (!m_options.decoder) {
+        throw vtrs::RendererError("No decoder is set for non KTX2 textures.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    std::vector<uint8_t> pixels {};
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    if (!m_options.decoder(path, pixels, &width, &height) || width == 0 || height == 0) {
+        throw vtrs::RendererError("Unable to decode texture image.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    if (pixels.size() < static_cast<size_t>(width) * height * 4) {
+        throw vtrs::RendererError("Decoded texture is smaller than its extent.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    *extent = {width, height};
+    *max_base_level = vtrs::MipGenerator::getLevelCount(width, height) - 1;
+
+    bool is_srgb = m_options.pixelFormat == VK_FORMAT_R8G8B8A8_SRGB;
+
+    decoded.baseLevel = std::min(base_level, *max_base_level);
+    decoded.format = m_options.pixelFormat;
+    decoded.extent = {std::max(width >> decoded.baseLevel, 1U), std::max(height >> decoded.baseLevel, 1U)};
+
+    if (decoded.baseLevel > 0) {
+        downsamplePixels(pixels, width, height, decoded.extent.width, decoded.extent.height, is_srgb);
+    }
+
+    VkExtent2D level_extent = decoded.extent;
+    append_level(pixels.data(), static_cast<VkDeviceSize>(level_extent.width) * level_extent.height * 4, level_extent);
+
+    /* Levels uploaded one at a time have to exist before the upload, so they are built here. */
+    if (m_options.progressiveUpload) {
+        decoded.levelCount = vtrs::MipGenerator::getLevelCount(decoded.extent.width, decoded.extent.height);
+
+        for (uint32_t level = 1; level < decoded.levelCount; level++) {
+            VkExtent2D next_extent {std::max(level_extent.width >> 1, 1U), std::max(level_extent.height >> 1, 1U)};
+            downsamplePixels(pixels, level_extent.width, level_extent.height, next_extent.width, next_extent.height, is_srgb);
+
+            level_extent = next_extent;
+            append_level(pixels.data(), static_cast<VkDeviceSize>(level_extent.width) * level_extent.height * 4, level_extent);
+        }
+
+        return;
+    }
+
+    decoded.generateMips = can_generate;
+    decoded.levelCount = can_generate ? vtrs::MipGenerator::getLevelCount(decoded.extent.width, decoded.extent.height) : 1;
+}
+
+uint32_t vtrs::TextureStreamer::getTargetLevel_(const stream_texture* texture) {
+    return std::min(std::max(texture->baseLevel, texture->minBaseLevel), texture->maxBaseLevel);
+}
+
+void vtrs::TextureStreamer::requeue_(vtrs::TextureStreamer::Handle handle, stream_texture* texture) {
+    texture->state = STATE_QUEUED;
+    m_decodeQueue.emplace(texture->priority, -(m_requestCount++), handle);
+    m_wakeCondition.notify_one();
+}
+
+void vtrs::TextureStreamer::restream_(vtrs::TextureStreamer::Handle handle, stream_texture* texture) {
+    /* Work already under way finishes first, update queues the texture again afterwards. */
+    if (texture->state == STATE_RESIDENT && texture->resident.baseLevel != getTargetLevel_(texture)) {
+        requeue_(handle, texture);
+    }
+}
+
+void vtrs::TextureStreamer::createImage_(
+        stream_image* image, VkFormat format, VkExtent2D extent, uint32_t level_count, VkImageUsageFlags usage, VkImageCreateFlags flags) {
+
+    VkImageCreateInfo image_info {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    image_info.flags = flags;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.extent = {extent.width, extent.height, 1};
+    image_info.mipLevels = level_count;
+    image_info.arrayLayers = 1;
+    image_info.format = format;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    image_info.usage = usage;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    auto result = vkCreateImage(m_logicalDevice, &image_info, nullptr, &image->image);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create streamed texture image.")
+
+    image->allocation = m_deviceAllocator->allocateImage(image->image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    image->format = format;
+    image->levelCount = level_count;
+    image->minLevel = 0;
+}
+
+void vtrs::TextureStreamer::createView_(stream_image* image) {
+    if (image->view != VK_NULL_HANDLE) {
+        stream_image old_view {};
+        old_view.view = image->view;
+
+        retire_(old_view, 0);
+    }
+
+    /* Levels below the clamp may not hold texels yet, they must never be sampled. */
+    uint32_t first_level = m_options.useMinLod ? 0 : image->minLevel;
+
+    VkImageViewCreateInfo view_info {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+    view_info.image = image->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = image->format;
+    view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, first_level, image->levelCount - first_level, 0, 1};
+
+    VkImageViewMinLodCreateInfoEXT min_lod_info {VK_STRUCTURE_TYPE_IMAGE_VIEW_MIN_LOD_CREATE_INFO_EXT};
+    min_lod_info.minLod = static_cast<float>(image->minLevel);
+
+    if (m_options.useMinLod && image->minLevel > 0) {
+        view_info.pNext = &min_lod_info;
+    }
+
+    auto result = vkCreateImageView(m_logicalDevice, &view_info, nullptr, &image->view);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create streamed texture view.")
+}
+
+void vtrs::TextureStreamer::upload_(stream_texture* texture, uint32_t first_level, uint32_t end_level) {
+    decoded_texture& decoded = texture->decoded;
+    bool is_first_run = end_level == decoded.levels.size();
+
+    if (is_first_run) {
+        VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        VkImageCreateFlags flags = 0;
+
+        if (decoded.generateMips) {
+            usage = m_options.mipGenerator->getImageUsage(decoded.format);
+            flags = m_options.mipGenerator->getImageFlags(decoded.format);
+        }
+
+        createImage_(&texture->incoming, decoded.format, decoded.extent, decoded.levelCount, usage, flags);
+        texture->incoming.baseLevel = decoded.baseLevel;
+        texture->incoming.minLevel = decoded.levelCount;
+        texture->landedLevel = decoded.levelCount;
+    }
+
+    /* Once the incoming image is on display, the remaining levels go straight into it. */
+    VkImage image = texture->incoming.image != VK_NULL_HANDLE ? texture->incoming.image : texture->resident.image;
+
+    vtrs::UploadQueue::ImageTarget upload_target {};
+    upload_target.range = {VK_IMAGE_ASPECT_COLOR_BIT, first_level, end_level - first_level, 0, 1};
+
+    /* The first run moves every level to its final layout, so a view
+     * covering levels that are still empty is never in the wrong layout. */
+    if (is_first_run && !decoded.generateMips) {
+        upload_target.range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, decoded.levelCount, 0, 1};
+    }
+
+    /* Level 0 is left as a transfer source, the mip generator fills the rest. */
+    if (decoded.generateMips) {
+        upload_target.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        upload_target.dstStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        upload_target.dstAccess = VK_ACCESS_TRANSFER_READ_BIT;
+    }
+
+    VkDeviceSize begin = decoded.levels[first_level].offset;
+    VkDeviceSize end = decoded.levels[end_level - 1].offset + decoded.levels[end_level - 1].size;
+
+    std::vector<VkBufferImageCopy> regions {};
+
+    for (uint32_t level = first_level; level < end_level; level++) {
+        const decoded_level& source = decoded.levels[level];
+
+        VkBufferImageCopy region {};
+        region.bufferOffset = source.offset - begin;
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+        region.imageExtent = {source.extent.width, source.extent.height, 1};
+
+        regions.push_back(region);
+    }
+
+    /* The texels are copied into the staging ring, the CPU copy goes once every level is recorded. */
+    m_uploadQueue->uploadImage(image, decoded.texels.data() + begin, end - begin, regions, upload_target);
+
+    if (decoded.generateMips) {
+        vtrs::MipGenerator::Target mip_target {};
+        mip_target.image = image;
+        mip_target.format = decoded.format;
+        mip_target.extent = decoded.extent;
+        mip_target.levelCount = decoded.levelCount;
+
+        m_options.mipGenerator->enqueue(mip_target);
+    }
+
+    texture->recordedLevel = first_level;
+}
+
+bool vtrs::TextureStreamer::showLevels_(stream_texture* texture) {
+    if (texture->incoming.image == VK_NULL_HANDLE) {
+        texture->resident.minLevel = texture->landedLevel;
+        createView_(&texture->resident);
+
+        return true;
+    }
+
+    texture->incoming.minLevel = texture->landedLevel;
+
+    /* The resident image stays bound until the incoming one shows at least as much detail. */
+    if (texture->isResident && texture->landedLevel > 0 &&
+        texture->incoming.baseLevel + texture->incoming.minLevel > texture->resident.baseLevel + texture->resident.minLevel) {
+        return false;
+    }
+
+    /* The image being replaced may still be sampled by frames in flight. */
+    retire_(texture->resident, 0);
+
+    texture->resident = texture->incoming;
+    texture->incoming = stream_image();
+    texture->isResident = true;
+
+    createView_(&texture->resident);
+    return true;
+}
+
+void vtrs::TextureStreamer::retire_(stream_image& image, vtrs::UploadQueue::Token token) {
+    if (image.image == VK_NULL_HANDLE && image.view == VK_NULL_HANDLE) {
+        return;
+    }
+
+    retired_image retired {};
+    retired.image = image;
+    retired.token = token;
+    retired.countdown = m_options.framesInFlight;
+
+    m_retired.push_back(retired);
+    image = stream_image();
+}
+
+void vtrs::TextureStreamer::destroyImage_(stream_image& image) {
+    if (m_options.descriptorAllocator != nullptr && image.view != VK_NULL_HANDLE) {
+        m_options.descriptorAllocator->invalidate(image.view);
+    }
+
+    vkDestroyImageView(m_logicalDevice, image.view, nullptr);
+    vkDestroyImage(m_logicalDevice, image.image, nullptr);
+    m_deviceAllocator->free(image.allocation);
+
+    image = stream_image();
+}
+
+void vtrs::TextureStreamer::createPlaceholder_() {
+    stream_image placeholder {};
+    createImage_(&placeholder, VK_FORMAT_R8G8B8A8_UNORM, {1, 1}, 1, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 0);
+    createView_(&placeholder);
+
+    m_placeholderImage = placeholder.image;
+    m_placeholderView = placeholder.view;
+    m_placeholderAllocation = placeholder.allocation;
+
+    /* A mid grey texel, neutral under most materials. */
+    const uint8_t texel[4] = {128, 128, 128, 255};
+    m_uploadQueue->uploadImage(m_placeholderImage, texel, sizeof(texel), {1, 1, 1});
+}
+
+void vtrs::TextureStreamer::bootstrap_(vtrs::texture_streamer_opts* options) {
+    m_options = *options;
+    m_options.framesInFlight = std::max<uint32_t>(m_options.framesInFlight, 1);
+
+    if (m_options.mipGenerator != nullptr && m_options.graphicsQueue == VK_NULL_HANDLE) {
+        throw vtrs::RendererError("Mip generation needs the graphics queue.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    createPlaceholder_();
+
+    /* Frames recorded from now on can sample the placeholder. */
+    m_uploadQueue->submit();
+
+    uint32_t thread_count = m_options.decodeThreads;
+
+    if (thread_count == 0) {
+        thread_count = std::max(std::thread::hardware_concurrency() / 2, 1U);
+    }
+
+    for (uint32_t worker = 0; worker < thread_count; worker++) {
+        m_workers.emplace_back(&TextureStreamer::workerLoop_, this, worker);
+    }
+}
+
+vtrs::TextureStreamer::TextureStreamer(
+        VkPhysicalDevice physical_device, VkDevice logical_device, vtrs::DeviceAllocator* allocator, vtrs::UploadQueue* upload_queue) :
+    m_physicalDevice(physical_device), m_logicalDevice(logical_device), m_deviceAllocator(allocator), m_uploadQueue(upload_queue) {}
+
+vtrs::TextureStreamer*
+vtrs::TextureStreamer::factory(
+        VkPhysicalDevice physical_device,
+        VkDevice logical_device,
+        vtrs::DeviceAllocator* allocator,
+        vtrs::UploadQueue* upload_queue,
+        vtrs::TextureStreamer::Options* options) {
+
+    auto instance = new TextureStreamer(physical_device, logical_device, allocator, upload_queue);
+    instance->bootstrap_(options);
+
+    return instance;
+}
+
+vtrs::TextureStreamer::~TextureStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_isStopping = true;
+    }
+
+    m_wakeCondition.notify_all();
+
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+
+    /* Uploads still in flight write into images about to be destroyed. */
+    vtrs::UploadQueue::Token last_token = 0;
+
+    for (auto handle : m_uploading) {
+        last_token = std::max(last_token, texture_(handle)->token);
+    }
+
+    for (const auto& retired : m_retired) {
+        last_token = std::max(last_token, retired.token);
+    }
+
+    if (last_token != 0) {
+        m_uploadQueue->wait(last_token);
+    }
+
+    if (m_options.mipGenerator != nullptr) {
+        m_options.mipGenerator->wait();
+    }
+
+    for (auto& texture : m_textures) {
+        if (texture->incoming.image != VK_NULL_HANDLE) {
+            destroyImage_(texture->incoming);
+        }
+
+        if (texture->resident.image != VK_NULL_HANDLE) {
+            destroyImage_(texture->resident);
+        }
+    }
+
+    for (auto& retired : m_retired) {
+        destroyImage_(retired.image);
+    }
+
+    if (m_options.descriptorAllocator != nullptr) {
+        m_options.descriptorAllocator->invalidate(m_placeholderView);
+    }
+
+    vkDestroyImageView(m_logicalDevice, m_placeholderView, nullptr);
+    vkDestroyImage(m_logicalDevice, m_placeholderImage, nullptr);
+    m_deviceAllocator->free(m_placeholderAllocation);
+}
+
+vtrs::TextureStreamer::Handle vtrs::TextureStreamer::request(const std::string& path, int priority, uint32_t base_level) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint32_t slot = 0;
+    uint32_t generation = 0;
+
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.back();
+        generation = m_textures[slot]->generation + 1;
+        m_freeSlots.pop_back();
+
+    } else if (m_textures.size() <= VTRS_STREAMER_SLOT_MASK) {
+        slot = static_cast<uint32_t>(m_textures.size());
+        m_textures.emplace_back();
+
+    } else {
+        throw vtrs::RendererError("Too many textures are streamed at once.", vtrs::RendererError::E_TYPE_GENERAL);
+    }
+
+    auto texture = std::make_unique<stream_texture>();
+    texture->generation = generation;
+    texture->path = path;
+    texture->priority = priority;
+    texture->baseLevel = base_level;
+
+    m_textures[slot] = std::move(texture);
+
+    auto handle = static_cast<Handle>(generation << VTRS_STREAMER_SLOT_BITS | slot);
+    m_decodeQueue.emplace(priority, -(m_requestCount++), handle);
+
+    m_wakeCondition.notify_one();
+    return handle;
+}
+
+void vtrs::TextureStreamer::release(vtrs::TextureStreamer::Handle handle) {
+    stream_texture* texture = texture_(handle);
+
+    if (texture == nullptr) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        switch (texture->state) {
+            case STATE_RELEASED:
+                return;
+
+            case STATE_DECODING:
+                /* The decode thread drops the texels once it is done. */
+                texture->isReleased = true;
+                break;
+
+            case STATE_DECODED:
+                m_decoded.erase(std::find(m_decoded.begin(), m_decoded.end(), handle));
+                texture->decoded = decoded_texture();
+                texture->state = STATE_RELEASED;
+                break;
+
+            case STATE_UPLOADING: {
+                auto waiting = std::find(m_decoded.begin(), m_decoded.end(), handle);
+
+                if (waiting != m_decoded.end()) {
+                    m_decoded.erase(waiting);
+                }
+
+                m_uploading.erase(std::find(m_uploading.begin(), m_uploading.end(), handle));
+                retire_(texture->incoming, texture->token);
+
+                texture->decoded = decoded_texture();
+                texture->pendingLevels.clear();
+                texture->state = STATE_RELEASED;
+                break;
+            }
+
+            default:
+                texture->state = STATE_RELEASED;
+                break;
+        }
+
+        texture->isReleased = true;
+
+        /* A texture being decoded gives its slot back once the decode thread lets go of it. */
+        if (texture->state == STATE_RELEASED) {
+            freeSlot_(handle);
+        }
+    }
+
+    /* Levels may still be on their way into the resident image. */
+    retire_(texture->resident, texture->token);
+    texture->isResident = false;
+}
+
+void vtrs::TextureStreamer::setPriority(vtrs::TextureStreamer::Handle handle, int priority) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    stream_texture* texture = texture_(handle);
+
+    if (texture == nullptr || texture->priority == priority || texture->isReleased) {
+        return;
+    }
+
+    texture->priority = priority;
+
+    /* The old entry stays in the heap and is skipped once popped. */
+    if (texture->state == STATE_QUEUED) {
+        requeue_(handle, texture);
+    }
+}
+
+void vtrs::TextureStreamer::setBaseLevel(vtrs::TextureStreamer::Handle handle, uint32_t base_level) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    stream_texture* texture = texture_(handle);
+
+    if (texture == nullptr || texture->isReleased || texture->state == STATE_FAILED) {
+        return;
+    }
+
+    texture->baseLevel = base_level;
+    restream_(handle, texture);
+}
+
+void vtrs::TextureStreamer::setMinBaseLevel(vtrs::TextureStreamer::Handle handle, uint32_t base_level) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    stream_texture* texture = texture_(handle);
+
+    if (texture == nullptr || texture->isReleased || texture->state == STATE_FAILED) {
+        return;
+    }
+
+    texture->minBaseLevel = base_level;
+    restream_(handle, texture);
+}
+
+bool vtrs::TextureStreamer::update() {
+    VTRS_PROFILE_FUNCTION();
+
+    bool has_changed = false;
+
+    for (auto iter = m_retired.begin(); iter != m_retired.end();) {
+        if (iter->countdown > 0) {
+            iter->countdown--;
+        }
+
+        if (iter->countdown > 0 || (iter->token != 0 && !m_uploadQueue->isComplete(iter->token))) {
+            ++iter;
+            continue;
+        }
+
+        destroyImage_(iter->image);
+        iter = m_retired.erase(iter);
+    }
+
+    for (auto iter = m_uploading.begin(); iter != m_uploading.end();) {
+        stream_texture* texture = texture_(*iter);
+        uint32_t landed_level = texture->landedLevel;
+
+        /* Runs are submitted coarsest first, so they also land in that order. */
+        while (!texture->pendingLevels.empty() && m_uploadQueue->isComplete(texture->pendingLevels.front().second)) {
+            landed_level = texture->pendingLevels.front().first;
+            texture->pendingLevels.erase(texture->pendingLevels.begin());
+        }
+
+        if (landed_level == texture->landedLevel) {
+            ++iter;
+            continue;
+        }
+
+        texture->landedLevel = landed_level;
+
+        if (showLevels_(texture)) {
+            has_changed = true;
+        }
+
+        if (landed_level > 0) {
+            ++iter;
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            texture->state = STATE_RESIDENT;
+            restream_(*iter, texture);
+        }
+
+        iter = m_uploading.erase(iter);
+    }
+
+    VkDeviceSize allowance = m_options.frameBudget;
+
+    if (m_budgetDebt >= allowance) {
+        m_budgetDebt -= allowance;
+        return has_changed;
+    }
+
+    allowance -= m_budgetDebt;
+    m_budgetDebt = 0;
+
+    /* Texture with the finest and one past the coarsest image level recorded this frame. */
+    std::vector<std::tuple<stream_texture*, uint32_t, uint32_t>> batch {};
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::stable_sort(m_decoded.begin(), m_decoded.end(), [this](Handle left, Handle right) {
+            return texture_(left)->priority > texture_(right)->priority;
+        });
+
+        std::vector<Handle> waiting {};
+
+        for (auto handle : m_decoded) {
+            stream_texture* texture = texture_(handle);
+            decoded_texture& decoded = texture->decoded;
+
+            /* The base level moved while the texture waited, its texels are stale. */
+            if (texture->state == STATE_DECODED && decoded.baseLevel != getTargetLevel_(texture)) {
+                texture->decoded = decoded_texture();
+                requeue_(handle, texture);
+                continue;
+            }
+
+            auto end_level = texture->state == STATE_DECODED ? static_cast<uint32_t>(decoded.levels.size()) : texture->recordedLevel;
+            uint32_t first_level = end_level;
+
+            while (first_level > 0 && allowance > 0) {
+                uint32_t next_level = m_options.progressiveUpload ? first_level - 1 : 0;
+                VkDeviceSize size = decoded.levels[first_level - 1].offset + decoded.levels[first_level - 1].size - decoded.levels[next_level].offset;
+
+                /* A run above the whole budget goes alone and is paid back over the next frames. */
+                if (size > allowance) {
+                    if (!batch.empty() || first_level != end_level || allowance < m_options.frameBudget) {
+                        allowance = 0;
+                        break;
+                    }
+
+                    m_budgetDebt = size - allowance;
+                    allowance = 0;
+
+                } else {
+                    allowance -= size;
+                }
+
+                first_level = next_level;
+            }
+
+            if (first_level == end_level) {
+                waiting.push_back(handle);
+                continue;
+            }
+
+            if (texture->state == STATE_DECODED) {
+                texture->state = STATE_UPLOADING;
+                m_uploading.push_back(handle);
+            }
+
+            if (first_level > 0) {
+                waiting.push_back(handle);
+            }
+
+            batch.emplace_back(texture, first_level, end_level);
+        }
+
+        m_decoded.swap(waiting);
+    }
+
+    if (batch.empty()) {
+        return has_changed;
+    }
+
+    for (auto& run : batch) {
+        upload_(std::get<0>(run), std::get<1>(run), std::get<2>(run));
+    }
+
+    auto token = m_uploadQueue->submit();
+
+    for (auto& run : batch) {
+        stream_texture* texture = std::get<0>(run);
+        texture->token = token;
+        texture->pendingLevels.emplace_back(std::get<1>(run), token);
+
+        if (texture->recordedLevel == 0) {
+            texture->decoded = decoded_texture();
+        }
+    }
+
+    /* Mip levels are built on the graphics queue once the upload token is reached. */
+    if (m_options.mipGenerator != nullptr) {
+        m_options.mipGenerator->submit(m_options.graphicsQueue, m_uploadQueue->getSemaphore(), token);
+    }
+
+    return has_changed;
+}
+
+VkImageView vtrs::TextureStreamer::getView(vtrs::TextureStreamer::Handle handle) const {
+    const stream_texture* texture = texture_(handle);
+    return texture != nullptr && texture->isResident ? texture->resident.view : m_placeholderView;
+}
+
+int vtrs::TextureStreamer::getState(vtrs::TextureStreamer::Handle handle) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const stream_texture* texture = texture_(handle);
+    return texture != nullptr ? texture->state : STATE_RELEASED;
+}
+
+bool vtrs::TextureStreamer::isResident(vtrs::TextureStreamer::Handle handle) const {
+    const stream_texture* texture = texture_(handle);
+    return texture != nullptr && texture->isResident;
+}
+
+uint32_t vtrs::TextureStreamer::getBaseLevel(vtrs::TextureStreamer::Handle handle) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const stream_texture* texture = texture_(handle);
+    return texture != nullptr ? getTargetLevel_(texture) : 0;
+}
+
+uint32_t vtrs::TextureStreamer::getResidentBaseLevel(vtrs::TextureStreamer::Handle handle) const {
+    const stream_texture* texture = texture_(handle);
+    return texture != nullptr ? texture->resident.baseLevel : 0;
+}
+
+uint32_t vtrs::TextureStreamer::getResidentLevel(vtrs::TextureStreamer::Handle handle) const {
+    const stream_texture* texture = texture_(handle);
+    return texture != nullptr ? texture->resident.baseLevel + texture->resident.minLevel : 0;
+}
+
+uint32_t vtrs::TextureStreamer::getMaxBaseLevel(vtrs::TextureStreamer::Handle handle) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const stream_texture* texture = texture_(handle);
+    return texture != nullptr && texture->maxBaseLevel != UINT32_MAX ? texture->maxBaseLevel : 0;
+}
+
+VkExtent2D vtrs::TextureStreamer::getExtent(vtrs::TextureStreamer::Handle handle) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const stream_texture* texture = texture_(handle);
+    return texture != nullptr ? texture->extent : VkExtent2D {0, 0};
+}
+
+VkDeviceSize vtrs::TextureStreamer::getResidentSize(vtrs::TextureStreamer::Handle handle) const {
+    const stream_texture* texture = texture_(handle);
+    return texture != nullptr ? texture->resident.allocation.size + texture->incoming.allocation.size : 0;
+}
+
+uint32_t vtrs::TextureStreamer::getPendingCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return static_cast<uint32_t>(std::count_if(m_textures.begin(), m_textures.end(), [](const std::unique_ptr<stream_texture>& texture) {
+        return texture->state != STATE_RESIDENT && texture->state != STATE_FAILED && texture->state != STATE_RELEASED;
+    }));
+}
+
+void vtrs::TextureStreamer::setFrameBudget(VkDeviceSize budget) {
+    m_options.frameBudget = std::max<VkDeviceSize>(budget, 1);
+}
+
+void vtrs::TextureStreamer::setFramesInFlight(uint32_t frames_in_flight) {
+    m_options.framesInFlight = std::max<uint32_t>(frames_in_flight, 1);
+}
@@ -0,0 +1,457 @@
+/**
+ * texture_streamer.hpp - Background texture decoding with budgeted uploads.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "vulkan_api.hpp"
+#include "device_allocator.hpp"
+#include "upload_queue.hpp"
+#include "mip_generator.hpp"
+#include "descriptor_allocator.hpp"
+#include "ktx2_texture.hpp"
+
+namespace vtrs {
+
+struct texture_streamer_opts {
+    /* Number of decode threads, zero picks half of the hardware threads. */
+    uint32_t decodeThreads = 0;
+
+    /* Bytes of texel data handed to the upload queue per frame. */
+    VkDeviceSize frameBudget = 8 * 1024 * 1024;
+
+    /* Released and replaced images are destroyed after this many updates. */
+    uint32_t framesInFlight = 2;
+
+    /* Builds missing mip levels on the graphics queue, nullptr to skip generation. */
+    vtrs::MipGenerator* mipGenerator = nullptr;
+    VkQueue graphicsQueue = VK_NULL_HANDLE;
+
+    /* Cached sets of views are invalidated in it before the views are destroyed. */
+    vtrs::DescriptorAllocator* descriptorAllocator = nullptr;
+
+    /* Decodes an image file into tightly packed RGBA8 pixels, returns false on failure. */
+    std::function<bool(const std::string& path, std::vector<uint8_t>& pixels, uint32_t* width, uint32_t* height)> decoder {};
+
+    /* Format the decoded pixels are uploaded as. */
+    VkFormat pixelFormat = VK_FORMAT_R8G8B8A8_SRGB;
+
+    /* Hooks used for .ktx2 files, which are imported without the decoder. */
+    vtrs::Ktx2Texture::Options ktx2Options {};
+
+    /* Upload levels coarsest first, a few per frame, instead of whole images.
+     * Pixel textures then get their mip chain built on the decode threads. */
+    bool progressiveUpload = false;
+
+    /* Clamp views with VK_EXT_image_view_min_lod, its minLod feature must be enabled.
+     * Otherwise views of partly uploaded images start at the finest level uploaded. */
+    bool useMinLod = false;
+};
+
+/**
+ * @brief Loads textures in the background and uploads them within a budget.
+ *
+ * A request returns a handle right away. Files are decoded on worker
+ * threads, highest priority first, and the decoded texels wait on the
+ * CPU until update hands them to the upload queue. Each update uploads
+ * at most the frame budget, so a heavy asset is spread over several
+ * frames instead of stalling one. A texture larger than the budget is
+ * uploaded alone and the excess is taken from the following frames.
+ *
+ * Until its upload token completes, a handle resolves to a 1x1
+ * placeholder view. update reports when a texture became resident so
+ * descriptors can be pointed at the real view.
+ *
+ * With progressive uploads, levels are uploaded coarsest first and each
+ * one is charged to the budget on its own. The view is clamped to the
+ * finest level that has landed, with minLod when the device allows it,
+ * so a texture sharpens over a few frames instead of popping in late.
+ *
+ * A texture can be streamed again from a coarser or finer base level,
+ * which becomes level 0 of a smaller or larger image. The level streamed
+ * is the finer of the requested base level and the minimum base level,
+ * so a residency heuristic and a memory budget can each hold their own.
+ * The resident image stays bound until the new one is at least as
+ * detailed. Replaced and released images are destroyed once the frames
+ * in flight can no longer sample them.
+ *
+ * The streamer is not thread safe, request and update are expected to
+ * be called from the thread that submits frames.
+ */
+class TextureStreamer {
+
+public:
+    enum State : int {
+        STATE_QUEUED = 0,
+        STATE_DECODING,
+        STATE_DECODED,
+        STATE_UPLOADING,
+        STATE_RESIDENT,
+        STATE_FAILED,
+        STATE_RELEASED
+    };
+
+    typedef uint32_t Handle;
+
+private:
+    struct stream_image {
+        VkImage     image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        vtrs::DeviceAllocator::Allocation allocation {};
+        VkFormat    format = VK_FORMAT_UNDEFINED;
+        uint32_t    baseLevel = 0;
+        uint32_t    levelCount = 1;
+
+        /* Finest level holding texels, the view is clamped to it. */
+        uint32_t    minLevel = 0;
+    };
+
+    struct decoded_level {
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        VkExtent2D   extent {0, 0};
+    };
+
+    struct decoded_texture {
+        /* Texels of the uploaded levels, level 0 of the image first. */
+        std::vector<uint8_t> texels {};
+        std::vector<decoded_level> levels {};
+
+        VkFormat   format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent {0, 0};
+        uint32_t   baseLevel = 0;
+
+        /* Levels of the image, more than were decoded when the mip generator fills them. */
+        uint32_t   levelCount = 1;
+        bool       generateMips = false;
+    };
+
+    struct stream_texture {
+        /* Bumped whenever the slot is reused, handles carry it in their upper bits. */
+        uint32_t generation = 0;
+
+        std::string path {};
+        int priority = 0;
+        int state = STATE_QUEUED;
+        bool isReleased = false;
+
+        /* The next decode starts from the finer of the two. */
+        uint32_t baseLevel = 0;
+        uint32_t minBaseLevel = 0;
+
+        /* Known once the file has been decoded. */
+        uint32_t   maxBaseLevel = UINT32_MAX;
+        VkExtent2D extent {0, 0};
+
+        decoded_texture decoded {};
+
+        stream_image incoming {};
+        stream_image resident {};
+        vtrs::UploadQueue::Token token = 0;
+
+        /* Image levels recorded and landed so far, counting down to zero. */
+        uint32_t recordedLevel = 0;
+        uint32_t landedLevel = 0;
+        std::vector<std::pair<uint32_t, vtrs::UploadQueue::Token>> pendingLevels {};
+
+        /* Only touched by the submitting thread, so views can be resolved without locking. */
+        bool isResident = false;
+    };
+
+    struct retired_image {
+        stream_image image {};
+        vtrs::UploadQueue::Token token = 0;
+        uint32_t countdown = 0;
+    };
+
+    /* Priority, then request order, then handle. */
+    typedef std::tuple<int, int64_t, Handle> queue_entry;
+
+    VkPhysicalDevice        m_physicalDevice = VK_NULL_HANDLE;
+    VkDevice                m_logicalDevice = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator*  m_deviceAllocator = nullptr;
+    vtrs::UploadQueue*      m_uploadQueue = nullptr;
+
+    struct texture_streamer_opts m_options {};
+
+    std::vector<std::unique_ptr<stream_texture>> m_textures {};
+    std::vector<uint32_t> m_freeSlots {};
+    std::priority_queue<queue_entry> m_decodeQueue {};
+    std::vector<Handle> m_decoded {};
+    std::vector<Handle> m_uploading {};
+    std::vector<retired_image> m_retired {};
+    int64_t m_requestCount = 0;
+
+    std::vector<std::thread> m_workers {};
+    std::mutex              m_mutex {};
+    std::condition_variable m_wakeCondition {};
+    bool                    m_isStopping = false;
+
+    /* Bytes uploaded beyond the budget, paid back by the next frames. */
+    VkDeviceSize m_budgetDebt = 0;
+
+    VkImage     m_placeholderImage = VK_NULL_HANDLE;
+    VkImageView m_placeholderView = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator::Allocation m_placeholderAllocation {};
+
+    /**
+     * @brief Returns the texture a handle refers to, nullptr once its slot was reused.
+     */
+    [[nodiscard]] stream_texture* texture_(Handle handle) const;
+
+    /**
+     * @brief Hands the slot of a released texture back for reuse. Expects the mutex to be held.
+     */
+    void freeSlot_(Handle handle);
+
+    /**
+     * @brief Loop executed by each decode thread.
+     */
+    void workerLoop_(uint32_t worker);
+
+    /**
+     * @brief Decodes a file from a base level. Runs on a decode thread.
+     * @param path Path of the texture file.
+     * @param base_level Requested base level, clamped to what the file provides.
+     * @param decoded Receives the texels.
+     * @param extent Receives the extent of level 0.
+     * @param max_base_level Receives the coarsest level the file can be streamed from.
+     */
+    void decode_(const std::string& path, uint32_t base_level, decoded_texture& decoded, VkExtent2D* extent, uint32_t* max_base_level);
+
+    /**
+     * @brief Returns the base level the texture is streamed from. Expects the mutex to be held.
+     */
+    static uint32_t getTargetLevel_(const stream_texture* texture);
+
+    /**
+     * @brief Queues a texture for decoding again. Expects the mutex to be held.
+     */
+    void requeue_(Handle handle, stream_texture* texture);
+
+    /**
+     * @brief Queues a resident texture again if its target level moved. Expects the mutex to be held.
+     */
+    void restream_(Handle handle, stream_texture* texture);
+
+    /**
+     * @brief Records the upload of a run of decoded levels.
+     * @param texture Texture being uploaded, its image is created with the first run.
+     * @param first_level Finest image level of the run.
+     * @param end_level One past the coarsest image level of the run.
+     */
+    void upload_(stream_texture* texture, uint32_t first_level, uint32_t end_level);
+
+    /**
+     * @brief Clamps the view of a texture to its landed levels, swapping in the incoming image when it is detailed enough.
+     * @param texture Texture whose levels landed.
+     * @return True if the view to sample changed.
+     */
+    bool showLevels_(stream_texture* texture);
+
+    /**
+     * @brief Creates a sampled 2D image without a view.
+     */
+    void createImage_(stream_image* image, VkFormat format, VkExtent2D extent, uint32_t level_count,
+                      VkImageUsageFlags usage, VkImageCreateFlags flags);
+
+    /**
+     * @brief Creates the view of an image from its finest landed level, retiring the previous one.
+     */
+    void createView_(stream_image* image);
+
+    /**
+     * @brief Hands an image or a lone view over to be destroyed once no frame can use it.
+     */
+    void retire_(stream_image& image, vtrs::UploadQueue::Token token);
+
+    /**
+     * @brief Destroys an image and its view.
+     */
+    void destroyImage_(stream_image& image);
+
+    /**
+     * @brief Creates the placeholder texture and records its upload.
+     */
+    void createPlaceholder_();
+
+    /**
+     * @brief Bootstraps the texture streamer.
+     * @param options Streamer configuration.
+     *
+     * The boostrap method will:
+     * - Create and upload the placeholder texture.
+     * - Start the decode threads.
+     */
+    void bootstrap_(struct texture_streamer_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     */
+    TextureStreamer(VkPhysicalDevice, VkDevice, vtrs::DeviceAllocator*, vtrs::UploadQueue*);
+
+public:
+    typedef struct texture_streamer_opts Options;
+
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    /**
+     * @brief Creates a streamer and starts its decode threads.
+     * @param physical_device   Vulkan physical device handle.
+     * @param logical_device    Vulkan logical device handle.
+     * @param allocator         Device allocator backing the images.
+     * @param upload_queue      Queue the texel uploads are recorded into.
+     * @param options           Streamer configuration.
+     * @return Instance of the texture streamer.
+     * @throws vtrs::RendererError Thrown if the placeholder could not be created.
+     */
+    static TextureStreamer* factory(VkPhysicalDevice, VkDevice, vtrs::DeviceAllocator*, vtrs::UploadQueue*, TextureStreamer::Options*);
+
+    /**
+     * @brief Stops the decode threads, waits for pending uploads and destroys every texture.
+     *
+     * The GPU must be done with every view handed out.
+     */
+    ~TextureStreamer();
+
+    /**
+     * @brief Queues a texture file for decoding.
+     * @param path Path to a .ktx2 file, or any file the decoder understands.
+     * @param priority Higher priorities are decoded and uploaded first.
+     * @param base_level Level streamed as level 0, finer levels are left out.
+     * @return Handle of the texture, which resolves to the placeholder until resident.
+     * @throws vtrs::RendererError Thrown if every handle slot is live.
+     */
+    Handle request(const std::string& path, int priority = 0, uint32_t base_level = 0);
+
+    /**
+     * @brief Drops a texture. Its handle resolves to the placeholder from now on.
+     *
+     * Pending work is cancelled and the images are destroyed once the
+     * frames in flight are done with them. The slot of the handle is
+     * reused under a new generation, and retired once its 4096 generations
+     * are used up, so a released handle never resolves to another texture.
+     */
+    void release(Handle handle);
+
+    /**
+     * @brief Changes the priority of a texture that has not been uploaded yet.
+     */
+    void setPriority(Handle handle, int priority);
+
+    /**
+     * @brief Streams a texture again with another level as its finest.
+     * @param handle Texture to stream.
+     * @param base_level Level of the full chain that becomes level 0 of the image.
+     *
+     * The level is clamped to the coarsest one the file provides. The
+     * resident image stays bound until the new one is at least as detailed.
+     */
+    void setBaseLevel(Handle handle, uint32_t base_level);
+
+    /**
+     * @brief Keeps a texture from being streamed finer than a level, whatever its base level asks for.
+     * @param handle Texture to limit.
+     * @param base_level Finest level allowed as level 0 of the image, zero lifts the limit.
+     */
+    void setMinBaseLevel(Handle handle, uint32_t base_level);
+
+    /**
+     * @brief Retires finished uploads and uploads decoded textures within the budget.
+     * @return True if any texture became resident or was replaced since the last call.
+     *
+     * Call once per frame, after waiting for the frame's fence and
+     * before recording commands that sample the textures.
+     */
+    bool update();
+
+    /**
+     * @brief Returns the view to sample, the placeholder until the texture is resident.
+     */
+    [[nodiscard]] VkImageView getView(Handle handle) const;
+
+    /**
+     * @brief Returns the state of a texture.
+     */
+    [[nodiscard]] int getState(Handle handle);
+
+    /**
+     * @brief Tells whether a texture can be sampled.
+     */
+    [[nodiscard]] bool isResident(Handle handle) const;
+
+    /**
+     * @brief Returns the base level the texture is being streamed towards, after the minimum is applied.
+     */
+    [[nodiscard]] uint32_t getBaseLevel(Handle handle);
+
+    /**
+     * @brief Returns the base level of the resident image.
+     */
+    [[nodiscard]] uint32_t getResidentBaseLevel(Handle handle) const;
+
+    /**
+     * @brief Returns the finest level of the full chain the resident view can sample.
+     */
+    [[nodiscard]] uint32_t getResidentLevel(Handle handle) const;
+
+    /**
+     * @brief Returns the coarsest base level, zero until the file has been decoded.
+     */
+    [[nodiscard]] uint32_t getMaxBaseLevel(Handle handle);
+
+    /**
+     * @brief Returns the extent of level 0, zero until the file has been decoded.
+     */
+    [[nodiscard]] VkExtent2D getExtent(Handle handle);
+
+    /**
+     * @brief Returns the device memory held by a texture, its resident image and the incoming one being streamed.
+     */
+    [[nodiscard]] VkDeviceSize getResidentSize(Handle handle) const;
+
+    /**
+     * @brief Returns the number of textures not yet resident, failed or released.
+     */
+    [[nodiscard]] uint32_t getPendingCount();
+
+    /**
+     * @brief Changes the number of bytes uploaded per frame.
+     */
+    void setFrameBudget(VkDeviceSize budget);
+
+    /**
+     * @brief Changes how many updates a retired image is kept for.
+     */
+    void setFramesInFlight(uint32_t frames_in_flight);
+};
+
+} // namespace vtrs
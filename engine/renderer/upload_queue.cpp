@@ -0,0 +1,520 @@
+/**
+ * upload_queue.cpp - Batched asynchronous uploads on the transfer queue.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#include <cstring>
+#include <algorithm>
+#include "assert.hpp"
+#include "upload_queue.hpp"
+
+static VkDeviceSize alignUp_(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool vtrs::UploadQueue::needsOwnershipTransfer_() const {
+    return m_transferFamily != m_graphicsFamily;
+}
+
+vtrs::UploadQueue::upload_batch* vtrs::UploadQueue::recordingBatch_() {
+    if (m_recording != nullptr) {
+        return m_recording;
+    }
+
+    upload_batch* batch;
+
+    if (!m_freeBatches.empty()) {
+        batch = m_freeBatches.back();
+        m_freeBatches.pop_back();
+
+    } else {
+        batch = new upload_batch();
+
+        VkCommandBufferAllocateInfo alloc_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        alloc_info.commandPool = m_transferPool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+
+        auto result = vkAllocateCommandBuffers(m_logicalDevice, &alloc_info, &batch->transferCommands);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to allocate upload command buffer.")
+
+        if (needsOwnershipTransfer_()) {
+            alloc_info.commandPool = m_graphicsPool;
+
+            result = vkAllocateCommandBuffers(m_logicalDevice, &alloc_info, &batch->acquireCommands);
+            VTRS_ASSERT_VK_RESULT(result, "Unable to allocate upload acquire command buffer.")
+        }
+    }
+
+    VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    auto result = vkBeginCommandBuffer(batch->transferCommands, &begin_info);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to begin upload command buffer.")
+
+    m_recording = batch;
+    return batch;
+}
+
+bool vtrs::UploadQueue::takeRing_(VkDeviceSize size, VkDeviceSize* offset) {
+    VkDeviceSize head = alignUp_(m_ringHead, m_stagingAlignment);
+
+    /* Ranges never end exactly on the tail while it is ahead of the head,
+     * so head == tail always means the ring is empty. */
+    if (m_ringHead >= m_ringTail) {
+        if (head + size <= m_stagingCapacity) {
+            *offset = head;
+            m_ringHead = head + size;
+            return true;
+        }
+
+        if (size < m_ringTail) {
+            *offset = 0;
+            m_ringHead = size;
+            return true;
+        }
+
+        return false;
+    }
+
+    if (head + size < m_ringTail) {
+        *offset = head;
+        m_ringHead = head + size;
+        return true;
+    }
+
+    return false;
+}
+
+VkBuffer vtrs::UploadQueue::stage_(const void* data, VkDeviceSize size, VkDeviceSize* offset) {
+    if (size > m_stagingCapacity / 2) {
+        VkBufferCreateInfo buffer_info {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+        buffer_info.size = size;
+        buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+        auto result = vkCreateBuffer(m_logicalDevice, &buffer_info, nullptr, &buffer);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to create oversized staging buffer.")
+
+        auto allocation = m_deviceAllocator->allocateBuffer(buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        std::memcpy(allocation.mappedData, data, static_cast<size_t>(size));
+        m_deviceAllocator->flush(allocation, 0, size);
+
+        recordingBatch_()->oversized.emplace_back(buffer, allocation);
+
+        *offset = 0;
+        return buffer;
+    }
+
+    while (!takeRing_(size, offset)) {
+        reclaim_();
+
+        if (takeRing_(size, offset)) {
+            break;
+        }
+
+        if (!m_pendingBatches.empty()) {
+            wait_(m_pendingBatches.front()->token);
+            reclaim_();
+
+        } else if (m_recording != nullptr) {
+            submit_();
+
+        } else {
+            throw vtrs::RendererError("Staging ring is too small for the upload.", vtrs::RendererError::E_TYPE_GENERAL);
+        }
+    }
+
+    std::memcpy(static_cast<char*>(m_stagingAllocation.mappedData) + *offset, data, static_cast<size_t>(size));
+    m_deviceAllocator->flush(m_stagingAllocation, *offset, size);
+
+    return m_stagingBuffer;
+}
+
+void vtrs::UploadQueue::reclaim_() {
+    while (!m_pendingBatches.empty()) {
+        auto batch = m_pendingBatches.front();
+
+        uint64_t value = 0;
+        vkGetSemaphoreCounterValue(m_logicalDevice, m_timeline, &value);
+
+        if (value < batch->token) {
+            break;
+        }
+
+        m_pendingBatches.pop_front();
+        m_ringTail = batch->ringEnd;
+
+        for (auto& oversized : batch->oversized) {
+            vkDestroyBuffer(m_logicalDevice, oversized.first, nullptr);
+            m_deviceAllocator->free(oversized.second);
+        }
+
+        batch->oversized.clear();
+
+        vkResetCommandBuffer(batch->transferCommands, 0);
+
+        if (batch->acquireCommands != VK_NULL_HANDLE) {
+            vkResetCommandBuffer(batch->acquireCommands, 0);
+        }
+
+        m_freeBatches.push_back(batch);
+    }
+
+    if (m_pendingBatches.empty() && m_recording == nullptr) {
+        m_ringHead = 0;
+        m_ringTail = 0;
+    }
+}
+
+uint64_t vtrs::UploadQueue::submit_() {
+    if (m_recording == nullptr) {
+        return m_lastToken;
+    }
+
+    auto batch = m_recording;
+    bool transfer_ownership = needsOwnershipTransfer_();
+
+    if (!transfer_ownership) {
+        if (!m_acquireBuffers.empty() || !m_acquireImages.empty()) {
+            vkCmdPipelineBarrier(batch->transferCommands,
+                VK_PIPELINE_STAGE_TRANSFER_BIT, m_acquireStages, 0, 0, nullptr,
+                static_cast<uint32_t>(m_acquireBuffers.size()), m_acquireBuffers.data(),
+                static_cast<uint32_t>(m_acquireImages.size()), m_acquireImages.data());
+        }
+
+    } else {
+        /* The release half keeps the layouts and families of the acquire
+         * half but carries no destination access, as the spec requires. */
+        std::vector<VkBufferMemoryBarrier> release_buffers = m_acquireBuffers;
+        std::vector<VkImageMemoryBarrier> release_images = m_acquireImages;
+
+        for (auto& barrier : release_buffers) barrier.dstAccessMask = 0;
+        for (auto& barrier : release_images) barrier.dstAccessMask = 0;
+        for (auto& barrier : m_acquireBuffers) barrier.srcAccessMask = 0;
+        for (auto& barrier : m_acquireImages) barrier.srcAccessMask = 0;
+
+        vkCmdPipelineBarrier(batch->transferCommands,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+            static_cast<uint32_t>(release_buffers.size()), release_buffers.data(),
+            static_cast<uint32_t>(release_images.size()), release_images.data());
+    }
+
+    auto result = vkEndCommandBuffer(batch->transferCommands);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to end upload command buffer.")
+
+    /* Each timeline is signalled from one queue only, so its values rise in
+     * submission order. With an ownership transfer the token is signalled
+     * by the acquire, which waits for the transfer on its own timeline. */
+    uint64_t transfer_value = transfer_ownership ? ++m_lastTransferValue : ++m_lastToken;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &transfer_value;
+
+    VkSubmitInfo submit_info {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit_info.pNext = &timeline_info;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch->transferCommands;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = transfer_ownership ? &m_transferTimeline : &m_timeline;
+
+    result = vkQueueSubmit(m_transferQueue, 1, &submit_info, VK_NULL_HANDLE);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to submit uploads to the transfer queue.")
+
+    if (transfer_ownership) {
+        VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        result = vkBeginCommandBuffer(batch->acquireCommands, &begin_info);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to begin upload acquire command buffer.")
+
+        vkCmdPipelineBarrier(batch->acquireCommands,
+            m_acquireStages, m_acquireStages, 0, 0, nullptr,
+            static_cast<uint32_t>(m_acquireBuffers.size()), m_acquireBuffers.data(),
+            static_cast<uint32_t>(m_acquireImages.size()), m_acquireImages.data());
+
+        result = vkEndCommandBuffer(batch->acquireCommands);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to end upload acquire command buffer.")
+
+        uint64_t acquire_value = ++m_lastToken;
+
+        timeline_info.waitSemaphoreValueCount = 1;
+        timeline_info.pWaitSemaphoreValues = &transfer_value;
+        timeline_info.pSignalSemaphoreValues = &acquire_value;
+
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = &m_transferTimeline;
+        submit_info.pWaitDstStageMask = &m_acquireStages;
+        submit_info.pCommandBuffers = &batch->acquireCommands;
+        submit_info.pSignalSemaphores = &m_timeline;
+
+        result = vkQueueSubmit(m_graphicsQueue, 1, &submit_info, VK_NULL_HANDLE);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to submit upload acquire barriers.")
+    }
+
+    batch->token = m_lastToken;
+    batch->ringEnd = m_ringHead;
+
+    m_pendingBatches.push_back(batch);
+    m_recording = nullptr;
+
+    m_acquireBuffers.clear();
+    m_acquireImages.clear();
+    m_acquireStages = 0;
+
+    return batch->token;
+}
+
+void vtrs::UploadQueue::wait_(uint64_t token) {
+    VkSemaphoreWaitInfo wait_info {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &m_timeline;
+    wait_info.pValues = &token;
+
+    auto result = vkWaitSemaphores(m_logicalDevice, &wait_info, UINT64_MAX);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to wait for uploads to complete.")
+}
+
+void vtrs::UploadQueue::bootstrap_(VkPhysicalDevice physical_device, vtrs::upload_queue_opts* options) {
+    m_transferFamily = options->transferFamily;
+    m_graphicsFamily = options->graphicsFamily;
+
+    vkGetDeviceQueue(m_logicalDevice, m_transferFamily, 0, &m_transferQueue);
+    vkGetDeviceQueue(m_logicalDevice, m_graphicsFamily, 0, &m_graphicsQueue);
+
+    VkCommandPoolCreateInfo pool_info {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = m_transferFamily;
+
+    auto result = vkCreateCommandPool(m_logicalDevice, &pool_info, nullptr, &m_transferPool);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create upload command pool.")
+
+    if (needsOwnershipTransfer_()) {
+        pool_info.queueFamilyIndex = m_graphicsFamily;
+
+        result = vkCreateCommandPool(m_logicalDevice, &pool_info, nullptr, &m_graphicsPool);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to create upload acquire command pool.")
+    }
+
+    VkSemaphoreTypeCreateInfo type_info {VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    semaphore_info.pNext = &type_info;
+
+    result = vkCreateSemaphore(m_logicalDevice, &semaphore_info, nullptr, &m_timeline);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create upload timeline semaphore.")
+
+    if (needsOwnershipTransfer_()) {
+        result = vkCreateSemaphore(m_logicalDevice, &semaphore_info, nullptr, &m_transferTimeline);
+        VTRS_ASSERT_VK_RESULT(result, "Unable to create upload transfer timeline semaphore.")
+    }
+
+    VkPhysicalDeviceProperties properties {};
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    /* Offsets must satisfy image copies of any texel size, hence the floor of 16. */
+    m_stagingAlignment = std::max<VkDeviceSize>(properties.limits.optimalBufferCopyOffsetAlignment, 16);
+    m_stagingCapacity = alignUp_(options->stagingCapacity, m_stagingAlignment);
+
+    VkBufferCreateInfo buffer_info {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size = m_stagingCapacity;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    result = vkCreateBuffer(m_logicalDevice, &buffer_info, nullptr, &m_stagingBuffer);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to create staging ring buffer.")
+
+    m_stagingAllocation = m_deviceAllocator->allocateBuffer(m_stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+}
+
+vtrs::UploadQueue::UploadQueue(VkDevice logical_device, vtrs::DeviceAllocator* allocator) :
+        m_logicalDevice(logical_device),
+        m_deviceAllocator(allocator) {
+}
+
+vtrs::UploadQueue*
+vtrs::UploadQueue::factory(
+        VkPhysicalDevice physical_device,
+        VkDevice logical_device,
+        vtrs::DeviceAllocator* allocator,
+        vtrs::UploadQueue::Options* options) {
+
+    auto upload_queue = new UploadQueue(logical_device, allocator);
+    upload_queue->bootstrap_(physical_device, options);
+
+    return upload_queue;
+}
+
+vtrs::UploadQueue::~UploadQueue() {
+    if (m_lastToken > 0) {
+        wait_(m_lastToken);
+    }
+
+    /* A batch that was recorded but never submitted still owns its
+     * command buffers and oversized staging; recycle it like the rest. */
+    if (m_recording != nullptr) {
+        vkEndCommandBuffer(m_recording->transferCommands);
+        m_freeBatches.push_back(m_recording);
+        m_recording = nullptr;
+    }
+
+    for (auto batch : m_pendingBatches) m_freeBatches.push_back(batch);
+    m_pendingBatches.clear();
+
+    for (auto batch : m_freeBatches) {
+        for (auto& oversized : batch->oversized) {
+            vkDestroyBuffer(m_logicalDevice, oversized.first, nullptr);
+            m_deviceAllocator->free(oversized.second);
+        }
+
+        delete batch;
+    }
+
+    vkDestroyCommandPool(m_logicalDevice, m_transferPool, nullptr);
+
+    if (m_graphicsPool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(m_logicalDevice, m_graphicsPool, nullptr);
+    }
+
+    vkDestroySemaphore(m_logicalDevice, m_timeline, nullptr);
+
+    if (m_transferTimeline != VK_NULL_HANDLE) {
+        vkDestroySemaphore(m_logicalDevice, m_transferTimeline, nullptr);
+    }
+    vkDestroyBuffer(m_logicalDevice, m_stagingBuffer, nullptr);
+    m_deviceAllocator->free(m_stagingAllocation);
+}
+
+void vtrs::UploadQueue::uploadBuffer(
+        VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+        VkPipelineStageFlags dst_stage, VkAccessFlags dst_access) {
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    VkDeviceSize staging_offset = 0;
+    VkBuffer staging = stage_(data, size, &staging_offset);
+    auto batch = recordingBatch_();
+
+    VkBufferCopy region {};
+    region.srcOffset = staging_offset;
+    region.dstOffset = offset;
+    region.size = size;
+
+    vkCmdCopyBuffer(batch->transferCommands, staging, buffer, 1, &region);
+
+    VkBufferMemoryBarrier barrier {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = dst_access;
+    barrier.srcQueueFamilyIndex = needsOwnershipTransfer_() ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = needsOwnershipTransfer_() ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+
+    m_acquireBuffers.push_back(barrier);
+    m_acquireStages |= dst_stage;
+}
+
+void vtrs::UploadQueue::uploadImage(
+        VkImage image, const void* data, VkDeviceSize size,
+        const std::vector<VkBufferImageCopy>& regions, const vtrs::UploadQueue::ImageTarget& target) {
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    VkDeviceSize staging_offset = 0;
+    VkBuffer staging = stage_(data, size, &staging_offset);
+    auto batch = recordingBatch_();
+
+    VkImageMemoryBarrier barrier {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = target.range;
+
+    vkCmdPipelineBarrier(batch->transferCommands,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+
+    std::vector<VkBufferImageCopy> staged_regions = regions;
+
+    for (auto& region : staged_regions) {
+        region.bufferOffset += staging_offset;
+    }
+
+    vkCmdCopyBufferToImage(batch->transferCommands, staging, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        static_cast<uint32_t>(staged_regions.size()), staged_regions.data());
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = target.dstAccess;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = target.finalLayout;
+    barrier.srcQueueFamilyIndex = needsOwnershipTransfer_() ? m_transferFamily : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = needsOwnershipTransfer_() ? m_graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+
+    m_acquireImages.push_back(barrier);
+    m_acquireStages |= target.dstStage;
+}
+
+void vtrs::UploadQueue::uploadImage(VkImage image, const void* data, VkDeviceSize size, VkExtent3D extent) {
+    VkBufferImageCopy region {};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = extent;
+
+    uploadImage(image, data, size, {region}, ImageTarget {});
+}
+
+vtrs::UploadQueue::Token vtrs::UploadQueue::submit() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    reclaim_();
+    return submit_();
+}
+
+bool vtrs::UploadQueue::isComplete(vtrs::UploadQueue::Token token) {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(m_logicalDevice, m_timeline, &value);
+
+    return value >= token;
+}
+
+void vtrs::UploadQueue::wait(vtrs::UploadQueue::Token token) {
+    wait_(token);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    reclaim_();
+}
+
+VkSemaphore vtrs::UploadQueue::getSemaphore() const {
+    return m_timeline;
+}
@@ -0,0 +1,241 @@
+/**
+ * upload_queue.hpp - Batched asynchronous uploads on the transfer queue.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include "vulkan_api.hpp"
+#include "device_allocator.hpp"
+
+namespace vtrs {
+
+struct upload_queue_opts {
+    uint32_t transferFamily = 0;
+    uint32_t graphicsFamily = 0;
+    VkDeviceSize stagingCapacity = 32 * 1024 * 1024;
+};
+
+struct upload_image_target {
+    VkImageSubresourceRange range {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    VkAccessFlags dstAccess = VK_ACCESS_SHADER_READ_BIT;
+};
+
+/**
+ * @brief Records buffer and image uploads and submits them in batches.
+ *
+ * Data is copied into a host visible staging ring and the copies are
+ * recorded into a command buffer on the transfer queue family. A call
+ * to submit sends every recorded copy in a single submission and returns
+ * a token, which is a value of the queue's timeline semaphore.
+ *
+ * When the transfer and graphics families differ, resources are released
+ * by the transfer queue and acquired by a small command buffer submitted
+ * to the graphics queue that waits on the transfer work. The transfer
+ * queue then signals a timeline of its own and the token is signalled by
+ * the acquire, so a completed token always includes the acquire. Graphics work
+ * submitted afterwards is therefore ordered after the upload without any
+ * CPU side wait. Staging space is reclaimed once its token completes.
+ */
+class UploadQueue {
+
+private:
+    struct upload_batch {
+        VkCommandBuffer transferCommands = VK_NULL_HANDLE;
+        VkCommandBuffer acquireCommands = VK_NULL_HANDLE;
+        uint64_t token = 0;
+        VkDeviceSize ringEnd = 0;
+        std::vector<std::pair<VkBuffer, vtrs::DeviceAllocator::Allocation>> oversized {};
+    };
+
+    VkDevice                m_logicalDevice = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator*  m_deviceAllocator = nullptr;
+
+    uint32_t    m_transferFamily = 0;
+    uint32_t    m_graphicsFamily = 0;
+    VkQueue     m_transferQueue = VK_NULL_HANDLE;
+    VkQueue     m_graphicsQueue = VK_NULL_HANDLE;
+
+    VkCommandPool m_transferPool = VK_NULL_HANDLE;
+    VkCommandPool m_graphicsPool = VK_NULL_HANDLE;
+    VkSemaphore   m_timeline = VK_NULL_HANDLE;
+    uint64_t      m_lastToken = 0;
+
+    /* Signalled by the transfer queue when ownership moves to the graphics
+     * queue, only the acquire submits signal the token timeline then. */
+    VkSemaphore   m_transferTimeline = VK_NULL_HANDLE;
+    uint64_t      m_lastTransferValue = 0;
+
+    VkBuffer m_stagingBuffer = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator::Allocation m_stagingAllocation {};
+    VkDeviceSize m_stagingCapacity = 0;
+    VkDeviceSize m_stagingAlignment = 16;
+    VkDeviceSize m_ringHead = 0;
+    VkDeviceSize m_ringTail = 0;
+
+    upload_batch* m_recording = nullptr;
+    std::deque<upload_batch*> m_pendingBatches {};
+    std::vector<upload_batch*> m_freeBatches {};
+
+    std::vector<VkBufferMemoryBarrier> m_acquireBuffers {};
+    std::vector<VkImageMemoryBarrier> m_acquireImages {};
+    VkPipelineStageFlags m_acquireStages = 0;
+
+    std::mutex m_mutex;
+
+    /**
+     * @brief Tells whether resources change queue family on the way to graphics.
+     */
+    [[nodiscard]] bool needsOwnershipTransfer_() const;
+
+    /**
+     * @brief Returns the batch being recorded, starting one if needed.
+     */
+    upload_batch* recordingBatch_();
+
+    /**
+     * @brief Copies data into staging memory owned by the recording batch.
+     * @param data Source bytes.
+     * @param size Number of bytes to copy.
+     * @param offset Receives the offset in the returned buffer.
+     * @return The staging buffer holding the data.
+     */
+    VkBuffer stage_(const void* data, VkDeviceSize size, VkDeviceSize* offset);
+
+    /**
+     * @brief Tries to carve a range from the staging ring.
+     */
+    bool takeRing_(VkDeviceSize size, VkDeviceSize* offset);
+
+    /**
+     * @brief Recycles batches whose token has completed.
+     */
+    void reclaim_();
+
+    /**
+     * @brief Submits the recording batch. Expects the mutex to be held.
+     */
+    uint64_t submit_();
+
+    /**
+     * @brief Blocks until the timeline reaches the token.
+     */
+    void wait_(uint64_t token);
+
+    /**
+     * @brief Bootstraps the upload queue.
+     * @param physical_device Vulkan physical device handle.
+     * @param options Upload queue configuration.
+     *
+     * The boostrap method will:
+     * - Create command pools on the transfer and graphics families.
+     * - Create the timeline semaphore used for completion tokens.
+     * - Create and map the staging ring buffer.
+     */
+    void bootstrap_(VkPhysicalDevice physical_device, struct upload_queue_opts* options);
+
+    /**
+     * @brief Initialises member variables.
+     * @param logicalDevice Vulkan logical device handle.
+     * @param allocator Device allocator providing staging memory.
+     */
+    explicit UploadQueue(VkDevice, vtrs::DeviceAllocator*);
+
+public:
+    typedef struct upload_queue_opts Options;
+    typedef struct upload_image_target ImageTarget;
+    typedef uint64_t Token;
+
+    /**
+     * @brief Creates and returns a new instance.
+     * @param physical_device   Vulkan physical device handle.
+     * @param logical_device    Vulkan logical device handle.
+     * @param allocator         Device allocator providing staging memory.
+     * @param options           Upload queue configuration.
+     * @return Instance of the upload queue.
+     * @throws vtrs::RendererError Thrown if the queue could not be created.
+     */
+    static UploadQueue* factory(VkPhysicalDevice, VkDevice, vtrs::DeviceAllocator*, UploadQueue::Options*);
+
+    /**
+     * @brief Waits for outstanding uploads and cleans up.
+     */
+    ~UploadQueue();
+
+    /**
+     * @brief Records a copy of host data into a buffer.
+     * @param buffer Destination buffer.
+     * @param offset Offset in the destination buffer.
+     * @param data Source bytes; copied before the call returns.
+     * @param size Number of bytes to copy.
+     * @param dst_stage Stages that will consume the buffer.
+     * @param dst_access Accesses that will consume the buffer.
+     */
+    void uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size,
+                      VkPipelineStageFlags dst_stage, VkAccessFlags dst_access);
+
+    /**
+     * @brief Records copies of host data into image subresources.
+     * @param image Destination image, currently in undefined layout.
+     * @param data Source bytes; copied before the call returns.
+     * @param size Number of bytes to copy.
+     * @param regions Copy regions with buffer offsets relative to data.
+     * @param target Subresources touched and the layout to leave them in.
+     */
+    void uploadImage(VkImage image, const void* data, VkDeviceSize size,
+                     const std::vector<VkBufferImageCopy>& regions, const ImageTarget& target);
+
+    /**
+     * @brief Records a copy of tightly packed pixels into the first level of an image.
+     */
+    void uploadImage(VkImage image, const void* data, VkDeviceSize size, VkExtent3D extent);
+
+    /**
+     * @brief Submits every recorded upload in one batch.
+     * @return Token that completes once the uploads are visible to graphics work.
+     *
+     * Returns the previous token if nothing was recorded.
+     */
+    Token submit();
+
+    /**
+     * @brief Tells whether the uploads behind a token have finished.
+     */
+    bool isComplete(Token token);
+
+    /**
+     * @brief Blocks until the uploads behind a token have finished.
+     */
+    void wait(Token token);
+
+    /**
+     * @brief Returns the timeline semaphore signalled with upload tokens.
+     *
+     * Other queues can wait on it with a token value instead of blocking
+     * on the CPU.
+     */
+    [[nodiscard]] VkSemaphore getSemaphore() const;
+};
+
+} // namespace vtrs
@@ -0,0 +1,189 @@
+/**
+ * vertex_layout.hpp - Vertex input descriptions generated from vertex structs.
+ * ------------------------------------------------------------------------
+ *
+ * Copyright (c) 2021-present Ajay Sreedhar
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * ========================================================================
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include "vulkan_api.hpp"
+
+/**
+ * @brief Describes a member of a vertex struct as a shader input.
+ * @param vertex Vertex struct type.
+ * @param member Name of the member.
+ * @param location Shader input location.
+ * @param format Vulkan format the member is read as, its size must match the member.
+ */
+#define VTRS_VERTEX_ATTRIBUTE(vertex, member, location, format) \
+    vtrs::VertexAttribute<sizeof(vertex::member), offsetof(vertex, member), location, format>
+
+namespace vtrs {
+
+/**
+ * @brief Returns the size of one element of a vertex attribute format, 0 if it is not known here.
+ */
+constexpr uint32_t getVertexFormatSize(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R8G8_SNORM:
+        case VK_FORMAT_R16_UNORM:
+        case VK_FORMAT_R16_SNORM:
+        case VK_FORMAT_R16_SFLOAT:
+            return 2;
+
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SNORM:
+        case VK_FORMAT_R8G8B8A8_UINT:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_A2B10G10R10_SNORM_PACK32:
+        case VK_FORMAT_R16G16_UNORM:
+        case VK_FORMAT_R16G16_SNORM:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_R32_UINT:
+            return 4;
+
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R16G16B16A16_SNORM:
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_UINT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+
+        case VK_FORMAT_R32G32B32_SFLOAT:
+            return 12;
+
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief One shader input read from a member of a vertex struct.
+ *
+ * Declared through VTRS_VERTEX_ATTRIBUTE, which fills in the size and
+ * offset of the member.
+ */
+template <size_t Size, size_t Offset, uint32_t Location, VkFormat Format>
+struct VertexAttribute {
+    static_assert(getVertexFormatSize(Format) != 0, "Vertex attribute format has no known size.");
+    static_assert(getVertexFormatSize(Format) == Size, "Vertex attribute format does not match the size of the member.");
+
+    static constexpr size_t size = Size;
+    static constexpr uint32_t offset = static_cast<uint32_t>(Offset);
+    static constexpr uint32_t location = Location;
+    static constexpr VkFormat format = Format;
+};
+
+/**
+ * @brief A vertex buffer binding holding an array of one vertex struct.
+ */
+template <typename Vertex, uint32_t Binding, typename... Attributes>
+struct VertexStream {
+    static_assert(sizeof...(Attributes) > 0, "Vertex stream has no attributes.");
+    static_assert(((Attributes::offset + Attributes::size <= sizeof(Vertex)) && ...), "Vertex attribute lies outside its vertex.");
+
+    typedef Vertex VertexType;
+
+    static constexpr uint32_t binding = Binding;
+    static constexpr uint32_t stride = sizeof(Vertex);
+    static constexpr size_t attributeCount = sizeof...(Attributes);
+
+    static constexpr std::array<VkVertexInputAttributeDescription, sizeof...(Attributes)> attributes = {{
+        {Attributes::location, Binding, Attributes::format, Attributes::offset}...
+    }};
+};
+
+/**
+ * @brief Vertex input state of a pipeline, built from one or more streams.
+ *
+ * Binding and attribute descriptions are generated at compile time and
+ * checked for duplicate bindings and locations, so a layout that does
+ * not match its structs fails to build instead of failing validation.
+ *
+ * Splitting attributes across streams lets passes that need only some
+ * of them, such as depth only passes reading positions, bind less.
+ */
+template <typename... Streams>
+class VertexLayout {
+
+private:
+    static constexpr size_t s_attributeCount = (Streams::attributeCount + ...);
+
+    static constexpr std::array<VkVertexInputAttributeDescription, s_attributeCount> collectAttributes_() {
+        std::array<VkVertexInputAttributeDescription, s_attributeCount> result {};
+        size_t index = 0;
+
+        auto append = [&result, &index](const auto& attributes) {
+            for (const auto& attribute : attributes) {
+                result[index++] = attribute;
+            }
+        };
+
+        (append(Streams::attributes), ...);
+
+        return result;
+    }
+
+    template <typename Description, size_t Count, typename Key>
+    static constexpr bool isUnique_(const std::array<Description, Count>& descriptions, Key key) {
+        for (size_t first = 0; first < Count; first++) {
+            for (size_t second = first + 1; second < Count; second++) {
+                if (key(descriptions[first]) == key(descriptions[second])) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+public:
+    static constexpr std::array<VkVertexInputBindingDescription, sizeof...(Streams)> bindings = {{
+        {Streams::binding, Streams::stride, VK_VERTEX_INPUT_RATE_VERTEX}...
+    }};
+
+    static constexpr std::array<VkVertexInputAttributeDescription, s_attributeCount> attributes = collectAttributes_();
+
+    static_assert(isUnique_(bindings, [](const VkVertexInputBindingDescription& binding) { return binding.binding; }),
+                  "Vertex streams share a binding.");
+    static_assert(isUnique_(attributes, [](const VkVertexInputAttributeDescription& attribute) { return attribute.location; }),
+                  "Vertex attributes share a location.");
+
+    /**
+     * @brief Returns the vertex input state, pointing at the generated descriptions.
+     */
+    static VkPipelineVertexInputStateCreateInfo getInputState() {
+        VkPipelineVertexInputStateCreateInfo input_state {};
+        input_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        input_state.vertexBindingDescriptionCount = static_cast<uint32_t>(bindings.size());
+        input_state.pVertexBindingDescriptions = bindings.data();
+        input_state.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size());
+        input_state.pVertexAttributeDescriptions = attributes.data();
+
+        return input_state;
+    }
+};
+
+} // namespace vtrs
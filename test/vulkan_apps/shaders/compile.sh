@@ -2,3 +2,4 @@
 
 echo 'glslc test/vulkan_apps/shaders/triangle.vert -o dist/test/shaders/triangle-vert.spv'
 echo 'glslc test/vulkan_apps/shaders/triangle.frag -o dist/test/shaders/triangle-frag.spv'
+echo 'glslc engine/renderer/shaders/mip_downsample.comp -o dist/test/shaders/mip-downsample-comp.spv'
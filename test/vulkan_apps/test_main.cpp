@@ -19,8 +19,10 @@
  * ========================================================================
  */
 
+#include <csignal>
 #include "platform/except.hpp"
 #include "platform/logger.hpp"
+#include "platform/profiler.hpp"
 #include "platform/linux/xcb_client.hpp"
 #include "vulkan_model.hpp"
 
@@ -41,6 +43,12 @@ int testVulkanModel(const std::string& model_type, const std::string& texture_fi
 
     application->printGPUInfo();
 
+#if (defined(VTRS_ENABLE_PROFILER) && VTRS_ENABLE_PROFILER == 1)
+    VTRS_PROFILE_THREAD("Main");
+    vtrs::Profiler::installSignalTrigger(SIGUSR1, 120, "vulkan-test-trace.json");
+    vtrs::Logger::info("Profiler armed, press [P] or send SIGUSR1 to capture 120 frames.");
+#endif
+
     try {
         if (model_type == "object") {
             application->loadModel(texture_file, model_file);
@@ -60,9 +68,9 @@ int testVulkanModel(const std::string& model_type, const std::string& texture_fi
     while (true) {
         auto event = xcb_client->pollEvents();
 
+        /* Only flags a rebuild, rendering carries on while the window is resized. */
         if (event.kind == vtrs::WSIWindowEvent::WINDOW_EXPOSE) {
             application->rebuildSwapchain();
-            continue;
         }
 
         application->drawFrame();
@@ -71,6 +79,21 @@ int testVulkanModel(const std::string& model_type, const std::string& texture_fi
             vtrs::Logger::info("User pressed Quit [Q] button!");
             break;
         }
+
+#if (defined(VTRS_ENABLE_PROFILER) && VTRS_ENABLE_PROFILER == 1)
+        /* Key [P] captures the next 120 frames. */
+        if (event.kind == vtrs::WSIWindowEvent::KEY_PRESS && event.eventDetail == 33) {
+            vtrs::Profiler::captureFrames(120, "vulkan-test-trace.json");
+        }
+#endif
+
+        /* Keys [1] to [3] change the number of frames in flight while running. */
+        if (event.kind == vtrs::WSIWindowEvent::KEY_PRESS && event.eventDetail >= 10 && event.eventDetail <= 12) {
+            uint32_t frames_in_flight = event.eventDetail - 9;
+
+            vtrs::Logger::info("Switching to", frames_in_flight, "frames in flight.");
+            application->setFramesInFlight(frames_in_flight);
+        }
     }
 
     application->waitIdle();
@@ -20,52 +20,22 @@
  */
 
 #define STB_IMAGE_IMPLEMENTATION 1
-#define TINYOBJLOADER_IMPLEMENTATION 1
 
 #include <set>
-#include <unordered_map>
-#include <cstring>
-#include <limits>
 #include <chrono>
+#include <algorithm>
+#include <memory>
+#include <cstring>
 #include <glm/gtc/matrix_transform.hpp>
 #include "third_party/stb/stb_image.h"
-#include "third_party/tiny_object_loader/tiny_obj_loader.h"
 #include "platform/logger.hpp"
+#include "platform/profiler.hpp"
 #include "platform/linux/xcb_client.hpp"
 #include "renderer/except.hpp"
 #include "renderer/assert.hpp"
+#include "assets/except.hpp"
 #include "vulkan_model.hpp"
 
-std::vector<vtest::Vertex> vtest::VulkanModel::s_vertices {};
-std::vector<uint32_t> vtest::VulkanModel::s_indices {};
-
-VkVertexInputBindingDescription vtest::Vertex::getInputBindingDescription() {
-    VkVertexInputBindingDescription description {0, sizeof(vtest::Vertex), VK_VERTEX_INPUT_RATE_VERTEX};
-
-    return description;
-}
-
-std::array<VkVertexInputAttributeDescription, 3> vtest::Vertex::getInputAttributeDescription() {
-    std::array<VkVertexInputAttributeDescription, 3> descriptions {};
-
-    descriptions.at(0).binding = 0;
-    descriptions.at(0).location = 0;
-    descriptions.at(0).format = VK_FORMAT_R32G32B32_SFLOAT;
-    descriptions.at(0).offset = offsetof(vtest::Vertex, coordinate);
-
-    descriptions.at(1).binding = 0;
-    descriptions.at(1).location = 1;
-    descriptions.at(1).format = VK_FORMAT_R32G32B32_SFLOAT;
-    descriptions.at(1).offset = offsetof(vtest::Vertex, rgbColor);
-
-    descriptions.at(2).binding = 0;
-    descriptions.at(2).location = 2;
-    descriptions.at(2).format = VK_FORMAT_R32G32_SFLOAT;
-    descriptions.at(2).offset = offsetof(vtest::Vertex, textureXY);
-
-    return descriptions;
-}
-
 vtrs::RendererGPU *vtest::VulkanModel::findDiscreteGPU_() {
     vtrs::RendererGPU* device = vtrs::RendererContext::getGPUList().front();
 
@@ -82,38 +52,6 @@ bool vtest::VulkanModel::hasStencilComponent_(VkFormat format) {
     return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-struct vtest::SPIRVBytes vtest::VulkanModel::readSPIRVShader(const std::string &path) {
-    std::ifstream shader_file(path, std::ios::ate | std::ios::binary);
-
-    if (!shader_file.is_open()) {
-        throw vtrs::RuntimeError("Unable to open shader file " + path, vtrs::RuntimeError::E_TYPE_GENERAL);
-    }
-
-    struct vtest::SPIRVBytes spirv_bytes {nullptr,0};
-
-    spirv_bytes.size = shader_file.tellg();
-    spirv_bytes.data = new char[spirv_bytes.size]();
-
-    shader_file.seekg(0);
-    shader_file.read(spirv_bytes.data, static_cast<std::streamsize>(spirv_bytes.size));
-    shader_file.close();
-
-    return spirv_bytes;
-}
-
-uint32_t vtest::VulkanModel::findMemoryType_(uint32_t filter, VkMemoryPropertyFlags flags) {
-    VkPhysicalDeviceMemoryProperties mem_props {};
-    vkGetPhysicalDeviceMemoryProperties(m_gpu->getDeviceHandle(), &mem_props);
-
-    for (unsigned int index = 0; index < mem_props.memoryTypeCount; index++) {
-        if ((filter & (1 << index)) && (mem_props.memoryTypes[index].propertyFlags & flags) == flags) {
-            return index;
-        }
-    }
-
-    throw vtrs::RuntimeError("Unable to find required memory type.", vtrs::RuntimeError::E_TYPE_GENERAL);
-}
-
 VkFormat vtest::VulkanModel::findSupportedFormat_(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features) {
     for (VkFormat format : candidates) {
         VkFormatProperties properties {};
@@ -159,13 +97,71 @@ void vtest::VulkanModel::createLogicalDevice_() {
         queue_info.push_back(info);
     }
 
+    VkPhysicalDeviceFeatures supported_features {};
+    vkGetPhysicalDeviceFeatures(m_gpu->getDeviceHandle(), &supported_features);
+
+    /* Statistics around the render pass also cover the secondaries, which needs inherited queries. */
+    m_usePipelineStatistics = supported_features.pipelineStatisticsQuery == VK_TRUE && supported_features.inheritedQueries == VK_TRUE;
+
     VkPhysicalDeviceFeatures gpu_features {};
     gpu_features.samplerAnisotropy = VK_TRUE;
+    gpu_features.pipelineStatisticsQuery = m_usePipelineStatistics ? VK_TRUE : VK_FALSE;
+    gpu_features.inheritedQueries = m_usePipelineStatistics ? VK_TRUE : VK_FALSE;
+
+    /* BC formats are what KTX2 textures are stored in or transcoded to. */
+    gpu_features.textureCompressionBC = supported_features.textureCompressionBC;
+
+    VkPhysicalDeviceVulkan12Features vulkan12_features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    vulkan12_features.timelineSemaphore = VK_TRUE;
+
+    VkPhysicalDeviceVulkan13Features vulkan13_features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+
+    if (m_useDynamicRendering) {
+        vulkan13_features.dynamicRendering = VK_TRUE;
+        vulkan13_features.synchronization2 = VK_TRUE;
+        vulkan12_features.pNext = &vulkan13_features;
+    }
 
     std::vector<const char*> req_extensions;
     req_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR};
+    VkPhysicalDevicePresentIdFeaturesKHR present_id_features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR};
+
+    /* Present wait lets the presenter measure pacing from actual presents. */
+    if (m_gpu->isPresentWaitSupported()) {
+        req_extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+        req_extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+
+        present_id_features.presentId = VK_TRUE;
+        present_wait_features.presentWait = VK_TRUE;
+        present_id_features.pNext = &present_wait_features;
+        present_wait_features.pNext = vulkan12_features.pNext;
+        vulkan12_features.pNext = &present_id_features;
+
+        m_usePresentWait = true;
+    }
+
+    if (m_gpu->isMemoryBudgetSupported()) {
+        req_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        m_useMemoryBudget = true;
+    }
+
+    VkPhysicalDeviceImageViewMinLodFeaturesEXT min_lod_features {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_VIEW_MIN_LOD_FEATURES_EXT};
+
+    /* Streamed textures are sampled while their finer levels are still on the way. */
+    if (m_gpu->isMinLodSupported()) {
+        req_extensions.push_back(VK_EXT_IMAGE_VIEW_MIN_LOD_EXTENSION_NAME);
+
+        min_lod_features.minLod = VK_TRUE;
+        min_lod_features.pNext = vulkan12_features.pNext;
+        vulkan12_features.pNext = &min_lod_features;
+
+        m_useMinLod = true;
+    }
+
     VkDeviceCreateInfo device_info {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
+    device_info.pNext = &vulkan12_features;
     device_info.pQueueCreateInfos = queue_info.data();
     device_info.queueCreateInfoCount = queue_info.size();
     device_info.ppEnabledExtensionNames = req_extensions.data();
@@ -176,171 +172,107 @@ void vtest::VulkanModel::createLogicalDevice_() {
     VTRS_ASSERT_VK_RESULT(result, "Unable to create logical device.")
 
     vkGetDeviceQueue(m_device, m_familyIndices.graphicsFamily.value(), 0, &m_graphicsQueue);
-    vkGetDeviceQueue(m_device, m_familyIndices.transferFamily.value(), 0, &m_transferQueue);
     vkGetDeviceQueue(m_device, m_familyIndices.surfaceFamily.value(), 0, &m_surfaceQueue);
-}
-
-void vtest::VulkanModel::createSwapchain_() {
-    /* Checking if required extensions for swapchain are supported by the GPU. */
-    int extension_flag = 0;
-    std::vector<const char*> extension_names = m_gpu->getExtensionNames();
 
-    for(auto& name : extension_names) {
-        if (strcmp(name, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) {
-            extension_flag++;
-            break;
-        }
-    }
+    vtrs::DeviceAllocator::Options allocator_options {};
+    m_allocator = vtrs::DeviceAllocator::factory(m_gpu->getDeviceHandle(), m_device, &allocator_options);
 
-    extension_names.clear();
+    vtrs::UploadQueue::Options upload_options {};
+    upload_options.transferFamily = m_familyIndices.transferFamily.value();
+    upload_options.graphicsFamily = m_familyIndices.graphicsFamily.value();
 
-    if (extension_flag <= 0) {
-        throw vtrs::RuntimeError("Selected GPU does not support required swapchain extension.", vtrs::RuntimeError::E_TYPE_GENERAL);
-    }
+    m_uploadQueue = vtrs::UploadQueue::factory(m_gpu->getDeviceHandle(), m_device, m_allocator, &upload_options);
 
-    /**
-     * Query swapchain support details before creating a swapchain.
-     * There are basically three kinds of properties we need to check:
-     * - Min/max number of images in swap chain,
-     *   min/max width and height of images.
-     * - Surface formats (pixel format, color space).
-     * -Available presentation modes.
-     */
-    uint32_t format_count; // Surface format count.
-    uint32_t mode_count;   // Present mode count.
-    struct SwapchainSupportBundle support_bundle;
-
-    auto result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_gpu->getDeviceHandle(), m_surface, &(support_bundle.surfaceCaps));
-    VTRS_ASSERT_VK_RESULT(result, "Unable to query surface capabilities of selected GPU.")
-
-    result = vkGetPhysicalDeviceSurfaceFormatsKHR(m_gpu->getDeviceHandle(), m_surface, &format_count, nullptr);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to query supported surface formats provided by the selected GPU.")
-
-    if (format_count <= 0) {
-        throw vtrs::RuntimeError("Selected GPU did not provide supported surface format count.", vtrs::RuntimeError::E_TYPE_GENERAL);
-    }
+    vtrs::PipelineCache::Options cache_options {};
+    m_pipelineCache = vtrs::PipelineCache::factory(m_gpu->getDeviceHandle(), m_device, &cache_options);
 
-    support_bundle.surfaceFormats.resize(format_count);
-    vkGetPhysicalDeviceSurfaceFormatsKHR(m_gpu->getDeviceHandle(), m_surface, &format_count, support_bundle.surfaceFormats.data());
+    m_shaderLibrary = vtrs::ShaderLibrary::factory(m_device);
 
-    result = vkGetPhysicalDeviceSurfacePresentModesKHR(m_gpu->getDeviceHandle(), m_surface, &mode_count, nullptr);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to query supported presentation modes provided by the selected GPU.")
+    vtrs::MipGenerator::Options mip_options {};
+    mip_options.queueFamily = m_familyIndices.graphicsFamily.value();
+    mip_options.pipelineCache = m_pipelineCache->getHandle();
 
-    if (mode_count <= 0) {
-        throw vtrs::RuntimeError("Selected GPU did not provide supported presentation mode count.", vtrs::RuntimeError::E_TYPE_GENERAL);
+    /* The compute fallback is only loaded on GPUs that can not blit the texture format. */
+    if (!vtrs::MipGenerator::isBlitSupported(m_gpu->getDeviceHandle(), VK_FORMAT_R8G8B8A8_SRGB)) {
+        mip_options.downsampleShader = m_shaderLibrary->load("shaders/mip-downsample-comp.spv");
     }
 
-    support_bundle.presentModes.resize(mode_count);
-    vkGetPhysicalDeviceSurfacePresentModesKHR(m_gpu->getDeviceHandle(), m_surface, &mode_count, support_bundle.presentModes.data());
+    m_mipGenerator = vtrs::MipGenerator::factory(m_gpu->getDeviceHandle(), m_device, m_shaderLibrary, &mip_options);
 
-    VkSwapchainCreateInfoKHR swapchain_info {VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR};
-    swapchain_info.surface = m_surface;
-    swapchain_info.minImageCount = support_bundle.surfaceCaps.minImageCount + 1;
+    vtrs::DescriptorAllocator::Options descriptor_options {};
+    descriptor_options.framesInFlight = m_framesInFlight;
+    m_descriptorAllocator = vtrs::DescriptorAllocator::factory(m_device, &descriptor_options);
 
-    if (support_bundle.surfaceCaps.maxImageCount > 0 && swapchain_info.minImageCount > support_bundle.surfaceCaps.maxImageCount)
-        swapchain_info.minImageCount = support_bundle.surfaceCaps.maxImageCount;
+    /* Streamed views are replaced as textures sharpen, their cached sets go with them. */
+    vtrs::TextureStreamer::Options streamer_options {};
+    streamer_options.mipGenerator = m_mipGenerator;
+    streamer_options.graphicsQueue = m_graphicsQueue;
+    streamer_options.descriptorAllocator = m_descriptorAllocator;
+    streamer_options.framesInFlight = m_framesInFlight;
+    streamer_options.progressiveUpload = true;
+    streamer_options.useMinLod = m_useMinLod;
 
-    swapchain_info.imageFormat = support_bundle.surfaceFormats.at(0).format;
-    swapchain_info.imageColorSpace = support_bundle.surfaceFormats.at(0).colorSpace;
+    /* Called on the decode threads, stb_image keeps no state between loads. */
+    streamer_options.decoder = [](const std::string& path, std::vector<uint8_t>& pixels, uint32_t* width, uint32_t* height) {
+        int image_width;
+        int image_height;
+        int image_channels;
 
-    for (auto& this_format : support_bundle.surfaceFormats) {
-        if (this_format.format == VK_FORMAT_B8G8R8A8_SRGB && this_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-            swapchain_info.imageFormat = this_format.format;
-            swapchain_info.imageColorSpace = this_format.colorSpace;
-            break;
-        }
-    }
-
-    if (support_bundle.surfaceCaps.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
-        swapchain_info.imageExtent = support_bundle.surfaceCaps.currentExtent;
-
-    } else {
-        VkExtent2D extend_2d;
-        extend_2d.width = 800;
-        extend_2d.height = 600;
-
-        swapchain_info.imageExtent = extend_2d;
-    }
+        stbi_uc* data = stbi_load(path.c_str(), &image_width, &image_height, &image_channels, STBI_rgb_alpha);
 
-    /* The imageArrayLayers specifies the amount of layers each
-     * image consists of. This is always 1 unless we are developing
-     * a stereoscopic 3D application.  */
-    swapchain_info.imageArrayLayers = 1;
-    swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-
-    if (m_familyIndices.surfaceFamily == m_familyIndices.graphicsFamily) {
-        swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        swapchain_info.queueFamilyIndexCount = 0;
-        swapchain_info.pQueueFamilyIndices = nullptr;
-
-    } else {
-        uint32_t family_indices[] = {m_familyIndices.surfaceFamily.value(), m_familyIndices.graphicsFamily.value()};
+        if (data == nullptr) {
+            return false;
+        }
 
-        swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        swapchain_info.queueFamilyIndexCount = 2;
-        swapchain_info.pQueueFamilyIndices = family_indices;
-    }
+        pixels.assign(data, data + static_cast<size_t>(image_width) * image_height * 4);
+        stbi_image_free(data);
 
-    swapchain_info.preTransform = support_bundle.surfaceCaps.currentTransform;
-    swapchain_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapchain_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-    swapchain_info.clipped = VK_TRUE;
-    swapchain_info.oldSwapchain = VK_NULL_HANDLE;
+        *width = static_cast<uint32_t>(image_width);
+        *height = static_cast<uint32_t>(image_height);
 
-    result = vkCreateSwapchainKHR(m_device, &swapchain_info, nullptr, &m_swapchain);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to create swapchain.")
+        return true;
+    };
 
-    m_swapExtend = swapchain_info.imageExtent;
-    m_swapFormat = swapchain_info.imageFormat;
+    m_textureStreamer = vtrs::TextureStreamer::factory(m_gpu->getDeviceHandle(), m_device, m_allocator, m_uploadQueue, &streamer_options);
 
-    uint32_t image_count;
-    result = vkGetSwapchainImagesKHR(m_device, m_swapchain, &image_count, nullptr);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to obtain swap chain images.")
+    vtrs::TextureCache::Options texture_cache_options {};
+    texture_cache_options.useMemoryBudget = m_useMemoryBudget;
 
-    m_swapImages.resize(image_count);
-    vkGetSwapchainImagesKHR(m_device, m_swapchain, &image_count, m_swapImages.data());
+    m_textureCache = vtrs::TextureCache::factory(m_gpu->getDeviceHandle(), m_device, m_textureStreamer, &texture_cache_options);
+    m_mipResidency = vtrs::MipResidency::factory(m_textureStreamer, nullptr);
 }
 
-void vtest::VulkanModel::createImageViews_() {
-    m_swapViews.resize(m_swapImages.size());
-
-    for (size_t index = 0; index < m_swapImages.size(); index++) {
-        VkImageViewCreateInfo image_view_info {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
-        image_view_info.image = m_swapImages.at(index);
-        image_view_info.format = m_swapFormat;
-        image_view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        image_view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-        image_view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        image_view_info.subresourceRange.baseMipLevel = 0;
-        image_view_info.subresourceRange.levelCount = 1;
-        image_view_info.subresourceRange.layerCount = 1;
-        image_view_info.subresourceRange.baseArrayLayer = 0;
-
-        auto result = vkCreateImageView(m_device, &image_view_info, nullptr, &(m_swapViews.at(index)));
-        VTRS_ASSERT_VK_RESULT(result, "Unable to create image view for image.")
+void vtest::VulkanModel::createPresenter_() {
+    /* Checking if required extensions for swapchain are supported by the GPU. */
+    int extension_flag = 0;
+    std::vector<const char*> extension_names = m_gpu->getExtensionNames();
+
+    for(auto& name : extension_names) {
+        if (strcmp(name, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) {
+            extension_flag++;
+            break;
+        }
     }
-}
 
-VkShaderModule vtest::VulkanModel::newShaderModule(struct vtest::SPIRVBytes spirv) {
-    VkShaderModuleCreateInfo module_info {VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
-    module_info.codeSize = spirv.size;
-    module_info.pCode = reinterpret_cast<const uint32_t*>(spirv.data);
+    extension_names.clear();
 
-    VkShaderModule shader_module;
+    if (extension_flag <= 0) {
+        throw vtrs::RuntimeError("Selected GPU does not support required swapchain extension.", vtrs::RuntimeError::E_TYPE_GENERAL);
+    }
 
-    auto result = vkCreateShaderModule(m_device, &module_info, nullptr, &shader_module);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to create SPIR-V shader module.")
+    vtrs::SurfacePresenter::Options presenter_options {};
+    presenter_options.graphicsQueueFamily = m_familyIndices.graphicsFamily;
+    presenter_options.surfaceQueueFamily = m_familyIndices.surfaceFamily;
+    presenter_options.framesInFlight = m_framesInFlight;
+    presenter_options.enablePresentWait = m_usePresentWait;
 
-    return shader_module;
+    m_presenter = vtrs::SurfacePresenter::factory(m_gpu->getDeviceHandle(), m_device, m_surface, &presenter_options);
 }
 
 void vtest::VulkanModel::createRenderPass_() {
     VkAttachmentDescription color_attachment {
         VK_ATTACHMENT_DESCRIPTION_MAY_ALIAS_BIT,
-        m_swapFormat,
+        m_presenter->getImageFormat(),
         VK_SAMPLE_COUNT_1_BIT,
         VK_ATTACHMENT_LOAD_OP_CLEAR,
         VK_ATTACHMENT_STORE_OP_STORE,
@@ -351,9 +283,7 @@ void vtest::VulkanModel::createRenderPass_() {
     };
 
     VkAttachmentDescription depth_attachment{};
-    depth_attachment.format = findSupportedFormat_({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-                                                   VK_IMAGE_TILING_OPTIMAL,
-                                                   VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    depth_attachment.format = m_depthFormat;
     depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
     depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -394,94 +324,36 @@ void vtest::VulkanModel::createRenderPass_() {
 }
 
 void vtest::VulkanModel::createDescSetLayout_() {
-    VkDescriptorSetLayoutBinding ubo_binding {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT};
-    VkDescriptorSetLayoutBinding sampler_binding {1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT};
+    m_vertexShader = m_shaderLibrary->load("shaders/triangle-vert.spv");
+    m_fragmentShader = m_shaderLibrary->load("shaders/triangle-frag.spv");
 
-    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {ubo_binding, sampler_binding};
+    /* The uniform block is bound with a dynamic offset into the frame allocator. */
+    auto layout = m_shaderLibrary->getPipelineLayout({m_vertexShader, m_fragmentShader}, {{0, 0}});
 
-    VkDescriptorSetLayoutCreateInfo layout_info {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
-    layout_info.bindingCount = bindings.size();
-    layout_info.pBindings = bindings.data();
-
-    auto result = vkCreateDescriptorSetLayout(m_device, &layout_info, nullptr, &m_descSetLayout);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to create UBO descriptor set layout.")
-}
-
-void vtest::VulkanModel::createDescPool_() {
-    std::array<VkDescriptorPoolSize, 2> pool_sizes {};
-    pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    pool_sizes[0].descriptorCount = static_cast<uint32_t>(VTEST_MAX_FRAMES_IN_FLIGHT);
-    pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    pool_sizes[1].descriptorCount = static_cast<uint32_t>(VTEST_MAX_FRAMES_IN_FLIGHT);
-
-    VkDescriptorPoolCreateInfo pool_info {VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
-    pool_info.poolSizeCount = pool_sizes.size();
-    pool_info.pPoolSizes = pool_sizes.data();
-    pool_info.maxSets = VTEST_MAX_FRAMES_IN_FLIGHT;
-
-    auto result = vkCreateDescriptorPool(m_device, &pool_info, nullptr, &m_descPool);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to create UBO descriptor pool.")
+    m_descSetLayout = layout.setLayouts.at(0);
+    m_pipelineLayout = layout.layout;
 }
 
 void vtest::VulkanModel::createDescSets_() {
-    std::vector<VkDescriptorSetLayout> layouts (VTEST_MAX_FRAMES_IN_FLIGHT, m_descSetLayout);
-
-    VkDescriptorSetAllocateInfo alloc_info {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
-    alloc_info.descriptorPool = m_descPool;
-    alloc_info.descriptorSetCount = VTEST_MAX_FRAMES_IN_FLIGHT;
-    alloc_info.pSetLayouts = layouts.data();
-
-    m_descSets.resize(VTEST_MAX_FRAMES_IN_FLIGHT);
-
-    auto result = vkAllocateDescriptorSets(m_device, &alloc_info, m_descSets.data());
-    VTRS_ASSERT_VK_RESULT(result, "Unable to create descriptor sets.")
-
-    for (size_t index = 0; index < VTEST_MAX_FRAMES_IN_FLIGHT; index++) {
-        VkDescriptorBufferInfo buffer_info {
-            m_uniformBuffer.at(index),
-            0,
-            sizeof(vtest::UniformBufferObject)
-        };
-
-        VkDescriptorImageInfo image_info {m_textureBundle.sampler, m_textureBundle.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
-
-        std::array<VkWriteDescriptorSet, 2> descriptor_writes {};
-        descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptor_writes[0].dstSet = m_descSets.at(index);
-        descriptor_writes[0].dstBinding = 0;
-        descriptor_writes[0].dstArrayElement = 0;
-        descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptor_writes[0].descriptorCount = 1;
-        descriptor_writes[0].pBufferInfo = &buffer_info;
-
-        descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptor_writes[1].dstSet = m_descSets.at(index);
-        descriptor_writes[1].dstBinding = 1;
-        descriptor_writes[1].dstArrayElement = 0;
-        descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptor_writes[1].descriptorCount = 1;
-        descriptor_writes[1].pImageInfo = &image_info;
-
-        vkUpdateDescriptorSets(m_device, descriptor_writes.size(), descriptor_writes.data(), 0, nullptr);
-    }
+    /* The uniform range is picked per frame through the dynamic offset,
+     * so every frame in flight shares one cached set. */
+    m_descSet = m_descriptorAllocator->getCached(m_descSetLayout, {
+        vtrs::DescriptorAllocator::bufferWrite(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, m_frameAllocator->getBuffer(), 0, sizeof(vtest::UniformBufferObject)),
+        vtrs::DescriptorAllocator::imageWrite(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_textureCache->getSampler(m_textureHandle.value()),
+                                              m_textureCache->getView(m_textureHandle.value()), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+    });
 }
 
 void vtest::VulkanModel::setupGraphicsPipeline_() {
-    auto vertex_bytes = readSPIRVShader("shaders/triangle-vert.spv");
-    auto fragment_bytes = readSPIRVShader("shaders/triangle-frag.spv");
-
-    VkShaderModule vert_shader_module = newShaderModule(vertex_bytes);
-    VkShaderModule frag_shader_module = newShaderModule(fragment_bytes);
-
     VkPipelineShaderStageCreateInfo vert_stage_info {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
-    vert_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vert_stage_info.module = vert_shader_module;
-    vert_stage_info.pName = "main";
+    vert_stage_info.stage = m_vertexShader->stage;
+    vert_stage_info.module = m_vertexShader->module;
+    vert_stage_info.pName = m_vertexShader->entryPoint.c_str();
 
     VkPipelineShaderStageCreateInfo frag_stage_info {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
-    frag_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    frag_stage_info.module = frag_shader_module;
-    frag_stage_info.pName = "main";
+    frag_stage_info.stage = m_fragmentShader->stage;
+    frag_stage_info.module = m_fragmentShader->module;
+    frag_stage_info.pName = m_fragmentShader->entryPoint.c_str();
 
     VkPipelineShaderStageCreateInfo shader_stages[] = {vert_stage_info, frag_stage_info};
 
@@ -494,26 +366,22 @@ void vtest::VulkanModel::setupGraphicsPipeline_() {
     dynamic_state_info.dynamicStateCount = dynamic_state_list.size();
     dynamic_state_info.pDynamicStates = dynamic_state_list.data();
 
-    auto vertex_bind_desc = vtest::Vertex::getInputBindingDescription();
-    auto vertex_attr_desc = vtest::Vertex::getInputAttributeDescription();
-
-    VkPipelineVertexInputStateCreateInfo vertex_input_info {VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO};
-    vertex_input_info.vertexBindingDescriptionCount = 1;
-    vertex_input_info.pVertexBindingDescriptions = &vertex_bind_desc;
-    vertex_input_info.vertexAttributeDescriptionCount = vertex_attr_desc.size();
-    vertex_input_info.pVertexAttributeDescriptions = vertex_attr_desc.data();
+    VkPipelineVertexInputStateCreateInfo vertex_input_info = vtest::MeshLayout::getInputState();
 
     VkPipelineInputAssemblyStateCreateInfo vertex_assembly_info {VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO};
     vertex_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
     vertex_assembly_info.primitiveRestartEnable = VK_FALSE;
 
+    /* Viewport and scissor are dynamic, so the pipeline outlives swapchain rebuilds. */
+    VkExtent2D swap_extent = m_presenter->getImageExtent();
+
     VkViewport viewport_region {0.0f, 0.0f};
-    viewport_region.width = static_cast<float>(m_swapExtend.width);
-    viewport_region.height = static_cast<float>(m_swapExtend.height);
+    viewport_region.width = static_cast<float>(swap_extent.width);
+    viewport_region.height = static_cast<float>(swap_extent.height);
     viewport_region.minDepth = 0.0f;
     viewport_region.maxDepth = 1.0f;
 
-    VkRect2D scissor_region { {0, 0}, m_swapExtend };
+    VkRect2D scissor_region { {0, 0}, swap_extent };
 
     VkPipelineViewportStateCreateInfo viewport_info {VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO};
     viewport_info.viewportCount = 1;
@@ -555,15 +423,6 @@ void vtest::VulkanModel::setupGraphicsPipeline_() {
         color_blend_info.blendConstants[index] = 0.0f;
     }
 
-    VkPipelineLayoutCreateInfo layout_info {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-    layout_info.setLayoutCount = 1;
-    layout_info.pSetLayouts = &m_descSetLayout;
-    layout_info.pushConstantRangeCount = 0; // Optional
-    layout_info.pPushConstantRanges = nullptr; // Optional
-
-    auto result = vkCreatePipelineLayout(m_device, &layout_info, nullptr, &m_pipelineLayout);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to create pipeline layout.")
-
     VkPipelineDepthStencilStateCreateInfo depth_stencil_info {VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO};
     depth_stencil_info.depthTestEnable = VK_TRUE;
     depth_stencil_info.depthWriteEnable = VK_TRUE;
@@ -571,7 +430,17 @@ void vtest::VulkanModel::setupGraphicsPipeline_() {
     depth_stencil_info.depthBoundsTestEnable = VK_FALSE;
     depth_stencil_info.stencilTestEnable = VK_FALSE;
 
+    /* Without a render pass the pipeline only needs the attachment formats. */
+    VkFormat color_format = m_presenter->getImageFormat();
+
+    VkPipelineRenderingCreateInfo rendering_info {VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO};
+    rendering_info.colorAttachmentCount = 1;
+    rendering_info.pColorAttachmentFormats = &color_format;
+    rendering_info.depthAttachmentFormat = m_depthFormat;
+    rendering_info.stencilAttachmentFormat = hasStencilComponent_(m_depthFormat) ? m_depthFormat : VK_FORMAT_UNDEFINED;
+
     VkGraphicsPipelineCreateInfo pipeline_info {VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO};
+    pipeline_info.pNext = m_useDynamicRendering ? &rendering_info : nullptr;
     pipeline_info.stageCount = 2;
     pipeline_info.pStages = shader_stages;
     pipeline_info.pDynamicState = &dynamic_state_info;
@@ -588,22 +457,18 @@ void vtest::VulkanModel::setupGraphicsPipeline_() {
     pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
     pipeline_info.basePipelineIndex = -1;
 
-    result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &m_graphicsPipeline);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to create graphics pipeline.")
-
-    vkDestroyShaderModule(m_device, vert_shader_module, nullptr);
-    vkDestroyShaderModule(m_device, frag_shader_module, nullptr);
+    m_pipelineCache->createGraphicsPipeline(&pipeline_info, &m_graphicsPipeline);
 }
 
 void vtest::VulkanModel::createDepthResources_() {
-    VkFormat depth_format = findSupportedFormat_({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
-                                                VK_IMAGE_TILING_OPTIMAL,
-                                                VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    VkFormat depth_format = m_depthFormat;
+
+    VkExtent2D swap_extent = m_presenter->getImageExtent();
 
-    struct ImageObjectBundle bundle = createImage_(m_swapExtend.width, m_swapExtend.height, depth_format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    struct ImageObjectBundle bundle = createImage_(swap_extent.width, swap_extent.height, depth_format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     m_depthResource.image = bundle.image;
     m_depthResource.view = bundle.view;
-    m_depthResource.memory = bundle.memory;
+    m_depthResource.allocation = bundle.allocation;
 
     VkImageViewCreateInfo view_info {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
     view_info.image = m_depthResource.image;
@@ -620,18 +485,20 @@ void vtest::VulkanModel::createDepthResources_() {
 }
 
 void vtest::VulkanModel::createFramebuffers_() {
-    m_swapFramebuffers.resize(m_swapViews.size());
+    m_swapFramebuffers.resize(m_presenter->getImageCount());
+
+    VkExtent2D swap_extent = m_presenter->getImageExtent();
 
     VkResult result;
-    for (size_t index = 0; index < m_swapViews.size(); index++) {
-        VkImageView attachments[] = { m_swapViews.at(index), m_depthResource.view };
+    for (uint32_t index = 0; index < m_presenter->getImageCount(); index++) {
+        VkImageView attachments[] = { m_presenter->getImageView(index), m_depthResource.view };
 
         VkFramebufferCreateInfo framebuffer_info {VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO};
         framebuffer_info.renderPass = m_renderPass;
         framebuffer_info.attachmentCount = 2;
         framebuffer_info.pAttachments = attachments;
-        framebuffer_info.width = m_swapExtend.width;
-        framebuffer_info.height = m_swapExtend.height;
+        framebuffer_info.width = swap_extent.width;
+        framebuffer_info.height = swap_extent.height;
         framebuffer_info.layers = 1;
 
         result = vkCreateFramebuffer(m_device, &framebuffer_info, nullptr, &(m_swapFramebuffers.at(index)));
@@ -639,74 +506,193 @@ void vtest::VulkanModel::createFramebuffers_() {
     }
 }
 
-void vtest::VulkanModel::createCommandPools_() {
-    VkCommandPoolCreateInfo pool_info {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
-    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    pool_info.queueFamilyIndex = m_familyIndices.graphicsFamily.value();
+void vtest::VulkanModel::createCommandRecorder_() {
+    m_threadPool = vtrs::ThreadPool::factory();
+
+    vtrs::CommandRecorder::Options recorder_options {};
+    recorder_options.queueFamily = m_familyIndices.graphicsFamily.value();
+    recorder_options.framesInFlight = m_framesInFlight;
+
+    m_commandRecorder = vtrs::CommandRecorder::factory(m_device, m_threadPool, &recorder_options);
 
-    auto result = vkCreateCommandPool(m_device, &pool_info, nullptr, &m_graphicsCmdPool);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to create Graphics Command Pool.")
+    vtrs::GpuProfiler::Options profiler_options {};
+    profiler_options.queueFamily = m_familyIndices.graphicsFamily.value();
+    profiler_options.framesInFlight = m_framesInFlight;
+    profiler_options.enableStatistics = m_usePipelineStatistics;
 
-    pool_info.queueFamilyIndex = m_familyIndices.transferFamily.value();
-    result = vkCreateCommandPool(m_device, &pool_info, nullptr, &m_transferCmdPool);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to create Transfer Command Pool.")
+    m_gpuProfiler = vtrs::GpuProfiler::factory(m_gpu->getDeviceHandle(), m_device, &profiler_options);
 }
 
-void vtest::VulkanModel::allocateCommandBuffers_() {
-    VkCommandBufferAllocateInfo buffer_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-    buffer_info.commandPool = m_graphicsCmdPool;
-    buffer_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    buffer_info.commandBufferCount = m_commandBuffers.size();
+void vtest::VulkanModel::beginRendering_(VkCommandBuffer command_buffer, uint32_t image_index, const std::array<VkClearValue, 2>& clear_values) {
+    VkImageAspectFlags depth_aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
 
-    auto result = vkAllocateCommandBuffers(m_device, &buffer_info, m_commandBuffers.data());
-    VTRS_ASSERT_VK_RESULT(result, "Unable to allocate command buffers.")
+    if (hasStencilComponent_(m_depthFormat)) {
+        depth_aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+
+    /* Previous contents are never loaded, so both attachments start from UNDEFINED. */
+    std::array<VkImageMemoryBarrier2, 2> barriers {};
+    barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barriers[0].srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    barriers[0].srcAccessMask = VK_ACCESS_2_NONE;
+    barriers[0].dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].image = m_presenter->getImage(image_index);
+    barriers[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+    barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barriers[1].srcStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+    barriers[1].srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barriers[1].dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[1].image = m_depthResource.image;
+    barriers[1].subresourceRange = {depth_aspect, 0, 1, 0, 1};
+
+    VkDependencyInfo dependency_info {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependency_info.imageMemoryBarrierCount = barriers.size();
+    dependency_info.pImageMemoryBarriers = barriers.data();
+
+    vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+    VkRenderingAttachmentInfo color_attachment {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+    color_attachment.imageView = m_presenter->getImageView(image_index);
+    color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color_attachment.clearValue = clear_values[0];
+
+    VkRenderingAttachmentInfo depth_attachment {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+    depth_attachment.imageView = m_depthResource.view;
+    depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.clearValue = clear_values[1];
+
+    VkRenderingInfo rendering_info {VK_STRUCTURE_TYPE_RENDERING_INFO};
+    rendering_info.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    rendering_info.renderArea = {{0, 0}, m_presenter->getImageExtent()};
+    rendering_info.layerCount = 1;
+    rendering_info.colorAttachmentCount = 1;
+    rendering_info.pColorAttachments = &color_attachment;
+    rendering_info.pDepthAttachment = &depth_attachment;
+    rendering_info.pStencilAttachment = hasStencilComponent_(m_depthFormat) ? &depth_attachment : nullptr;
+
+    vkCmdBeginRendering(command_buffer, &rendering_info);
 }
 
-void vtest::VulkanModel::recordCommands_(VkCommandBuffer command_buffer, uint32_t image_index) {
-    VkCommandBufferBeginInfo command_buffer_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+void vtest::VulkanModel::endRendering_(VkCommandBuffer command_buffer, uint32_t image_index) {
+    vkCmdEndRendering(command_buffer);
+
+    VkImageMemoryBarrier2 present_barrier {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+    present_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+    present_barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+    present_barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+    present_barrier.dstAccessMask = VK_ACCESS_2_NONE;
+    present_barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    present_barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    present_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    present_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    present_barrier.image = m_presenter->getImage(image_index);
+    present_barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+    VkDependencyInfo dependency_info {VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependency_info.imageMemoryBarrierCount = 1;
+    dependency_info.pImageMemoryBarriers = &present_barrier;
+
+    vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+}
+
+VkCommandBuffer vtest::VulkanModel::recordCommands_(uint32_t image_index, uint32_t uniform_offset) {
+    VTRS_PROFILE_FUNCTION();
 
-    auto result = vkBeginCommandBuffer(command_buffer, &command_buffer_info);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to start recording command command_buffer.")
+    VkCommandBuffer command_buffer = m_commandRecorder->beginPrimary();
+    VkExtent2D swap_extent = m_presenter->getImageExtent();
+
+    /* The fence of this frame has been waited on, so its previous queries are ready. */
+    m_gpuProfiler->beginFrame(m_currentFrame, command_buffer);
+    uint32_t frame_scope = m_gpuProfiler->beginScope(command_buffer, "frame");
 
     std::array<VkClearValue, 2> clear_colours {};
     clear_colours[0].color = {{0.004f, 0.00266f, 0.0088f, 1.0f}};
     clear_colours[1].depthStencil = {1.0f, 0};
 
-    VkRenderPassBeginInfo render_pass_info {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
-    render_pass_info.renderPass = m_renderPass;
-    render_pass_info.framebuffer = m_swapFramebuffers.at(image_index);
-    render_pass_info.renderArea.offset = {0, 0};
-    render_pass_info.renderArea.extent = m_swapExtend;
-    render_pass_info.clearValueCount = clear_colours.size();
-    render_pass_info.pClearValues = clear_colours.data();
+    vtrs::CommandRecorder::Inheritance inheritance {};
+    inheritance.pipelineStatistics = m_gpuProfiler->getStatisticFlags();
+
+    uint32_t pass_scope = m_gpuProfiler->beginScope(command_buffer, "main pass");
+
+    if (m_useDynamicRendering) {
+        beginRendering_(command_buffer, image_index, clear_colours);
+
+        inheritance.colorFormats = {m_presenter->getImageFormat()};
+        inheritance.depthFormat = m_depthFormat;
+        inheritance.stencilFormat = hasStencilComponent_(m_depthFormat) ? m_depthFormat : VK_FORMAT_UNDEFINED;
+
+    } else {
+        VkRenderPassBeginInfo render_pass_info {VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO};
+        render_pass_info.renderPass = m_renderPass;
+        render_pass_info.framebuffer = m_swapFramebuffers.at(image_index);
+        render_pass_info.renderArea.offset = {0, 0};
+        render_pass_info.renderArea.extent = swap_extent;
+        render_pass_info.clearValueCount = clear_colours.size();
+        render_pass_info.pClearValues = clear_colours.data();
+
+        vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        inheritance.renderPass = m_renderPass;
+        inheritance.framebuffer = m_swapFramebuffers.at(image_index);
+    }
+
+    VkDescriptorSet descriptor_set = m_descSet;
+
+    /* Workers draw disjoint triangle ranges, secondaries start with no state bound. */
+    m_commandRecorder->recordParallel(command_buffer, inheritance, m_indexCount / 3, [&](VkCommandBuffer secondary, uint32_t first, uint32_t count) {
+        vkCmdBindPipeline(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
 
-    vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+        VkViewport viewport {0.0f, 0.0f};
+        viewport.width = static_cast<float>(swap_extent.width);
+        viewport.height = static_cast<float>(swap_extent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
 
-    VkViewport viewport {0.0f, 0.0f};
-    viewport.width = static_cast<float>(m_swapExtend.width);
-    viewport.height = static_cast<float>(m_swapExtend.height);
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(secondary, 0, 1, &viewport);
 
-    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+        VkRect2D scissor{{ 0, 0 }, swap_extent};
+        vkCmdSetScissor(secondary, 0, 1, &scissor);
 
-    VkRect2D scissor{{ 0, 0 }, m_swapExtend};
-    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+        VkBuffer vertex_buffers[] = {m_vertexBuffer, m_vertexBuffer};
+        VkDeviceSize offsets[] = {0, m_attributeOffset};
 
-    VkBuffer vertex_buffers[] = {m_vertexBuffer};
-    VkDeviceSize offsets[] = {0};
+        vkCmdBindVertexBuffers(secondary, 0, 2, vertex_buffers, offsets);
+        vkCmdBindIndexBuffer(secondary, m_indexBuffer, 0, m_indexType);
 
-    vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
-    vkCmdBindIndexBuffer(command_buffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindDescriptorSets(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &descriptor_set, 1, &uniform_offset);
 
-    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &(m_descSets.at(m_currentFrame)), 0, nullptr);
+        vkCmdDrawIndexed(secondary, count * 3, 1, first * 3, 0, 0);
+    });
 
-    vkCmdDrawIndexed(command_buffer, s_indices.size(), 1, 0, 0, 0);
-    vkCmdEndRenderPass(command_buffer);
+    if (m_useDynamicRendering) {
+        endRendering_(command_buffer, image_index);
 
-    result = vkEndCommandBuffer(command_buffer);
+    } else {
+        vkCmdEndRenderPass(command_buffer);
+    }
+
+    m_gpuProfiler->endScope(command_buffer, pass_scope);
+    m_gpuProfiler->endScope(command_buffer, frame_scope);
+
+    auto result = vkEndCommandBuffer(command_buffer);
     VTRS_ASSERT_VK_RESULT(result, "Unable to stop recording command command_buffer.")
+
+    return command_buffer;
 }
 
 void vtest::VulkanModel::createSyncObjects_() {
@@ -715,7 +701,11 @@ void vtest::VulkanModel::createSyncObjects_() {
     VkFenceCreateInfo fence_info{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
     fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    for (size_t index = 0; index < VTEST_MAX_FRAMES_IN_FLIGHT; index++) {
+    m_syncObjects.imageAvailableSem.resize(m_framesInFlight);
+    m_syncObjects.renderFinishedSem.resize(m_framesInFlight);
+    m_syncObjects.inFlightFence.resize(m_framesInFlight);
+
+    for (size_t index = 0; index < m_framesInFlight; index++) {
         auto result = vkCreateSemaphore(m_device, &semaphore_info, nullptr, &(m_syncObjects.imageAvailableSem.at(index)));
         VTRS_ASSERT_VK_RESULT(result, "Unable to obtain image synchronization semaphore.")
 
@@ -727,42 +717,20 @@ void vtest::VulkanModel::createSyncObjects_() {
     }
 }
 
-void vtest::VulkanModel::copyBuffer_(VkBuffer dest_buffer, VkBuffer src_buffer, VkDeviceSize buffer_size) {
-    VkCommandBufferAllocateInfo alloc_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandPool = m_transferCmdPool;
-    alloc_info.commandBufferCount = 1;
-
-    VkCommandBuffer cmd_buffer = VK_NULL_HANDLE;
-    auto result = vkAllocateCommandBuffers(m_device, &alloc_info, &cmd_buffer);
-    VTRS_ASSERT_VK_RESULT(result, "Private member copyBuffer_ failed while allocating command buffer.")
-
-    VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    result = vkBeginCommandBuffer(cmd_buffer, &begin_info);
-    VTRS_ASSERT_VK_RESULT(result, "Private member copyBuffer_ failed while attempting to record commands.")
-
-    VkBufferCopy copy_region {0, 0, buffer_size};
-    vkCmdCopyBuffer(cmd_buffer, src_buffer, dest_buffer, 1, &copy_region);
-
-    result = vkEndCommandBuffer(cmd_buffer);
-    VTRS_ASSERT_VK_RESULT(result, "Private member copyBuffer_ failed after copying buffer region.")
-
-    VkSubmitInfo submit_info {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &cmd_buffer;
-
-    result = vkQueueSubmit(m_transferQueue, 1, &submit_info, VK_NULL_HANDLE);
-    VTRS_ASSERT_VK_RESULT(result, "Private member copyBuffer_ failed while submitting command buffer.")
+void vtest::VulkanModel::destroySyncObjects_() {
+    for (size_t index = 0; index < m_syncObjects.inFlightFence.size(); index++) {
+        vkDestroySemaphore(m_device, m_syncObjects.imageAvailableSem.at(index), nullptr);
+        vkDestroySemaphore(m_device, m_syncObjects.renderFinishedSem.at(index), nullptr);
+        vkDestroyFence(m_device, m_syncObjects.inFlightFence.at(index), nullptr);
+    }
 
-    vkQueueWaitIdle(m_transferQueue);
-    vkFreeCommandBuffers(m_device, m_transferCmdPool, 1, &cmd_buffer);
+    m_syncObjects.imageAvailableSem.clear();
+    m_syncObjects.renderFinishedSem.clear();
+    m_syncObjects.inFlightFence.clear();
 }
 
-
 vtest::BufferObjectBundle vtest::VulkanModel::createBuffer_(VkDeviceSize buffer_size, VkBufferUsageFlags buffer_flags, VkMemoryPropertyFlags mem_flags) {
-    BufferObjectBundle bundle {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    BufferObjectBundle bundle {};
 
     VkBufferCreateInfo buffer_info {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
     buffer_info.size = buffer_size;
@@ -772,18 +740,7 @@ vtest::BufferObjectBundle vtest::VulkanModel::createBuffer_(VkDeviceSize buffer_
     auto result = vkCreateBuffer(m_device, &buffer_info, nullptr, &(bundle.buffer));
     VTRS_ASSERT_VK_RESULT(result, "Unable to create specified buffer buffer.")
 
-    VkMemoryRequirements mem_reqs {};
-    vkGetBufferMemoryRequirements(m_device, bundle.buffer, &mem_reqs);
-
-    VkMemoryAllocateInfo alloc_info {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-    alloc_info.allocationSize = mem_reqs.size;
-    alloc_info.memoryTypeIndex = findMemoryType_(mem_reqs.memoryTypeBits, mem_flags);
-
-    result = vkAllocateMemory(m_device, &alloc_info, nullptr, &(bundle.memory));
-    VTRS_ASSERT_VK_RESULT(result, "Unable to allocate memory for buffer.")
-
-    result = vkBindBufferMemory(m_device, bundle.buffer, bundle.memory, 0);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to bind new memory for buffer.")
+    bundle.allocation = m_allocator->allocateBuffer(bundle.buffer, mem_flags);
 
     return bundle;
 }
@@ -794,17 +751,19 @@ vtest::VulkanModel::createImage_(uint32_t width,
                                  VkFormat format,
                                  VkImageTiling tiling,
                                  VkImageUsageFlags usage_flags,
-                                 VkMemoryPropertyFlags memory_flags) {
+                                 VkMemoryPropertyFlags memory_flags,
+                                 uint32_t mip_levels,
+                                 VkImageCreateFlags create_flags) {
 
-    ImageObjectBundle bundle {VK_NULL_HANDLE, VK_NULL_HANDLE};
-    VkMemoryRequirements mem_reqs {};
+    ImageObjectBundle bundle {};
 
     VkImageCreateInfo image_info {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+    image_info.flags = create_flags;
     image_info.imageType = VK_IMAGE_TYPE_2D;
     image_info.extent.width = width;
     image_info.extent.height = height;
     image_info.extent.depth = 1;
-    image_info.mipLevels = 1;
+    image_info.mipLevels = mip_levels;
     image_info.arrayLayers = 1;
     image_info.format = format;
     image_info.tiling = tiling;
@@ -816,247 +775,71 @@ vtest::VulkanModel::createImage_(uint32_t width,
     auto result = vkCreateImage(m_device, &image_info, nullptr, &(bundle.image));
     VTRS_ASSERT_VK_RESULT(result, "Failed to create image bundle.")
 
-    vkGetImageMemoryRequirements(m_device, bundle.image, &mem_reqs);
-
-    VkMemoryAllocateInfo alloc_info {VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-    alloc_info.allocationSize = mem_reqs.size;
-    alloc_info.memoryTypeIndex = findMemoryType_(mem_reqs.memoryTypeBits, memory_flags);
-
-    result = vkAllocateMemory(m_device, &alloc_info, nullptr, &(bundle.memory));
-    VTRS_ASSERT_VK_RESULT(result, "Failed to allocate memory for image bundle.")
+    bundle.allocation = m_allocator->allocateImage(bundle.image, tiling, memory_flags);
 
-    vkBindImageMemory(m_device, bundle.image, bundle.memory, 0);
     return bundle;
 }
 
-void vtest::VulkanModel::createVertexBuffer_() {
-    VkDeviceSize buffer_size = sizeof(s_vertices.at(0)) * s_vertices.size();
-    BufferObjectBundle staging_bundle = createBuffer_(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+void vtest::VulkanModel::createVertexBuffer_(const vtrs::mesh_packed_position* positions, const vtrs::mesh_packed_attributes* attributes,
+                                             uint32_t count, const float* scale, const float* bias) {
+    VkDeviceSize positions_size = sizeof(vtrs::mesh_packed_position) * count;
+    VkDeviceSize attributes_size = sizeof(vtrs::mesh_packed_attributes) * count;
 
-    auto result = vkMapMemory(m_device, staging_bundle.memory, 0, buffer_size, 0, &m_vertexData);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to map staging vertex memory.")
-
-    memcpy(m_vertexData, s_vertices.data(), static_cast<size_t>(buffer_size));
-
-    BufferObjectBundle local_bundle = createBuffer_(buffer_size,
+    BufferObjectBundle local_bundle = createBuffer_(positions_size + attributes_size,
         VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     m_vertexBuffer = local_bundle.buffer;
-    m_vertexMemory = local_bundle.memory;
+    m_vertexAllocation = local_bundle.allocation;
+    m_attributeOffset = positions_size;
 
-    copyBuffer_(m_vertexBuffer, staging_bundle.buffer, buffer_size);
+    /* Dequantization rides along in the model matrix, the shader reads positions as they are. */
+    m_meshTransform = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(bias[0], bias[1], bias[2])), glm::vec3(scale[0], scale[1], scale[2]));
 
-    vkUnmapMemory(m_device, staging_bundle.memory);
+    m_uploadQueue->uploadBuffer(m_vertexBuffer, 0, positions, positions_size,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 
-    vkDestroyBuffer(m_device, staging_bundle.buffer, nullptr);
-    vkFreeMemory(m_device, staging_bundle.memory, nullptr);
+    m_uploadQueue->uploadBuffer(m_vertexBuffer, m_attributeOffset, attributes, attributes_size,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 }
 
-void vtest::VulkanModel::createIndexBuffer_() {
-    VkDeviceSize buffer_size = sizeof(s_indices.at(0)) * s_indices.size();
-    BufferObjectBundle staging_bundle = createBuffer_(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    auto result = vkMapMemory(m_device, staging_bundle.memory, 0, buffer_size, 0, &m_indexData);
-    VTRS_ASSERT_VK_RESULT(result, "Unable to map staging index memory.")
-
-    memcpy(m_indexData, s_indices.data(), static_cast<size_t>(buffer_size));
+void vtest::VulkanModel::createIndexBuffer_(const void* data, uint32_t count, VkIndexType type) {
+    VkDeviceSize buffer_size = (type == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t)) * count;
 
     BufferObjectBundle local_bundle = createBuffer_(buffer_size,
                                                     VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
                                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     m_indexBuffer = local_bundle.buffer;
-    m_indexMemory = local_bundle.memory;
-
-    copyBuffer_(m_indexBuffer, staging_bundle.buffer, buffer_size);
+    m_indexAllocation = local_bundle.allocation;
+    m_indexCount = count;
+    m_indexType = type;
 
-    vkUnmapMemory(m_device, staging_bundle.memory);
-    vkDestroyBuffer(m_device, staging_bundle.buffer, nullptr);
-    vkFreeMemory(m_device, staging_bundle.memory, nullptr);
+    m_uploadQueue->uploadBuffer(m_indexBuffer, 0, data, buffer_size,
+        VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT);
 }
 
 void vtest::VulkanModel::createUniformBuffers_() {
-    VkDeviceSize buffer_size = sizeof (struct vtest::UniformBufferObject);
-    m_uniformBuffer.resize(VTEST_MAX_FRAMES_IN_FLIGHT);
-    m_uniformMemory.resize(VTEST_MAX_FRAMES_IN_FLIGHT);
-
-    for (int index = 0; index < VTEST_MAX_FRAMES_IN_FLIGHT; index++) {
-        auto bundle = createBuffer_(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        m_uniformBuffer.at(index) = bundle.buffer;
-        m_uniformMemory.at(index) = bundle.memory;
-    }
-}
-
-void vtest::VulkanModel::copyBufferToImage_(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-    VkCommandBufferAllocateInfo alloc_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandPool = m_graphicsCmdPool;
-    alloc_info.commandBufferCount = 1;
-
-    VkCommandBuffer command_buffer;
-    auto result = vkAllocateCommandBuffers(m_device, &alloc_info, &command_buffer);
-    VTRS_ASSERT_VK_RESULT(result, "Method copyBufferToImage_ failed while allocating command buffer.")
-
-    VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(command_buffer, &begin_info);
-
-    VkBufferImageCopy region {};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
-    region.imageOffset = {0, 0, 0};
-    region.imageExtent = {width, height, 1};
+    vtrs::FrameAllocator::Options allocator_options {};
+    allocator_options.framesInFlight = m_framesInFlight;
+    allocator_options.frameCapacity = 256 * 1024;
 
-    vkCmdCopyBufferToImage(command_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    vkEndCommandBuffer(command_buffer);
-
-    VkSubmitInfo submit_info {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer;
-
-    vkQueueSubmit(m_graphicsQueue, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(m_graphicsQueue);
-
-    vkFreeCommandBuffers(m_device, m_graphicsCmdPool, 1, &command_buffer);
-}
-
-void vtest::VulkanModel::transitionImageLayout_(VkImage image, VkFormat, VkImageLayout old_layout, VkImageLayout new_layout) {
-    VkCommandBufferAllocateInfo alloc_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandPool = m_graphicsCmdPool;
-    alloc_info.commandBufferCount = 1;
-
-    VkCommandBuffer command_buffer;
-    auto result = vkAllocateCommandBuffers(m_device, &alloc_info, &command_buffer);
-    VTRS_ASSERT_VK_RESULT(result, "Method transitionImageLayout_ failed while allocating command buffer.")
-
-    VkCommandBufferBeginInfo begin_info {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(command_buffer, &begin_info);
-
-    VkImageMemoryBarrier barrier {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
-    barrier.oldLayout = old_layout;
-    barrier.newLayout = new_layout;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = image;
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-
-    VkPipelineStageFlags src_stage;
-    VkPipelineStageFlags dst_stage;
-
-    if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-        src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        dst_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    } else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-        src_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-        dst_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-
-    } else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-        src_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        dst_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    } else {
-        throw vtrs::RuntimeError("Unsupported layout transition.", vtrs::RuntimeError::E_TYPE_GENERAL);
-    }
-
-    vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    vkEndCommandBuffer(command_buffer);
-
-    VkSubmitInfo submit_info {VK_STRUCTURE_TYPE_SUBMIT_INFO};
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer;
-
-    vkQueueSubmit(m_graphicsQueue, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(m_graphicsQueue);
-
-    vkFreeCommandBuffers(m_device, m_graphicsCmdPool, 1, &command_buffer);
+    m_frameAllocator = vtrs::FrameAllocator::factory(m_gpu->getDeviceHandle(), m_device, m_allocator, &allocator_options);
 }
 
 void vtest::VulkanModel::createTextureImage_(const std::string& file_path) {
-    int image_width;
-    int image_height;
-    int image_channels;
+    vtrs::TextureCache::SamplerState sampler_state {};
+    sampler_state.maxAnisotropy = m_gpu->getGPULimit<float>("maxSamplerAnisotropy");
 
-    stbi_uc* pixels = stbi_load(file_path.c_str(), &image_width, &image_height, &image_channels, STBI_rgb_alpha);
-
-    if (pixels == nullptr) {
-        throw vtrs::RuntimeError("Unable to load texture image.", vtrs::RuntimeError::E_TYPE_GENERAL);
+    /* A texture loaded before stays cached, loading the same file again is a hit. */
+    if (m_textureHandle.has_value()) {
+        m_mipResidency->untrack(m_textureCache->getTexture(m_textureHandle.value()));
+        m_textureCache->release(m_textureHandle.value());
     }
 
-    VkDeviceSize image_size = image_width * image_height * 4;
-    vtest::BufferObjectBundle staging_bundle = createBuffer_(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    void* buffer_data;
-    vkMapMemory(m_device, staging_bundle.memory, 0, image_size, 0, &buffer_data);
-    memcpy(buffer_data, pixels, static_cast<size_t>(image_size));
-    vkUnmapMemory(m_device, staging_bundle.memory);
-
-    stbi_image_free(pixels);
-
-    auto image_bundle = createImage_(image_width, image_height, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    m_textureBundle.image  = image_bundle.image;
-    m_textureBundle.memory = image_bundle.memory;
-
-    transitionImageLayout_(m_textureBundle.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copyBufferToImage_(staging_bundle.buffer, m_textureBundle.image, static_cast<uint32_t>(image_width), static_cast<uint32_t>(image_height));
-    transitionImageLayout_(m_textureBundle.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    VkImageViewCreateInfo view_info {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
-    view_info.image = m_textureBundle.image;
-    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    view_info.format = VK_FORMAT_R8G8B8A8_SRGB;
-    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    view_info.subresourceRange.baseMipLevel = 0;
-    view_info.subresourceRange.levelCount = 1;
-    view_info.subresourceRange.baseArrayLayer = 0;
-    view_info.subresourceRange.layerCount = 1;
-
-    auto result = vkCreateImageView(m_device, &view_info, nullptr, &(m_textureBundle.view));
-    VTRS_ASSERT_VK_RESULT(result, "Method createTextureImage_ failed while creating image view.")
-
-    VkSamplerCreateInfo samplerInfo{};
-    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.magFilter = VK_FILTER_LINEAR;
-    samplerInfo.minFilter = VK_FILTER_LINEAR;
-    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    samplerInfo.anisotropyEnable = VK_TRUE;
-    samplerInfo.maxAnisotropy =  m_gpu->getGPULimit<float>("maxSamplerAnisotropy");
-    samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-    samplerInfo.unnormalizedCoordinates = VK_FALSE;
-    samplerInfo.compareEnable = VK_FALSE;
-    samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
-    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-
-    result = vkCreateSampler(m_device, &samplerInfo, nullptr, &(m_textureBundle.sampler));
-    VTRS_ASSERT_VK_RESULT(result, "Method createTextureImage_ failed while creating sampler")
-
-    vkDestroyBuffer(m_device, staging_bundle.buffer, nullptr);
-    vkFreeMemory(m_device, staging_bundle.memory, nullptr);
+    /* Decoding and upload happen in the background, drawFrame swaps the view in once it lands. */
+    m_textureHandle = m_textureCache->acquire(file_path, sampler_state);
+    m_mipResidency->track(m_textureCache->getTexture(m_textureHandle.value()));
 }
 
 void vtest::VulkanModel::bootstrap_() {
@@ -1073,44 +856,62 @@ void vtest::VulkanModel::bootstrap_() {
         }
     }
 
+    const auto& vulkan13_features = m_gpu->getVulkan13Features();
+    m_useDynamicRendering = vulkan13_features.dynamicRendering && vulkan13_features.synchronization2;
+
+    m_depthFormat = findSupportedFormat_({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+                                         VK_IMAGE_TILING_OPTIMAL,
+                                         VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+
     createLogicalDevice_();
-    createSwapchain_();
-    createImageViews_();
-    createRenderPass_();
+    createPresenter_();
+
+    /* Render pass and framebuffers are only the fallback for pre 1.3 devices. */
+    if (!m_useDynamicRendering) {
+        createRenderPass_();
+    }
+
     createDescSetLayout_();
     setupGraphicsPipeline_();
     createDepthResources_();
-    createFramebuffers_();
-    createCommandPools_();
-    allocateCommandBuffers_();
+
+    if (!m_useDynamicRendering) {
+        createFramebuffers_();
+    }
+
+    createCommandRecorder_();
     createSyncObjects_();
 }
 
-void vtest::VulkanModel::updateUniformBuffers_(uint32_t current_frame) const {
-    static auto start_time = std::chrono::high_resolution_clock::now();
-    auto current_time = std::chrono::high_resolution_clock::now();
+uint32_t vtest::VulkanModel::updateUniformBuffers_() const {
+    VTRS_PROFILE_FUNCTION();
+
+    /* Independent of the profiler clock, which calibrates the TSC on first use. */
+    static auto start_time = std::chrono::steady_clock::now();
+    auto current_time = std::chrono::steady_clock::now();
 
     float time = std::chrono::duration<float, std::chrono::seconds::period>(current_time - start_time).count();
 
     UniformBufferObject ubo {};
-    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)) * m_meshTransform;
     ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 
-    float aspect = static_cast<float>(m_swapExtend.width) / static_cast<float>(m_swapExtend.height);
+    VkExtent2D swap_extent = m_presenter->getImageExtent();
+    float aspect = static_cast<float>(swap_extent.width) / static_cast<float>(swap_extent.height);
 
     ubo.projection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 10.0f);
 
     /* Inverting Y-axis. */
     ubo.projection[1][1] *= -1;
 
-    void* buffer_data;
-    vkMapMemory(m_device, m_uniformMemory.at(current_frame), 0, sizeof(ubo), 0, &buffer_data);
-    memcpy(buffer_data, &ubo, sizeof(ubo));
-    vkUnmapMemory(m_device, m_uniformMemory.at(current_frame));
+    auto allocation = m_frameAllocator->pushUniform(ubo);
+
+    return static_cast<uint32_t>(allocation.offset);
 }
 
-vtest::VulkanModel *vtest::VulkanModel::factory(vtrs::XCBClient* client, vtrs::XCBWindow window) {
+vtest::VulkanModel *vtest::VulkanModel::factory(vtrs::XCBClient* client, vtrs::XCBWindow window, uint32_t frames_in_flight) {
     auto application = new VulkanModel();
+    application->m_framesInFlight = std::max<uint32_t>(frames_in_flight, 1);
     application->createSurface_(client->getConnection(), window.identifier);
     application->bootstrap_();
 
@@ -1126,93 +927,124 @@ vtest::VulkanModel::VulkanModel() {
 
     m_gpu = findDiscreteGPU_();
 
-    m_commandBuffers.resize(VTEST_MAX_FRAMES_IN_FLIGHT);
-
-    m_syncObjects.imageAvailableSem.resize(VTEST_MAX_FRAMES_IN_FLIGHT);
-    m_syncObjects.renderFinishedSem.resize(VTEST_MAX_FRAMES_IN_FLIGHT);
-    m_syncObjects.inFlightFence.resize(VTEST_MAX_FRAMES_IN_FLIGHT);
 }
 
 vtest::VulkanModel::~VulkanModel() {
     vtrs::Logger::info("Cleaning up Vulkan Model application.");
 
     vkDestroyBuffer(m_device, m_vertexBuffer, nullptr);
-    vkFreeMemory(m_device, m_vertexMemory, nullptr);
+    m_allocator->free(m_vertexAllocation);
 
     vkDestroyBuffer(m_device, m_indexBuffer, nullptr);
-    vkFreeMemory(m_device, m_indexMemory, nullptr);
+    m_allocator->free(m_indexAllocation);
 
-    for (size_t index = 0; index < VTEST_MAX_FRAMES_IN_FLIGHT; index++) {
-        vkDestroySemaphore(m_device, m_syncObjects.imageAvailableSem.at(index), nullptr);
-        vkDestroySemaphore(m_device, m_syncObjects.renderFinishedSem.at(index), nullptr);
-        vkDestroyFence(m_device, m_syncObjects.inFlightFence.at(index), nullptr);
+    destroySyncObjects_();
 
-        vkDestroyBuffer(m_device, m_uniformBuffer.at(index), nullptr);
-        vkFreeMemory(m_device, m_uniformMemory.at(index), nullptr);
-    }
+    delete m_frameAllocator;
 
-    vkDestroyDescriptorPool(m_device, m_descPool, nullptr);
-    vkDestroyCommandPool(m_device, m_transferCmdPool, nullptr);
-    vkDestroyCommandPool(m_device, m_graphicsCmdPool, nullptr);
+    delete m_commandRecorder;
+    delete m_threadPool;
+
+#if (defined(VTRS_MODE_DEBUG) && VTRS_MODE_DEBUG == 1)
+    m_gpuProfiler->printStats();
+#endif
+
+    delete m_gpuProfiler;
 
     for (auto framebuffer : m_swapFramebuffers) {
         vkDestroyFramebuffer(m_device, framebuffer, nullptr);
     }
 
     vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
-    vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+
+#if (defined(VTRS_MODE_DEBUG) && VTRS_MODE_DEBUG == 1)
+    m_pipelineCache->printStats();
+
+    auto pacing_stats = m_presenter->getPacingStats();
+    vtrs::Logger::debug("Presented", pacing_stats.presentCount, "frames, frame time", pacing_stats.frameTime, "ms, jitter", pacing_stats.jitter, "ms.");
+#endif
+
+    delete m_pipelineCache;
     vkDestroyRenderPass(m_device, m_renderPass, nullptr);
 
-    vkDestroyDescriptorSetLayout(m_device, m_descSetLayout, nullptr);
+#if (defined(VTRS_MODE_DEBUG) && VTRS_MODE_DEBUG == 1)
+    m_textureCache->printStats();
+#endif
 
-    for(auto image_view : m_swapViews) {
-        vkDestroyImageView(m_device, image_view, nullptr);
-    }
+    delete m_mipResidency;
+    delete m_textureCache;
+    delete m_textureStreamer;
+    delete m_descriptorAllocator;
+    delete m_mipGenerator;
+    delete m_shaderLibrary;
 
     vkDestroyImageView(m_device, m_depthResource.view, nullptr);
     vkDestroyImage(m_device, m_depthResource.image, nullptr);
-    vkFreeMemory(m_device, m_depthResource.memory, nullptr);
+    m_allocator->free(m_depthResource.allocation);
 
-    vkDestroyImageView(m_device, m_textureBundle.view, nullptr);
-    vkDestroySampler(m_device, m_textureBundle.sampler, nullptr);
-    vkDestroyImage(m_device, m_textureBundle.image, nullptr);
-    vkFreeMemory(m_device, m_textureBundle.memory, nullptr);
+    /* Runs the deleters still queued for retired swapchains and size dependent resources. */
+    delete m_presenter;
+
+    delete m_uploadQueue;
+    delete m_allocator;
 
-    vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
     vkDestroyDevice(m_device, nullptr);
     vkDestroySurfaceKHR(vtrs::RendererContext::getInstanceHandle(), m_surface, nullptr);
 
-    m_syncObjects.imageAvailableSem.clear();
-    m_syncObjects.renderFinishedSem.clear();
-    m_syncObjects.inFlightFence.clear();
-
-    m_swapViews.clear();
-    m_swapImages.clear();
     m_swapFramebuffers.clear();
-    m_commandBuffers.clear();
 
     m_gpu = nullptr;
 }
 
 bool vtest::VulkanModel::drawFrame() {
-    vkWaitForFences(m_device, 1, &(m_syncObjects.inFlightFence.at(m_currentFrame)), VK_TRUE, UINT64_MAX);
+    VTRS_PROFILE_FRAME();
+    VTRS_PROFILE_FUNCTION();
+
+    {
+        VTRS_PROFILE_ZONE("Wait for frame fence");
+        vkWaitForFences(m_device, 1, &(m_syncObjects.inFlightFence.at(m_currentFrame)), VK_TRUE, UINT64_MAX);
+    }
+
+    /* A pending rebuild happens here, once per frame, however many events asked for it. */
+    if (m_presenter->beginFrame(m_frameNumber)) {
+        recreateSizeDependents_();
+    }
+
+    m_frameAllocator->beginFrame(m_currentFrame);
+    m_commandRecorder->beginFrame(m_currentFrame);
+    m_descriptorAllocator->beginFrame(m_currentFrame);
+
+    /* The model fits in a unit sphere at the origin, seen as in updateUniformBuffers_. */
+    if (m_textureHandle.has_value()) {
+        float screen_size = vtrs::MipResidency::getScreenSize(1.0f, glm::length(glm::vec3(2.0f, 2.0f, 2.0f)), glm::radians(45.0f),
+                                                              static_cast<float>(m_presenter->getImageExtent().height));
+
+        m_mipResidency->report(m_textureCache->getTexture(m_textureHandle.value()), screen_size);
+    }
+
+    m_mipResidency->update();
+
+    /* Cached sets are keyed by their writes, so a resident texture gets a new set
+     * while frames still in flight keep sampling the placeholder. */
+    if (m_textureCache->update()) {
+        createDescSets_();
+    }
 
     uint32_t image_index;
-    auto result = vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, m_syncObjects.imageAvailableSem.at(m_currentFrame), VK_NULL_HANDLE, &image_index);
+    auto result = m_presenter->acquire(m_syncObjects.imageAvailableSem.at(m_currentFrame), &image_index);
 
-    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-        rebuildSwapchain();
+    /* The presenter flags itself for a rebuild, a suboptimal image is still drawn.
+     * The frame number stays, so the retry keeps the deleters of this rebuild queued. */
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
         return false;
     }
 
-    VTRS_ASSERT_VK_RESULT(result, "Unable to obtain next image from swapchain.")
-
     vkResetFences(m_device, 1, &(m_syncObjects.inFlightFence.at(m_currentFrame)));
 
-    vkResetCommandBuffer(m_commandBuffers.at(m_currentFrame), /*VkCommandBufferResetFlagBits*/ 0);
-    recordCommands_(m_commandBuffers.at(m_currentFrame), image_index);
+    uint32_t uniform_offset = updateUniformBuffers_();
+    m_frameAllocator->flush();
 
-    updateUniformBuffers_(m_currentFrame);
+    VkCommandBuffer command_buffer = recordCommands_(image_index, uniform_offset);
 
     VkSubmitInfo submit_info {VK_STRUCTURE_TYPE_SUBMIT_INFO};
 
@@ -1222,7 +1054,7 @@ bool vtest::VulkanModel::drawFrame() {
     submit_info.pWaitSemaphores = wait_semaphores;
     submit_info.pWaitDstStageMask = wait_stages;
     submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &(m_commandBuffers.at(m_currentFrame));
+    submit_info.pCommandBuffers = &command_buffer;
 
     VkSemaphore signal_semaphores[] = {m_syncObjects.renderFinishedSem.at(m_currentFrame)};
     submit_info.signalSemaphoreCount = 1;
@@ -1231,18 +1063,13 @@ bool vtest::VulkanModel::drawFrame() {
     result = vkQueueSubmit(m_graphicsQueue, 1, &submit_info, m_syncObjects.inFlightFence.at(m_currentFrame));
     VTRS_ASSERT_VK_RESULT(result, "Failed to submit command buffer to queue.")
 
-    VkPresentInfoKHR present_info {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
-    present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = signal_semaphores;
-
-    VkSwapchainKHR swapchains[] = {m_swapchain};
-    present_info.swapchainCount = 1;
-    present_info.pSwapchains = swapchains;
-    present_info.pImageIndices = &image_index;
-
-    vkQueuePresentKHR(m_surfaceQueue, &present_info);
+    {
+        VTRS_PROFILE_ZONE("Present");
+        m_presenter->present(m_surfaceQueue, image_index, signal_semaphores[0]);
+    }
 
-    m_currentFrame = (m_currentFrame + 1) % VTEST_MAX_FRAMES_IN_FLIGHT;
+    m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
+    m_frameNumber++;
     return true;
 }
 
@@ -1255,118 +1082,165 @@ void vtest::VulkanModel::waitIdle() {
 }
 
 void vtest::VulkanModel::rebuildSwapchain() {
-    if (m_swapchain == VK_NULL_HANDLE) {
+    if (m_presenter == nullptr) {
         throw vtrs::RuntimeError("Swapchain should be built first.", vtrs::RuntimeError::E_TYPE_GENERAL);
     }
 
-    waitIdle();
+    m_presenter->requestRebuild();
+}
+
+void vtest::VulkanModel::setFramesInFlight(uint32_t frames_in_flight) {
+    frames_in_flight = std::max<uint32_t>(frames_in_flight, 1);
 
-    for (auto buffer: m_swapFramebuffers) {
-        vkDestroyFramebuffer(m_device, buffer, nullptr);
+    if (frames_in_flight == m_framesInFlight) {
+        return;
     }
 
-    for (auto image_view: m_swapViews) {
-        vkDestroyImageView(m_device, image_view, nullptr);
+    /* Only the frames already queued are waited on, the device itself keeps running. */
+    auto result = vkWaitForFences(m_device, m_syncObjects.inFlightFence.size(), m_syncObjects.inFlightFence.data(), VK_TRUE, UINT64_MAX);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to wait for frames in flight.")
+
+    /* The fences say nothing about presentation, a queued present may still be
+     * waiting on a render finished semaphore that is about to be destroyed. */
+    result = vkQueueWaitIdle(m_surfaceQueue);
+    VTRS_ASSERT_VK_RESULT(result, "Unable to wait for queued presents.")
+
+    destroySyncObjects_();
+
+    m_framesInFlight = frames_in_flight;
+    m_currentFrame = 0;
+
+    createSyncObjects_();
+
+    m_presenter->setFramesInFlight(m_framesInFlight);
+    m_commandRecorder->setFramesInFlight(m_framesInFlight);
+    m_gpuProfiler->setFramesInFlight(m_framesInFlight);
+    m_descriptorAllocator->setFramesInFlight(m_framesInFlight);
+    m_textureStreamer->setFramesInFlight(m_framesInFlight);
+
+    /* The uniform ring is a new buffer, which may reuse the handle value of the old one. */
+    if (m_frameAllocator != nullptr) {
+        m_descriptorAllocator->invalidate(m_frameAllocator->getBuffer());
+        m_frameAllocator->setFramesInFlight(m_framesInFlight);
+        createDescSets_();
     }
+}
 
-    vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
+void vtest::VulkanModel::setSwapchainImageCount(uint32_t image_count) {
+    m_presenter->setImageCount(image_count);
+}
 
-    createSwapchain_();
-    createImageViews_();
+void vtest::VulkanModel::recreateSizeDependents_() {
+    VkDevice device = m_device;
+    vtrs::DeviceAllocator* allocator = m_allocator;
+    struct DepthResourceBundle old_depth = m_depthResource;
+    std::vector<VkFramebuffer> old_framebuffers = m_swapFramebuffers;
 
-    vkDestroyImageView(m_device, m_depthResource.view, nullptr);
-    vkDestroyImage(m_device, m_depthResource.image, nullptr);
-    vkFreeMemory(m_device, m_depthResource.memory, nullptr);
+    m_presenter->defer([device, allocator, old_depth, old_framebuffers]() mutable {
+        for (auto framebuffer : old_framebuffers) {
+            vkDestroyFramebuffer(device, framebuffer, nullptr);
+        }
 
+        vkDestroyImageView(device, old_depth.view, nullptr);
+        vkDestroyImage(device, old_depth.image, nullptr);
+        allocator->free(old_depth.allocation);
+    });
+
+    m_swapFramebuffers.clear();
     createDepthResources_();
-    createFramebuffers_();
+
+    if (!m_useDynamicRendering) {
+        createFramebuffers_();
+    }
 }
 
 void vtest::VulkanModel::loadCube(const std::string& texture_file) {
-    if (s_vertices.empty()) {
-        s_vertices.push_back({{-0.9f, -0.9f, 0.4f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}});  // 0
-        s_vertices.push_back({{0.9f, -0.9f, 0.4f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}});   // 1
-        s_vertices.push_back({{0.9f, 0.9f, 0.4f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}});    // 2
-        s_vertices.push_back({{-0.9f, 0.9f, 0.4f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}});   // 3
-
-        s_vertices.push_back({{-0.9f, -0.9f, -0.1f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}}); // 4
-        s_vertices.push_back({{0.9f, -0.9f, -0.1f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}});  // 5
-        s_vertices.push_back({{0.9f, 0.9f, -0.1f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}});   // 6
-        s_vertices.push_back({{-0.9f, 0.9f, -0.1f}, {1.0f, 1.0f, 1.0f}, {1.0f, 1.0f}});  // 7
-
-        s_indices.push_back(0);
-        s_indices.push_back(1);
-        s_indices.push_back(2);
-        s_indices.push_back(0);
-        s_indices.push_back(2);
-        s_indices.push_back(3);
-
-        s_indices.push_back(4);
-        s_indices.push_back(5);
-        s_indices.push_back(6);
-        s_indices.push_back(6);
-        s_indices.push_back(7);
-        s_indices.push_back(4);
-
-        s_indices.push_back(4);
-        s_indices.push_back(0);
-        s_indices.push_back(7);
-
-        s_indices.push_back(3);
-        s_indices.push_back(4);
-        s_indices.push_back(7);
+    static const float s_corners[][5] = {
+        {-0.9f, -0.9f, 0.4f, 1.0f, 0.0f},  {0.9f, -0.9f, 0.4f, 0.0f, 0.0f},
+        {0.9f, 0.9f, 0.4f, 0.0f, 1.0f},    {-0.9f, 0.9f, 0.4f, 1.0f, 1.0f},
+        {-0.9f, -0.9f, -0.1f, 1.0f, 0.0f}, {0.9f, -0.9f, -0.1f, 0.0f, 0.0f},
+        {0.9f, 0.9f, -0.1f, 0.0f, 1.0f},   {-0.9f, 0.9f, -0.1f, 1.0f, 1.0f}
+    };
+
+    static const uint32_t s_indices[] = {0, 1, 2, 0, 2, 3, 4, 5, 6, 6, 7, 4, 4, 0, 7, 3, 4, 7};
+
+    vtrs::mesh_data mesh {};
+    mesh.indices.assign(std::begin(s_indices), std::end(s_indices));
+    std::copy(s_corners[0], s_corners[0] + 3, mesh.boundsMin);
+    std::copy(s_corners[0], s_corners[0] + 3, mesh.boundsMax);
+
+    for (const auto& corner : s_corners) {
+        vtrs::mesh_vertex vertex {};
+        std::copy(corner, corner + 3, vertex.position);
+        std::copy(corner + 3, corner + 5, vertex.uv);
+        vertex.normal[2] = 1.0f;
+
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            mesh.boundsMin[axis] = std::min(mesh.boundsMin[axis], corner[axis]);
+            mesh.boundsMax[axis] = std::max(mesh.boundsMax[axis], corner[axis]);
+        }
+
+        mesh.vertices.push_back(vertex);
     }
 
+    std::unique_ptr<vtrs::VertexPacker> packer(vtrs::VertexPacker::factory());
+    packer->pack(&mesh);
+
     createTextureImage_(texture_file);
     createUniformBuffers_();
-    createDescPool_();
     createDescSets_();
-    createVertexBuffer_();
-    createIndexBuffer_();
+    createVertexBuffer_(mesh.packed.positions.data(), mesh.packed.attributes.data(),
+                        static_cast<uint32_t>(mesh.vertices.size()), mesh.packed.scale, mesh.packed.bias);
+    createIndexBuffer_(mesh.packed.indices16.data(), static_cast<uint32_t>(mesh.packed.indices16.size()), VK_INDEX_TYPE_UINT16);
+
+    /* Every upload goes out in one submission. The graphics queue acquires
+     * the resources before any frame is recorded, so no CPU wait is needed.
+     * The texture streams in on its own from the first frame. */
+    m_uploadQueue->submit();
 }
 
 void vtest::VulkanModel::loadModel(const std::string& texture_file, const std::string& model_file) {
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string warn, err;
-
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, model_file.c_str())) {
-        throw vtrs::RuntimeError(warn + err, vtrs::RuntimeError::E_TYPE_GENERAL);
-    }
-
-    std::unordered_map<vtest::Vertex, uint32_t> unique_vertices {};
+    /* The OBJ is only parsed when its .vmesh cache is missing or stale. Parsing
+     * and welding run on the command recording threads, idle while loading.
+     * The settings hash changes whenever the steps below do. */
+    std::unique_ptr<vtrs::MeshFile> mesh(vtrs::MeshFile::importCached(model_file, [this](const std::string& path) {
+        std::unique_ptr<vtrs::ObjImporter> importer(vtrs::ObjImporter::factory(m_threadPool));
+        auto imported = importer->load(path);
 
-    for (const auto& shape : shapes) {
-        for (const auto& index : shape.mesh.indices) {
-            vtest::Vertex vertex {};
+        std::unique_ptr<vtrs::MeshOptimizer> optimizer(vtrs::MeshOptimizer::factory());
+        vtrs::MeshOptimizer::printReport(optimizer->optimize(&imported));
 
-            vertex.coordinate = {
-                attrib.vertices[3 * index.vertex_index + 0],
-                attrib.vertices[3 * index.vertex_index + 1],
-                attrib.vertices[3 * index.vertex_index + 2]
-            };
+        std::unique_ptr<vtrs::VertexPacker> packer(vtrs::VertexPacker::factory());
+        packer->pack(&imported);
 
-            vertex.textureXY = {
-                attrib.texcoords[2 * index.texcoord_index + 0],
-                1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-            };
+        return imported;
+    }, 2));
 
-            vertex.rgbColor = {1.0f, 1.0f, 1.0f};
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    const vtrs::mesh_packed_position* positions = mesh->getPackedPositions(&vertex_count);
+    const vtrs::mesh_packed_attributes* attributes = mesh->getPackedAttributes(&vertex_count);
 
-            if (unique_vertices.count(vertex) == 0) {
-                unique_vertices[vertex] = static_cast<uint32_t>(s_vertices.size());
-                s_vertices.push_back(vertex);
-            }
-
-            s_indices.push_back(unique_vertices[vertex]);
-        }
+    if (positions == nullptr || attributes == nullptr) {
+        throw vtrs::AssetError(model_file + ": Mesh has no packed vertices.", vtrs::AssetError::E_TYPE_MALFORMED);
     }
 
     createTextureImage_(texture_file);
     createUniformBuffers_();
-    createDescPool_();
     createDescSets_();
-    createVertexBuffer_();
-    createIndexBuffer_();
+
+    /* Staged straight from the mapped file, which can be closed once recorded. */
+    createVertexBuffer_(positions, attributes, vertex_count, mesh->getPositionScale(), mesh->getPositionBias());
+
+    if (const uint16_t* indices = mesh->getPackedIndices(&index_count)) {
+        createIndexBuffer_(indices, index_count, VK_INDEX_TYPE_UINT16);
+
+    } else {
+        createIndexBuffer_(mesh->getIndices(&index_count), index_count, VK_INDEX_TYPE_UINT32);
+    }
+
+    /* Every upload goes out in one submission. The graphics queue acquires
+     * the resources before any frame is recorded, so no CPU wait is needed.
+     * The texture streams in on its own from the first frame. */
+    m_uploadQueue->submit();
 }
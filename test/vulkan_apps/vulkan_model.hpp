@@ -23,17 +23,32 @@
 
 #define GLM_FORCE_RADIANS 1
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE 1
-#define GLM_ENABLE_EXPERIMENTAL 1
 
 #include <vector>
 #include <optional>
 #include <array>
-#include <glm/gtx/hash.hpp>
 #include <glm/glm.hpp>
 #include "platform/linux/xcb_client.hpp"
 #include "renderer/renderer_context.hpp"
-
-#define VTEST_MAX_FRAMES_IN_FLIGHT 2
+#include "renderer/surface_presenter.hpp"
+#include "renderer/device_allocator.hpp"
+#include "renderer/frame_allocator.hpp"
+#include "renderer/upload_queue.hpp"
+#include "renderer/vertex_layout.hpp"
+#include "renderer/pipeline_cache.hpp"
+#include "renderer/shader_library.hpp"
+#include "renderer/command_recorder.hpp"
+#include "renderer/descriptor_allocator.hpp"
+#include "renderer/gpu_profiler.hpp"
+#include "renderer/mip_generator.hpp"
+#include "renderer/texture_cache.hpp"
+#include "renderer/mip_residency.hpp"
+#include "assets/obj_importer.hpp"
+#include "assets/mesh_optimizer.hpp"
+#include "assets/mesh_file.hpp"
+#include "assets/vertex_packer.hpp"
+
+#define VTEST_DEFAULT_FRAMES_IN_FLIGHT 2
 
 namespace vtest {
 
@@ -43,17 +58,6 @@ struct QueueFamilyIndices {
     std::optional<uint32_t> surfaceFamily;
 };
 
-struct SwapchainSupportBundle {
-    VkSurfaceCapabilitiesKHR surfaceCaps;
-    std::vector<VkSurfaceFormatKHR> surfaceFormats;
-    std::vector<VkPresentModeKHR> presentModes;
-};
-
-struct SPIRVBytes {
-    char* data;
-    size_t size;
-};
-
 struct SyncObjectBundle {
     std::vector<VkSemaphore> imageAvailableSem;
     std::vector<VkSemaphore> renderFinishedSem;
@@ -62,34 +66,31 @@ struct SyncObjectBundle {
 
 struct BufferObjectBundle {
     VkBuffer buffer = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator::Allocation allocation {};
 };
 
 struct ImageObjectBundle {
     VkImage image = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator::Allocation allocation {};
     VkImageView view = VK_NULL_HANDLE;
     VkSampler sampler = VK_NULL_HANDLE;
 };
 
 struct DepthResourceBundle {
     VkImage image = VK_NULL_HANDLE;
-    VkDeviceMemory memory = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator::Allocation allocation {};
     VkImageView view = VK_NULL_HANDLE;
 };
 
-struct Vertex {
-    glm::vec3 coordinate;
-    glm::vec3 rgbColor;
-    glm::vec2 textureXY;
+/* Positions on their own, so passes that only need depth fetch 8 bytes per vertex. */
+typedef vtrs::VertexStream<vtrs::mesh_packed_position, 0,
+    VTRS_VERTEX_ATTRIBUTE(vtrs::mesh_packed_position, position, 0, VK_FORMAT_R16G16B16A16_SNORM)> PositionStream;
 
-    static VkVertexInputBindingDescription getInputBindingDescription();
-    static std::array<VkVertexInputAttributeDescription, 3> getInputAttributeDescription();
+typedef vtrs::VertexStream<vtrs::mesh_packed_attributes, 1,
+    VTRS_VERTEX_ATTRIBUTE(vtrs::mesh_packed_attributes, normal, 1, VK_FORMAT_R16G16_SNORM),
+    VTRS_VERTEX_ATTRIBUTE(vtrs::mesh_packed_attributes, uv, 2, VK_FORMAT_R16G16_SFLOAT)> AttributeStream;
 
-    bool operator==(const Vertex& other) const {
-        return coordinate == other.coordinate && rgbColor == other.rgbColor && textureXY == other.textureXY;
-    }
-};
+typedef vtrs::VertexLayout<PositionStream, AttributeStream> MeshLayout;
 
 struct UniformBufferObject {
     glm::mat4 model;
@@ -106,59 +107,83 @@ struct UniformBufferObject {
 class VulkanModel {
 
 private: // *** Private members *** //
-    static std::vector<Vertex> s_vertices;
-    static std::vector<uint32_t> s_indices;
-
     struct QueueFamilyIndices m_familyIndices {};
     vtrs::RendererGPU* m_gpu;
 
     VkDevice m_device = VK_NULL_HANDLE;
     VkSurfaceKHR m_surface = VK_NULL_HANDLE;
 
+    vtrs::DeviceAllocator* m_allocator = nullptr;
+    vtrs::FrameAllocator* m_frameAllocator = nullptr;
+    vtrs::UploadQueue* m_uploadQueue = nullptr;
+    vtrs::PipelineCache* m_pipelineCache = nullptr;
+    vtrs::ShaderLibrary* m_shaderLibrary = nullptr;
+    vtrs::MipGenerator* m_mipGenerator = nullptr;
+    vtrs::TextureStreamer* m_textureStreamer = nullptr;
+    vtrs::TextureCache* m_textureCache = nullptr;
+    vtrs::MipResidency* m_mipResidency = nullptr;
+
     VkQueue m_surfaceQueue = VK_NULL_HANDLE;
     VkQueue m_graphicsQueue = VK_NULL_HANDLE;
-    VkQueue m_transferQueue = VK_NULL_HANDLE;
 
-    VkSwapchainKHR m_swapchain = VK_NULL_HANDLE;
-    VkExtent2D m_swapExtend {};
-    VkFormat m_swapFormat = VK_FORMAT_B8G8R8A8_SRGB;
-    std::vector<VkImage> m_swapImages;
-    std::vector<VkImageView> m_swapViews;
+    vtrs::SurfacePresenter* m_presenter = nullptr;
     VkPipeline m_graphicsPipeline = VK_NULL_HANDLE;
     VkDescriptorSetLayout m_descSetLayout = VK_NULL_HANDLE;
     VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
     VkRenderPass m_renderPass = VK_NULL_HANDLE;
+    VkFormat m_depthFormat = VK_FORMAT_UNDEFINED;
 
-    VkCommandPool m_graphicsCmdPool = VK_NULL_HANDLE;
-    VkCommandPool m_transferCmdPool = VK_NULL_HANDLE;
+    /* Vulkan 1.3 dynamic rendering, with a render pass as the fallback. */
+    bool m_useDynamicRendering = false;
 
-    std::vector<VkCommandBuffer> m_commandBuffers;
+    /* VK_KHR_present_id and VK_KHR_present_wait, used for pacing statistics. */
+    bool m_usePresentWait = false;
+
+    const vtrs::ShaderLibrary::Module* m_vertexShader = nullptr;
+    const vtrs::ShaderLibrary::Module* m_fragmentShader = nullptr;
+
+    vtrs::ThreadPool* m_threadPool = nullptr;
+    vtrs::CommandRecorder* m_commandRecorder = nullptr;
+    vtrs::GpuProfiler* m_gpuProfiler = nullptr;
+
+    /* Pipeline statistics and inherited queries, counted by the GPU profiler. */
+    bool m_usePipelineStatistics = false;
 
     std::vector<VkFramebuffer> m_swapFramebuffers;
 
     VkBuffer m_vertexBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory m_vertexMemory = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator::Allocation m_vertexAllocation {};
+    VkDeviceSize m_attributeOffset = 0;
+
+    /* Maps packed positions back into model space. */
+    glm::mat4 m_meshTransform {1.0f};
 
     VkBuffer m_indexBuffer = VK_NULL_HANDLE;
-    VkDeviceMemory m_indexMemory = VK_NULL_HANDLE;
+    vtrs::DeviceAllocator::Allocation m_indexAllocation {};
+    uint32_t m_indexCount = 0;
+    VkIndexType m_indexType = VK_INDEX_TYPE_UINT32;
 
     struct SyncObjectBundle m_syncObjects {};
 
-    VkDescriptorPool m_descPool = VK_NULL_HANDLE;
-    std::vector<VkDescriptorSet>  m_descSets {};
+    vtrs::DescriptorAllocator* m_descriptorAllocator = nullptr;
+    VkDescriptorSet m_descSet = VK_NULL_HANDLE;
 
-    std::vector<VkBuffer> m_uniformBuffer {};
-    std::vector<VkDeviceMemory> m_uniformMemory {};
+    /* The cached texture resolves to a placeholder view until it is resident. */
+    std::optional<vtrs::TextureCache::Handle> m_textureHandle {};
 
-    struct ImageObjectBundle m_textureBundle {VK_NULL_HANDLE, VK_NULL_HANDLE};
+    /* VK_EXT_memory_budget, used by the texture cache to size itself. */
+    bool m_useMemoryBudget = false;
+
+    /* VK_EXT_image_view_min_lod, clamps views of textures still streaming in. */
+    bool m_useMinLod = false;
 
     struct DepthResourceBundle m_depthResource {};
 
     unsigned int m_currentFrame = 0;
 
-    void* m_vertexData = nullptr;
-
-    void* m_indexData = nullptr;
+    /* Counts submitted frames, the presenter retires its deleters by it. */
+    uint64_t m_frameNumber = 0;
+    uint32_t m_framesInFlight = VTEST_DEFAULT_FRAMES_IN_FLIGHT;
 
     /**
      * @brief Finds the discrete GPU from the enumerated list of GPUs.
@@ -166,17 +191,8 @@ private: // *** Private members *** //
      */
     static vtrs::RendererGPU* findDiscreteGPU_();
 
-    /**
-     * @brief Reads characters from a compiled SPIR-V shader file.
-     * @param path The absolute path to the file.
-     * @return The bytes read.
-     */
-    static struct SPIRVBytes readSPIRVShader(const std::string& path);
-
     static bool hasStencilComponent_(VkFormat format);
 
-    uint32_t findMemoryType_(uint32_t filter, VkMemoryPropertyFlags flags);
-
     VkFormat findSupportedFormat_(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 
     /**
@@ -191,37 +207,30 @@ private: // *** Private members *** //
      *
      * his method will create logical device required for this application
      * and assigns handles to surface queue and graphics queue members.
+     * The device memory allocator, the upload queue, the pipeline
+     * cache, the shader library, the texture streamer and cache and
+     * the descriptor allocator are created along with the device.
      */
     void createLogicalDevice_();
 
     /**
-     * @brief Creates swapchain.
-     */
-    void createSwapchain_();
-
-    /**
-     * @brief Creates image views for every swapchain image.
-     */
-    void createImageViews_();
-
-    /**
-     * @brief Creates a new shader module from the SPIR-V bytes.
-     * @return Vulkan shader module.
+     * @brief Creates the surface presenter that owns the swapchain and its views.
      */
-    VkShaderModule newShaderModule(struct SPIRVBytes);
+    void createPresenter_();
 
     /**
-     * @brief Creates render pass.
+     * @brief Creates render pass, used only when dynamic rendering is unavailable.
      */
     void createRenderPass_();
 
     /**
-     * @brief Creates descriptor set for uniform buffer object.
+     * @brief Loads the shaders and takes the set and pipeline layouts reflected from them.
      */
     void createDescSetLayout_();
 
-    void createDescPool_();
-
+    /**
+     * @brief Takes the descriptor set of the loaded model from the descriptor allocator cache.
+     */
     void createDescSets_();
 
     /**
@@ -233,20 +242,39 @@ private: // *** Private members *** //
 
     void createFramebuffers_();
 
-    void createCommandPools_();
+    /**
+     * @brief Replaces the depth image and framebuffers after the swapchain was rebuilt.
+     *
+     * The old ones are handed to the presenter's deletion queue, since
+     * frames still in flight may be using them.
+     */
+    void recreateSizeDependents_();
 
     struct BufferObjectBundle createBuffer_(VkDeviceSize, VkBufferUsageFlags, VkMemoryPropertyFlags);
 
-    void copyBuffer_(VkBuffer, VkBuffer, VkDeviceSize);
+    struct ImageObjectBundle createImage_(uint32_t, uint32_t, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags,
+                                          uint32_t mip_levels = 1, VkImageCreateFlags create_flags = 0);
 
-    struct ImageObjectBundle createImage_(uint32_t, uint32_t, VkFormat, VkImageTiling, VkImageUsageFlags, VkMemoryPropertyFlags);
+    /**
+     * @brief Starts the recording threads and their per-frame command pools.
+     */
+    void createCommandRecorder_();
 
     /**
-     * @brief Allocates command buffers for the frames in flight.
+     * @brief Moves the attachments to their rendering layouts and begins dynamic rendering.
      */
-    void allocateCommandBuffers_();
+    void beginRendering_(VkCommandBuffer, uint32_t, const std::array<VkClearValue, 2>&);
 
-    void recordCommands_(VkCommandBuffer, uint32_t);
+    /**
+     * @brief Ends dynamic rendering and moves the swapchain image to the present layout.
+     */
+    void endRendering_(VkCommandBuffer, uint32_t);
+
+    /**
+     * @brief Records the frame, splitting the draw across the recording threads.
+     * @return The primary command buffer to submit.
+     */
+    VkCommandBuffer recordCommands_(uint32_t, uint32_t);
 
     /**
      * @brief Creates synchronization objects and stores them as a bundle.
@@ -255,16 +283,38 @@ private: // *** Private members *** //
      */
     void createSyncObjects_();
 
-    void createVertexBuffer_();
-
-    void createIndexBuffer_();
+    /**
+     * @brief Destroys the semaphores and fences of every frame.
+     */
+    void destroySyncObjects_();
 
-    void createUniformBuffers_();
+    /**
+     * @brief Creates the vertex buffer holding both packed streams and queues its upload.
+     * @param positions Packed positions.
+     * @param attributes Packed normals and texture coordinates.
+     * @param count Number of vertices.
+     * @param scale Scale that maps packed positions back.
+     * @param bias Bias added after the scale.
+     */
+    void createVertexBuffer_(const vtrs::mesh_packed_position* positions, const vtrs::mesh_packed_attributes* attributes,
+                             uint32_t count, const float* scale, const float* bias);
 
-    void copyBufferToImage_(VkBuffer, VkImage, uint32_t, uint32_t);
+    /**
+     * @brief Creates the index buffer and queues its upload.
+     * @param data Indices of the given type.
+     * @param count Number of indices.
+     * @param type VK_INDEX_TYPE_UINT16 or VK_INDEX_TYPE_UINT32.
+     */
+    void createIndexBuffer_(const void* data, uint32_t count, VkIndexType type);
 
-    void transitionImageLayout_(VkImage, VkFormat, VkImageLayout, VkImageLayout);
+    /**
+     * @brief Creates the transient allocator that holds per-frame uniforms.
+     */
+    void createUniformBuffers_();
 
+    /**
+     * @brief Takes the texture from the cache, which streams it in on a miss.
+     */
     void createTextureImage_(const std::string&);
 
     /**
@@ -272,7 +322,11 @@ private: // *** Private members *** //
      */
     void bootstrap_();
 
-    void updateUniformBuffers_(uint32_t) const;
+    /**
+     * @brief Writes the uniforms of the current frame.
+     * @return Dynamic offset of the uniform range in the frame allocator.
+     */
+    uint32_t updateUniformBuffers_() const;
 
     /**
      * @brief Initialises the instance.
@@ -286,7 +340,7 @@ private: // *** Private members *** //
     VulkanModel();
 
 public: // *** Public members *** //
-    static VulkanModel* factory(vtrs::XCBClient*, vtrs::XCBWindow);
+    static VulkanModel* factory(vtrs::XCBClient*, vtrs::XCBWindow, uint32_t frames_in_flight = VTEST_DEFAULT_FRAMES_IN_FLIGHT);
 
     /**
      * @brief Cleans up upon destruction of the object.
@@ -301,8 +355,28 @@ public: // *** Public members *** //
 
     void waitIdle();
 
+    /**
+     * @brief Asks for the swapchain to be rebuilt before the next frame.
+     *
+     * Bursts of calls between two frames are coalesced into one rebuild.
+     */
     void rebuildSwapchain();
 
+    /**
+     * @brief Changes how many frames are recorded ahead of the GPU.
+     * @param frames_in_flight New number of frames in flight.
+     *
+     * Waits for the frames already in flight, then resizes the sync
+     * objects, command pools, uniform ring and descriptor pools.
+     */
+    void setFramesInFlight(uint32_t frames_in_flight);
+
+    /**
+     * @brief Changes the number of swapchain images, applied by the next rebuild.
+     * @param image_count Images to ask for, zero for one above the surface minimum.
+     */
+    void setSwapchainImageCount(uint32_t image_count);
+
     /**
      * @brief Prints the selected GPU information.
      *
@@ -313,11 +387,3 @@ public: // *** Public members *** //
 };
 
 } // namespace vtest
-
-namespace std {
-    template<> struct hash<vtest::Vertex> {
-        size_t operator()(vtest::Vertex const& vertex) const {
-            return ((hash<glm::vec3>()(vertex.coordinate) ^ (hash<glm::vec3>()(vertex.rgbColor) << 1)) >> 1) ^ (hash<glm::vec2>()(vertex.textureXY) << 1);
-        }
-    };
-}
\ No newline at end of file